@@ -11,6 +11,25 @@
 #define H5FNAL_LEFT_DATA_PRODUCT_NAME           "left data product"
 #define H5FNAL_RIGHT_DATA_PRODUCT_NAME          "right data product"
 
+/* Event table slot (the data dataset shares the pairs' range) */
+#define ASSNS_EVENT_PAIRS                       0
+
+/* An append queued for the writer thread, with its own copy of the
+ * data
+ */
+typedef struct assns_job_t {
+    h5fnal_async_job_t      job;
+    h5fnal_assns_t         *assns;
+    hbool_t                 for_event;
+    uint32_t                run;
+    uint32_t                subrun;
+    uint32_t                event;
+    h5fnal_assns_data_t     data;
+} assns_job_t;
+
+static herr_t append_assns(h5fnal_assns_t *assns, h5fnal_assns_data_t *data);
+static herr_t append_assns_for_event(h5fnal_assns_t *assns, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_assns_data_t *data);
+
 hid_t
 h5fnal_create_pair_type(void)
 {
@@ -43,6 +62,20 @@ error:
     return H5FNAL_BAD_HID_T;
 } /* h5fnal_create_association_type */
 
+/************************************************************************
+ * init_appenders()
+ *
+ * Points the appenders at the current dataset IDs.
+ ************************************************************************/
+static void
+init_appenders(h5fnal_assns_t *assns)
+{
+    h5fnal_init_appender(&(assns->pair_app), assns->pair_dset_id, assns->pair_dtype_id, TRUE);
+    h5fnal_init_appender(&(assns->data_app), assns->data_dset_id, assns->data_dtype_id, TRUE);
+
+    return;
+} /* end init_appenders() */
+
 /************************************************************************
  * h5fnal_close_vector_on_err()
  *
@@ -57,6 +90,9 @@ h5fnal_close_assns_on_err(h5fnal_assns_t *assns)
     if (assns) {
 
         H5E_BEGIN_TRY {
+            h5fnal_close_appender(&(assns->pair_app));
+            h5fnal_close_appender(&(assns->data_app));
+            h5fnal_close_event_table(&(assns->events));
             H5Dclose(assns->pair_dset_id);
             H5Dclose(assns->data_dset_id);
             H5Tclose(assns->pair_dtype_id);
@@ -82,15 +118,13 @@ h5fnal_close_assns_on_err(h5fnal_assns_t *assns)
 
 herr_t
 h5fnal_create_assns(hid_t loc_id, const char *name, const char *left, const char *right, 
-        hid_t data_dtype_id, h5fnal_assns_t *assns)
+        hid_t data_dtype_id, const h5fnal_storage_profile_t *profile, h5fnal_assns_t *assns)
 {
-    hid_t dcpl_id = -1;
-    hid_t sid = -1;
-    hsize_t chunk_dims[1];
-    hsize_t init_dims[1];
-    hsize_t max_dims[1];
+    const h5fnal_product_types_t *types = NULL;
     size_t dp_len;
 
+    h5fnal_drain_async_writes();
+
     if (loc_id < 0)
         H5FNAL_PROGRAM_ERROR("invalid loc_id parameter");
     if (NULL == name)
@@ -104,6 +138,8 @@ h5fnal_create_assns(hid_t loc_id, const char *name, const char *left, const char
 
     /* Initialize the data product struct */
     memset(assns, 0, sizeof(h5fnal_assns_t));
+    init_appenders(assns);
+    h5fnal_init_event_table(&(assns->events));
 
     /* Create top-level group */
     if ((assns->top_level_group_id = H5Gcreate2(loc_id, name, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT)) < 0)
@@ -115,6 +151,10 @@ h5fnal_create_assns(hid_t loc_id, const char *name, const char *left, const char
     if (h5fnal_add_string_attribute(assns->top_level_group_id, H5FNAL_RIGHT_DATA_PRODUCT_NAME, right) < 0)
         H5FNAL_PROGRAM_ERROR("could not add left data product name attribute");
 
+    /* Set up the (empty) event table */
+    if (h5fnal_open_event_table(assns->top_level_group_id, &(assns->events)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not set up event table");
+
     /* Store the names of the right and left data products in the struct */
     dp_len = strlen(left) + 1;
     if (NULL == (assns->left = (char *)malloc(dp_len)))
@@ -125,78 +165,62 @@ h5fnal_create_assns(hid_t loc_id, const char *name, const char *left, const char
         H5FNAL_PROGRAM_ERROR("could not get memory for right data product string");
     strcpy(assns->right, right);
 
-    /* Create the dataset creation property list */
-    if ((dcpl_id = H5Pcreate(H5P_DATASET_CREATE)) < 0)
-        H5FNAL_HDF5_ERROR;
-
-    /* Set up chunking (size is arbitrary for now) */
-    chunk_dims[0] = 1024;
-    if (H5Pset_chunk(dcpl_id, 1, chunk_dims) < 0)
-        H5FNAL_HDF5_ERROR;
-
-    /* Turn on compession */
-    if (H5Pset_shuffle(dcpl_id) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Pset_deflate(dcpl_id, 6) < 0)
-        H5FNAL_HDF5_ERROR;
-
-    /* Create the dataspace (set of points describing the data size, etc.) */
-    init_dims[0] = 0;
-    max_dims[0] = H5S_UNLIMITED;
-    if ((sid = H5Screate_simple(1, init_dims, max_dims)) < 0)
-        H5FNAL_HDF5_ERROR;
-
-    /* Create the pair datatype */
-    if ((assns->pair_dtype_id = h5fnal_create_pair_type()) < 0)
+    /* Share the library's in-memory datatypes */
+    if (NULL == (types = h5fnal_get_product_types()))
+        H5FNAL_PROGRAM_ERROR("could not get product datatypes");
+    if ((assns->pair_dtype_id = h5fnal_share_type(types->pair_dtype_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create pair datatype");
 
-    /* Create the pair dataset */
-    if ((assns->pair_dset_id = H5Dcreate2(assns->top_level_group_id, H5FNAL_ASSNS_PAIR_DATASET_NAME,
-            assns->pair_dtype_id, sid, H5P_DEFAULT, dcpl_id, H5P_DEFAULT)) < 0)
-        H5FNAL_HDF5_ERROR;
-
-    /* Store the 'extra' data datatype and create the associated dataset of that type.
+    /* Store the 'extra' data datatype.
      *
      * We'll store a 'known invalid' value if the datatype is invalid (i.e.: not used)
      * to make things more consistent.
      */
+    assns->data_dset_id = H5FNAL_BAD_HID_T;
     if (data_dtype_id >= 0) {
         if((assns->data_dtype_id = H5Tcopy(data_dtype_id)) < 0)
             H5FNAL_HDF5_ERROR;
-        if ((assns->data_dset_id = H5Dcreate2(assns->top_level_group_id, H5FNAL_ASSNS_DATA_DATASET_NAME,
-                assns->data_dtype_id, sid, H5P_DEFAULT, dcpl_id, H5P_DEFAULT)) < 0)
+        if (0 == (assns->data_size = H5Tget_size(assns->data_dtype_id)))
             H5FNAL_HDF5_ERROR;
     }
-    else {
+    else
         assns->data_dtype_id = H5FNAL_BAD_HID_T;
-        assns->data_dset_id = H5FNAL_BAD_HID_T;
-    }
+    init_appenders(assns);
 
-    /* close everything */
-    if (H5Pclose(dcpl_id) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Sclose(sid) < 0)
-        H5FNAL_HDF5_ERROR;
+    /* Create the pair dataset and the 'extra' data dataset, if used
+     * (the appenders create them, as the storage profile says, and
+     * may put that off until the first appends)
+     */
+    if (h5fnal_appender_create_dset(&(assns->pair_app), assns->top_level_group_id,
+            H5FNAL_ASSNS_PAIR_DATASET_NAME, profile, &(assns->pair_dset_id)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create pair dataset");
+    if (assns->data_dtype_id >= 0)
+        if (h5fnal_appender_create_dset(&(assns->data_app), assns->top_level_group_id,
+                H5FNAL_ASSNS_DATA_DATASET_NAME, profile, &(assns->data_dset_id)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not create data dataset");
 
     return H5FNAL_SUCCESS;
 
 error:
-    H5E_BEGIN_TRY {
-        H5Sclose(sid);
-        H5Pclose(dcpl_id);
-    } H5E_END_TRY;
-
     if (assns)
         h5fnal_close_assns_on_err(assns);
 
     return H5FNAL_FAILURE;
 } /* h5fnal_create_assns */
 
+/************************************************************************
+ * h5fnal_open_assns_with_types()
+ *
+ * Same as h5fnal_open_assns(), but shares the pair datatype in types
+ * (if not NULL) instead of the library's.
+ ************************************************************************/
 herr_t
-h5fnal_open_assns(hid_t loc_id, const char *name, h5fnal_assns_t *assns)
+h5fnal_open_assns_with_types(hid_t loc_id, const char *name, const h5fnal_product_types_t *types, h5fnal_assns_t *assns)
 {
     htri_t  data_dataset_exists;
 
+    h5fnal_drain_async_writes();
+
     if (loc_id < 0)
         H5FNAL_PROGRAM_ERROR("invalid loc_id parameter");
     if (NULL == name)
@@ -206,9 +230,15 @@ h5fnal_open_assns(hid_t loc_id, const char *name, h5fnal_assns_t *assns)
 
     /* Initialize the data product struct */
     memset(assns, 0, sizeof(h5fnal_assns_t));
+    init_appenders(assns);
+    h5fnal_init_event_table(&(assns->events));
 
-    /* Create datatype */
-    if ((assns->pair_dtype_id = h5fnal_create_pair_type()) < 0)
+    /* Share the in-memory datatypes (the library's, unless the
+     * caller passed its own)
+     */
+    if (NULL == types && NULL == (types = h5fnal_get_product_types()))
+        H5FNAL_PROGRAM_ERROR("could not get product datatypes");
+    if ((assns->pair_dtype_id = h5fnal_share_type(types->pair_dtype_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create pair datatype");
 
     /* Open top-level group */
@@ -233,11 +263,18 @@ h5fnal_open_assns(hid_t loc_id, const char *name, h5fnal_assns_t *assns)
             H5FNAL_HDF5_ERROR;
         if ((assns->data_dtype_id = H5Dget_type(assns->data_dset_id)) < 0)
             H5FNAL_HDF5_ERROR;
+        if (0 == (assns->data_size = H5Tget_size(assns->data_dtype_id)))
+            H5FNAL_HDF5_ERROR;
     }
     else {
         assns->data_dset_id = H5FNAL_BAD_HID_T;
         assns->data_dtype_id = H5FNAL_BAD_HID_T;
     }
+    init_appenders(assns);
+
+    /* Load the event table, if there is one */
+    if (h5fnal_open_event_table(assns->top_level_group_id, &(assns->events)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not open event table");
 
     return H5FNAL_SUCCESS;
 
@@ -246,11 +283,19 @@ error:
         h5fnal_close_assns_on_err(assns);
 
     return H5FNAL_FAILURE;
+} /* h5fnal_open_assns_with_types */
+
+herr_t
+h5fnal_open_assns(hid_t loc_id, const char *name, h5fnal_assns_t *assns)
+{
+    return h5fnal_open_assns_with_types(loc_id, name, NULL, assns);
 } /* h5fnal_open_assns */
 
 herr_t
 h5fnal_close_assns(h5fnal_assns_t *assns)
 {
+    h5fnal_drain_async_writes();
+
     if (NULL == assns)
         H5FNAL_PROGRAM_ERROR("assns parameter cannot be NULL");
 
@@ -259,6 +304,13 @@ h5fnal_close_assns(h5fnal_assns_t *assns)
     assns->left = NULL;
     assns->right = NULL;
 
+    if (h5fnal_close_appender(&(assns->pair_app)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close pair appender");
+    if (h5fnal_close_appender(&(assns->data_app)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close data appender");
+    if (h5fnal_close_event_table(&(assns->events)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close event table");
+
     if (H5Gclose(assns->top_level_group_id) < 0)
         H5FNAL_HDF5_ERROR;
 
@@ -280,6 +332,7 @@ h5fnal_close_assns(h5fnal_assns_t *assns)
     assns->pair_dtype_id = H5FNAL_BAD_HID_T;
     assns->data_dset_id = H5FNAL_BAD_HID_T;
     assns->data_dtype_id = H5FNAL_BAD_HID_T;
+    assns->data_size = 0;
 
     return H5FNAL_SUCCESS;
 
@@ -291,103 +344,202 @@ error:
 
 } /* h5fnal_close_assns */
 
+/************************************************************************
+ * write_assns_job()
+ *
+ * Runs on the writer thread. Appends the job's copy of the pairs and
+ * their data.
+ ************************************************************************/
+static herr_t
+write_assns_job(h5fnal_async_job_t *job)
+{
+    assns_job_t *aj = (assns_job_t *)job;
+
+    if (aj->for_event)
+        return append_assns_for_event(aj->assns, aj->run, aj->subrun, aj->event, &(aj->data));
+    else
+        return append_assns(aj->assns, &(aj->data));
+} /* end write_assns_job() */
+
+static void
+release_assns_job(h5fnal_async_job_t *job)
+{
+    assns_job_t *aj = (assns_job_t *)job;
+
+    free(aj->data.pairs);
+    free(aj->data.data);
+    free(aj);
+
+    return;
+} /* end release_assns_job() */
+
+/************************************************************************
+ * queue_assns()
+ *
+ * Copies the pairs and data into a job for the writer thread (see
+ * h5fnal_set_async_writes()).
+ ************************************************************************/
+static herr_t
+queue_assns(h5fnal_assns_t *assns, hbool_t for_event, uint32_t run, uint32_t subrun, uint32_t event, const h5fnal_assns_data_t *data)
+{
+    assns_job_t *aj = NULL;
+
+    if (NULL == (aj = (assns_job_t *)calloc(1, sizeof(assns_job_t))))
+        H5FNAL_PROGRAM_ERROR("could not get memory for queued append");
+    aj->job.write = write_assns_job;
+    aj->job.release = release_assns_job;
+    aj->assns = assns;
+    aj->for_event = for_event;
+    aj->run = run;
+    aj->subrun = subrun;
+    aj->event = event;
+
+    if (h5fnal_copy_async_array((void **)&(aj->data.pairs), data->pairs, data->n, sizeof(h5fnal_pair_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not copy pairs");
+    if (assns->data_size > 0)
+        if (h5fnal_copy_async_array(&(aj->data.data), data->data, data->n, assns->data_size) < 0)
+            H5FNAL_PROGRAM_ERROR("could not copy data");
+    aj->data.n = data->n;
+
+    if (h5fnal_submit_async_job(&(aj->job)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not queue append");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    if (aj)
+        release_assns_job(&(aj->job));
+
+    return H5FNAL_FAILURE;
+} /* end queue_assns() */
+
+/************************************************************************
+ * h5fnal_append_assns()
+ *
+ * With asynchronous appends on, the data is copied and appended
+ * later on the writer thread.
+ ************************************************************************/
 herr_t
 h5fnal_append_assns(h5fnal_assns_t *assns, h5fnal_assns_data_t *data)
 {
-    hid_t file_sid = -1;                /* dataspace ID                             */
-    hid_t memory_sid = -1;              /* dataspace ID                             */
-    hsize_t curr_dims[1];               /* initial size of dataset                  */
-    hsize_t new_dims[1];                /* new size of data dataset             */
-    hsize_t start[1];
-    hsize_t stride[1];
-    hsize_t count[1];
-    hsize_t block[1];
-
-    /* Create the memory dataspace (set of points describing the data size, etc.) */
-    curr_dims[0] = data->n;
-    if ((memory_sid = H5Screate_simple(1, curr_dims, curr_dims)) < 0)
-        H5FNAL_HDF5_ERROR;
+    if (!assns)
+        H5FNAL_PROGRAM_ERROR("assns parameter cannot be NULL");
+    if (!data)
+        H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL");
+
+    if (h5fnal_get_async_writes() > 0) {
+        if (queue_assns(assns, FALSE, 0, 0, 0, data) < 0)
+            H5FNAL_PROGRAM_ERROR("could not queue associations");
+    }
+    else if (append_assns(assns, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not append associations");
 
-    /* Get the size (current size only) of the dataset. Both datasets are the
-     * same size.
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_append_assns() */
+
+static herr_t
+append_assns(h5fnal_assns_t *assns, h5fnal_assns_data_t *data)
+{
+    /* Write the pairs to the dataset */
+    if (h5fnal_appender_append(&(assns->pair_app), data->n, data->pairs) < 0)
+        H5FNAL_PROGRAM_ERROR("could not append pairs");
+
+    /* Write the data to the dataset, if necessary. Both datasets
+     * always have the same size.
      */
-    if ((file_sid = H5Dget_space(assns->pair_dset_id)) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Sget_simple_extent_dims(file_sid, curr_dims, NULL) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Sclose(file_sid) < 0)
-        H5FNAL_HDF5_ERROR;
+    if (assns->data_dtype_id >= 0)
+        if (h5fnal_appender_append(&(assns->data_app), data->n, data->data) < 0)
+            H5FNAL_PROGRAM_ERROR("could not append data");
 
-    /* Resize the datasets to hold the new data */
-    new_dims[0] = curr_dims[0] + data->n;
-    if (H5Dset_extent(assns->pair_dset_id, new_dims) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (assns->data_dset_id >= 0)
-        if (H5Dset_extent(assns->data_dset_id, new_dims) < 0)
-            H5FNAL_HDF5_ERROR;
+    return H5FNAL_SUCCESS;
 
-    /* Get the resized file space */
-    if ((file_sid = H5Dget_space(assns->pair_dset_id)) < 0)
-        H5FNAL_HDF5_ERROR;
+error:
+    return H5FNAL_FAILURE;
+} /* end append_assns() */
 
-    /* Create a hyperslab describing where the data should go */
-    start[0] = curr_dims[0];
-    stride[0] = 1;
-    count[0] = data->n;
-    block[0] = 1;
-    if (H5Sselect_hyperslab(file_sid, H5S_SELECT_SET, start, stride, count, block) < 0)
-        H5FNAL_HDF5_ERROR;
 
-    /* Write the pairs to the dataset */
-    if (H5Dwrite(assns->pair_dset_id, assns->pair_dtype_id, memory_sid, file_sid, H5P_DEFAULT, data->pairs) < 0)
-        H5FNAL_HDF5_ERROR;
+/************************************************************************
+ * h5fnal_flush_assns()
+ *
+ * Writes out anything still in the append buffers. Reads do this
+ * themselves.
+ ************************************************************************/
+herr_t
+h5fnal_flush_assns(h5fnal_assns_t *assns)
+{
+    h5fnal_drain_async_writes();
 
-    /* Write the data to the dataset, if necessary */
-    if (assns->data_dset_id >= 0)
-        if (H5Dwrite(assns->data_dset_id, assns->data_dtype_id, memory_sid, file_sid, H5P_DEFAULT, data->data) < 0)
-            H5FNAL_HDF5_ERROR;
+    if (!assns)
+        H5FNAL_PROGRAM_ERROR("assns parameter cannot be NULL");
 
-    /* Close everything */
-    if (H5Sclose(file_sid) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Sclose(memory_sid) < 0)
-        H5FNAL_HDF5_ERROR;
+    if (h5fnal_flush_appender(&(assns->pair_app)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush pairs");
+    if (h5fnal_flush_appender(&(assns->data_app)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush data");
+    if (h5fnal_flush_event_table(&(assns->events)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush event table");
 
     return H5FNAL_SUCCESS;
 
 error:
-    H5E_BEGIN_TRY {
-        H5Sclose(file_sid);
-        H5Sclose(memory_sid);
-    } H5E_END_TRY;
-
     return H5FNAL_FAILURE;
-} /* end h5fnal_write_assns() */
+} /* end h5fnal_flush_assns() */
 
 
 herr_t
 h5fnal_read_all_assns(h5fnal_assns_t *assns, h5fnal_assns_data_t *data)
 {
-    hid_t       sid     = H5FNAL_BAD_HID_T;
+    if (!data)
+        H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL");
+
+    /* Initialize the data struct */
+    memset(data, 0, sizeof(h5fnal_assns_data_t));
+
+    if (h5fnal_read_all_assns_into(assns, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read assns");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    if (data)
+        h5fnal_free_assns_mem_data(data);
+
+    return H5FNAL_FAILURE;
+
+} /* end h5fnal_read_all_assns() */
+
+/************************************************************************
+ * h5fnal_read_all_assns_into()
+ *
+ * Same as h5fnal_read_all_assns(), but reads into the buffers that
+ * are already in data, growing them only if needed. data must be
+ * zeroed (or hold buffers from an earlier read) and is still owned by
+ * the caller on failure (the element count is set to zero).
+ ************************************************************************/
+herr_t
+h5fnal_read_all_assns_into(h5fnal_assns_t *assns, h5fnal_assns_data_t *data)
+{
+    hssize_t    n;
 
     if (!assns)
         H5FNAL_PROGRAM_ERROR("assns parameter cannot be NULL");
     if (!data)
         H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL");
 
-    /* Initialize the data struct */
-    memset(data, 0, sizeof(h5fnal_assns_data_t));
- 
+    data->n = 0;
+
+    if (h5fnal_flush_assns(assns) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush appended data");
+
     /* Get the size of the datasets (both have the same size) */
-    if ((sid = H5Dget_space(assns->pair_dset_id)) < 0)
-        H5FNAL_HDF5_ERROR;
-    if ((data->n = H5Sget_simple_extent_npoints(sid)) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Sclose(sid) < 0)
-        H5FNAL_HDF5_ERROR;
+    if ((n = h5fnal_get_dset_size(assns->pair_dset_id)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get dataset size");
 
-    /* Generate a buffer for the pairs data and read it */
-    if (NULL == (data->pairs = (h5fnal_pair_t *)calloc(data->n, sizeof(h5fnal_pair_t))))
+    /* Make sure the pairs buffer is big enough and read the pairs */
+    if (h5fnal_reserve_buffer((void **)&(data->pairs), &(data->pairs_capacity), (hsize_t)n, sizeof(h5fnal_pair_t)) < 0)
         H5FNAL_PROGRAM_ERROR("could not allocate memory for pairs");
     if (H5Dread(assns->pair_dset_id, assns->pair_dtype_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, data->pairs) < 0)
         H5FNAL_HDF5_ERROR;
@@ -399,25 +551,156 @@ h5fnal_read_all_assns(h5fnal_assns_t *assns, h5fnal_assns_data_t *data)
         /* Note that we can get the native type size from the HDF5 type */
         if (0 == (type_size = H5Tget_size(assns->data_dtype_id)))
             H5FNAL_HDF5_ERROR;
-        if (NULL == (data->data = calloc(data->n, type_size)))
+        if (h5fnal_reserve_buffer(&(data->data), &(data->data_capacity), (hsize_t)n * type_size, 1) < 0)
             H5FNAL_PROGRAM_ERROR("could not allocate memory for data");
         if (H5Dread(assns->data_dset_id, assns->data_dtype_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, data->data) < 0)
             H5FNAL_HDF5_ERROR;
     }
 
+    data->n = (hsize_t)n;
+
     return H5FNAL_SUCCESS;
 
 error:
-    H5E_BEGIN_TRY {
-        H5Sclose(sid);
-    } H5E_END_TRY;
+    return H5FNAL_FAILURE;
+
+} /* end h5fnal_read_all_assns_into() */
+
+/************************************************************************
+ * h5fnal_append_assns_for_event()
+ *
+ * Appends an event's associations (as in h5fnal_append_assns()) and
+ * records where they went in the Assns' event table. Used when one
+ * Assns holds a whole run or sub-run.
+ ************************************************************************/
+herr_t
+h5fnal_append_assns_for_event(h5fnal_assns_t *assns, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_assns_data_t *data)
+{
+    if (!assns)
+        H5FNAL_PROGRAM_ERROR("assns parameter cannot be NULL");
+    if (!data)
+        H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL");
+
+    if (h5fnal_get_async_writes() > 0) {
+        if (queue_assns(assns, TRUE, run, subrun, event, data) < 0)
+            H5FNAL_PROGRAM_ERROR("could not queue associations");
+    }
+    else if (append_assns_for_event(assns, run, subrun, event, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not append associations");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_append_assns_for_event() */
+
+static herr_t
+append_assns_for_event(h5fnal_assns_t *assns, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_assns_data_t *data)
+{
+    hsize_t start[H5FNAL_MAX_EVENT_DSETS];
+    hsize_t count[H5FNAL_MAX_EVENT_DSETS];
+    hssize_t n;
+
+    /* Fail before any data is written */
+    if (h5fnal_check_new_event(&(assns->events), run, subrun, event) < 0)
+        H5FNAL_PROGRAM_ERROR("event is already in the product");
+
+    if ((n = h5fnal_get_appender_size(&(assns->pair_app))) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get dataset size");
+
+    memset(start, 0, sizeof(start));
+    memset(count, 0, sizeof(count));
+    start[ASSNS_EVENT_PAIRS] = (hsize_t)n;
+    count[ASSNS_EVENT_PAIRS] = data->n;
+
+    if (append_assns(assns, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not append associations");
+    if (h5fnal_add_event(&(assns->events), run, subrun, event, start, count) < 0)
+        H5FNAL_PROGRAM_ERROR("could not add event to event table");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end append_assns_for_event() */
+
+herr_t
+h5fnal_read_assns_for_event(h5fnal_assns_t *assns, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_assns_data_t *data)
+{
+    if (!data)
+        H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL");
+
+    /* Initialize the data struct */
+    memset(data, 0, sizeof(h5fnal_assns_data_t));
+
+    if (h5fnal_read_assns_for_event_into(assns, run, subrun, event, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read associations");
 
+    return H5FNAL_SUCCESS;
+
+error:
     if (data)
         h5fnal_free_assns_mem_data(data);
-
     return H5FNAL_FAILURE;
+} /* end h5fnal_read_assns_for_event() */
 
-} /* end h5fnal_read_all_assns() */
+/************************************************************************
+ * h5fnal_read_assns_for_event_into()
+ *
+ * Reads one event's associations from an Assns that holds a whole
+ * run or sub-run, reusing the buffers in data (see
+ * h5fnal_read_all_assns_into()).
+ ************************************************************************/
+herr_t
+h5fnal_read_assns_for_event_into(h5fnal_assns_t *assns, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_assns_data_t *data)
+{
+    h5fnal_event_entry_t entry;
+    htri_t found;
+    hsize_t start;
+    hsize_t n;
+
+    if (!assns)
+        H5FNAL_PROGRAM_ERROR("assns parameter cannot be NULL");
+    if (!data)
+        H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL");
+
+    data->n = 0;
+
+    if (h5fnal_flush_assns(assns) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush appended data");
+
+    if ((found = h5fnal_find_event(&(assns->events), run, subrun, event, &entry)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not look up event");
+    if (!found)
+        H5FNAL_PROGRAM_ERROR("event is not in the event table");
+    start = entry.start[ASSNS_EVENT_PAIRS];
+    n = entry.count[ASSNS_EVENT_PAIRS];
+
+    /* Make sure the pairs buffer is big enough and read the pairs */
+    if (h5fnal_reserve_buffer((void **)&(data->pairs), &(data->pairs_capacity), n, sizeof(h5fnal_pair_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not allocate memory for pairs");
+    if (h5fnal_read_dset_range(assns->pair_dset_id, assns->pair_dtype_id, start, n, data->pairs) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read pairs");
+
+    /* Read the same range of the 'extra' associated data, if it exists */
+    if (assns->data_dset_id >= 0) {
+        size_t type_size = 0;
+
+        if (0 == (type_size = H5Tget_size(assns->data_dtype_id)))
+            H5FNAL_HDF5_ERROR;
+        if (h5fnal_reserve_buffer(&(data->data), &(data->data_capacity), n * type_size, 1) < 0)
+            H5FNAL_PROGRAM_ERROR("could not allocate memory for data");
+        if (h5fnal_read_dset_range(assns->data_dset_id, assns->data_dtype_id, start, n, data->data) < 0)
+            H5FNAL_PROGRAM_ERROR("could not read data");
+    }
+
+    data->n = n;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_read_assns_for_event_into() */
 
 /************************************************************************
  * h5fnal_free_assns_mem_data()
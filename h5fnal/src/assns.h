@@ -28,11 +28,19 @@ typedef struct h5fnal_association_t {
  *
  * Note that the pairs and data arrays have the same number
  * of elements.
+ *
+ * pairs_capacity is the allocated size of pairs (in elements) and
+ * data_capacity is the allocated size of data (in bytes, since the
+ * data type varies). h5fnal_read_all_assns_into() reuses the arrays
+ * and only grows them when needed.
  */
 typedef struct h5fnal_assns_data_t {
     h5fnal_pair_t       *pairs;
     void                *data;
     hsize_t             n;
+
+    hsize_t             pairs_capacity;
+    hsize_t             data_capacity;
 } h5fnal_assns_data_t;
 
 /* Assns HDF5 data and related
@@ -49,8 +57,18 @@ typedef struct h5fnal_assns_t {
     hid_t       pair_dtype_id;
     hid_t       data_dset_id;
     hid_t       data_dtype_id;
+    size_t      data_size;      /* of data_dtype_id, 0 if unused    */
     char       *left;
     char       *right;
+
+    /* Appenders for the datasets (cache the sizes and dataspaces) */
+    h5fnal_appender_t   pair_app;
+    h5fnal_appender_t   data_app;
+
+    /* Where each event is, when the Assns holds a whole run or
+     * sub-run (see h5fnal_append_assns_for_event())
+     */
+    h5fnal_event_table_t    events;
 } h5fnal_assns_t;
 
 
@@ -60,12 +78,20 @@ extern "C" {
 hid_t h5fnal_create_pair_type(void);
 
 herr_t h5fnal_create_assns(hid_t loc_id, const char *name, const char *left, const char *right,
-        hid_t data_datatype_id, h5fnal_assns_t *assns);
+        hid_t data_datatype_id, const h5fnal_storage_profile_t *profile, h5fnal_assns_t *assns);
 herr_t h5fnal_open_assns(hid_t loc_id, const char *name, h5fnal_assns_t *assns);
+herr_t h5fnal_open_assns_with_types(hid_t loc_id, const char *name, const h5fnal_product_types_t *types, h5fnal_assns_t *assns);
 herr_t h5fnal_close_assns(h5fnal_assns_t *assns);
 
 herr_t h5fnal_append_assns(h5fnal_assns_t *assns, h5fnal_assns_data_t *data);
+herr_t h5fnal_flush_assns(h5fnal_assns_t *assns);
 herr_t h5fnal_read_all_assns(h5fnal_assns_t *assns, h5fnal_assns_data_t *data);
+herr_t h5fnal_read_all_assns_into(h5fnal_assns_t *assns, h5fnal_assns_data_t *data);
+
+/* One Assns per run or sub-run, with an event table */
+herr_t h5fnal_append_assns_for_event(h5fnal_assns_t *assns, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_assns_data_t *data);
+herr_t h5fnal_read_assns_for_event(h5fnal_assns_t *assns, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_assns_data_t *data);
+herr_t h5fnal_read_assns_for_event_into(h5fnal_assns_t *assns, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_assns_data_t *data);
 
 herr_t h5fnal_free_assns_mem_data(h5fnal_assns_data_t *data);
 
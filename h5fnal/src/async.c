@@ -0,0 +1,243 @@
+/* async.c
+ *
+ * The writer thread for asynchronous appends.
+ *
+ * The HDF5 library isn't thread-safe, so only one thread may be in
+ * it at a time. While appends are queued, the writer thread is the
+ * one doing HDF5 I/O: the library's other calls that touch a file
+ * (creating, opening, flushing and closing runs, events, data
+ * products and files) wait for the queue to empty first. Callers
+ * that make their own HDF5 calls must call h5fnal_wait_all() before
+ * them.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "h5fnal.h"
+
+static pthread_mutex_t  queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t   done_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t            writer;
+static unsigned             depth = 0;          /* 0: no writer thread  */
+static hbool_t              shutting_down = FALSE;
+static h5fnal_async_job_t  *queue_head = NULL;
+static h5fnal_async_job_t  *queue_tail = NULL;
+static unsigned             n_queued = 0;       /* including the one
+                                                 * being written        */
+static hbool_t              write_failed = FALSE;
+
+
+/************************************************************************
+ * writer_main()
+ ************************************************************************/
+static void *
+writer_main(void *arg)
+{
+    h5fnal_async_job_t *job = NULL;
+    herr_t ret;
+
+    (void)arg;
+
+    pthread_mutex_lock(&queue_lock);
+    for (;;) {
+        while (NULL == queue_head && !shutting_down)
+            pthread_cond_wait(&work_cond, &queue_lock);
+
+        /* Finish the queue before exiting */
+        if (NULL == queue_head)
+            break;
+
+        job = queue_head;
+        queue_head = job->next;
+        if (NULL == queue_head)
+            queue_tail = NULL;
+
+        pthread_mutex_unlock(&queue_lock);
+        ret = job->write(job);
+        job->release(job);
+        pthread_mutex_lock(&queue_lock);
+
+        if (ret < 0)
+            write_failed = TRUE;
+        n_queued--;
+        pthread_cond_broadcast(&done_cond);
+    }
+    pthread_mutex_unlock(&queue_lock);
+
+    return NULL;
+} /* end writer_main() */
+
+/************************************************************************
+ * stop_writer()
+ *
+ * Lets the writer finish the queued appends, then joins it.
+ ************************************************************************/
+static void
+stop_writer(void)
+{
+    if (0 == depth)
+        return;
+
+    pthread_mutex_lock(&queue_lock);
+    shutting_down = TRUE;
+    pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&queue_lock);
+
+    pthread_join(writer, NULL);
+
+    depth = 0;
+    shutting_down = FALSE;
+
+    return;
+} /* end stop_writer() */
+
+/************************************************************************
+ * h5fnal_set_async_writes()
+ *
+ * With a queue depth above 0, the data products' append calls copy
+ * the caller's data into a queue and return, and a writer thread
+ * appends it. The append blocks while queue_depth appends are
+ * waiting. Appends that were already queued are finished first.
+ *
+ * Call with 0 before exiting to shut the thread down (this fails if
+ * any queued append failed). Not thread-safe (call from the thread
+ * that does the HDF5 I/O).
+ ************************************************************************/
+herr_t
+h5fnal_set_async_writes(unsigned queue_depth)
+{
+    herr_t ret;
+
+    if (queue_depth == depth)
+        return H5FNAL_SUCCESS;
+
+    stop_writer();
+    ret = h5fnal_wait_all();
+
+    if (0 == queue_depth)
+        return ret;
+
+    if (pthread_create(&writer, NULL, writer_main, NULL) != 0)
+        H5FNAL_PROGRAM_ERROR("could not start writer thread");
+    depth = queue_depth;
+
+    return ret;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_set_async_writes() */
+
+unsigned
+h5fnal_get_async_writes(void)
+{
+    return depth;
+} /* end h5fnal_get_async_writes() */
+
+/************************************************************************
+ * h5fnal_wait_all()
+ ************************************************************************/
+herr_t
+h5fnal_wait_all(void)
+{
+    herr_t ret;
+
+    h5fnal_drain_async_writes();
+
+    pthread_mutex_lock(&queue_lock);
+    ret = write_failed ? H5FNAL_FAILURE : H5FNAL_SUCCESS;
+    write_failed = FALSE;
+    pthread_mutex_unlock(&queue_lock);
+
+    if (ret < 0)
+        H5FNAL_PROGRAM_ERROR("a queued append failed");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_wait_all() */
+
+/************************************************************************
+ * h5fnal_drain_async_writes()
+ *
+ * Waits for the queue to empty, leaving any failure for
+ * h5fnal_wait_all() to report. Does nothing on the writer thread
+ * (the library calls this from functions the appends may use).
+ ************************************************************************/
+void
+h5fnal_drain_async_writes(void)
+{
+    if (0 == depth || pthread_equal(pthread_self(), writer))
+        return;
+
+    pthread_mutex_lock(&queue_lock);
+    while (n_queued > 0)
+        pthread_cond_wait(&done_cond, &queue_lock);
+    pthread_mutex_unlock(&queue_lock);
+
+    return;
+} /* end h5fnal_drain_async_writes() */
+
+/************************************************************************
+ * h5fnal_submit_async_job()
+ *
+ * Queues an append, waiting for room. The queue owns the job (and
+ * releases it) once this succeeds.
+ ************************************************************************/
+herr_t
+h5fnal_submit_async_job(h5fnal_async_job_t *job)
+{
+    if (NULL == job)
+        H5FNAL_PROGRAM_ERROR("job parameter cannot be NULL");
+    if (0 == depth)
+        H5FNAL_PROGRAM_ERROR("asynchronous appends are not enabled");
+
+    job->next = NULL;
+
+    pthread_mutex_lock(&queue_lock);
+    while (n_queued >= depth)
+        pthread_cond_wait(&done_cond, &queue_lock);
+    if (queue_tail)
+        queue_tail->next = job;
+    else
+        queue_head = job;
+    queue_tail = job;
+    n_queued++;
+    pthread_cond_signal(&work_cond);
+    pthread_mutex_unlock(&queue_lock);
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_submit_async_job() */
+
+/************************************************************************
+ * h5fnal_copy_async_array()
+ *
+ * Copies n elements of the caller's data for a job (*dst is NULL
+ * when n is 0).
+ ************************************************************************/
+herr_t
+h5fnal_copy_async_array(void **dst, const void *src, hsize_t n, size_t elem_size)
+{
+    *dst = NULL;
+
+    if (0 == n)
+        return H5FNAL_SUCCESS;
+    if (NULL == src)
+        H5FNAL_PROGRAM_ERROR("no data to copy");
+
+    if (NULL == (*dst = malloc((size_t)n * elem_size)))
+        H5FNAL_PROGRAM_ERROR("could not get memory for queued data");
+    memcpy(*dst, src, (size_t)n * elem_size);
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_copy_async_array() */
@@ -0,0 +1,50 @@
+/* async.h
+ *
+ * Header for asynchronous appends: a writer thread that does the
+ * data products' appends (dataset extends, writes and compression)
+ * while the caller gets the next event ready.
+ */
+
+#ifndef H5FNAL_ASYNC_H
+#define H5FNAL_ASYNC_H
+
+#include "h5fnal.h"
+
+/* A queued append
+ *
+ * The data products embed this at the start of their own job
+ * structs, which hold a copy of the caller's arrays. write() runs on
+ * the writer thread and release() frees the job once it has run.
+ */
+typedef struct h5fnal_async_job_t {
+    herr_t  (*write)(struct h5fnal_async_job_t *job);
+    void    (*release)(struct h5fnal_async_job_t *job);
+
+    struct h5fnal_async_job_t *next;
+} h5fnal_async_job_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Number of appends that may be queued (0, the default, appends on
+ * the calling thread)
+ */
+herr_t h5fnal_set_async_writes(unsigned queue_depth);
+unsigned h5fnal_get_async_writes(void);
+
+/* Waits for the queued appends. Fails if any of them failed since
+ * the last call.
+ */
+herr_t h5fnal_wait_all(void);
+
+/* Used by the library */
+herr_t h5fnal_submit_async_job(h5fnal_async_job_t *job);
+void h5fnal_drain_async_writes(void);
+herr_t h5fnal_copy_async_array(void **dst, const void *src, hsize_t n, size_t elem_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* H5FNAL_ASYNC_H */
@@ -0,0 +1,303 @@
+/* compress.c
+ *
+ * Chunk compression and the worker threads that run it.
+ *
+ * Only the compression runs on the workers. All HDF5 calls stay on
+ * the thread that owns the jobs, which writes the finished chunks
+ * in the order it submitted them.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include "h5fnal.h"
+
+/* The worker pool. The lock and condition variables outlive the
+ * workers so that jobs from an old pool can still be waited on after
+ * the thread count changes.
+ */
+static pthread_mutex_t  pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t   done_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t           *workers = NULL;
+static unsigned             n_workers = 0;
+static hbool_t              shutting_down = FALSE;
+static h5fnal_chunk_job_t  *queue_head = NULL;
+static h5fnal_chunk_job_t  *queue_tail = NULL;
+
+
+/************************************************************************
+ * h5fnal_shuffle_chunk()
+ *
+ * Does what the HDF5 shuffle filter does: byte j of element i goes
+ * to dst[j * n_elems + i]. The elements are read from src every
+ * src_stride bytes, so a field can be shuffled straight out of an
+ * array of structs.
+ ************************************************************************/
+void
+h5fnal_shuffle_chunk(unsigned char *dst, const unsigned char *src, size_t elem_size, size_t n_elems, size_t src_stride)
+{
+    size_t i, j;
+
+    for (i = 0; i < n_elems; i++, src += src_stride)
+        for (j = 0; j < elem_size; j++)
+            dst[j * n_elems + i] = src[j];
+
+    return;
+} /* end h5fnal_shuffle_chunk() */
+
+/************************************************************************
+ * deflate_chunk()
+ *
+ * As in the filter pipeline, a chunk that doesn't get any smaller is
+ * stored shuffled but not deflated, with the deflate filter (the
+ * second one) masked off.
+ ************************************************************************/
+static void
+deflate_chunk(h5fnal_chunk_job_t *job)
+{
+    uLongf n_deflated = compressBound((uLong)job->n_bytes);
+
+    if (Z_OK == compress2(job->deflated, &n_deflated, job->shuffled, (uLong)job->n_bytes, job->level)
+            && n_deflated < job->n_bytes) {
+        job->out = job->deflated;
+        job->out_size = (size_t)n_deflated;
+        job->filter_mask = 0;
+    }
+    else {
+        job->out = job->shuffled;
+        job->out_size = job->n_bytes;
+        job->filter_mask = 0x2;
+    }
+
+    return;
+} /* end deflate_chunk() */
+
+/************************************************************************
+ * worker_main()
+ ************************************************************************/
+static void *
+worker_main(void *arg)
+{
+    h5fnal_chunk_job_t *job = NULL;
+
+    (void)arg;
+
+    pthread_mutex_lock(&pool_lock);
+    for (;;) {
+        while (NULL == queue_head && !shutting_down)
+            pthread_cond_wait(&work_cond, &pool_lock);
+
+        /* Finish the queue before exiting */
+        if (NULL == queue_head)
+            break;
+
+        job = queue_head;
+        queue_head = job->next_queued;
+        if (NULL == queue_head)
+            queue_tail = NULL;
+
+        pthread_mutex_unlock(&pool_lock);
+        deflate_chunk(job);
+        pthread_mutex_lock(&pool_lock);
+
+        job->done = TRUE;
+        pthread_cond_broadcast(&done_cond);
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    return NULL;
+} /* end worker_main() */
+
+/************************************************************************
+ * stop_workers()
+ *
+ * Lets the workers finish the queued jobs, then joins them.
+ ************************************************************************/
+static void
+stop_workers(void)
+{
+    unsigned u;
+
+    if (0 == n_workers)
+        return;
+
+    pthread_mutex_lock(&pool_lock);
+    shutting_down = TRUE;
+    pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&pool_lock);
+
+    for (u = 0; u < n_workers; u++)
+        pthread_join(workers[u], NULL);
+
+    free(workers);
+    workers = NULL;
+    n_workers = 0;
+    shutting_down = FALSE;
+
+    return;
+} /* end stop_workers() */
+
+/************************************************************************
+ * h5fnal_set_compression_threads()
+ *
+ * Sets the number of threads that compress chunks for direct chunk
+ * writes (see h5fnal_set_direct_chunk_write()). With 0 threads the
+ * chunks are compressed on the calling thread. Jobs that were
+ * already submitted are finished first.
+ *
+ * Call with 0 before exiting to shut the threads down. Not
+ * thread-safe (call from the thread that does the HDF5 I/O).
+ ************************************************************************/
+herr_t
+h5fnal_set_compression_threads(unsigned n_threads)
+{
+    unsigned u;
+
+    /* Queued appends may be using the workers */
+    h5fnal_drain_async_writes();
+
+    if (n_threads == n_workers)
+        return H5FNAL_SUCCESS;
+
+    stop_workers();
+
+    if (0 == n_threads)
+        return H5FNAL_SUCCESS;
+
+    if (NULL == (workers = (pthread_t *)calloc(n_threads, sizeof(pthread_t))))
+        H5FNAL_PROGRAM_ERROR("could not get memory for compression threads");
+
+    for (u = 0; u < n_threads; u++) {
+        if (pthread_create(&workers[u], NULL, worker_main, NULL) != 0)
+            H5FNAL_PROGRAM_ERROR("could not start compression thread");
+        n_workers++;
+    }
+
+    return H5FNAL_SUCCESS;
+
+error:
+    stop_workers();
+    free(workers);
+    workers = NULL;
+
+    return H5FNAL_FAILURE;
+} /* end h5fnal_set_compression_threads() */
+
+unsigned
+h5fnal_get_compression_threads(void)
+{
+    return n_workers;
+} /* end h5fnal_get_compression_threads() */
+
+/************************************************************************
+ * h5fnal_create_chunk_job()
+ *
+ * Gets a job with room for a chunk of n_bytes.
+ ************************************************************************/
+h5fnal_chunk_job_t *
+h5fnal_create_chunk_job(size_t n_bytes)
+{
+    h5fnal_chunk_job_t *job = NULL;
+
+    if (NULL == (job = (h5fnal_chunk_job_t *)calloc(1, sizeof(h5fnal_chunk_job_t))))
+        H5FNAL_PROGRAM_ERROR("could not get memory for chunk job");
+    if (NULL == (job->shuffled = (unsigned char *)malloc(n_bytes)))
+        H5FNAL_PROGRAM_ERROR("could not get memory for chunk");
+    if (NULL == (job->deflated = (unsigned char *)malloc(compressBound((uLong)n_bytes))))
+        H5FNAL_PROGRAM_ERROR("could not get memory for compressed chunk");
+    job->n_bytes = n_bytes;
+
+    return job;
+
+error:
+    h5fnal_free_chunk_job(job);
+
+    return NULL;
+} /* end h5fnal_create_chunk_job() */
+
+/************************************************************************
+ * h5fnal_submit_chunk_job()
+ *
+ * Queues the job for the workers, or compresses it right away if
+ * there aren't any.
+ ************************************************************************/
+herr_t
+h5fnal_submit_chunk_job(h5fnal_chunk_job_t *job)
+{
+    if (NULL == job)
+        H5FNAL_PROGRAM_ERROR("job parameter cannot be NULL");
+
+    job->done = FALSE;
+    job->next_queued = NULL;
+
+    if (0 == n_workers) {
+        deflate_chunk(job);
+        job->done = TRUE;
+        return H5FNAL_SUCCESS;
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    if (queue_tail)
+        queue_tail->next_queued = job;
+    else
+        queue_head = job;
+    queue_tail = job;
+    pthread_cond_signal(&work_cond);
+    pthread_mutex_unlock(&pool_lock);
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_submit_chunk_job() */
+
+hbool_t
+h5fnal_chunk_job_done(h5fnal_chunk_job_t *job)
+{
+    hbool_t done;
+
+    pthread_mutex_lock(&pool_lock);
+    done = job->done;
+    pthread_mutex_unlock(&pool_lock);
+
+    return done;
+} /* end h5fnal_chunk_job_done() */
+
+herr_t
+h5fnal_wait_chunk_job(h5fnal_chunk_job_t *job)
+{
+    if (NULL == job)
+        H5FNAL_PROGRAM_ERROR("job parameter cannot be NULL");
+
+    pthread_mutex_lock(&pool_lock);
+    while (!job->done)
+        pthread_cond_wait(&done_cond, &pool_lock);
+    pthread_mutex_unlock(&pool_lock);
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_wait_chunk_job() */
+
+/************************************************************************
+ * h5fnal_free_chunk_job()
+ *
+ * The job must not be queued (wait for it first).
+ ************************************************************************/
+void
+h5fnal_free_chunk_job(h5fnal_chunk_job_t *job)
+{
+    if (job) {
+        free(job->shuffled);
+        free(job->deflated);
+        free(job);
+    }
+
+    return;
+} /* end h5fnal_free_chunk_job() */
@@ -0,0 +1,65 @@
+/* compress.h
+ *
+ * Header for chunk compression (shuffle + deflate, done the same
+ * way as the HDF5 filters) and the worker threads that run it.
+ */
+
+#ifndef H5FNAL_COMPRESS_H
+#define H5FNAL_COMPRESS_H
+
+#include "h5fnal.h"
+
+/* A chunk to be compressed
+ *
+ * The caller fills in shuffled (n_bytes of shuffled chunk data),
+ * level and offset, submits the job and later waits on it. Once
+ * the job is done, out/out_size/filter_mask are what should be
+ * handed to H5Dwrite_chunk(). out points at either deflated or
+ * shuffled.
+ *
+ * Jobs belong to whoever created them, the workers only read
+ * shuffled and write deflated.
+ */
+typedef struct h5fnal_chunk_job_t {
+    hsize_t         offset;         /* first element of the chunk        */
+    int             level;          /* deflate level                     */
+
+    unsigned char  *shuffled;
+    size_t          n_bytes;
+    unsigned char  *deflated;       /* compressBound(n_bytes) bytes      */
+
+    const void     *out;
+    size_t          out_size;
+    uint32_t        filter_mask;
+
+    hbool_t         done;
+
+    struct h5fnal_chunk_job_t *next_queued;     /* worker queue     */
+    struct h5fnal_chunk_job_t *next;            /* owner's list     */
+} h5fnal_chunk_job_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Number of compression worker threads (0, the default, compresses
+ * on the calling thread)
+ */
+herr_t h5fnal_set_compression_threads(unsigned n_threads);
+unsigned h5fnal_get_compression_threads(void);
+
+/* Byte-shuffle n_elems elements (taken every src_stride bytes) */
+void h5fnal_shuffle_chunk(unsigned char *dst, const unsigned char *src, size_t elem_size, size_t n_elems, size_t src_stride);
+
+/* Chunk jobs */
+h5fnal_chunk_job_t *h5fnal_create_chunk_job(size_t n_bytes);
+herr_t h5fnal_submit_chunk_job(h5fnal_chunk_job_t *job);
+hbool_t h5fnal_chunk_job_done(h5fnal_chunk_job_t *job);
+herr_t h5fnal_wait_chunk_job(h5fnal_chunk_job_t *job);
+void h5fnal_free_chunk_job(h5fnal_chunk_job_t *job);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* H5FNAL_COMPRESS_H */
@@ -0,0 +1,335 @@
+/* event_table.c
+ *
+ * Per-product event tables (see event_table.h).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "h5fnal.h"
+
+/************************************************************************
+ * h5fnal_create_event_entry_type()
+ *
+ * Creates and returns an HDF5 compound datatype that represents an
+ * event table row.
+ ************************************************************************/
+hid_t
+h5fnal_create_event_entry_type(void)
+{
+    hid_t tid = H5FNAL_BAD_HID_T;
+    hid_t array_tid = H5FNAL_BAD_HID_T;
+    hsize_t dims[1];
+
+    dims[0] = H5FNAL_MAX_EVENT_DSETS;
+    if ((array_tid = H5Tarray_create2(H5T_NATIVE_HSIZE, 1, dims)) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    if ((tid = H5Tcreate(H5T_COMPOUND, sizeof(h5fnal_event_entry_t))) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Tinsert(tid, "run", HOFFSET(h5fnal_event_entry_t, run), H5T_NATIVE_UINT32) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Tinsert(tid, "subrun", HOFFSET(h5fnal_event_entry_t, subrun), H5T_NATIVE_UINT32) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Tinsert(tid, "event", HOFFSET(h5fnal_event_entry_t, event), H5T_NATIVE_UINT32) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Tinsert(tid, "start", HOFFSET(h5fnal_event_entry_t, start), array_tid) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Tinsert(tid, "count", HOFFSET(h5fnal_event_entry_t, count), array_tid) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    if (H5Tclose(array_tid) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    return tid;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Tclose(array_tid);
+        H5Tclose(tid);
+    } H5E_END_TRY;
+
+    return H5FNAL_BAD_HID_T;
+} /* end h5fnal_create_event_entry_type() */
+
+/************************************************************************
+ * compare_events()
+ *
+ * Orders event table rows by run, sub-run and event. Also used to
+ * compare a row with a key.
+ ************************************************************************/
+static int
+compare_events(const void *_a, const void *_b)
+{
+    const h5fnal_event_entry_t *a = (const h5fnal_event_entry_t *)_a;
+    const h5fnal_event_entry_t *b = (const h5fnal_event_entry_t *)_b;
+
+    if (a->run != b->run)
+        return a->run < b->run ? -1 : 1;
+    if (a->subrun != b->subrun)
+        return a->subrun < b->subrun ? -1 : 1;
+    if (a->event != b->event)
+        return a->event < b->event ? -1 : 1;
+    return 0;
+} /* end compare_events() */
+
+/************************************************************************
+ * h5fnal_init_event_table()
+ *
+ * Sets up an empty, closed table so that it can be closed safely
+ * before it is opened. No HDF5 calls are made.
+ ************************************************************************/
+void
+h5fnal_init_event_table(h5fnal_event_table_t *table)
+{
+    memset(table, 0, sizeof(h5fnal_event_table_t));
+    table->loc_id = H5FNAL_BAD_HID_T;
+    table->dset_id = H5FNAL_BAD_HID_T;
+    table->dtype_id = H5FNAL_BAD_HID_T;
+    table->sorted = TRUE;
+    h5fnal_init_appender(&(table->app), H5FNAL_BAD_HID_T, H5FNAL_BAD_HID_T, TRUE);
+
+    return;
+} /* end h5fnal_init_event_table() */
+
+/************************************************************************
+ * h5fnal_open_event_table()
+ *
+ * Sets up the event table for the product whose group is loc_id and
+ * loads the rows, if the product has a table. If it doesn't, one is
+ * created when the first event is added.
+ ************************************************************************/
+herr_t
+h5fnal_open_event_table(hid_t loc_id, h5fnal_event_table_t *table)
+{
+    const h5fnal_product_types_t *types = NULL;
+    hssize_t n;
+    htri_t exists;
+    hsize_t u;
+
+    if (loc_id < 0)
+        H5FNAL_PROGRAM_ERROR("invalid loc_id parameter");
+    if (NULL == table)
+        H5FNAL_PROGRAM_ERROR("table parameter cannot be NULL");
+
+    h5fnal_init_event_table(table);
+    table->loc_id = loc_id;
+
+    if (NULL == (types = h5fnal_get_product_types()))
+        H5FNAL_PROGRAM_ERROR("could not get product datatypes");
+    if ((table->dtype_id = h5fnal_share_type(types->event_entry_dtype_id)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create event table datatype");
+    table->app.tid = table->dtype_id;
+
+    if ((exists = H5Lexists(loc_id, H5FNAL_EVENT_TABLE_DATASET_NAME, H5P_DEFAULT)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (!exists)
+        return H5FNAL_SUCCESS;
+
+    if ((table->dset_id = H5Dopen2(loc_id, H5FNAL_EVENT_TABLE_DATASET_NAME, H5P_DEFAULT)) < 0)
+        H5FNAL_HDF5_ERROR;
+    table->app.did = table->dset_id;
+
+    /* Load the rows */
+    if ((n = h5fnal_get_dset_size(table->dset_id)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get size of event table");
+    if (h5fnal_reserve_buffer((void **)&(table->entries), &(table->capacity), (hsize_t)n, sizeof(h5fnal_event_entry_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not allocate memory for event table");
+    if (n > 0)
+        if (H5Dread(table->dset_id, table->dtype_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, table->entries) < 0)
+            H5FNAL_HDF5_ERROR;
+    table->n_entries = (hsize_t)n;
+
+    for (u = 1; u < table->n_entries; u++)
+        if (compare_events(&(table->entries[u - 1]), &(table->entries[u])) > 0) {
+            table->sorted = FALSE;
+            break;
+        }
+
+    return H5FNAL_SUCCESS;
+
+error:
+    if (table)
+        H5E_BEGIN_TRY {
+            h5fnal_close_event_table(table);
+        } H5E_END_TRY;
+
+    return H5FNAL_FAILURE;
+} /* end h5fnal_open_event_table() */
+
+/************************************************************************
+ * h5fnal_close_event_table()
+ *
+ * Writes out any rows that are still buffered and closes the table.
+ * Everything is released even if that fails.
+ ************************************************************************/
+herr_t
+h5fnal_close_event_table(h5fnal_event_table_t *table)
+{
+    herr_t ret = H5FNAL_SUCCESS;
+
+    if (NULL == table)
+        H5FNAL_PROGRAM_ERROR("table parameter cannot be NULL");
+
+    if (h5fnal_close_appender(&(table->app)) < 0)
+        ret = H5FNAL_FAILURE;
+    if (table->dset_id >= 0 && H5Dclose(table->dset_id) < 0)
+        ret = H5FNAL_FAILURE;
+    if (table->dtype_id >= 0 && H5Tclose(table->dtype_id) < 0)
+        ret = H5FNAL_FAILURE;
+
+    free(table->entries);
+
+    h5fnal_init_event_table(table);
+
+    return ret;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_close_event_table() */
+
+/************************************************************************
+ * h5fnal_flush_event_table()
+ ************************************************************************/
+herr_t
+h5fnal_flush_event_table(h5fnal_event_table_t *table)
+{
+    if (NULL == table)
+        H5FNAL_PROGRAM_ERROR("table parameter cannot be NULL");
+
+    if (h5fnal_flush_appender(&(table->app)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush event table");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_flush_event_table() */
+
+/************************************************************************
+ * h5fnal_check_new_event()
+ *
+ * Fails if the event is already in the table. The products call this
+ * before appending an event's data, so that a duplicate doesn't leave
+ * rows behind that no event points to.
+ ************************************************************************/
+herr_t
+h5fnal_check_new_event(h5fnal_event_table_t *table, uint32_t run, uint32_t subrun, uint32_t event)
+{
+    h5fnal_event_entry_t key;
+    htri_t found;
+
+    if (NULL == table)
+        H5FNAL_PROGRAM_ERROR("table parameter cannot be NULL");
+
+    key.run = run;
+    key.subrun = subrun;
+    key.event = event;
+
+    /* Events usually come in order, so only look the event up when it
+     * doesn't go at the end (the last row is only the largest while
+     * the rows are sorted)
+     */
+    if (table->n_entries > 0
+            && (!table->sorted || compare_events(&(table->entries[table->n_entries - 1]), &key) >= 0)) {
+        if ((found = h5fnal_find_event(table, run, subrun, event, NULL)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not look up event");
+        if (found)
+            H5FNAL_PROGRAM_ERROR("event is already in the event table");
+    }
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_check_new_event() */
+
+/************************************************************************
+ * h5fnal_add_event()
+ *
+ * Adds a row for an event whose data was just appended to the
+ * product. start and count have H5FNAL_MAX_EVENT_DSETS elements.
+ *
+ * Adding an event that is already in the table is an error (check
+ * with h5fnal_check_new_event() before appending the data).
+ ************************************************************************/
+herr_t
+h5fnal_add_event(h5fnal_event_table_t *table, uint32_t run, uint32_t subrun, uint32_t event,
+        const hsize_t *start, const hsize_t *count)
+{
+    h5fnal_event_entry_t entry;
+
+    if (NULL == table)
+        H5FNAL_PROGRAM_ERROR("table parameter cannot be NULL");
+    if (NULL == start || NULL == count)
+        H5FNAL_PROGRAM_ERROR("start and count parameters cannot be NULL");
+
+    memset(&entry, 0, sizeof(h5fnal_event_entry_t));
+    entry.run = run;
+    entry.subrun = subrun;
+    entry.event = event;
+    memcpy(entry.start, start, sizeof(entry.start));
+    memcpy(entry.count, count, sizeof(entry.count));
+
+    if (h5fnal_check_new_event(table, run, subrun, event) < 0)
+        H5FNAL_PROGRAM_ERROR("could not add event");
+    if (table->n_entries > 0 && compare_events(&(table->entries[table->n_entries - 1]), &entry) > 0)
+        table->sorted = FALSE;
+
+    /* Create the dataset with the first event */
+    if (table->dset_id < 0)
+        if (h5fnal_appender_create_dset(&(table->app), table->loc_id, H5FNAL_EVENT_TABLE_DATASET_NAME, NULL, &(table->dset_id)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not create event table");
+
+    if (h5fnal_reserve_buffer((void **)&(table->entries), &(table->capacity), table->n_entries + 1, sizeof(h5fnal_event_entry_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not grow event table");
+    table->entries[table->n_entries++] = entry;
+
+    if (h5fnal_appender_append(&(table->app), 1, &entry) < 0)
+        H5FNAL_PROGRAM_ERROR("could not append to event table");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_add_event() */
+
+/************************************************************************
+ * h5fnal_find_event()
+ *
+ * Binary search of the in-memory rows (sorting them first if they
+ * were added out of order). entry can be NULL.
+ ************************************************************************/
+htri_t
+h5fnal_find_event(h5fnal_event_table_t *table, uint32_t run, uint32_t subrun, uint32_t event,
+        h5fnal_event_entry_t *entry)
+{
+    h5fnal_event_entry_t key;
+    h5fnal_event_entry_t *found = NULL;
+
+    if (NULL == table)
+        H5FNAL_PROGRAM_ERROR("table parameter cannot be NULL");
+
+    if (0 == table->n_entries)
+        return FALSE;
+
+    if (!table->sorted) {
+        qsort(table->entries, (size_t)table->n_entries, sizeof(h5fnal_event_entry_t), compare_events);
+        table->sorted = TRUE;
+    }
+
+    key.run = run;
+    key.subrun = subrun;
+    key.event = event;
+    found = (h5fnal_event_entry_t *)bsearch(&key, table->entries, (size_t)table->n_entries, sizeof(h5fnal_event_entry_t), compare_events);
+
+    if (NULL == found)
+        return FALSE;
+    if (entry)
+        *entry = *found;
+
+    return TRUE;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_find_event() */
@@ -0,0 +1,80 @@
+/* event_table.h
+ *
+ * Header for per-product event tables.
+ *
+ * A data product can be created once per run (or sub-run) instead of
+ * once per event and have each event appended to it. The event table
+ * is a dataset in the product's group with one row per event that
+ * gives the range each of the product's datasets holds for that
+ * event, so reading an event is a hyperslab selection instead of a
+ * chain of group and dataset opens.
+ */
+
+#ifndef H5FNAL_EVENT_TABLE_H
+#define H5FNAL_EVENT_TABLE_H
+
+#include "h5fnal.h"
+
+#define H5FNAL_EVENT_TABLE_DATASET_NAME     "event_table"
+
+/* Datasets per row (the most any data product has) */
+#define H5FNAL_MAX_EVENT_DSETS              5
+
+/* Event table row
+ *
+ * start and count are element ranges in the product's datasets (the
+ * order is up to the product). Unused slots are zero.
+ */
+typedef struct h5fnal_event_entry_t {
+    uint32_t    run;
+    uint32_t    subrun;
+    uint32_t    event;
+    hsize_t     start[H5FNAL_MAX_EVENT_DSETS];
+    hsize_t     count[H5FNAL_MAX_EVENT_DSETS];
+} h5fnal_event_entry_t;
+
+/* Event table
+ *
+ * The dataset is created with the first event that is added to it.
+ * All the rows are also kept in memory for lookups. They are sorted
+ * (by run, sub-run and event) the first time an event is looked up
+ * after rows were added out of order.
+ */
+typedef struct h5fnal_event_table_t {
+    hid_t                   loc_id;     /* the product's group (borrowed) */
+    hid_t                   dset_id;
+    hid_t                   dtype_id;
+    h5fnal_appender_t       app;
+
+    h5fnal_event_entry_t   *entries;
+    hsize_t                 n_entries;
+    hsize_t                 capacity;
+    hbool_t                 sorted;
+} h5fnal_event_table_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+hid_t h5fnal_create_event_entry_type(void);
+
+/* Used by the data products */
+void h5fnal_init_event_table(h5fnal_event_table_t *table);
+herr_t h5fnal_open_event_table(hid_t loc_id, h5fnal_event_table_t *table);
+herr_t h5fnal_close_event_table(h5fnal_event_table_t *table);
+herr_t h5fnal_flush_event_table(h5fnal_event_table_t *table);
+herr_t h5fnal_check_new_event(h5fnal_event_table_t *table, uint32_t run, uint32_t subrun, uint32_t event);
+herr_t h5fnal_add_event(h5fnal_event_table_t *table, uint32_t run, uint32_t subrun, uint32_t event,
+        const hsize_t *start, const hsize_t *count);
+
+/* Look up an event. Returns TRUE and copies the row into entry if the
+ * event is in the table, FALSE if it isn't.
+ */
+htri_t h5fnal_find_event(h5fnal_event_table_t *table, uint32_t run, uint32_t subrun, uint32_t event,
+        h5fnal_event_entry_t *entry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* H5FNAL_EVENT_TABLE_H */
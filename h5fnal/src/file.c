@@ -0,0 +1,823 @@
+/* file.c
+ *
+ * h5fnal files and the file-level state shared by the data
+ * products in a file.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "h5fnal.h"
+
+/* A string dictionary shared by all the products in a file */
+typedef struct h5fnal_file_dict_t {
+    char                       *path;
+    string_dictionary_t         dict;
+    struct h5fnal_file_dict_t  *next;
+} h5fnal_file_dict_t;
+
+/* A datatype committed to the file */
+typedef struct h5fnal_file_type_t {
+    hid_t                       tid;
+    struct h5fnal_file_type_t  *next;
+} h5fnal_file_type_t;
+
+/* File-level event index row (see h5fnal_index_event()) */
+typedef struct h5fnal_event_index_entry_t {
+    uint32_t    run;
+    uint32_t    subrun;
+    uint32_t    event;
+    uint64_t    addr;       /* object header address of the event group */
+} h5fnal_event_index_entry_t;
+
+/* File-level state for a file opened through h5fnal */
+typedef struct h5fnal_file_t {
+    hid_t                   fid;
+    hbool_t                 writable;
+    h5fnal_file_dict_t     *dicts;
+
+    /* Committed datatypes (loaded from the file on first use) */
+    h5fnal_file_type_t     *types;
+    hbool_t                 types_loaded;
+
+    /* Event index, kept in memory and written out (sorted) when the
+     * file is flushed or closed
+     */
+    h5fnal_event_index_entry_t *events;
+    hsize_t                 n_events;
+    hsize_t                 events_capacity;
+    hbool_t                 events_sorted;
+    hbool_t                 events_dirty;
+
+    struct h5fnal_file_t   *next;
+} h5fnal_file_t;
+
+/* All the files opened with h5fnal_create_file() / h5fnal_open_file() */
+static h5fnal_file_t *open_files = NULL;
+
+
+/************************************************************************
+ * find_file()
+ *
+ * Returns the file-level state for the file that contains loc_id,
+ * or NULL if the file was not opened through h5fnal.
+ *
+ * H5Iget_file_id() hands back the ID the file was opened with (with
+ * its reference count bumped), so we can match on the hid_t.
+ ************************************************************************/
+static h5fnal_file_t *
+find_file(hid_t loc_id)
+{
+    hid_t fid = H5FNAL_BAD_HID_T;
+    h5fnal_file_t *file = NULL;
+
+    H5E_BEGIN_TRY {
+        fid = H5Iget_file_id(loc_id);
+    } H5E_END_TRY;
+    if (fid < 0)
+        return NULL;
+
+    for (file = open_files; file; file = file->next)
+        if (file->fid == fid)
+            break;
+
+    /* Only drops the reference H5Iget_file_id() added */
+    H5Fclose(fid);
+
+    return file;
+} /* end find_file() */
+
+/************************************************************************
+ * register_file()
+ ************************************************************************/
+static herr_t
+register_file(hid_t fid, hbool_t writable)
+{
+    h5fnal_file_t *file = NULL;
+
+    if (NULL == (file = (h5fnal_file_t *)calloc(1, sizeof(h5fnal_file_t))))
+        H5FNAL_PROGRAM_ERROR("could not get memory for file state");
+
+    file->fid = fid;
+    file->writable = writable;
+    file->dicts = NULL;
+    file->events_sorted = TRUE;
+
+    file->next = open_files;
+    open_files = file;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end register_file() */
+
+/************************************************************************
+ * compare_index_entries()
+ *
+ * qsort()/bsearch() callback. Orders rows by run, sub-run and event.
+ ************************************************************************/
+static int
+compare_index_entries(const void *_a, const void *_b)
+{
+    const h5fnal_event_index_entry_t *a = (const h5fnal_event_index_entry_t *)_a;
+    const h5fnal_event_index_entry_t *b = (const h5fnal_event_index_entry_t *)_b;
+
+    if (a->run != b->run)
+        return a->run < b->run ? -1 : 1;
+    if (a->subrun != b->subrun)
+        return a->subrun < b->subrun ? -1 : 1;
+    if (a->event != b->event)
+        return a->event < b->event ? -1 : 1;
+    return 0;
+} /* end compare_index_entries() */
+
+/************************************************************************
+ * create_event_index_type()
+ ************************************************************************/
+static hid_t
+create_event_index_type(void)
+{
+    hid_t tid = H5FNAL_BAD_HID_T;
+
+    if ((tid = H5Tcreate(H5T_COMPOUND, sizeof(h5fnal_event_index_entry_t))) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Tinsert(tid, "run", HOFFSET(h5fnal_event_index_entry_t, run), H5T_NATIVE_UINT32) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Tinsert(tid, "subrun", HOFFSET(h5fnal_event_index_entry_t, subrun), H5T_NATIVE_UINT32) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Tinsert(tid, "event", HOFFSET(h5fnal_event_index_entry_t, event), H5T_NATIVE_UINT32) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Tinsert(tid, "addr", HOFFSET(h5fnal_event_index_entry_t, addr), H5T_NATIVE_UINT64) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    return tid;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Tclose(tid);
+    } H5E_END_TRY;
+
+    return H5FNAL_BAD_HID_T;
+} /* end create_event_index_type() */
+
+/************************************************************************
+ * sort_event_index()
+ ************************************************************************/
+static void
+sort_event_index(h5fnal_file_t *file)
+{
+    if (!file->events_sorted) {
+        qsort(file->events, (size_t)file->n_events, sizeof(h5fnal_event_index_entry_t), compare_index_entries);
+        file->events_sorted = TRUE;
+    }
+} /* end sort_event_index() */
+
+/************************************************************************
+ * load_event_index()
+ *
+ * Reads the event index into memory, if the file has one.
+ ************************************************************************/
+static herr_t
+load_event_index(h5fnal_file_t *file)
+{
+    hid_t did = H5FNAL_BAD_HID_T;
+    hid_t tid = H5FNAL_BAD_HID_T;
+    hssize_t n;
+    htri_t exists;
+
+    if ((exists = H5Lexists(file->fid, H5FNAL_FILE_EVENT_INDEX_PATH, H5P_DEFAULT)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (!exists)
+        return H5FNAL_SUCCESS;
+
+    if ((did = H5Dopen2(file->fid, H5FNAL_FILE_EVENT_INDEX_PATH, H5P_DEFAULT)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if ((tid = create_event_index_type()) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create event index datatype");
+    if ((n = h5fnal_get_dset_size(did)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get event index size");
+
+    if (h5fnal_reserve_buffer((void **)&(file->events), &(file->events_capacity), (hsize_t)n, sizeof(h5fnal_event_index_entry_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not allocate memory for event index");
+    if (n > 0)
+        if (H5Dread(did, tid, H5S_ALL, H5S_ALL, H5P_DEFAULT, file->events) < 0)
+            H5FNAL_HDF5_ERROR;
+    file->n_events = (hsize_t)n;
+
+    /* It was written sorted */
+    file->events_sorted = TRUE;
+    file->events_dirty = FALSE;
+
+    if (H5Tclose(tid) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Dclose(did) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Tclose(tid);
+        H5Dclose(did);
+    } H5E_END_TRY;
+
+    return H5FNAL_FAILURE;
+} /* end load_event_index() */
+
+/************************************************************************
+ * write_event_index()
+ *
+ * Writes the whole (sorted) event index out, if events were added
+ * since it was last written.
+ ************************************************************************/
+static herr_t
+write_event_index(h5fnal_file_t *file)
+{
+    hid_t did = H5FNAL_BAD_HID_T;
+    hid_t tid = H5FNAL_BAD_HID_T;
+    htri_t exists;
+
+    if (!file->writable || !file->events_dirty)
+        return H5FNAL_SUCCESS;
+
+    sort_event_index(file);
+
+    if ((tid = create_event_index_type()) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create event index datatype");
+
+    if ((exists = H5Lexists(file->fid, H5FNAL_FILE_EVENT_INDEX_PATH, H5P_DEFAULT)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (exists) {
+        if ((did = H5Dopen2(file->fid, H5FNAL_FILE_EVENT_INDEX_PATH, H5P_DEFAULT)) < 0)
+            H5FNAL_HDF5_ERROR;
+    }
+    else if (h5fnal_create_1D_dset(file->fid, H5FNAL_FILE_EVENT_INDEX_PATH, tid, NULL, &did) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create event index dataset");
+
+    /* The rows may have moved, so rewrite all of them */
+    if (H5Dset_extent(did, &(file->n_events)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (file->n_events > 0)
+        if (H5Dwrite(did, tid, H5S_ALL, H5S_ALL, H5P_DEFAULT, file->events) < 0)
+            H5FNAL_HDF5_ERROR;
+
+    file->events_dirty = FALSE;
+
+    if (H5Tclose(tid) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Dclose(did) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Tclose(tid);
+        H5Dclose(did);
+    } H5E_END_TRY;
+
+    return H5FNAL_FAILURE;
+} /* end write_event_index() */
+
+/************************************************************************
+ * add_file_type()
+ *
+ * Adds a committed datatype to the file state, which takes over the
+ * ID.
+ ************************************************************************/
+static herr_t
+add_file_type(h5fnal_file_t *file, hid_t tid)
+{
+    h5fnal_file_type_t *ft = NULL;
+
+    if (NULL == (ft = (h5fnal_file_type_t *)calloc(1, sizeof(h5fnal_file_type_t))))
+        H5FNAL_PROGRAM_ERROR("could not get memory for committed datatype");
+
+    ft->tid = tid;
+    ft->next = file->types;
+    file->types = ft;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end add_file_type() */
+
+/************************************************************************
+ * load_file_types()
+ *
+ * Opens the datatypes that were committed to the file earlier, so
+ * that new datasets share them too.
+ ************************************************************************/
+static herr_t
+load_file_types(h5fnal_file_t *file)
+{
+    hid_t gid = H5FNAL_BAD_HID_T;
+    hid_t tid = H5FNAL_BAD_HID_T;
+    H5G_info_t info;
+    htri_t exists;
+    hsize_t u;
+
+    file->types_loaded = TRUE;
+
+    if ((exists = H5Lexists(file->fid, H5FNAL_FILE_DATATYPES_PATH, H5P_DEFAULT)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (!exists)
+        return H5FNAL_SUCCESS;
+
+    if ((gid = H5Gopen2(file->fid, H5FNAL_FILE_DATATYPES_PATH, H5P_DEFAULT)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Gget_info(gid, &info) < 0)
+        H5FNAL_HDF5_ERROR;
+    for (u = 0; u < info.nlinks; u++) {
+        if ((tid = H5Oopen_by_idx(gid, ".", H5_INDEX_NAME, H5_ITER_INC, u, H5P_DEFAULT)) < 0)
+            H5FNAL_HDF5_ERROR;
+        if (H5I_DATATYPE != H5Iget_type(tid))
+            H5FNAL_PROGRAM_ERROR("non-datatype object in the datatypes group");
+        if (add_file_type(file, tid) < 0)
+            H5FNAL_PROGRAM_ERROR("could not add committed datatype");
+        tid = H5FNAL_BAD_HID_T;
+    }
+
+    if (H5Gclose(gid) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Oclose(tid);
+        H5Gclose(gid);
+    } H5E_END_TRY;
+
+    return H5FNAL_FAILURE;
+} /* end load_file_types() */
+
+/************************************************************************
+ * release_file()
+ *
+ * Flushes and closes everything in the file-level state, then
+ * unlinks and frees it. Keeps going on errors so nothing leaks.
+ ************************************************************************/
+static herr_t
+release_file(h5fnal_file_t *file)
+{
+    h5fnal_file_t **pp;
+    herr_t ret = H5FNAL_SUCCESS;
+
+    /* Write out the event index */
+    if (write_event_index(file) < 0)
+        ret = H5FNAL_FAILURE;
+    free(file->events);
+
+    /* Close the string dictionaries (this writes out any new strings) */
+    while (file->dicts) {
+        h5fnal_file_dict_t *fd = file->dicts;
+
+        file->dicts = fd->next;
+        if (close_string_dictionary(&(fd->dict)) < 0)
+            ret = H5FNAL_FAILURE;
+        free(fd->path);
+        free(fd);
+    }
+
+    /* Close the committed datatypes (they hold the file open) */
+    while (file->types) {
+        h5fnal_file_type_t *ft = file->types;
+
+        file->types = ft->next;
+        if (H5Tclose(ft->tid) < 0)
+            ret = H5FNAL_FAILURE;
+        free(ft);
+    }
+
+    /* Unlink */
+    for (pp = &open_files; *pp; pp = &((*pp)->next))
+        if (*pp == file) {
+            *pp = file->next;
+            break;
+        }
+
+    free(file);
+
+    return ret;
+} /* end release_file() */
+
+hid_t
+h5fnal_create_file(const char *name, unsigned flags, hid_t fcpl_id, hid_t fapl_id)
+{
+    hid_t fid = H5FNAL_BAD_HID_T;
+
+    h5fnal_drain_async_writes();
+
+    if (NULL == name)
+        H5FNAL_PROGRAM_ERROR("name parameter cannot be NULL");
+
+    if ((fid = H5Fcreate(name, flags, fcpl_id, fapl_id)) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    if (register_file(fid, TRUE) < 0)
+        H5FNAL_PROGRAM_ERROR("could not set up file state");
+
+    return fid;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Fclose(fid);
+    } H5E_END_TRY;
+
+    return H5FNAL_BAD_HID_T;
+} /* end h5fnal_create_file() */
+
+hid_t
+h5fnal_open_file(const char *name, unsigned flags, hid_t fapl_id)
+{
+    hid_t fid = H5FNAL_BAD_HID_T;
+
+    h5fnal_drain_async_writes();
+
+    if (NULL == name)
+        H5FNAL_PROGRAM_ERROR("name parameter cannot be NULL");
+
+    if ((fid = H5Fopen(name, flags, fapl_id)) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    if (register_file(fid, (flags & H5F_ACC_RDWR) ? TRUE : FALSE) < 0)
+        H5FNAL_PROGRAM_ERROR("could not set up file state");
+    if (load_event_index(open_files) < 0)
+        H5FNAL_PROGRAM_ERROR("could not load event index");
+
+    return fid;
+
+error:
+    if (open_files && open_files->fid == fid)
+        release_file(open_files);
+    H5E_BEGIN_TRY {
+        H5Fclose(fid);
+    } H5E_END_TRY;
+
+    return H5FNAL_BAD_HID_T;
+} /* end h5fnal_open_file() */
+
+/************************************************************************
+ * h5fnal_flush_file()
+ *
+ * Writes out any file-level state (e.g. new dictionary strings and
+ * the event index) and
+ * flushes the file. Useful as a cheap checkpoint for long-running
+ * writers.
+ ************************************************************************/
+herr_t
+h5fnal_flush_file(hid_t fid)
+{
+    h5fnal_file_t *file = NULL;
+    h5fnal_file_dict_t *fd = NULL;
+
+    h5fnal_drain_async_writes();
+
+    if (fid < 0)
+        H5FNAL_PROGRAM_ERROR("invalid fid parameter");
+
+    if (NULL != (file = find_file(fid))) {
+        for (fd = file->dicts; fd; fd = fd->next)
+            if (flush_string_dictionary(&(fd->dict)) < 0)
+                H5FNAL_PROGRAM_ERROR("could not flush string dictionary");
+        if (write_event_index(file) < 0)
+            H5FNAL_PROGRAM_ERROR("could not write event index");
+    }
+
+    if (H5Fflush(fid, H5F_SCOPE_LOCAL) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_flush_file() */
+
+herr_t
+h5fnal_close_file(hid_t fid)
+{
+    h5fnal_file_t *file = NULL;
+    herr_t ret = H5FNAL_SUCCESS;
+
+    h5fnal_drain_async_writes();
+
+    if (fid < 0)
+        H5FNAL_PROGRAM_ERROR("invalid fid parameter");
+
+    /* Shut down the file-level state before the file goes away */
+    if (NULL != (file = find_file(fid)))
+        if (release_file(file) < 0) {
+            H5FNAL_ERROR_MSG
+            fprintf(stderr, "%s\n", "could not close file-level state");
+            ret = H5FNAL_FAILURE;
+        }
+
+    if (H5Fclose(fid) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    return ret;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_close_file() */
+
+herr_t
+h5fnal_get_string_dictionary(hid_t loc_id, const char *path, hbool_t create, /*OUT*/ string_dictionary_t **dict)
+{
+    h5fnal_file_t *file = NULL;
+    h5fnal_file_dict_t *fd = NULL;
+    hid_t gid = H5FNAL_BAD_HID_T;
+    hbool_t dict_open = FALSE;
+    htri_t exists;
+
+    if (loc_id < 0)
+        H5FNAL_PROGRAM_ERROR("invalid loc_id parameter");
+    if (NULL == path)
+        H5FNAL_PROGRAM_ERROR("path parameter cannot be NULL");
+    if (NULL == dict)
+        H5FNAL_PROGRAM_ERROR("dict parameter cannot be NULL");
+
+    *dict = NULL;
+
+    if (NULL == (file = find_file(loc_id)))
+        H5FNAL_PROGRAM_ERROR("file was not opened with h5fnal_create_file() or h5fnal_open_file()");
+
+    /* Already open? */
+    for (fd = file->dicts; fd; fd = fd->next)
+        if (!strcmp(fd->path, path)) {
+            *dict = &(fd->dict);
+            return H5FNAL_SUCCESS;
+        }
+
+    /* Set up a new cache entry */
+    if (NULL == (fd = (h5fnal_file_dict_t *)calloc(1, sizeof(h5fnal_file_dict_t))))
+        H5FNAL_PROGRAM_ERROR("could not get memory for string dictionary");
+    if (NULL == (fd->path = (char *)malloc(strlen(path) + 1)))
+        H5FNAL_PROGRAM_ERROR("could not get memory for string dictionary path");
+    strcpy(fd->path, path);
+
+    /* Open (or create) the group that holds the dictionary */
+    if (!strcmp(path, "/"))
+        exists = TRUE;
+    else if ((exists = H5Lexists(file->fid, path, H5P_DEFAULT)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (exists) {
+        if ((gid = H5Gopen2(file->fid, path, H5P_DEFAULT)) < 0)
+            H5FNAL_HDF5_ERROR;
+    }
+    else if (create && file->writable) {
+        if ((gid = H5Gcreate2(file->fid, path, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT)) < 0)
+            H5FNAL_HDF5_ERROR;
+    }
+    else
+        H5FNAL_PROGRAM_ERROR("no string dictionary at path");
+
+    /* Open (or create) the dictionary itself */
+    if ((exists = H5Lexists(gid, H5FNAL_STRINGS_DATASET_NAME, H5P_DEFAULT)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (exists) {
+        if (open_string_dictionary(gid, &(fd->dict)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not open string dictionary");
+    }
+    else if (create && file->writable) {
+        if (create_string_dictionary(gid, &(fd->dict)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not create string dictionary");
+    }
+    else
+        H5FNAL_PROGRAM_ERROR("no string dictionary at path");
+    dict_open = TRUE;
+
+    if (H5Gclose(gid) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    fd->next = file->dicts;
+    file->dicts = fd;
+
+    *dict = &(fd->dict);
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Gclose(gid);
+        if (dict_open)
+            close_string_dictionary(&(fd->dict));
+    } H5E_END_TRY;
+
+    if (fd) {
+        free(fd->path);
+        free(fd);
+    }
+
+    return H5FNAL_FAILURE;
+} /* end h5fnal_get_string_dictionary() */
+
+/************************************************************************
+ * h5fnal_index_event()
+ *
+ * Adds an event group to the file's event index so that it can be
+ * opened with h5fnal_open_event_by_id(). Events don't have to be
+ * added in order.
+ ************************************************************************/
+herr_t
+h5fnal_index_event(hid_t event_id, uint32_t run, uint32_t subrun, uint32_t event)
+{
+    h5fnal_file_t *file = NULL;
+    h5fnal_event_index_entry_t entry;
+    H5O_info_t info;
+
+    h5fnal_drain_async_writes();
+
+    if (event_id < 0)
+        H5FNAL_PROGRAM_ERROR("invalid event_id parameter");
+
+    if (NULL == (file = find_file(event_id)))
+        H5FNAL_PROGRAM_ERROR("file was not opened with h5fnal_create_file() or h5fnal_open_file()");
+    if (!file->writable)
+        H5FNAL_PROGRAM_ERROR("file is not writable");
+
+    if (H5Oget_info2(event_id, &info, H5O_INFO_BASIC) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    entry.run = run;
+    entry.subrun = subrun;
+    entry.event = event;
+    entry.addr = (uint64_t)info.addr;
+
+    /* Events usually come in order, so only search when this one
+     * doesn't go at the end (the last entry is only the largest while
+     * the index is sorted)
+     */
+    if (file->n_events > 0
+            && (!file->events_sorted || compare_index_entries(&(file->events[file->n_events - 1]), &entry) >= 0)) {
+        sort_event_index(file);
+        if (bsearch(&entry, file->events, (size_t)file->n_events, sizeof(h5fnal_event_index_entry_t), compare_index_entries))
+            H5FNAL_PROGRAM_ERROR("event is already in the event index");
+    }
+    if (file->n_events > 0 && compare_index_entries(&(file->events[file->n_events - 1]), &entry) > 0)
+        file->events_sorted = FALSE;
+
+    if (h5fnal_reserve_buffer((void **)&(file->events), &(file->events_capacity), file->n_events + 1, sizeof(h5fnal_event_index_entry_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not grow event index");
+    file->events[file->n_events++] = entry;
+    file->events_dirty = TRUE;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_index_event() */
+
+/************************************************************************
+ * h5fnal_open_event_by_id()
+ *
+ * Opens an event group through the file's event index: a binary
+ * search in memory and an open by address, instead of looking up the
+ * run, sub-run and event groups by name.
+ ************************************************************************/
+hid_t
+h5fnal_open_event_by_id(hid_t fid, uint32_t run, uint32_t subrun, uint32_t event)
+{
+    h5fnal_file_t *file = NULL;
+    h5fnal_event_index_entry_t key;
+    h5fnal_event_index_entry_t *found = NULL;
+    hid_t gid = H5FNAL_BAD_HID_T;
+
+    h5fnal_drain_async_writes();
+
+    if (fid < 0)
+        H5FNAL_PROGRAM_ERROR("invalid fid parameter");
+
+    if (NULL == (file = find_file(fid)))
+        H5FNAL_PROGRAM_ERROR("file was not opened with h5fnal_create_file() or h5fnal_open_file()");
+
+    sort_event_index(file);
+
+    key.run = run;
+    key.subrun = subrun;
+    key.event = event;
+    key.addr = 0;
+    if (NULL == (found = (h5fnal_event_index_entry_t *)bsearch(&key, file->events, (size_t)file->n_events,
+            sizeof(h5fnal_event_index_entry_t), compare_index_entries)))
+        H5FNAL_PROGRAM_ERROR("event is not in the event index");
+
+    if ((gid = H5Oopen_by_addr(file->fid, (haddr_t)found->addr)) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    return gid;
+
+error:
+    return H5FNAL_BAD_HID_T;
+} /* end h5fnal_open_event_by_id() */
+
+/************************************************************************
+ * h5fnal_get_committed_type()
+ *
+ * Finds (or makes) the file's committed copy of a compound or enum
+ * datatype, so that all the datasets with that type share one type
+ * object instead of each holding a copy of the type in its object
+ * header. New types are committed to the datatypes group under the
+ * last component of name (with a number added if that's taken).
+ *
+ * *file_tid is set to a new reference to the committed type (close it
+ * with H5Tclose()), or to H5FNAL_BAD_HID_T if the type should be used
+ * as is: it isn't a compound or enum type, or the file wasn't opened
+ * for writing through h5fnal.
+ ************************************************************************/
+herr_t
+h5fnal_get_committed_type(hid_t loc_id, hid_t tid, const char *name, /*OUT*/ hid_t *file_tid)
+{
+    h5fnal_file_t *file = NULL;
+    h5fnal_file_type_t *ft = NULL;
+    hid_t gid = H5FNAL_BAD_HID_T;
+    hid_t new_tid = H5FNAL_BAD_HID_T;
+    H5T_class_t type_class;
+    const char *base = NULL;
+    char *link_name = NULL;
+    htri_t exists;
+    htri_t equal;
+    unsigned n;
+
+    if (tid < 0)
+        H5FNAL_PROGRAM_ERROR("invalid tid parameter");
+    if (NULL == name)
+        H5FNAL_PROGRAM_ERROR("name parameter cannot be NULL");
+    if (NULL == file_tid)
+        H5FNAL_PROGRAM_ERROR("file_tid parameter cannot be NULL");
+
+    *file_tid = H5FNAL_BAD_HID_T;
+
+    if ((type_class = H5Tget_class(tid)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5T_COMPOUND != type_class && H5T_ENUM != type_class)
+        return H5FNAL_SUCCESS;
+    if (NULL == (file = find_file(loc_id)) || !file->writable)
+        return H5FNAL_SUCCESS;
+
+    if (!file->types_loaded)
+        if (load_file_types(file) < 0)
+            H5FNAL_PROGRAM_ERROR("could not load committed datatypes");
+
+    /* Already committed? */
+    for (ft = file->types; ft; ft = ft->next) {
+        if ((equal = H5Tequal(ft->tid, tid)) < 0)
+            H5FNAL_HDF5_ERROR;
+        if (equal) {
+            if ((*file_tid = h5fnal_share_type(ft->tid)) < 0)
+                H5FNAL_PROGRAM_ERROR("could not share committed datatype");
+            return H5FNAL_SUCCESS;
+        }
+    }
+
+    /* Open (or create) the datatypes group */
+    if ((exists = H5Lexists(file->fid, H5FNAL_FILE_DATATYPES_PATH, H5P_DEFAULT)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (exists) {
+        if ((gid = H5Gopen2(file->fid, H5FNAL_FILE_DATATYPES_PATH, H5P_DEFAULT)) < 0)
+            H5FNAL_HDF5_ERROR;
+    }
+    else if ((gid = H5Gcreate2(file->fid, H5FNAL_FILE_DATATYPES_PATH, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT)) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    /* Pick a free name */
+    base = strrchr(name, '/') ? strrchr(name, '/') + 1 : name;
+    if (NULL == (link_name = (char *)malloc(strlen(base) + 16)))
+        H5FNAL_PROGRAM_ERROR("could not get memory for datatype name");
+    strcpy(link_name, base);
+    for (n = 1; ; n++) {
+        if ((exists = H5Lexists(gid, link_name, H5P_DEFAULT)) < 0)
+            H5FNAL_HDF5_ERROR;
+        if (!exists)
+            break;
+        sprintf(link_name, "%s_%u", base, n);
+    }
+
+    /* Commit a copy */
+    if ((new_tid = H5Tcopy(tid)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Tcommit2(gid, link_name, new_tid, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (add_file_type(file, new_tid) < 0)
+        H5FNAL_PROGRAM_ERROR("could not add committed datatype");
+    if ((*file_tid = h5fnal_share_type(new_tid)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not share committed datatype");
+    new_tid = H5FNAL_BAD_HID_T;
+
+    free(link_name);
+    if (H5Gclose(gid) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Tclose(new_tid);
+        H5Gclose(gid);
+    } H5E_END_TRY;
+    free(link_name);
+
+    return H5FNAL_FAILURE;
+} /* end h5fnal_get_committed_type() */
@@ -0,0 +1,67 @@
+/* file.h
+ *
+ * Header for h5fnal files and the file-level state that is shared
+ * by all the data products in a file.
+ */
+
+#ifndef H5FNAL_FILE_H
+#define H5FNAL_FILE_H
+
+#include "h5fnal.h"
+
+/* Path of the file-wide string dictionary in new files */
+#define H5FNAL_FILE_DICTIONARY_PATH         "/string_dictionary"
+
+/* Group holding the datatypes committed to the file */
+#define H5FNAL_FILE_DATATYPES_PATH          "/datatypes"
+
+/* File-wide event index: (run, sub-run, event) to event group */
+#define H5FNAL_FILE_EVENT_INDEX_PATH        "/event_index"
+
+/* Where older files kept their string dictionary (the root group) */
+#define H5FNAL_LEGACY_DICTIONARY_PATH       "/"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Files
+ *
+ * Files that contain data products which share file-level objects
+ * (e.g. the MC Truth string dictionary) must be created/opened and
+ * closed with these instead of H5Fcreate()/H5Fopen()/H5Fclose().
+ */
+hid_t h5fnal_create_file(const char *name, unsigned flags, hid_t fcpl_id, hid_t fapl_id);
+hid_t h5fnal_open_file(const char *name, unsigned flags, hid_t fapl_id);
+herr_t h5fnal_flush_file(hid_t fid);
+herr_t h5fnal_close_file(hid_t fid);
+
+/* Get the (cached) string dictionary stored at path in the file that
+ * contains loc_id, opening it on first use. If create is set and
+ * no dictionary exists at path, one is created. The dictionary is
+ * owned by the file and is flushed and closed by h5fnal_close_file().
+ */
+herr_t h5fnal_get_string_dictionary(hid_t loc_id, const char *path, hbool_t create, /*OUT*/ string_dictionary_t **dict);
+
+/* Get a reference to the file's committed copy of a compound or enum
+ * type, committing it first if needed (see file.c). Used when creating
+ * datasets.
+ */
+herr_t h5fnal_get_committed_type(hid_t loc_id, hid_t tid, const char *name, /*OUT*/ hid_t *file_tid);
+
+/* Event index
+ *
+ * Events added with h5fnal_index_event() are written to a sorted
+ * index dataset when the file is flushed or closed, and the index is
+ * read into memory when the file is opened. h5fnal_open_event_by_id()
+ * then opens an event group (close it with h5fnal_close_event())
+ * without walking the run and sub-run groups.
+ */
+herr_t h5fnal_index_event(hid_t event_id, uint32_t run, uint32_t subrun, uint32_t event);
+hid_t h5fnal_open_event_by_id(hid_t fid, uint32_t run, uint32_t subrun, uint32_t event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* H5FNAL_FILE_H */
@@ -12,6 +12,8 @@ h5fnal_create_run(hid_t loc_id, const char *name, hbool_t compress_names)
     hid_t gid = -1;         /* group ID                                     */
     hid_t gcpl_id = -1;     /* group creation property list ID              */
 
+    h5fnal_drain_async_writes();
+
     /* Create a group to contain the events (or sub-runs).
      *
      * We want to index the group by creation order since that will
@@ -50,6 +52,8 @@ h5fnal_open_run(hid_t loc_id, const char *name)
 {
     hid_t gid = -1;         /* group ID                                     */
 
+    h5fnal_drain_async_writes();
+
     if ((gid = H5Gopen2(loc_id, name, H5P_DEFAULT)) < 0)
         H5FNAL_HDF5_ERROR;
 
@@ -66,6 +70,8 @@ error:
 herr_t
 h5fnal_close_run(hid_t loc_id)
 {
+    h5fnal_drain_async_writes();
+
     if (H5Gclose(loc_id) < 0)
         H5FNAL_HDF5_ERROR;
 
@@ -81,6 +87,8 @@ h5fnal_create_event(hid_t loc_id, const char *name, hbool_t compress_names)
     hid_t gid = -1;         /* group ID                                     */
     hid_t gcpl_id = -1;     /* group creation property list ID              */
 
+    h5fnal_drain_async_writes();
+
     /* Create a group to contain the events (or sub-runs).
      *
      * We want to index the group by creation order since that will
@@ -116,6 +124,8 @@ h5fnal_open_event(hid_t loc_id, const char *name)
 {
     hid_t gid = -1;         /* group ID                                     */
 
+    h5fnal_drain_async_writes();
+
     if ((gid = H5Gopen2(loc_id, name, H5P_DEFAULT)) < 0)
         H5FNAL_HDF5_ERROR;
 
@@ -132,6 +142,8 @@ error:
 herr_t
 h5fnal_close_event(hid_t loc_id)
 {
+    h5fnal_drain_async_writes();
+
     if (H5Gclose(loc_id) < 0)
         H5FNAL_HDF5_ERROR;
 
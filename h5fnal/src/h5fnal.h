@@ -38,11 +38,19 @@ typedef struct h5fnal_product_id_t {
 } h5fnal_product_id_t;
 
 /* Data type headers */
+#include "storage.h"
 #include "util.h"
+#include "event_table.h"
+#include "compress.h"
+#include "async.h"
 #include "string_dictionary.h"
+#include "file.h"
+#include "types.h"
+#include "reader.h"
 #include "v_mc_hit_collection.h"
 #include "v_mc_truth.h"
 #include "assns.h"
+#include "prefetch.h"
 
 /* h5fnal API */
 
@@ -0,0 +1,404 @@
+/* prefetch.c
+ *
+ * Prefetching sequential event reader: a background thread reads
+ * events into a ring of reusable buffers.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "h5fnal.h"
+
+/* Where the walk is */
+typedef struct walk_data_t {
+    h5fnal_prefetcher_t    *pf;
+    uint32_t                run;
+    uint32_t                subrun;
+} walk_data_t;
+
+/* H5Literate() callbacks */
+static herr_t prefetch_run(hid_t gid, const char *name, const H5L_info_t *info, void *op_data);
+static herr_t prefetch_subrun(hid_t gid, const char *name, const H5L_info_t *info, void *op_data);
+static herr_t prefetch_event(hid_t gid, const char *name, const H5L_info_t *info, void *op_data);
+
+
+/************************************************************************
+ * parse_id()
+ *
+ * Runs, sub-runs and events are named by their number.
+ ************************************************************************/
+static herr_t
+parse_id(const char *name, uint32_t *id)
+{
+    char *end = NULL;
+    unsigned long value;
+
+    if (name[0] < '0' || name[0] > '9')
+        H5FNAL_PROGRAM_ERROR("run, sub-run and event names must be numbers");
+    errno = 0;
+    value = strtoul(name, &end, 10);
+    if (errno != 0 || *end != '\0' || value > UINT32_MAX)
+        H5FNAL_PROGRAM_ERROR("run, sub-run and event names must be numbers");
+
+    *id = (uint32_t)value;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end parse_id() */
+
+/************************************************************************
+ * read_product()
+ *
+ * Reads the prefetcher's data product from an event into a slot.
+ ************************************************************************/
+static herr_t
+read_product(h5fnal_prefetcher_t *pf, hid_t event_id, h5fnal_prefetched_event_t *slot)
+{
+    h5fnal_vect_hitcoll_t hits;
+    h5fnal_vect_truth_t truths;
+    hbool_t hits_open = FALSE;
+    hbool_t truths_open = FALSE;
+
+    switch (pf->product) {
+        case H5FNAL_PREFETCH_HITS:
+            if (h5fnal_open_v_mc_hit_collection_with_types(event_id, pf->product_name, &(pf->types), &hits) < 0)
+                H5FNAL_PROGRAM_ERROR("could not open vector of mc hit collection");
+            hits_open = TRUE;
+            if (h5fnal_read_all_hits_into(&hits, &(slot->hits)) < 0)
+                H5FNAL_PROGRAM_ERROR("could not read hit collections");
+            hits_open = FALSE;
+            if (h5fnal_close_v_mc_hit_collection(&hits) < 0)
+                H5FNAL_PROGRAM_ERROR("could not close vector of mc hit collection");
+            break;
+
+        case H5FNAL_PREFETCH_TRUTHS:
+            if (h5fnal_open_v_mc_truth_with_types(event_id, pf->product_name, &(pf->types), &truths) < 0)
+                H5FNAL_PROGRAM_ERROR("could not open vector of mc truth");
+            truths_open = TRUE;
+            if (h5fnal_read_all_truths_into(&truths, &(slot->truths)) < 0)
+                H5FNAL_PROGRAM_ERROR("could not read truths");
+            slot->dict = truths.dict;
+            truths_open = FALSE;
+            if (h5fnal_close_v_mc_truth(&truths) < 0)
+                H5FNAL_PROGRAM_ERROR("could not close vector of mc truth");
+            break;
+
+        default:
+            H5FNAL_PROGRAM_ERROR("unknown data product");
+    }
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        if (hits_open)
+            h5fnal_close_v_mc_hit_collection(&hits);
+        if (truths_open)
+            h5fnal_close_v_mc_truth(&truths);
+    } H5E_END_TRY;
+
+    return H5FNAL_FAILURE;
+} /* end read_product() */
+
+static herr_t
+prefetch_run(hid_t gid, const char *name, const H5L_info_t *info, void *op_data)
+{
+    walk_data_t *walk = (walk_data_t *)op_data;
+    herr_t ret;
+
+    if (parse_id(name, &(walk->run)) < 0)
+        H5FNAL_PROGRAM_ERROR("bad run name");
+
+    /* Iterate over the sub-runs (a positive value means stop) */
+    if ((ret = H5Literate_by_name(gid, name, H5_INDEX_CRT_ORDER, H5_ITER_INC, NULL, prefetch_subrun, op_data, H5P_DEFAULT)) < 0)
+        H5FNAL_PROGRAM_ERROR("iteration over sub-runs failed");
+
+    return ret;
+
+error:
+    return -1;
+} /* end prefetch_run() */
+
+static herr_t
+prefetch_subrun(hid_t gid, const char *name, const H5L_info_t *info, void *op_data)
+{
+    walk_data_t *walk = (walk_data_t *)op_data;
+    herr_t ret;
+
+    if (parse_id(name, &(walk->subrun)) < 0)
+        H5FNAL_PROGRAM_ERROR("bad sub-run name");
+
+    /* Iterate over the events (a positive value means stop) */
+    if ((ret = H5Literate_by_name(gid, name, H5_INDEX_CRT_ORDER, H5_ITER_INC, NULL, prefetch_event, op_data, H5P_DEFAULT)) < 0)
+        H5FNAL_PROGRAM_ERROR("iteration over events failed");
+
+    return ret;
+
+error:
+    return -1;
+} /* end prefetch_subrun() */
+
+/************************************************************************
+ * prefetch_event()
+ *
+ * Waits for a free slot and reads the event into it. Returns 1 to
+ * stop the iteration when the prefetcher is being stopped.
+ ************************************************************************/
+static herr_t
+prefetch_event(hid_t gid, const char *name, const H5L_info_t *info, void *op_data)
+{
+    walk_data_t *walk = (walk_data_t *)op_data;
+    h5fnal_prefetcher_t *pf = walk->pf;
+    h5fnal_prefetched_event_t *slot = NULL;
+    hid_t event_id = H5FNAL_BAD_HID_T;
+    hbool_t stop;
+
+    /* The slot after the ready ones is free once the caller has
+     * handed back the one it holds.
+     */
+    pthread_mutex_lock(&(pf->lock));
+    while (!pf->stop && pf->n_ready + (pf->held ? 1 : 0) >= pf->n_slots)
+        pthread_cond_wait(&(pf->free_cond), &(pf->lock));
+    stop = pf->stop;
+    slot = &(pf->slots[pf->write_slot]);
+    pthread_mutex_unlock(&(pf->lock));
+
+    if (stop)
+        return 1;
+
+    /* Fill it outside the lock */
+    slot->run = walk->run;
+    slot->subrun = walk->subrun;
+    if (parse_id(name, &(slot->event)) < 0)
+        H5FNAL_PROGRAM_ERROR("bad event name");
+    if ((event_id = h5fnal_open_event(gid, name)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not open event");
+    if (read_product(pf, event_id, slot) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read data product");
+    if (h5fnal_close_event(event_id) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close event");
+
+    pthread_mutex_lock(&(pf->lock));
+    pf->write_slot = (pf->write_slot + 1) % pf->n_slots;
+    pf->n_ready++;
+    pthread_cond_signal(&(pf->ready_cond));
+    pthread_mutex_unlock(&(pf->lock));
+
+    return 0;
+
+error:
+    H5E_BEGIN_TRY {
+        if (event_id >= 0)
+            h5fnal_close_event(event_id);
+    } H5E_END_TRY;
+
+    return -1;
+} /* end prefetch_event() */
+
+static void *
+prefetch_thread(void *arg)
+{
+    h5fnal_prefetcher_t *pf = (h5fnal_prefetcher_t *)arg;
+    walk_data_t walk;
+    herr_t ret;
+
+    memset(&walk, 0, sizeof(walk_data_t));
+    walk.pf = pf;
+
+    ret = H5Literate(pf->loc_id, H5_INDEX_CRT_ORDER, H5_ITER_INC, NULL, prefetch_run, (void *)&walk);
+
+    pthread_mutex_lock(&(pf->lock));
+    pf->status = (ret < 0) ? H5FNAL_FAILURE : H5FNAL_SUCCESS;
+    pf->done = TRUE;
+    pthread_cond_broadcast(&(pf->ready_cond));
+    pthread_mutex_unlock(&(pf->lock));
+
+    return NULL;
+} /* end prefetch_thread() */
+
+/************************************************************************
+ * free_slots()
+ ************************************************************************/
+static herr_t
+free_slots(h5fnal_prefetcher_t *pf)
+{
+    herr_t ret = H5FNAL_SUCCESS;
+    size_t u;
+
+    if (NULL == pf->slots)
+        return H5FNAL_SUCCESS;
+
+    for (u = 0; u < pf->n_slots; u++) {
+        if (h5fnal_free_hitcoll_mem_data(&(pf->slots[u].hits)) < 0)
+            ret = H5FNAL_FAILURE;
+        if (h5fnal_free_truth_mem_data(&(pf->slots[u].truths)) < 0)
+            ret = H5FNAL_FAILURE;
+    }
+    free(pf->slots);
+    pf->slots = NULL;
+
+    return ret;
+} /* end free_slots() */
+
+/************************************************************************
+ * h5fnal_start_prefetcher()
+ *
+ * Sets up the ring and starts reading events on a new thread.
+ ************************************************************************/
+herr_t
+h5fnal_start_prefetcher(h5fnal_prefetcher_t *pf, hid_t loc_id, const char *product_name, h5fnal_prefetch_product_t product, size_t depth)
+{
+    hbool_t have_types = FALSE;
+    hbool_t have_lock = FALSE;
+    hbool_t have_ready_cond = FALSE;
+    hbool_t have_free_cond = FALSE;
+
+    if (NULL == pf)
+        H5FNAL_PROGRAM_ERROR("pf parameter cannot be NULL");
+    if (loc_id < 0)
+        H5FNAL_PROGRAM_ERROR("invalid loc_id parameter");
+    if (NULL == product_name)
+        H5FNAL_PROGRAM_ERROR("product_name parameter cannot be NULL");
+    if (product != H5FNAL_PREFETCH_HITS && product != H5FNAL_PREFETCH_TRUTHS)
+        H5FNAL_PROGRAM_ERROR("unknown data product");
+    if (0 == depth)
+        H5FNAL_PROGRAM_ERROR("depth must be at least one event");
+
+    memset(pf, 0, sizeof(h5fnal_prefetcher_t));
+    pf->loc_id = loc_id;
+    pf->product = product;
+    pf->n_slots = depth + 1;
+
+    if (NULL == (pf->product_name = strdup(product_name)))
+        H5FNAL_PROGRAM_ERROR("could not copy product name");
+    if (NULL == (pf->slots = (h5fnal_prefetched_event_t *)calloc(pf->n_slots, sizeof(h5fnal_prefetched_event_t))))
+        H5FNAL_PROGRAM_ERROR("could not allocate memory for prefetch slots");
+
+    /* Built here, since the thread can't be the first to use them */
+    if (h5fnal_share_product_types(&(pf->types)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get product datatypes");
+    have_types = TRUE;
+
+    if (pthread_mutex_init(&(pf->lock), NULL) != 0)
+        H5FNAL_PROGRAM_ERROR("could not create prefetch lock");
+    have_lock = TRUE;
+    if (pthread_cond_init(&(pf->ready_cond), NULL) != 0)
+        H5FNAL_PROGRAM_ERROR("could not create prefetch condition variable");
+    have_ready_cond = TRUE;
+    if (pthread_cond_init(&(pf->free_cond), NULL) != 0)
+        H5FNAL_PROGRAM_ERROR("could not create prefetch condition variable");
+    have_free_cond = TRUE;
+
+    if (pthread_create(&(pf->thread), NULL, prefetch_thread, (void *)pf) != 0)
+        H5FNAL_PROGRAM_ERROR("could not start prefetch thread");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    if (pf) {
+        if (have_free_cond)
+            pthread_cond_destroy(&(pf->free_cond));
+        if (have_ready_cond)
+            pthread_cond_destroy(&(pf->ready_cond));
+        if (have_lock)
+            pthread_mutex_destroy(&(pf->lock));
+        H5E_BEGIN_TRY {
+            if (have_types)
+                h5fnal_close_product_types(&(pf->types));
+        } H5E_END_TRY;
+        free_slots(pf);
+        free(pf->product_name);
+        pf->product_name = NULL;
+    }
+
+    return H5FNAL_FAILURE;
+} /* end h5fnal_start_prefetcher() */
+
+/************************************************************************
+ * h5fnal_stop_prefetcher()
+ *
+ * Stops the thread (it may not have reached the end) and frees the
+ * ring. Events handed out earlier are no longer valid.
+ ************************************************************************/
+herr_t
+h5fnal_stop_prefetcher(h5fnal_prefetcher_t *pf)
+{
+    herr_t ret = H5FNAL_SUCCESS;
+
+    if (NULL == pf)
+        H5FNAL_PROGRAM_ERROR("pf parameter cannot be NULL");
+
+    pthread_mutex_lock(&(pf->lock));
+    pf->stop = TRUE;
+    pthread_cond_broadcast(&(pf->free_cond));
+    pthread_mutex_unlock(&(pf->lock));
+
+    if (pthread_join(pf->thread, NULL) != 0)
+        ret = H5FNAL_FAILURE;
+
+    pthread_cond_destroy(&(pf->free_cond));
+    pthread_cond_destroy(&(pf->ready_cond));
+    pthread_mutex_destroy(&(pf->lock));
+
+    if (h5fnal_close_product_types(&(pf->types)) < 0)
+        ret = H5FNAL_FAILURE;
+    if (free_slots(pf) < 0)
+        ret = H5FNAL_FAILURE;
+    free(pf->product_name);
+    pf->product_name = NULL;
+
+    return ret;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_stop_prefetcher() */
+
+/************************************************************************
+ * h5fnal_prefetcher_next()
+ *
+ * Hands back the caller's current event and waits for the next one.
+ * Events read before a failure are still handed out; the failure is
+ * returned in place of the end of the walk.
+ ************************************************************************/
+herr_t
+h5fnal_prefetcher_next(h5fnal_prefetcher_t *pf, const h5fnal_prefetched_event_t **event)
+{
+    herr_t ret = H5FNAL_SUCCESS;
+
+    if (NULL == pf)
+        H5FNAL_PROGRAM_ERROR("pf parameter cannot be NULL");
+    if (NULL == event)
+        H5FNAL_PROGRAM_ERROR("event parameter cannot be NULL");
+
+    pthread_mutex_lock(&(pf->lock));
+
+    if (pf->held) {
+        pf->held = FALSE;
+        pthread_cond_signal(&(pf->free_cond));
+    }
+
+    while (!pf->done && 0 == pf->n_ready)
+        pthread_cond_wait(&(pf->ready_cond), &(pf->lock));
+
+    if (pf->n_ready > 0) {
+        *event = &(pf->slots[pf->read_slot]);
+        pf->read_slot = (pf->read_slot + 1) % pf->n_slots;
+        pf->n_ready--;
+        pf->held = TRUE;
+    }
+    else {
+        *event = NULL;
+        ret = pf->status;
+    }
+
+    pthread_mutex_unlock(&(pf->lock));
+
+    return ret;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_prefetcher_next() */
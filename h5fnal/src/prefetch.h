@@ -0,0 +1,97 @@
+/* prefetch.h
+ *
+ * Header for the prefetching sequential event reader.
+ *
+ * A prefetcher walks the runs, sub-runs and events under a group in
+ * creation order (the order the writers create them) and reads one
+ * data product from each event on a background thread, a few events
+ * ahead of the caller. The caller converts and compares event N
+ * while event N+1 is being read.
+ *
+ * The HDF5 library is not thread-safe unless built that way, so all
+ * of the prefetcher's HDF5 I/O happens on its thread. The caller
+ * must not make HDF5 calls between h5fnal_start_prefetcher() and
+ * h5fnal_stop_prefetcher().
+ */
+
+#ifndef H5FNAL_PREFETCH_H
+#define H5FNAL_PREFETCH_H
+
+#include <pthread.h>
+
+#include "h5fnal.h"
+
+/* Which data product to read from each event */
+typedef enum h5fnal_prefetch_product_t {
+    H5FNAL_PREFETCH_HITS    = 0,
+    H5FNAL_PREFETCH_TRUTHS  = 1
+} h5fnal_prefetch_product_t;
+
+/* A prefetched event
+ *
+ * Run, sub-run and event are the numbers the groups are named by.
+ * Only the data for the prefetcher's product is filled in. The
+ * buffers belong to the prefetcher and are reused for later events.
+ *
+ * dict is the file's string dictionary for the truths' process
+ * names (owned by the file). It isn't read again once the file is
+ * open, so the caller may look strings up in it.
+ */
+typedef struct h5fnal_prefetched_event_t {
+    uint32_t                    run;
+    uint32_t                    subrun;
+    uint32_t                    event;
+
+    h5fnal_vect_hitcoll_data_t  hits;
+    h5fnal_vect_truth_data_t    truths;
+    const string_dictionary_t  *dict;
+} h5fnal_prefetched_event_t;
+
+/* Prefetcher
+ *
+ * The slots are a ring of depth + 1 events: up to depth read ahead
+ * and the one the caller is looking at.
+ */
+typedef struct h5fnal_prefetcher_t {
+    hid_t                       loc_id;
+    char                       *product_name;
+    h5fnal_prefetch_product_t   product;
+    h5fnal_product_types_t      types;
+
+    h5fnal_prefetched_event_t  *slots;
+    size_t                      n_slots;
+    size_t                      read_slot;  /* next slot for next()   */
+    size_t                      write_slot; /* next slot to fill      */
+    size_t                      n_ready;    /* filled, not handed out */
+    hbool_t                     held;       /* caller has a slot      */
+
+    hbool_t                     done;       /* walk finished          */
+    hbool_t                     stop;       /* stop was requested     */
+    herr_t                      status;     /* how the walk finished  */
+
+    pthread_t                   thread;
+    pthread_mutex_t             lock;
+    pthread_cond_t              ready_cond;
+    pthread_cond_t              free_cond;
+} h5fnal_prefetcher_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* loc_id is the group that holds the runs (borrowed). depth is the
+ * number of events to read ahead.
+ */
+herr_t h5fnal_start_prefetcher(h5fnal_prefetcher_t *pf, hid_t loc_id, const char *product_name, h5fnal_prefetch_product_t product, size_t depth);
+herr_t h5fnal_stop_prefetcher(h5fnal_prefetcher_t *pf);
+
+/* Blocks until the next event has been read. *event is set to NULL
+ * after the last event. The event stays valid until the next call.
+ */
+herr_t h5fnal_prefetcher_next(h5fnal_prefetcher_t *pf, const h5fnal_prefetched_event_t **event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* H5FNAL_PREFETCH_H */
@@ -0,0 +1,120 @@
+/* reader.c
+ *
+ * Sequential event reader: cached run and sub-run groups.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "h5fnal.h"
+
+/* Big enough for any uint32_t in decimal */
+#define ID_NAME_LEN     16
+
+herr_t
+h5fnal_init_reader(h5fnal_reader_t *reader, hid_t loc_id)
+{
+    if (NULL == reader)
+        H5FNAL_PROGRAM_ERROR("reader parameter cannot be NULL");
+    if (loc_id < 0)
+        H5FNAL_PROGRAM_ERROR("invalid loc_id parameter");
+
+    memset(reader, 0, sizeof(h5fnal_reader_t));
+    reader->loc_id = loc_id;
+    reader->run_id = H5FNAL_BAD_HID_T;
+    reader->subrun_id = H5FNAL_BAD_HID_T;
+
+    if (h5fnal_share_product_types(&(reader->types)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get product datatypes");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_init_reader() */
+
+herr_t
+h5fnal_close_reader(h5fnal_reader_t *reader)
+{
+    herr_t ret = H5FNAL_SUCCESS;
+
+    if (NULL == reader)
+        H5FNAL_PROGRAM_ERROR("reader parameter cannot be NULL");
+
+    if (reader->have_subrun)
+        if (h5fnal_close_run(reader->subrun_id) < 0)
+            ret = H5FNAL_FAILURE;
+    if (reader->have_run)
+        if (h5fnal_close_run(reader->run_id) < 0)
+            ret = H5FNAL_FAILURE;
+    if (h5fnal_close_product_types(&(reader->types)) < 0)
+        ret = H5FNAL_FAILURE;
+
+    reader->have_subrun = FALSE;
+    reader->have_run = FALSE;
+    reader->subrun_id = H5FNAL_BAD_HID_T;
+    reader->run_id = H5FNAL_BAD_HID_T;
+
+    return ret;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_close_reader() */
+
+/************************************************************************
+ * h5fnal_reader_open_event()
+ *
+ * Opens an event group, re-opening the run and sub-run groups only
+ * when they differ from the last event's.
+ ************************************************************************/
+hid_t
+h5fnal_reader_open_event(h5fnal_reader_t *reader, uint32_t run, uint32_t subrun, uint32_t event)
+{
+    char name[ID_NAME_LEN];
+    hid_t event_id = H5FNAL_BAD_HID_T;
+
+    if (NULL == reader)
+        H5FNAL_PROGRAM_ERROR("reader parameter cannot be NULL");
+
+    /* New run (which means a new sub-run, too) */
+    if (!reader->have_run || reader->run != run) {
+        if (reader->have_subrun) {
+            reader->have_subrun = FALSE;
+            if (h5fnal_close_run(reader->subrun_id) < 0)
+                H5FNAL_PROGRAM_ERROR("could not close sub-run");
+        }
+        if (reader->have_run) {
+            reader->have_run = FALSE;
+            if (h5fnal_close_run(reader->run_id) < 0)
+                H5FNAL_PROGRAM_ERROR("could not close run");
+        }
+        snprintf(name, sizeof(name), "%u", (unsigned)run);
+        if ((reader->run_id = h5fnal_open_run(reader->loc_id, name)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not open run");
+        reader->run = run;
+        reader->have_run = TRUE;
+    }
+
+    /* New sub-run */
+    if (!reader->have_subrun || reader->subrun != subrun) {
+        if (reader->have_subrun) {
+            reader->have_subrun = FALSE;
+            if (h5fnal_close_run(reader->subrun_id) < 0)
+                H5FNAL_PROGRAM_ERROR("could not close sub-run");
+        }
+        snprintf(name, sizeof(name), "%u", (unsigned)subrun);
+        if ((reader->subrun_id = h5fnal_open_run(reader->run_id, name)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not open sub-run");
+        reader->subrun = subrun;
+        reader->have_subrun = TRUE;
+    }
+
+    snprintf(name, sizeof(name), "%u", (unsigned)event);
+    if ((event_id = h5fnal_open_event(reader->subrun_id, name)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not open event");
+
+    return event_id;
+
+error:
+    return H5FNAL_BAD_HID_T;
+} /* end h5fnal_reader_open_event() */
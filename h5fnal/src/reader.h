@@ -0,0 +1,53 @@
+/* reader.h
+ *
+ * Header for the sequential event reader.
+ *
+ * Reading a file event by event means opening the run, sub-run and
+ * event groups and building the product datatypes for every event.
+ * A reader keeps the current run and sub-run groups open (they only
+ * change at run and sub-run boundaries) and holds the datatypes for
+ * the products opened through it to share.
+ */
+
+#ifndef H5FNAL_READER_H
+#define H5FNAL_READER_H
+
+#include "h5fnal.h"
+
+/* Reader
+ *
+ * loc_id is the group that holds the runs (borrowed). Runs and
+ * sub-runs are groups named by their number, as the writers
+ * create them.
+ */
+typedef struct h5fnal_reader_t {
+    hid_t                   loc_id;
+
+    hbool_t                 have_run;
+    uint32_t                run;
+    hid_t                   run_id;
+
+    hbool_t                 have_subrun;
+    uint32_t                subrun;
+    hid_t                   subrun_id;
+
+    h5fnal_product_types_t  types;
+} h5fnal_reader_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+herr_t h5fnal_init_reader(h5fnal_reader_t *reader, hid_t loc_id);
+herr_t h5fnal_close_reader(h5fnal_reader_t *reader);
+
+/* Open an event group (close it with h5fnal_close_event()). The run
+ * and sub-run groups are only opened again when they change.
+ */
+hid_t h5fnal_reader_open_event(h5fnal_reader_t *reader, uint32_t run, uint32_t subrun, uint32_t event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* H5FNAL_READER_H */
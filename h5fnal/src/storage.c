@@ -0,0 +1,207 @@
+/* storage.c
+ *
+ * Storage profiles (chunking and compression of data product datasets).
+ */
+
+#include <string.h>
+
+#include "h5fnal.h"
+
+/************************************************************************
+ * h5fnal_default_storage_profile()
+ *
+ * 1024-element chunks, shuffle and deflate at level 6.
+ ************************************************************************/
+void
+h5fnal_default_storage_profile(h5fnal_storage_profile_t *profile)
+{
+    if (NULL == profile)
+        return;
+
+    memset(profile, 0, sizeof(h5fnal_storage_profile_t));
+    profile->chunk_size = H5FNAL_DEFAULT_CHUNK_SIZE;
+    profile->shuffle = TRUE;
+    profile->compression = H5FNAL_COMPRESSION_DEFLATE;
+    profile->deflate_level = H5FNAL_DEFAULT_DEFLATE_LEVEL;
+
+    return;
+} /* end h5fnal_default_storage_profile() */
+
+/************************************************************************
+ * h5fnal_scratch_storage_profile()
+ *
+ * The default chunk size and no filters, for files that are written
+ * once and thrown away.
+ ************************************************************************/
+void
+h5fnal_scratch_storage_profile(h5fnal_storage_profile_t *profile)
+{
+    if (NULL == profile)
+        return;
+
+    h5fnal_default_storage_profile(profile);
+    profile->shuffle = FALSE;
+    profile->compression = H5FNAL_COMPRESSION_NONE;
+
+    return;
+} /* end h5fnal_scratch_storage_profile() */
+
+/************************************************************************
+ * h5fnal_filter_storage_profile()
+ *
+ * The default profile, but compressed with a registered filter
+ * (e.g. H5FNAL_FILTER_LZ4 or H5FNAL_FILTER_ZSTD) instead of deflate.
+ * values are the filter's client data (cd_values) and can be NULL
+ * when n_values is 0.
+ ************************************************************************/
+herr_t
+h5fnal_filter_storage_profile(h5fnal_storage_profile_t *profile, H5Z_filter_t filter_id,
+        size_t n_values, const unsigned *values)
+{
+    if (NULL == profile)
+        H5FNAL_PROGRAM_ERROR("profile parameter cannot be NULL");
+    if (filter_id < 0)
+        H5FNAL_PROGRAM_ERROR("invalid filter_id parameter");
+    if (n_values > H5FNAL_MAX_FILTER_VALUES)
+        H5FNAL_PROGRAM_ERROR("too many filter values");
+    if (n_values > 0 && NULL == values)
+        H5FNAL_PROGRAM_ERROR("values parameter cannot be NULL");
+
+    h5fnal_default_storage_profile(profile);
+    profile->compression = H5FNAL_COMPRESSION_FILTER;
+    profile->filter_id = filter_id;
+    profile->n_filter_values = n_values;
+    if (n_values > 0)
+        memcpy(profile->filter_values, values, n_values * sizeof(unsigned));
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_filter_storage_profile() */
+
+/************************************************************************
+ * h5fnal_set_auto_chunking()
+ *
+ * Sizes each dataset's chunks by bytes instead of elements and,
+ * with n_sample_appends > 0, defers creating the datasets until
+ * that many appends have been seen (see h5fnal_storage_profile_t).
+ * Works on top of any of the other profiles.
+ ************************************************************************/
+void
+h5fnal_set_auto_chunking(h5fnal_storage_profile_t *profile, size_t chunk_bytes, unsigned n_sample_appends)
+{
+    if (NULL == profile)
+        return;
+
+    profile->chunk_bytes = chunk_bytes;
+    profile->n_sample_appends = n_sample_appends;
+
+    return;
+} /* end h5fnal_set_auto_chunking() */
+
+/************************************************************************
+ * h5fnal_get_profile_chunk_size()
+ *
+ * Returns the number of elements per chunk for a dataset with
+ * elements of elem_size bytes, or 0 on errors.
+ ************************************************************************/
+hsize_t
+h5fnal_get_profile_chunk_size(const h5fnal_storage_profile_t *profile, size_t elem_size)
+{
+    hsize_t chunk_size;
+
+    if (NULL == profile)
+        return H5FNAL_DEFAULT_CHUNK_SIZE;
+
+    if (0 == profile->chunk_bytes)
+        return profile->chunk_size;
+
+    if (0 == elem_size)
+        H5FNAL_PROGRAM_ERROR("elem_size parameter cannot be zero");
+
+    chunk_size = (hsize_t)(profile->chunk_bytes / elem_size);
+    if (0 == chunk_size)
+        chunk_size = 1;
+
+    return chunk_size;
+
+error:
+    return 0;
+} /* end h5fnal_get_profile_chunk_size() */
+
+/************************************************************************
+ * h5fnal_create_dcpl()
+ *
+ * Creates a dataset creation property list for a 1D chunked dataset
+ * with elements of elem_size bytes stored as the profile says. NULL
+ * gets the default profile. The caller closes the property list.
+ ************************************************************************/
+hid_t
+h5fnal_create_dcpl(const h5fnal_storage_profile_t *profile, size_t elem_size)
+{
+    h5fnal_storage_profile_t default_profile;
+    hid_t dcpl_id = H5FNAL_BAD_HID_T;
+    hsize_t chunk_dims[1];
+    htri_t avail;
+    hbool_t use_deflate = FALSE;
+
+    if (NULL == profile) {
+        h5fnal_default_storage_profile(&default_profile);
+        profile = &default_profile;
+    }
+
+    if (0 == (chunk_dims[0] = h5fnal_get_profile_chunk_size(profile, elem_size)))
+        H5FNAL_PROGRAM_ERROR("chunk size cannot be zero");
+
+    if ((dcpl_id = H5Pcreate(H5P_DATASET_CREATE)) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    /* Set up chunking */
+    if (H5Pset_chunk(dcpl_id, 1, chunk_dims) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    if (H5FNAL_COMPRESSION_NONE == profile->compression)
+        return dcpl_id;
+
+    /* Turn on compession */
+    if (profile->shuffle)
+        if (H5Pset_shuffle(dcpl_id) < 0)
+            H5FNAL_HDF5_ERROR;
+
+    switch (profile->compression) {
+        case H5FNAL_COMPRESSION_DEFLATE:
+            use_deflate = TRUE;
+            break;
+
+        case H5FNAL_COMPRESSION_FILTER:
+            /* Loads the plugin if it hasn't been already */
+            H5E_BEGIN_TRY {
+                avail = H5Zfilter_avail(profile->filter_id);
+            } H5E_END_TRY;
+            if (avail > 0) {
+                if (H5Pset_filter(dcpl_id, profile->filter_id, H5Z_FLAG_MANDATORY,
+                            profile->n_filter_values, profile->filter_values) < 0)
+                    H5FNAL_HDF5_ERROR;
+            }
+            else
+                use_deflate = TRUE;
+            break;
+
+        default:
+            H5FNAL_PROGRAM_ERROR("invalid compression in storage profile");
+    }
+
+    if (use_deflate)
+        if (H5Pset_deflate(dcpl_id, (unsigned)profile->deflate_level) < 0)
+            H5FNAL_HDF5_ERROR;
+
+    return dcpl_id;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Pclose(dcpl_id);
+    } H5E_END_TRY;
+
+    return H5FNAL_BAD_HID_T;
+} /* end h5fnal_create_dcpl() */
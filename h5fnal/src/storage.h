@@ -0,0 +1,90 @@
+/* storage.h
+ *
+ * Public header for storage profiles, which say how the datasets of
+ * a data product are chunked and compressed.
+ */
+
+#ifndef H5FNAL_STORAGE_H
+#define H5FNAL_STORAGE_H
+
+#include "h5fnal.h"
+
+/* Defaults (what every dataset used before profiles existed) */
+#define H5FNAL_DEFAULT_CHUNK_SIZE       1024
+#define H5FNAL_DEFAULT_DEFLATE_LEVEL    6
+
+/* A reasonable chunk_bytes for automatic chunking */
+#define H5FNAL_DEFAULT_CHUNK_BYTES      (256 * 1024)
+
+/* IDs of registered filters that are loaded as plugins */
+#define H5FNAL_FILTER_LZ4       32004
+#define H5FNAL_FILTER_ZSTD      32015
+
+#define H5FNAL_MAX_FILTER_VALUES    8
+
+/* Compression */
+typedef enum h5fnal_compression_t {
+    H5FNAL_COMPRESSION_NONE,        /* chunked, no filters              */
+    H5FNAL_COMPRESSION_DEFLATE,     /* zlib at deflate_level            */
+    H5FNAL_COMPRESSION_FILTER       /* the registered filter filter_id  */
+} h5fnal_compression_t;
+
+/* Storage profile
+ *
+ * Passed to the h5fnal_create_* functions for data products. A NULL
+ * profile is the default one (see h5fnal_default_storage_profile()).
+ *
+ * chunk_size is in elements and applies to every dataset in the
+ * product. The shuffle filter is only used with compression.
+ *
+ * If chunk_bytes is set, chunk_size is ignored and each dataset gets
+ * as many elements per chunk as fit in chunk_bytes, so datasets with
+ * small elements don't end up with tiny chunks.
+ *
+ * If n_sample_appends is also set, the datasets aren't created until
+ * that many appends have been made to them (or they are flushed).
+ * The appends are held in memory until then, and the chunk size is
+ * rounded to a whole number of the average append so that chunks
+ * line up with the events.
+ *
+ * A registered filter (e.g. LZ4 or Zstd) is loaded from the HDF5
+ * plugin path when the datasets are created. If it isn't available,
+ * deflate at deflate_level is used instead so that the file can
+ * still be written (and read anywhere).
+ */
+typedef struct h5fnal_storage_profile_t {
+    hsize_t                 chunk_size;
+    hbool_t                 shuffle;
+    h5fnal_compression_t    compression;
+    int                     deflate_level;
+
+    size_t                  chunk_bytes;
+    unsigned                n_sample_appends;
+
+    H5Z_filter_t            filter_id;
+    size_t                  n_filter_values;
+    unsigned                filter_values[H5FNAL_MAX_FILTER_VALUES];
+} h5fnal_storage_profile_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Fill in a profile */
+void h5fnal_default_storage_profile(h5fnal_storage_profile_t *profile);
+void h5fnal_scratch_storage_profile(h5fnal_storage_profile_t *profile);
+herr_t h5fnal_filter_storage_profile(h5fnal_storage_profile_t *profile, H5Z_filter_t filter_id,
+        size_t n_values, const unsigned *values);
+void h5fnal_set_auto_chunking(h5fnal_storage_profile_t *profile, size_t chunk_bytes, unsigned n_sample_appends);
+
+/* Chunk size (in elements) a profile gives a dataset */
+hsize_t h5fnal_get_profile_chunk_size(const h5fnal_storage_profile_t *profile, size_t elem_size);
+
+/* Create a dataset creation property list for a profile */
+hid_t h5fnal_create_dcpl(const h5fnal_storage_profile_t *profile, size_t elem_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* H5FNAL_STORAGE_H */
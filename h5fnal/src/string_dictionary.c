@@ -11,12 +11,9 @@
 
 #include "h5fnal.h"
 
-#define INITIAL_N_STRINGS   16
-#define CONCAT_STRING_INCR  4096
-
-/* Dataset names for the string collection */
-#define H5FNAL_STRINGS_DATASET_NAME     "dict_strings"
-#define H5FNAL_INDICES_DATASET_NAME     "dict_indices"
+#define INITIAL_N_STRINGS       16
+#define INITIAL_STRINGS_SIZE    4096
+#define INITIAL_N_HASH_SLOTS    32
 
 
 /************************************************************************
@@ -46,6 +43,200 @@ error:
 } /* create_index_type */
 
 
+/************************************************************************
+ * hash_string()
+ *
+ * FNV-1a hash of the first len characters of s.
+ ************************************************************************/
+static size_t
+hash_string(const char *s, size_t len)
+{
+    size_t hash = (size_t)2166136261U;
+    size_t u;
+
+    for (u = 0; u < len; u++) {
+        hash ^= (unsigned char)s[u];
+        hash *= (size_t)16777619U;
+    }
+
+    return hash;
+} /* end hash_string() */
+
+/************************************************************************
+ * find_hash_slot()
+ *
+ * Returns the hash slot that either holds the string s (of length len)
+ * or the empty slot where it would be inserted. The table always
+ * has at least one empty slot, so the probe terminates.
+ ************************************************************************/
+static unsigned
+find_hash_slot(const string_dictionary_t *dict, const char *s, size_t len)
+{
+    unsigned mask = dict->n_hash_slots - 1;
+    unsigned slot = (unsigned)(hash_string(s, len) & mask);
+
+    while (dict->hash_slots[slot] != 0) {
+        const dict_index_t *idx = &(dict->indices[dict->hash_slots[slot] - 1]);
+
+        if ((size_t)(idx->end - idx->start) == len && !memcmp(dict->concat_strings + idx->start, s, len))
+            break;
+
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+} /* end find_hash_slot() */
+
+/************************************************************************
+ * build_hash_index()
+ *
+ * (Re)builds the hash index with n_slots slots from the indices
+ * array. n_slots must be a power of two.
+ ************************************************************************/
+static herr_t
+build_hash_index(string_dictionary_t *dict, unsigned n_slots)
+{
+    unsigned u;
+
+    free(dict->hash_slots);
+    if (NULL == (dict->hash_slots = (unsigned *)calloc((size_t)n_slots, sizeof(unsigned))))
+        H5FNAL_PROGRAM_ERROR("could not allocate memory for string hash index");
+    dict->n_hash_slots = n_slots;
+
+    for (u = 0; u < dict->n_strings; u++) {
+        const dict_index_t *idx = &(dict->indices[u]);
+        unsigned slot = find_hash_slot(dict, dict->concat_strings + idx->start, (size_t)(idx->end - idx->start));
+
+        /* Keep the first copy of duplicate strings, like a linear search would */
+        if (0 == dict->hash_slots[slot])
+            dict->hash_slots[slot] = u + 1;
+    }
+
+    return H5FNAL_SUCCESS;
+
+error:
+    dict->n_hash_slots = 0;
+    return H5FNAL_FAILURE;
+} /* end build_hash_index() */
+
+/************************************************************************
+ * reserve_hash_slots()
+ *
+ * Makes sure the hash index can hold n_strings strings while staying
+ * at most half full, doubling the table (and rehashing) if needed.
+ ************************************************************************/
+static herr_t
+reserve_hash_slots(string_dictionary_t *dict, unsigned n_strings)
+{
+    unsigned n_slots;
+
+    if (dict->hash_slots && 2 * n_strings <= dict->n_hash_slots)
+        return H5FNAL_SUCCESS;
+
+    n_slots = dict->n_hash_slots ? dict->n_hash_slots : INITIAL_N_HASH_SLOTS;
+    while (2 * n_strings > n_slots)
+        n_slots *= 2;
+
+    return build_hash_index(dict, n_slots);
+} /* end reserve_hash_slots() */
+
+/************************************************************************
+ * grow_indices()
+ *
+ * Makes sure the indices array can hold at least n_strings entries.
+ * The array grows geometrically so repeated adds are amortized O(1).
+ ************************************************************************/
+static herr_t
+grow_indices(string_dictionary_t *dict, unsigned n_strings)
+{
+    unsigned n_allocated;
+    dict_index_t *indices;
+
+    if (n_strings <= dict->n_allocated)
+        return H5FNAL_SUCCESS;
+
+    n_allocated = dict->n_allocated ? dict->n_allocated : INITIAL_N_STRINGS;
+    while (n_allocated < n_strings)
+        n_allocated *= 2;
+
+    if (NULL == (indices = (dict_index_t *)realloc((void *)dict->indices, n_allocated * sizeof(dict_index_t))))
+        H5FNAL_PROGRAM_ERROR("could not reallocate memory for string indices");
+    dict->indices = indices;
+    dict->n_allocated = n_allocated;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end grow_indices() */
+
+/************************************************************************
+ * grow_strings()
+ *
+ * Makes sure the concatenated strings buffer can hold at least
+ * n_bytes characters (including terminal \0s). Grows geometrically.
+ ************************************************************************/
+static herr_t
+grow_strings(string_dictionary_t *dict, size_t n_bytes)
+{
+    size_t alloc;
+    char *strings;
+
+    if (n_bytes <= dict->total_string_alloc)
+        return H5FNAL_SUCCESS;
+
+    alloc = dict->total_string_alloc ? dict->total_string_alloc : INITIAL_STRINGS_SIZE;
+    while (alloc < n_bytes)
+        alloc *= 2;
+
+    if (NULL == (strings = (char *)realloc((void *)dict->concat_strings, alloc * sizeof(char))))
+        H5FNAL_PROGRAM_ERROR("could not reallocate memory for strings");
+    dict->concat_strings = strings;
+    dict->total_string_alloc = alloc;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end grow_strings() */
+
+/************************************************************************
+ * store_string()
+ *
+ * Copies len characters of s (plus a terminal \0) into the
+ * concatenated strings buffer and adds its index entry. Does not
+ * touch the hash index.
+ ************************************************************************/
+static herr_t
+store_string(string_dictionary_t *dict, const char *s, size_t len)
+{
+    unsigned u;
+
+    /* Increase the array sizes, if necessary.
+     * We'll be storing the terminal \0, so add one for that.
+     */
+    if (grow_indices(dict, dict->n_strings + 1) < 0)
+        H5FNAL_PROGRAM_ERROR("could not reallocate memory for string indices expansion");
+    if (grow_strings(dict, dict->total_string_size + len + 1) < 0)
+        H5FNAL_PROGRAM_ERROR("could not reallocate memory for string array expansion");
+
+    /* Add the string index info */
+    u = dict->n_strings;
+    dict->indices[u].start = dict->total_string_size;
+    dict->indices[u].end = dict->total_string_size + len;
+    dict->n_strings++;
+
+    /* Copy the string */
+    memcpy(dict->concat_strings + dict->total_string_size, s, len);
+    dict->concat_strings[dict->total_string_size + len] = '\0';
+    dict->total_string_size += len + 1;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end store_string() */
+
 /************************************************************************
  * close_dict_on_err()
  ************************************************************************/
@@ -64,6 +255,10 @@ close_dict_on_err(string_dictionary_t *dict)
         dict->indices_dset_id   = H5FNAL_BAD_HID_T;
         dict->strings_dtype_id   = H5FNAL_BAD_HID_T;
         dict->indices_dtype_id   = H5FNAL_BAD_HID_T;
+
+        free(dict->hash_slots);
+        dict->hash_slots = NULL;
+        dict->n_hash_slots = 0;
     }
 
     return;
@@ -109,7 +304,6 @@ error:
 herr_t
 create_string_dictionary(hid_t loc_id, string_dictionary_t *dict)
 {
-    hsize_t chunk_dim;
 
     if (loc_id < 0)
         H5FNAL_PROGRAM_ERROR("loc_id parameter cannot be negative");
@@ -126,9 +320,12 @@ create_string_dictionary(hid_t loc_id, string_dictionary_t *dict)
     dict->n_allocated = INITIAL_N_STRINGS;
     dict->n_strings = 0;
     /* concatenated strings */
-    if (NULL == (dict->concat_strings = (char *)calloc((size_t)CONCAT_STRING_INCR, sizeof(char))))
+    if (NULL == (dict->concat_strings = (char *)calloc((size_t)INITIAL_STRINGS_SIZE, sizeof(char))))
         H5FNAL_PROGRAM_ERROR("couldn't allocate memory for strings");
-    dict->total_string_alloc = CONCAT_STRING_INCR;
+    dict->total_string_alloc = INITIAL_STRINGS_SIZE;
+    /* hash index */
+    if (build_hash_index(dict, INITIAL_N_HASH_SLOTS) < 0)
+        H5FNAL_PROGRAM_ERROR("couldn't create string hash index");
 
     /* Create HDF5 types */
     if ((dict->strings_dtype_id = H5Tcopy(H5T_NATIVE_CHAR)) < 0)
@@ -137,19 +334,15 @@ create_string_dictionary(hid_t loc_id, string_dictionary_t *dict)
         H5FNAL_PROGRAM_ERROR("could not create datatype");
 
     /* Create the HDF5 datasets that will store the string data */
-    chunk_dim = 1024; /* arbitrary */
-    if (h5fnal_create_1D_dset(loc_id, H5FNAL_STRINGS_DATASET_NAME, dict->strings_dtype_id, chunk_dim, &(dict->strings_dset_id)) < 0)
+    if (h5fnal_create_1D_dset(loc_id, H5FNAL_STRINGS_DATASET_NAME, dict->strings_dtype_id, NULL, &(dict->strings_dset_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create dataset");
-    if (h5fnal_create_1D_dset(loc_id, H5FNAL_INDICES_DATASET_NAME, dict->indices_dtype_id, chunk_dim, &(dict->indices_dset_id)) < 0)
+    if (h5fnal_create_1D_dset(loc_id, H5FNAL_INDICES_DATASET_NAME, dict->indices_dtype_id, NULL, &(dict->indices_dset_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create dataset");
 
     /* Add the empty string as the first string */
     if (add_string_to_dictionary("", dict) < 0)
         H5FNAL_PROGRAM_ERROR("could not add string to dictionary");
 
-    /* Set the 'save on close' flag */
-    dict->save_on_close = TRUE;
-
     return H5FNAL_SUCCESS;
 
 error:
@@ -210,6 +403,13 @@ error:
     
 } /* end read_all_strings() */
 
+/************************************************************************
+ * open_string_dictionary()
+ *
+ * Opens and reads an existing dictionary. If the file was opened
+ * read-write, strings can be added and will be appended to the
+ * stored dictionary on flush or close.
+ ************************************************************************/
 herr_t
 open_string_dictionary(hid_t loc_id, string_dictionary_t *dict)
 {
@@ -237,8 +437,13 @@ open_string_dictionary(hid_t loc_id, string_dictionary_t *dict)
     if (read_all_strings(dict) < 0)
         H5FNAL_PROGRAM_ERROR("could not strings after open");
 
-    /* Set the 'save on close' flag */
-    dict->save_on_close = FALSE;
+    /* Index the strings */
+    if (reserve_hash_slots(dict, dict->n_strings) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create string hash index");
+
+    /* Everything in memory is already in the file */
+    dict->n_strings_flushed = dict->n_strings;
+    dict->total_string_size_flushed = dict->total_string_size;
 
     return H5FNAL_SUCCESS;
 
@@ -250,26 +455,77 @@ error:
 
 
 
+/************************************************************************
+ * flush_string_dictionary()
+ *
+ * Appends the strings added since the last flush (or since the
+ * dictionary was created or opened) to the file. Cheap enough to
+ * call as a checkpoint; call H5Fflush() afterwards to make the data
+ * durable. The strings are written before the indices that refer
+ * to them.
+ ************************************************************************/
 herr_t
-close_string_dictionary(string_dictionary_t *dict)
+flush_string_dictionary(string_dictionary_t *dict)
 {
+    hsize_t n;
+
     if (!dict)
         H5FNAL_PROGRAM_ERROR("dict parameter cannot be NULL");
 
-    if (dict->save_on_close) {
-        /* Write out the indices */
-        if (h5fnal_append_data(dict->indices_dset_id, dict->indices_dtype_id, dict->n_strings, (const void *)dict->indices) < 0)
-            H5FNAL_PROGRAM_ERROR("could not write indices");
-
-        /* Write the strings to the file */
-        if (h5fnal_append_data(dict->strings_dset_id, dict->strings_dtype_id, (hsize_t)dict->total_string_size, (const void *)dict->concat_strings) < 0)
+    /* Write the new strings to the file */
+    if (dict->total_string_size > dict->total_string_size_flushed) {
+        n = (hsize_t)(dict->total_string_size - dict->total_string_size_flushed);
+        if (h5fnal_append_data(dict->strings_dset_id, dict->strings_dtype_id, n,
+                (const void *)(dict->concat_strings + dict->total_string_size_flushed)) < 0)
             H5FNAL_PROGRAM_ERROR("could not write strings");
+        dict->total_string_size_flushed = dict->total_string_size;
+    }
+
+    /* Write out the new indices */
+    if (dict->n_strings > dict->n_strings_flushed) {
+        n = (hsize_t)(dict->n_strings - dict->n_strings_flushed);
+        if (h5fnal_append_data(dict->indices_dset_id, dict->indices_dtype_id, n,
+                (const void *)(dict->indices + dict->n_strings_flushed)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not write indices");
+        dict->n_strings_flushed = dict->n_strings;
     }
 
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end flush_string_dictionary() */
+
+herr_t
+close_string_dictionary(string_dictionary_t *dict)
+{
+    if (!dict)
+        H5FNAL_PROGRAM_ERROR("dict parameter cannot be NULL");
+
+    /* Write anything added since the last flush */
+    if (flush_string_dictionary(dict) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush string dictionary");
+
     /* Shut down the HDF5 IDs */
     if (close_dict_hdf5_ids(dict) < 0)
         H5FNAL_PROGRAM_ERROR("could not close string dictionary HDF5 IDs");
-     return H5FNAL_SUCCESS;
+
+    /* Release the in-memory data */
+    free(dict->indices);
+    free(dict->concat_strings);
+    free(dict->hash_slots);
+    dict->indices = NULL;
+    dict->concat_strings = NULL;
+    dict->hash_slots = NULL;
+    dict->n_strings = 0;
+    dict->n_allocated = 0;
+    dict->total_string_size = 0;
+    dict->total_string_alloc = 0;
+    dict->n_hash_slots = 0;
+    dict->n_strings_flushed = 0;
+    dict->total_string_size_flushed = 0;
+
+    return H5FNAL_SUCCESS;
 
 error:
     if (dict)
@@ -281,55 +537,102 @@ error:
 herr_t
 add_string_to_dictionary(const char *s, string_dictionary_t *dict)
 {
-    unsigned u;
     size_t len;
+    unsigned slot;
 
     if (!s)
         H5FNAL_PROGRAM_ERROR("s parameter cannot be NULL");
     if (!dict)
         H5FNAL_PROGRAM_ERROR("dict parameter cannot be NULL");
 
-    /* Get the length of the new string.
-     * We'll be storing the terminal \0, so add one for that.
-     */
-    len = strlen(s) + 1;
+    len = strlen(s);
 
-    /* Increase the indices array size, if necessary */
-    if (dict->n_strings == dict->n_allocated) {
-        dict->n_allocated += INITIAL_N_STRINGS;
-        if (NULL == (dict->indices = (dict_index_t *)realloc((void *)dict->indices, dict->n_allocated * sizeof(dict_index_t))))
-            H5FNAL_PROGRAM_ERROR("could not reallocate memory for string indices expansion");
-    }
+    /* Make room in the hash index first so the slot stays valid */
+    if (reserve_hash_slots(dict, dict->n_strings + 1) < 0)
+        H5FNAL_PROGRAM_ERROR("could not grow string hash index");
+    slot = find_hash_slot(dict, s, len);
+
+    if (store_string(dict, s, len) < 0)
+        H5FNAL_PROGRAM_ERROR("could not store string");
+
+    /* Index the new string (keep the first copy of duplicates) */
+    if (0 == dict->hash_slots[slot])
+        dict->hash_slots[slot] = dict->n_strings;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end add_string_to_dictionary() */
+
+/************************************************************************
+ * intern_string()
+ *
+ * Returns the index of the string s (of length len, which need not
+ * be \0-terminated), adding it to the dictionary if it is not already
+ * stored. The string is hashed once.
+ ************************************************************************/
+herr_t
+intern_string(string_dictionary_t *dict, const char *s, size_t len, /*OUT*/ unsigned *index)
+{
+    unsigned slot;
+
+    if (!dict)
+        H5FNAL_PROGRAM_ERROR("dict parameter cannot be NULL");
+    if (!s)
+        H5FNAL_PROGRAM_ERROR("s parameter cannot be NULL");
+    if (!index)
+        H5FNAL_PROGRAM_ERROR("index parameter cannot be NULL");
 
-    /* Increase the strings array size, if necessary */
-    if (dict->total_string_size + len > dict->total_string_alloc) {
-        dict->total_string_alloc += CONCAT_STRING_INCR;
-        if (NULL == (dict->concat_strings = (char *)realloc((void *)dict->concat_strings, dict->total_string_alloc * sizeof(char))))
-            H5FNAL_PROGRAM_ERROR("could not reallocate memory for string array expansion");
+    /* Make room in the hash index first so the slot stays valid on a miss */
+    if (reserve_hash_slots(dict, dict->n_strings + 1) < 0)
+        H5FNAL_PROGRAM_ERROR("could not grow string hash index");
+    slot = find_hash_slot(dict, s, len);
+
+    if (0 == dict->hash_slots[slot]) {
+        if (store_string(dict, s, len) < 0)
+            H5FNAL_PROGRAM_ERROR("could not store string");
+        dict->hash_slots[slot] = dict->n_strings;
     }
 
+    *index = dict->hash_slots[slot] - 1;
 
-    /* Add the string index info */
-    u = dict->n_strings;
-    dict->indices[u].start = dict->total_string_size;
-    dict->indices[u].end = dict->total_string_size + len - 1;
-    dict->n_strings++;
+    return H5FNAL_SUCCESS;
 
-    /* Copy the string */
-    u = dict->total_string_size;
-    strcpy(&(dict->concat_strings[u]), s);
-    dict->total_string_size += len;
+error:
+    return H5FNAL_FAILURE;
+} /* end intern_string() */
+
+/************************************************************************
+ * reserve_string_dictionary()
+ *
+ * Pre-sizes the dictionary so it can hold n_strings strings totalling
+ * n_bytes characters (counting each string's terminal \0) without
+ * any further reallocation. Never shrinks anything.
+ ************************************************************************/
+herr_t
+reserve_string_dictionary(string_dictionary_t *dict, unsigned n_strings, size_t n_bytes)
+{
+    if (!dict)
+        H5FNAL_PROGRAM_ERROR("dict parameter cannot be NULL");
+
+    if (grow_indices(dict, n_strings) < 0)
+        H5FNAL_PROGRAM_ERROR("could not reserve string indices");
+    if (grow_strings(dict, n_bytes) < 0)
+        H5FNAL_PROGRAM_ERROR("could not reserve string storage");
+    if (reserve_hash_slots(dict, n_strings) < 0)
+        H5FNAL_PROGRAM_ERROR("could not reserve string hash index");
 
     return H5FNAL_SUCCESS;
 
 error:
     return H5FNAL_FAILURE;
-} /* end add_string_to_dictionary() */
+} /* end reserve_string_dictionary() */
 
 herr_t
 get_string_index(const char *s, string_dictionary_t *dict, /*OUT*/ hbool_t *found, /*OUT*/ unsigned *index)
 {
-    unsigned u;
+    unsigned slot;
 
     if (!s)
         H5FNAL_PROGRAM_ERROR("s parameter cannot be NULL (the string dictionary never contains NULL)");
@@ -343,17 +646,11 @@ get_string_index(const char *s, string_dictionary_t *dict, /*OUT*/ hbool_t *foun
     *found = FALSE;
     *index = dict->n_strings; // Where the next string will go if not found.
 
-    /* Wildly inefficient. Should be a hash table. */
-    for (u = 0; u < dict->n_strings; u++) {
-        /* Point to the beginning of the next string */
-        char *dict_s = dict->concat_strings + dict->indices[u].start;
-
-        /* Same? */
-        if (!strcmp(s, dict_s)) {
-            *found = TRUE;
-            *index = u;
-            break;
-        }
+    /* Look the string up in the hash index */
+    slot = find_hash_slot(dict, s, strlen(s));
+    if (dict->hash_slots[slot] != 0) {
+        *found = TRUE;
+        *index = dict->hash_slots[slot] - 1;
     }
 
     return H5FNAL_SUCCESS;
@@ -395,3 +692,31 @@ error:
     return H5FNAL_FAILURE;
 } /* end get_string() */
 
+/************************************************************************
+ * get_string_ptr()
+ *
+ * Zero-copy version of get_string(). Returns a pointer into the
+ * dictionary's string storage along with the string length (not
+ * counting the terminal \0). The pointer must not be freed and is
+ * only valid until the dictionary is closed or a string is added
+ * (which may move the storage).
+ ************************************************************************/
+herr_t
+get_string_ptr(const string_dictionary_t *dict, unsigned index, /*OUT*/ const char **s, /*OUT*/ size_t *len)
+{
+    if (!dict)
+        H5FNAL_PROGRAM_ERROR("dict parameter cannot be NULL");
+    if (index >= dict->n_strings)
+        H5FNAL_PROGRAM_ERROR("index is larger than the number of strings in the dictionary");
+    if (!s)
+        H5FNAL_PROGRAM_ERROR("s parameter cannot be NULL");
+
+    *s = dict->concat_strings + dict->indices[index].start;
+    if (len)
+        *len = (size_t)(dict->indices[index].end - dict->indices[index].start);
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end get_string_ptr() */
@@ -8,6 +8,10 @@
 
 #include "h5fnal.h"
 
+/* Dataset names for the string collection */
+#define H5FNAL_STRINGS_DATASET_NAME     "dict_strings"
+#define H5FNAL_INDICES_DATASET_NAME     "dict_indices"
+
 typedef struct dict_index_t {
     hsize_t     start;
     hsize_t     end;
@@ -30,11 +34,20 @@ typedef struct string_dictionary_t {
     size_t total_string_alloc;
     char *concat_strings;
 
-    /* The string collection is (cheaply) implements as write-once,
-     * read-many, so we keep a 'created' flag to know if we need
-     * to store the data on close.
+    /* Hash index over the stored strings (open addressing with
+     * linear probing). Each slot holds a string index + 1 so that
+     * zero can mark an empty slot. The number of slots is always
+     * a power of two.
+     */
+    unsigned n_hash_slots;
+    unsigned *hash_slots;
+
+    /* The datasets are append-only. These track how much of the
+     * in-memory data has already been written to the file so that
+     * a flush only writes the strings added since the last one.
      */
-    hbool_t save_on_close;
+    unsigned n_strings_flushed;
+    size_t total_string_size_flushed;
 } string_dictionary_t;
 
 #ifdef __cplusplus
@@ -43,14 +56,29 @@ extern "C" {
 
 herr_t create_string_dictionary(hid_t loc_id, string_dictionary_t *dict);
 herr_t open_string_dictionary(hid_t loc_id, string_dictionary_t *dict);
+herr_t flush_string_dictionary(string_dictionary_t *dict);
 herr_t close_string_dictionary(string_dictionary_t *dict);
 
+herr_t reserve_string_dictionary(string_dictionary_t *dict, unsigned n_strings, size_t n_bytes);
+
 herr_t add_string_to_dictionary(const char *s, string_dictionary_t *dict);
 
+/* Find-or-insert. s need not be \0-terminated. */
+herr_t intern_string(string_dictionary_t *dict, const char *s, size_t len, /*OUT*/ unsigned *index);
+
 herr_t get_string_index(const char *s, string_dictionary_t *dict, /*OUT*/ hbool_t *found, /*OUT*/ unsigned *index);
 
 herr_t get_string(string_dictionary_t *dict, unsigned index, /*OUT*/ char **s);
 
+/* Borrowed pointer into the dictionary (do not free). len is optional.
+ * The strings share one growable buffer, so the pointer is only valid
+ * until the next string is added (add_string_to_dictionary() or an
+ * intern_string() that inserts) or the dictionary is closed. Reserving
+ * the space with reserve_string_dictionary() keeps it stable while the
+ * added strings fit.
+ */
+herr_t get_string_ptr(const string_dictionary_t *dict, unsigned index, /*OUT*/ const char **s, /*OUT*/ size_t *len);
+
 #ifdef __cplusplus
 }
 #endif
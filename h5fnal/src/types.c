@@ -0,0 +1,178 @@
+/* types.c
+ *
+ * In-memory datatypes shared by the data products.
+ */
+
+#include <pthread.h>
+
+#include "h5fnal.h"
+
+#define N_PRODUCT_TYPES     (sizeof(h5fnal_product_types_t) / sizeof(hid_t))
+
+/* The process-wide types */
+static pthread_mutex_t          cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static hbool_t                  cache_built = FALSE;
+static h5fnal_product_types_t   cache;
+
+
+/************************************************************************
+ * init_product_types()
+ ************************************************************************/
+static void
+init_product_types(h5fnal_product_types_t *types)
+{
+    unsigned f, v;
+
+    types->hit_dtype_id         = H5FNAL_BAD_HID_T;
+    types->hitcoll_dtype_id     = H5FNAL_BAD_HID_T;
+    types->origin_dtype_id      = H5FNAL_BAD_HID_T;
+    types->neutrino_dtype_id    = H5FNAL_BAD_HID_T;
+    types->particle_dtype_id    = H5FNAL_BAD_HID_T;
+    types->daughter_dtype_id    = H5FNAL_BAD_HID_T;
+    types->trajectory_dtype_id  = H5FNAL_BAD_HID_T;
+    types->truth_dtype_id       = H5FNAL_BAD_HID_T;
+    for (f = 0; f < H5FNAL_N_TRAJECTORY_FORMATS; f++)
+        for (v = 0; v < H5FNAL_N_TRAJECTORY_VERSIONS; v++)
+            types->encoded_trajectory_dtype_ids[f][v] = H5FNAL_BAD_HID_T;
+    types->pair_dtype_id        = H5FNAL_BAD_HID_T;
+    types->event_entry_dtype_id = H5FNAL_BAD_HID_T;
+} /* end init_product_types() */
+
+herr_t
+h5fnal_create_product_types(h5fnal_product_types_t *types)
+{
+    unsigned f, v;
+
+    if (NULL == types)
+        H5FNAL_PROGRAM_ERROR("types parameter cannot be NULL");
+
+    init_product_types(types);
+
+    if ((types->hit_dtype_id = h5fnal_create_hit_type()) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create hit datatype");
+    if ((types->hitcoll_dtype_id = h5fnal_create_hitcoll_type()) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create hitcoll datatype");
+    if ((types->origin_dtype_id = h5fnal_create_origin_type()) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create origin datatype");
+    if ((types->neutrino_dtype_id = h5fnal_create_neutrino_type()) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create neutrino datatype");
+    if ((types->particle_dtype_id = h5fnal_create_particle_type()) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create particle datatype");
+    if ((types->daughter_dtype_id = h5fnal_create_daughter_type()) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create daughter datatype");
+    if ((types->trajectory_dtype_id = h5fnal_create_trajectory_type()) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create trajectory datatype");
+    if ((types->truth_dtype_id = h5fnal_create_truth_type()) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create truth datatype");
+    for (f = 0; f < H5FNAL_N_TRAJECTORY_FORMATS; f++)
+        for (v = 0; v < H5FNAL_N_TRAJECTORY_VERSIONS; v++)
+            if ((types->encoded_trajectory_dtype_ids[f][v] = h5fnal_create_encoded_trajectory_type((h5fnal_trajectory_format_t)f,
+                    H5FNAL_TRAJECTORY_VERSION_1 + v)) < 0)
+                H5FNAL_PROGRAM_ERROR("could not create encoded trajectory datatype");
+    if ((types->pair_dtype_id = h5fnal_create_pair_type()) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create pair datatype");
+    if ((types->event_entry_dtype_id = h5fnal_create_event_entry_type()) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create event table datatype");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    if (types)
+        h5fnal_close_product_types(types);
+
+    return H5FNAL_FAILURE;
+} /* end h5fnal_create_product_types() */
+
+/************************************************************************
+ * h5fnal_close_product_types()
+ *
+ * Drops the types' references. Keeps going on errors.
+ ************************************************************************/
+herr_t
+h5fnal_close_product_types(h5fnal_product_types_t *types)
+{
+    hid_t *tids;
+    herr_t ret = H5FNAL_SUCCESS;
+    size_t u;
+
+    if (NULL == types)
+        H5FNAL_PROGRAM_ERROR("types parameter cannot be NULL");
+
+    tids = (hid_t *)types;
+    for (u = 0; u < N_PRODUCT_TYPES; u++)
+        if (tids[u] >= 0) {
+            if (H5Tclose(tids[u]) < 0)
+                ret = H5FNAL_FAILURE;
+            tids[u] = H5FNAL_BAD_HID_T;
+        }
+
+    return ret;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_close_product_types() */
+
+/************************************************************************
+ * h5fnal_get_product_types()
+ *
+ * Returns the process-wide types, building them the first time, or
+ * NULL if they can't be built.
+ ************************************************************************/
+const h5fnal_product_types_t *
+h5fnal_get_product_types(void)
+{
+    const h5fnal_product_types_t *types = NULL;
+
+    pthread_mutex_lock(&cache_lock);
+    if (!cache_built)
+        if (h5fnal_create_product_types(&cache) >= 0)
+            cache_built = TRUE;
+    if (cache_built)
+        types = &cache;
+    pthread_mutex_unlock(&cache_lock);
+
+    return types;
+} /* end h5fnal_get_product_types() */
+
+hid_t
+h5fnal_share_type(hid_t tid)
+{
+    if (H5Iinc_ref(tid) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    return tid;
+
+error:
+    return H5FNAL_BAD_HID_T;
+} /* end h5fnal_share_type() */
+
+herr_t
+h5fnal_share_product_types(h5fnal_product_types_t *types)
+{
+    const h5fnal_product_types_t *shared = NULL;
+    const hid_t *src;
+    hid_t *dst;
+    size_t u;
+
+    if (NULL == types)
+        H5FNAL_PROGRAM_ERROR("types parameter cannot be NULL");
+
+    init_product_types(types);
+
+    if (NULL == (shared = h5fnal_get_product_types()))
+        H5FNAL_PROGRAM_ERROR("could not get product datatypes");
+
+    src = (const hid_t *)shared;
+    dst = (hid_t *)types;
+    for (u = 0; u < N_PRODUCT_TYPES; u++)
+        if ((dst[u] = h5fnal_share_type(src[u])) < 0)
+            H5FNAL_PROGRAM_ERROR("could not share product datatype");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    if (types)
+        h5fnal_close_product_types(types);
+
+    return H5FNAL_FAILURE;
+} /* end h5fnal_share_product_types() */
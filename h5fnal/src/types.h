@@ -0,0 +1,64 @@
+/* types.h
+ *
+ * Header for the in-memory (native) datatypes of the data products.
+ *
+ * Building the compound types is a fair amount of H5Tcreate() and
+ * H5Tinsert() work, so the library builds each one once per process
+ * and every product shares it, taking a reference instead of making
+ * its own. Closing a product only drops its references.
+ */
+
+#ifndef H5FNAL_TYPES_H
+#define H5FNAL_TYPES_H
+
+#include "h5fnal.h"
+
+/* The encoded trajectory point types are kept for every format and
+ * version (see v_mc_truth.h), indexed by [format][version - 1]
+ */
+#define H5FNAL_N_TRAJECTORY_FORMATS     3
+#define H5FNAL_N_TRAJECTORY_VERSIONS    2
+
+/* In-memory datatypes for all the data products */
+typedef struct h5fnal_product_types_t {
+    hid_t       hit_dtype_id;
+    hid_t       hitcoll_dtype_id;
+
+    hid_t       origin_dtype_id;
+    hid_t       neutrino_dtype_id;
+    hid_t       particle_dtype_id;
+    hid_t       daughter_dtype_id;
+    hid_t       trajectory_dtype_id;
+    hid_t       truth_dtype_id;
+    hid_t       encoded_trajectory_dtype_ids[H5FNAL_N_TRAJECTORY_FORMATS][H5FNAL_N_TRAJECTORY_VERSIONS];
+
+    hid_t       pair_dtype_id;
+
+    hid_t       event_entry_dtype_id;
+} h5fnal_product_types_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Build a new set of types / drop a set's references */
+herr_t h5fnal_create_product_types(h5fnal_product_types_t *types);
+herr_t h5fnal_close_product_types(h5fnal_product_types_t *types);
+
+/* The process-wide types (built on first use). The IDs belong to the
+ * library, so take references with h5fnal_share_type() or
+ * h5fnal_share_product_types() to keep them.
+ */
+const h5fnal_product_types_t *h5fnal_get_product_types(void);
+
+/* Take a reference to a type, or to all of the process-wide types
+ * (drop them with H5Tclose() / h5fnal_close_product_types())
+ */
+hid_t h5fnal_share_type(hid_t tid);
+herr_t h5fnal_share_product_types(h5fnal_product_types_t *types);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* H5FNAL_TYPES_H */
@@ -6,6 +6,9 @@
 #include "h5fnal.h"
 #include "util.h"
 
+/* Whether buffered appenders compress chunks themselves */
+static hbool_t direct_chunk_write = FALSE;
+
 herr_t
 h5fnal_add_string_attribute(hid_t loc_id, const char *name, const char *value)
 {
@@ -121,6 +124,174 @@ error:
 
 } /* end h5fnal_get_string_attribute() */
 
+/************************************************************************
+ * h5fnal_set_double_attribute()
+ *
+ * Writes n doubles to an attribute, creating it if needed.
+ ************************************************************************/
+herr_t
+h5fnal_set_double_attribute(hid_t loc_id, const char *name, hsize_t n, const double *values)
+{
+    hid_t aid = -1;
+    hid_t sid = -1;
+    htri_t exists;
+
+    if (loc_id < 0)
+        H5FNAL_PROGRAM_ERROR("invalid loc_id parameter");
+    if (NULL == name)
+        H5FNAL_PROGRAM_ERROR("name parameter cannot be NULL");
+    if (NULL == values)
+        H5FNAL_PROGRAM_ERROR("values parameter cannot be NULL");
+
+    if ((exists = H5Aexists(loc_id, name)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (exists) {
+        if ((aid = H5Aopen(loc_id, name, H5P_DEFAULT)) < 0)
+            H5FNAL_HDF5_ERROR;
+    }
+    else {
+        if ((sid = H5Screate_simple(1, &n, NULL)) < 0)
+            H5FNAL_HDF5_ERROR;
+        if ((aid = H5Acreate(loc_id, name, H5T_NATIVE_DOUBLE, sid, H5P_DEFAULT, H5P_DEFAULT)) < 0)
+            H5FNAL_HDF5_ERROR;
+        if (H5Sclose(sid) < 0)
+            H5FNAL_HDF5_ERROR;
+        sid = -1;
+    }
+
+    if (H5Awrite(aid, H5T_NATIVE_DOUBLE, values) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    if (H5Aclose(aid) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Aclose(aid);
+        H5Sclose(sid);
+    } H5E_END_TRY;
+
+    return H5FNAL_FAILURE;
+} /* end h5fnal_set_double_attribute() */
+
+/************************************************************************
+ * h5fnal_get_double_attribute()
+ *
+ * Reads an attribute of n doubles.
+ ************************************************************************/
+herr_t
+h5fnal_get_double_attribute(hid_t loc_id, const char *name, hsize_t n, double *values)
+{
+    hid_t aid = -1;
+    hid_t sid = -1;
+    hssize_t n_stored;
+
+    if (loc_id < 0)
+        H5FNAL_PROGRAM_ERROR("invalid loc_id parameter");
+    if (NULL == name)
+        H5FNAL_PROGRAM_ERROR("name parameter cannot be NULL");
+    if (NULL == values)
+        H5FNAL_PROGRAM_ERROR("values parameter cannot be NULL");
+
+    if ((aid = H5Aopen(loc_id, name, H5P_DEFAULT)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if ((sid = H5Aget_space(aid)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if ((n_stored = H5Sget_simple_extent_npoints(sid)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if ((hsize_t)n_stored != n)
+        H5FNAL_PROGRAM_ERROR("attribute has the wrong number of values");
+
+    if (H5Aread(aid, H5T_NATIVE_DOUBLE, values) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    if (H5Sclose(sid) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Aclose(aid) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Sclose(sid);
+        H5Aclose(aid);
+    } H5E_END_TRY;
+
+    return H5FNAL_FAILURE;
+} /* end h5fnal_get_double_attribute() */
+
+/************************************************************************
+ * h5fnal_add_uint_attribute()
+ ************************************************************************/
+herr_t
+h5fnal_add_uint_attribute(hid_t loc_id, const char *name, unsigned value)
+{
+    hid_t aid = -1;
+    hid_t sid = -1;
+
+    if (loc_id < 0)
+        H5FNAL_PROGRAM_ERROR("invalid loc_id parameter");
+    if (NULL == name)
+        H5FNAL_PROGRAM_ERROR("name parameter cannot be NULL");
+
+    if ((sid = H5Screate(H5S_SCALAR)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if ((aid = H5Acreate(loc_id, name, H5T_NATIVE_UINT, sid, H5P_DEFAULT, H5P_DEFAULT)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Awrite(aid, H5T_NATIVE_UINT, &value) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    if (H5Sclose(sid) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Aclose(aid) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Aclose(aid);
+        H5Sclose(sid);
+    } H5E_END_TRY;
+
+    return H5FNAL_FAILURE;
+} /* end h5fnal_add_uint_attribute() */
+
+/************************************************************************
+ * h5fnal_get_uint_attribute()
+ ************************************************************************/
+herr_t
+h5fnal_get_uint_attribute(hid_t loc_id, const char *name, unsigned *value)
+{
+    hid_t aid = -1;
+
+    if (loc_id < 0)
+        H5FNAL_PROGRAM_ERROR("invalid loc_id parameter");
+    if (NULL == name)
+        H5FNAL_PROGRAM_ERROR("name parameter cannot be NULL");
+    if (NULL == value)
+        H5FNAL_PROGRAM_ERROR("value parameter cannot be NULL");
+
+    if ((aid = H5Aopen(loc_id, name, H5P_DEFAULT)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Aread(aid, H5T_NATIVE_UINT, value) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Aclose(aid) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Aclose(aid);
+    } H5E_END_TRY;
+
+    return H5FNAL_FAILURE;
+} /* end h5fnal_get_uint_attribute() */
+
 hssize_t
 h5fnal_get_dset_size(hid_t did)
 {
@@ -148,14 +319,60 @@ error:
     return -1;
 } /* end h5fnal_get_dset_size() */
 
+/************************************************************************
+ * h5fnal_read_dset_range()
+ *
+ * Reads count elements of a 1D dataset, starting at element start,
+ * into buf.
+ ************************************************************************/
+herr_t
+h5fnal_read_dset_range(hid_t did, hid_t tid, hsize_t start, hsize_t count, void *buf)
+{
+    hid_t file_sid = H5FNAL_BAD_HID_T;
+    hid_t mem_sid = H5FNAL_BAD_HID_T;
+
+    if (did < 0)
+        H5FNAL_PROGRAM_ERROR("did parameter cannot be negative");
+
+    /* Trivial case of no elements */
+    if (0 == count)
+        return H5FNAL_SUCCESS;
+
+    if ((file_sid = H5Dget_space(did)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Sselect_hyperslab(file_sid, H5S_SELECT_SET, &start, NULL, &count, NULL) < 0)
+        H5FNAL_HDF5_ERROR;
+    if ((mem_sid = H5Screate_simple(1, &count, NULL)) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    if (H5Dread(did, tid, mem_sid, file_sid, H5P_DEFAULT, buf) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    if (H5Sclose(mem_sid) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Sclose(file_sid) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Sclose(mem_sid);
+        H5Sclose(file_sid);
+    } H5E_END_TRY;
+
+    return H5FNAL_FAILURE;
+} /* end h5fnal_read_dset_range() */
+
 
 /* Create an empty, chunked, 1D dataset */
 herr_t
-h5fnal_create_1D_dset(hid_t loc_id, const char *name, hid_t tid, hsize_t chunk_dim, /*OUT*/ hid_t *did)
+h5fnal_create_1D_dset(hid_t loc_id, const char *name, hid_t tid, const h5fnal_storage_profile_t *profile, /*OUT*/ hid_t *did)
 {
     hid_t dcpl_id = -1;
     hid_t sid = -1;
-    hsize_t chunk_dims[1];
+    hid_t file_tid = -1;
+    size_t elem_size;
     hsize_t init_dims[1];
     hsize_t max_dims[1];
 
@@ -169,19 +386,10 @@ h5fnal_create_1D_dset(hid_t loc_id, const char *name, hid_t tid, hsize_t chunk_d
         H5FNAL_PROGRAM_ERROR("did parameter cannot be NULL");
 
     /* Create the dataset creation property list */
-    if ((dcpl_id = H5Pcreate(H5P_DATASET_CREATE)) < 0)
-        H5FNAL_HDF5_ERROR;
-
-    /* Set up chunking */
-    chunk_dims[0] = chunk_dim;
-    if (H5Pset_chunk(dcpl_id, 1, chunk_dims) < 0)
-        H5FNAL_HDF5_ERROR;
-
-    /* Turn on compession */
-    if (H5Pset_shuffle(dcpl_id) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Pset_deflate(dcpl_id, 6) < 0)
+    if (0 == (elem_size = H5Tget_size(tid)))
         H5FNAL_HDF5_ERROR;
+    if ((dcpl_id = h5fnal_create_dcpl(profile, elem_size)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create dataset creation property list");
 
     /* Create the dataspace */
     init_dims[0] = 0;
@@ -189,11 +397,18 @@ h5fnal_create_1D_dset(hid_t loc_id, const char *name, hid_t tid, hsize_t chunk_d
     if ((sid = H5Screate_simple(1, init_dims, max_dims)) < 0)
         H5FNAL_HDF5_ERROR;
 
+    /* Use the file's committed copy of the type, if it has one */
+    if (h5fnal_get_committed_type(loc_id, tid, name, &file_tid) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get committed datatype");
+
     /* Create datasets */
-    if ((*did = H5Dcreate2(loc_id, name, tid, sid, H5P_DEFAULT, dcpl_id, H5P_DEFAULT)) < 0)
+    if ((*did = H5Dcreate2(loc_id, name, file_tid >= 0 ? file_tid : tid, sid, H5P_DEFAULT, dcpl_id, H5P_DEFAULT)) < 0)
         H5FNAL_HDF5_ERROR;
 
     /* close everything */
+    if (file_tid >= 0)
+        if (H5Tclose(file_tid) < 0)
+            H5FNAL_HDF5_ERROR;
     if (H5Pclose(dcpl_id) < 0)
         H5FNAL_HDF5_ERROR;
     if (H5Sclose(sid) < 0)
@@ -205,6 +420,7 @@ error:
     H5E_BEGIN_TRY {
         H5Sclose(sid);
         H5Pclose(dcpl_id);
+        H5Tclose(file_tid);
     } H5E_END_TRY;
 
     if (did)
@@ -214,72 +430,805 @@ error:
 
 } /* end h5fnal_create_1D_dset() */
 
+/************************************************************************
+ * h5fnal_reserve_buffer()
+ *
+ * Makes sure *buf can hold at least n elements of elem_size bytes,
+ * reallocating it if needed. *capacity is the current size of the
+ * buffer in elements and is updated. Buffers grow geometrically so
+ * reusing one across many reads settles down to no allocations.
+ *
+ * The contents of the buffer are kept, new space is not initialized.
+ * On failure the old buffer is left as it was.
+ ************************************************************************/
+herr_t
+h5fnal_reserve_buffer(void **buf, hsize_t *capacity, hsize_t n, size_t elem_size)
+{
+    hsize_t new_capacity;
+    void *new_buf = NULL;
+
+    if (NULL == buf)
+        H5FNAL_PROGRAM_ERROR("buf parameter cannot be NULL");
+    if (NULL == capacity)
+        H5FNAL_PROGRAM_ERROR("capacity parameter cannot be NULL");
+    if (0 == elem_size)
+        H5FNAL_PROGRAM_ERROR("elem_size parameter cannot be zero");
+
+    if (*buf && n <= *capacity)
+        return H5FNAL_SUCCESS;
+
+    new_capacity = *buf ? *capacity : 0;
+    if (new_capacity < 16)
+        new_capacity = 16;
+    while (new_capacity < n)
+        new_capacity *= 2;
+
+    if (NULL == (new_buf = realloc(*buf, (size_t)new_capacity * elem_size)))
+        H5FNAL_PROGRAM_ERROR("could not reallocate buffer");
+
+    *buf = new_buf;
+    *capacity = new_capacity;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_reserve_buffer() */
+
 herr_t
 h5fnal_append_data(hid_t did, hid_t tid, hsize_t n_elements, const void *data)
 {
-    hid_t file_sid = -1;                /* dataspace ID                             */
-    hid_t memory_sid = -1;              /* dataspace ID                             */
-    hsize_t curr_dims[1];               /* initial size of dataset                  */
-    hsize_t new_dims[1];                /* new size of data dataset                 */
-    hsize_t start[1];
-    hsize_t stride[1];
-    hsize_t count[1];
-    hsize_t block[1];
+    return h5fnal_append_strided_data(did, tid, n_elements, 0, 1, data);
+} /* end h5fnal_append_data() */
 
-    /* NOTE: no parameter check on data parameter to make it easier on higher-level code */
+/************************************************************************
+ * h5fnal_append_strided_data()
+ *
+ * Like h5fnal_append_data(), but the elements are taken from every
+ * mem_stride'th slot of the memory buffer, starting at slot mem_start
+ * (slots are the size of tid). Lets us write one field of an array of
+ * structs without copying it out first.
+ *
+ * This is a one-shot append. Code that appends to the same dataset
+ * over and over should keep an h5fnal_appender_t around instead.
+ ************************************************************************/
+herr_t
+h5fnal_append_strided_data(hid_t did, hid_t tid, hsize_t n_elements, hsize_t mem_start, hsize_t mem_stride, const void *data)
+{
+    h5fnal_appender_t app;
 
     /* Trivial case of no elements */
     if (0 == n_elements)
         return H5FNAL_SUCCESS;
 
-    /* Create the memory dataspace (set of points describing the data size, etc.) */
-    curr_dims[0] = n_elements;
-    if ((memory_sid = H5Screate_simple(1, curr_dims, curr_dims)) < 0)
+    h5fnal_init_appender(&app, did, tid, FALSE);
+
+    if (h5fnal_appender_append_strided(&app, n_elements, mem_start, mem_stride, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not append data");
+
+    if (h5fnal_close_appender(&app) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close appender");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        h5fnal_close_appender(&app);
+    } H5E_END_TRY;
+
+    return H5FNAL_FAILURE;
+} /* end h5fnal_append_strided_data() */
+
+/************************************************************************
+ * h5fnal_init_appender()
+ *
+ * Sets up an appender for a 1D dataset. No HDF5 calls are made.
+ *
+ * Buffered appenders hold on to appended elements until they fill a
+ * whole chunk, so small appends don't each rewrite (and recompress)
+ * the last, partial chunk of the dataset. Anything left over is
+ * written by h5fnal_flush_appender() or h5fnal_close_appender().
+ ************************************************************************/
+void
+h5fnal_init_appender(h5fnal_appender_t *app, hid_t did, hid_t tid, hbool_t buffered)
+{
+    app->did            = did;
+    app->tid            = tid;
+    app->size           = 0;
+    app->max_size       = 0;
+    app->file_sid       = H5FNAL_BAD_HID_T;
+    app->mem_sid        = H5FNAL_BAD_HID_T;
+    app->mem_size       = 0;
+
+    app->buffered       = buffered;
+    app->elem_size      = 0;
+    app->chunk_size     = 0;
+    app->buf            = NULL;
+    app->n_buf          = 0;
+    app->buf_capacity   = 0;
+
+    app->direct             = FALSE;
+    app->deflate_level      = 0;
+    app->pending_head       = NULL;
+    app->pending_tail       = NULL;
+    app->n_pending          = 0;
+
+    app->create_loc_id      = H5FNAL_BAD_HID_T;
+    app->create_name        = NULL;
+    app->create_did         = NULL;
+    app->n_appends          = 0;
+    memset(&(app->create_profile), 0, sizeof(h5fnal_storage_profile_t));
+
+    return;
+} /* end h5fnal_init_appender() */
+
+/************************************************************************
+ * h5fnal_appender_create_dset()
+ *
+ * Creates the appender's empty 1D dataset, with the appender's type,
+ * as the storage profile says, and points the appender at it.
+ *
+ * If the profile has n_sample_appends set, nothing is created yet and
+ * *did is set to an invalid ID. The appends are buffered and the
+ * dataset is created after n_sample_appends of them (or when the
+ * appender is flushed), with a chunk size rounded down to a whole
+ * number of the average append. *did is set then. loc_id must stay
+ * open until the appender is closed.
+ ************************************************************************/
+herr_t
+h5fnal_appender_create_dset(h5fnal_appender_t *app, hid_t loc_id, const char *name, const h5fnal_storage_profile_t *profile, /*OUT*/ hid_t *did)
+{
+    if (NULL == app)
+        H5FNAL_PROGRAM_ERROR("app parameter cannot be NULL");
+    if (loc_id < 0)
+        H5FNAL_PROGRAM_ERROR("loc_id parameter cannot be negative");
+    if (NULL == name)
+        H5FNAL_PROGRAM_ERROR("name parameter cannot be NULL");
+    if (NULL == did)
+        H5FNAL_PROGRAM_ERROR("did parameter cannot be NULL");
+
+    /* Create it now */
+    if (NULL == profile || 0 == profile->n_sample_appends) {
+        if (h5fnal_create_1D_dset(loc_id, name, app->tid, profile, did) < 0)
+            H5FNAL_PROGRAM_ERROR("could not create dataset");
+        app->did = *did;
+        return H5FNAL_SUCCESS;
+    }
+
+    /* Create it later (the element size is needed for the chunk size
+     * even if nothing is ever appended)
+     */
+    if (0 == (app->elem_size = H5Tget_size(app->tid)))
         H5FNAL_HDF5_ERROR;
+    if (NULL == (app->create_name = (char *)malloc(strlen(name) + 1)))
+        H5FNAL_PROGRAM_ERROR("could not get memory for dataset name");
+    strcpy(app->create_name, name);
+    app->create_loc_id = loc_id;
+    app->create_profile = *profile;
+    app->create_did = did;
+    app->n_appends = 0;
+    app->did = H5FNAL_BAD_HID_T;
+    *did = H5FNAL_BAD_HID_T;
 
-    /* Get the size (current size only) of the dataset */
-    if ((file_sid = H5Dget_space(did)) < 0)
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_appender_create_dset() */
+
+/************************************************************************
+ * h5fnal_set_direct_chunk_write()
+ *
+ * Turns direct chunk writes on or off for appenders that are set up
+ * afterwards.
+ *
+ * With this on, buffered appenders for datasets that use exactly the
+ * shuffle + deflate filters (and whose file type is the memory type)
+ * do the shuffle and the deflate for each whole chunk themselves and
+ * hand the finished chunk to H5Dwrite_chunk(). The compression then
+ * happens outside the HDF5 library, on the compression threads if
+ * there are any (see h5fnal_set_compression_threads()). The chunks
+ * are the same as the filter pipeline would produce, so the files
+ * can be read normally. Partial chunks still go through H5Dwrite().
+ ************************************************************************/
+void
+h5fnal_set_direct_chunk_write(hbool_t enable)
+{
+    direct_chunk_write = enable;
+
+    return;
+} /* end h5fnal_set_direct_chunk_write() */
+
+hbool_t
+h5fnal_get_direct_chunk_write(void)
+{
+    return direct_chunk_write;
+} /* end h5fnal_get_direct_chunk_write() */
+
+/************************************************************************
+ * setup_direct_write()
+ *
+ * Turns on direct chunk writes for the appender if the dataset's
+ * filters are ones we know how to apply ourselves.
+ ************************************************************************/
+static herr_t
+setup_direct_write(h5fnal_appender_t *app, hid_t dcpl_id)
+{
+    hid_t file_tid = H5FNAL_BAD_HID_T;
+    unsigned flags;
+    size_t n_values;
+    unsigned values[8];
+    htri_t same_type;
+
+    /* Shuffle followed by deflate, and nothing else */
+    if (2 != H5Pget_nfilters(dcpl_id))
+        return H5FNAL_SUCCESS;
+    n_values = 8;
+    if (H5Z_FILTER_SHUFFLE != H5Pget_filter2(dcpl_id, 0, &flags, &n_values, values, 0, NULL, NULL))
+        return H5FNAL_SUCCESS;
+    n_values = 8;
+    if (H5Z_FILTER_DEFLATE != H5Pget_filter2(dcpl_id, 1, &flags, &n_values, values, 0, NULL, NULL) || n_values < 1)
+        return H5FNAL_SUCCESS;
+    app->deflate_level = (int)values[0];
+
+    /* No type conversion allowed, we write the bytes we're given */
+    if ((file_tid = H5Dget_type(app->did)) < 0)
         H5FNAL_HDF5_ERROR;
-    if (H5Sget_simple_extent_dims(file_sid, curr_dims, NULL) < 0)
+    if ((same_type = H5Tequal(file_tid, app->tid)) < 0)
         H5FNAL_HDF5_ERROR;
-    if (H5Sclose(file_sid) < 0)
+    if (H5Tclose(file_tid) < 0)
         H5FNAL_HDF5_ERROR;
+    if (!same_type)
+        return H5FNAL_SUCCESS;
+
+    app->direct = TRUE;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Tclose(file_tid);
+    } H5E_END_TRY;
 
-    /* Resize the dataset to hold the new data */
-    new_dims[0] = curr_dims[0] + n_elements;
-    if (H5Dset_extent(did, new_dims) < 0)
+    return H5FNAL_FAILURE;
+} /* end setup_direct_write() */
+
+/************************************************************************
+ * attach_appender()
+ *
+ * Gets the dataset's file dataspace and size (and, for buffered
+ * appenders, the chunk size), if we don't already have them.
+ ************************************************************************/
+static herr_t
+attach_appender(h5fnal_appender_t *app)
+{
+    hid_t dcpl_id = H5FNAL_BAD_HID_T;
+    hsize_t dims[1];
+    hsize_t max_dims[1];
+    H5D_layout_t layout;
+
+    if (app->file_sid >= 0)
+        return H5FNAL_SUCCESS;
+
+    if (app->did < 0)
+        H5FNAL_PROGRAM_ERROR("appender has no dataset");
+
+    if ((app->file_sid = H5Dget_space(app->did)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Sget_simple_extent_dims(app->file_sid, dims, max_dims) < 0)
         H5FNAL_HDF5_ERROR;
 
-    /* Get the resized file space */
-    if ((file_sid = H5Dget_space(did)) < 0)
+    app->size = dims[0];
+    app->max_size = max_dims[0];
+
+    /* Buffering only makes sense for chunked datasets */
+    if (app->buffered && 0 == app->chunk_size) {
+        if (0 == (app->elem_size = H5Tget_size(app->tid)))
+            H5FNAL_HDF5_ERROR;
+        if ((dcpl_id = H5Dget_create_plist(app->did)) < 0)
+            H5FNAL_HDF5_ERROR;
+        if ((layout = H5Pget_layout(dcpl_id)) < 0)
+            H5FNAL_HDF5_ERROR;
+        if (H5D_CHUNKED == layout) {
+            if (H5Pget_chunk(dcpl_id, 1, dims) < 0)
+                H5FNAL_HDF5_ERROR;
+            app->chunk_size = dims[0];
+            if (direct_chunk_write)
+                if (setup_direct_write(app, dcpl_id) < 0)
+                    H5FNAL_PROGRAM_ERROR("could not set up direct chunk writes");
+        }
+        else
+            app->buffered = FALSE;
+        if (H5Pclose(dcpl_id) < 0)
+            H5FNAL_HDF5_ERROR;
+    }
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Sclose(app->file_sid);
+        H5Pclose(dcpl_id);
+    } H5E_END_TRY;
+    app->file_sid = H5FNAL_BAD_HID_T;
+
+    return H5FNAL_FAILURE;
+} /* end attach_appender() */
+
+/************************************************************************
+ * h5fnal_get_appender_size()
+ *
+ * Returns the number of elements in the dataset, including any that
+ * are still buffered (without going to the file after the first
+ * call).
+ ************************************************************************/
+hssize_t
+h5fnal_get_appender_size(h5fnal_appender_t *app)
+{
+    if (NULL == app)
+        H5FNAL_PROGRAM_ERROR("app parameter cannot be NULL");
+
+    /* Nothing in the file yet */
+    if (app->create_name)
+        return (hssize_t)app->n_buf;
+
+    if (attach_appender(app) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get dataset dataspace");
+
+    return (hssize_t)(app->size + app->n_buf);
+
+error:
+    return -1;
+} /* end h5fnal_get_appender_size() */
+
+/************************************************************************
+ * write_pending_chunks()
+ *
+ * Writes compressed chunks, oldest first. Chunks that are done are
+ * always written. Beyond that, waits for chunks until no more than
+ * max_pending are left (0 writes them all).
+ ************************************************************************/
+static herr_t
+write_pending_chunks(h5fnal_appender_t *app, hsize_t max_pending)
+{
+    h5fnal_chunk_job_t *job = NULL;
+    hsize_t offset[1];
+
+    while (NULL != (job = app->pending_head)) {
+        if (app->n_pending <= max_pending && !h5fnal_chunk_job_done(job))
+            break;
+        if (h5fnal_wait_chunk_job(job) < 0)
+            H5FNAL_PROGRAM_ERROR("could not wait for chunk compression");
+
+        offset[0] = job->offset;
+        if (H5Dwrite_chunk(app->did, H5P_DEFAULT, job->filter_mask, offset, job->out_size, job->out) < 0)
+            H5FNAL_HDF5_ERROR;
+
+        app->pending_head = job->next;
+        if (NULL == app->pending_head)
+            app->pending_tail = NULL;
+        app->n_pending--;
+        h5fnal_free_chunk_job(job);
+    }
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end write_pending_chunks() */
+
+/************************************************************************
+ * discard_pending_chunks()
+ *
+ * Waits for and throws away any chunks that haven't been written.
+ ************************************************************************/
+static void
+discard_pending_chunks(h5fnal_appender_t *app)
+{
+    h5fnal_chunk_job_t *job = NULL;
+
+    while (NULL != (job = app->pending_head)) {
+        h5fnal_wait_chunk_job(job);
+        app->pending_head = job->next;
+        h5fnal_free_chunk_job(job);
+    }
+    app->pending_tail = NULL;
+    app->n_pending = 0;
+
+    return;
+} /* end discard_pending_chunks() */
+
+/************************************************************************
+ * write_chunks_direct()
+ *
+ * Extends the dataset and queues n_chunks whole chunks at the end of
+ * it (which must be on a chunk boundary) for compression.
+ *
+ * The shuffle is done here (it also copies the data out of the
+ * caller's buffer) and the deflate on the compression threads. The
+ * finished chunks are written with H5Dwrite_chunk() as they come
+ * in, in order. At most twice as many chunks as there are threads
+ * are left in flight per appender, which bounds the memory used.
+ ************************************************************************/
+static herr_t
+write_chunks_direct(h5fnal_appender_t *app, hsize_t n_chunks, hsize_t mem_start, hsize_t mem_stride, const void *data)
+{
+    const unsigned char *src = (const unsigned char *)data;
+    h5fnal_chunk_job_t *job = NULL;
+    size_t chunk_bytes = (size_t)app->chunk_size * app->elem_size;
+    size_t src_stride = (size_t)mem_stride * app->elem_size;
+    hsize_t max_pending = 2 * (hsize_t)h5fnal_get_compression_threads();
+    hsize_t new_dims[1];
+    hsize_t max_dims[1];
+    hsize_t c;
+
+    /* Resize the dataset and keep the cached file dataspace in step */
+    new_dims[0] = app->size + n_chunks * app->chunk_size;
+    max_dims[0] = app->max_size;
+    if (H5Dset_extent(app->did, new_dims) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Sset_extent_simple(app->file_sid, 1, new_dims, max_dims) < 0)
         H5FNAL_HDF5_ERROR;
 
-    /* Create a hyperslab describing where the data should go */
-    start[0] = curr_dims[0];
-    stride[0] = 1;
-    count[0] = n_elements;
-    block[0] = 1;
-    if (H5Sselect_hyperslab(file_sid, H5S_SELECT_SET, start, stride, count, block) < 0)
+    src += (size_t)mem_start * app->elem_size;
+    for (c = 0; c < n_chunks; c++) {
+        if (NULL == (job = h5fnal_create_chunk_job(chunk_bytes)))
+            H5FNAL_PROGRAM_ERROR("could not create chunk job");
+        h5fnal_shuffle_chunk(job->shuffled, src, app->elem_size, (size_t)app->chunk_size, src_stride);
+        src += (size_t)app->chunk_size * src_stride;
+        job->offset = app->size;
+        job->level = app->deflate_level;
+        app->size += app->chunk_size;
+
+        if (h5fnal_submit_chunk_job(job) < 0)
+            H5FNAL_PROGRAM_ERROR("could not submit chunk job");
+        if (app->pending_tail)
+            app->pending_tail->next = job;
+        else
+            app->pending_head = job;
+        app->pending_tail = job;
+        app->n_pending++;
+        job = NULL;
+
+        if (write_pending_chunks(app, max_pending) < 0)
+            H5FNAL_PROGRAM_ERROR("could not write compressed chunks");
+    }
+
+    return H5FNAL_SUCCESS;
+
+error:
+    h5fnal_free_chunk_job(job);
+
+    return H5FNAL_FAILURE;
+} /* end write_chunks_direct() */
+
+/************************************************************************
+ * write_elements()
+ *
+ * Extends the dataset and writes n_elements at the end of it.
+ *
+ * The cached dataspaces are resized in place with
+ * H5Sset_extent_simple(), so the only file operations are the
+ * H5Dset_extent() and the H5Dwrite().
+ ************************************************************************/
+static herr_t
+write_elements(h5fnal_appender_t *app, hsize_t n_elements, hsize_t mem_start, hsize_t mem_stride, const void *data)
+{
+    hsize_t mem_dims[1];
+    hsize_t new_dims[1];
+    hsize_t max_dims[1];
+    hsize_t start[1];
+    hsize_t stride[1];
+    hsize_t count[1];
+
+    /* Whole, aligned chunks can skip the filter pipeline */
+    if (app->direct && 0 == app->size % app->chunk_size && 0 == n_elements % app->chunk_size)
+        return write_chunks_direct(app, n_elements / app->chunk_size, mem_start, mem_stride, data);
+
+    /* Keep the writes in order */
+    if (write_pending_chunks(app, 0) < 0)
+        H5FNAL_PROGRAM_ERROR("could not write compressed chunks");
+
+    /* Set up the memory dataspace */
+    mem_dims[0] = mem_start + (n_elements - 1) * mem_stride + 1;
+    if (app->mem_sid < 0) {
+        if ((app->mem_sid = H5Screate_simple(1, mem_dims, NULL)) < 0)
+            H5FNAL_HDF5_ERROR;
+        app->mem_size = mem_dims[0];
+    }
+    else if (app->mem_size != mem_dims[0]) {
+        if (H5Sset_extent_simple(app->mem_sid, 1, mem_dims, NULL) < 0)
+            H5FNAL_HDF5_ERROR;
+        app->mem_size = mem_dims[0];
+    }
+    if (mem_stride > 1 || mem_start > 0) {
+        start[0] = mem_start;
+        stride[0] = mem_stride;
+        count[0] = n_elements;
+        if (H5Sselect_hyperslab(app->mem_sid, H5S_SELECT_SET, start, stride, count, NULL) < 0)
+            H5FNAL_HDF5_ERROR;
+    }
+    else if (H5Sselect_all(app->mem_sid) < 0)
         H5FNAL_HDF5_ERROR;
 
-    /* Write the data to the dataset */
-    if (H5Dwrite(did, tid, memory_sid, file_sid, H5P_DEFAULT, data) < 0)
+    /* Resize the dataset to hold the new data and keep the cached
+     * file dataspace in step with it
+     */
+    new_dims[0] = app->size + n_elements;
+    max_dims[0] = app->max_size;
+    if (H5Dset_extent(app->did, new_dims) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Sset_extent_simple(app->file_sid, 1, new_dims, max_dims) < 0)
         H5FNAL_HDF5_ERROR;
+    start[0] = app->size;
+    app->size = new_dims[0];
 
-    /* Close everything */
-    if (H5Sclose(file_sid) < 0)
+    /* Select where the data should go */
+    count[0] = n_elements;
+    if (H5Sselect_hyperslab(app->file_sid, H5S_SELECT_SET, start, NULL, count, NULL) < 0)
         H5FNAL_HDF5_ERROR;
-    if (H5Sclose(memory_sid) < 0)
+
+    /* Write the data to the dataset */
+    if (H5Dwrite(app->did, app->tid, app->mem_sid, app->file_sid, H5P_DEFAULT, data) < 0)
         H5FNAL_HDF5_ERROR;
 
     return H5FNAL_SUCCESS;
 
 error:
-    H5E_BEGIN_TRY {
-        H5Sclose(file_sid);
-        H5Sclose(memory_sid);
-    } H5E_END_TRY;
+    return H5FNAL_FAILURE;
+} /* end write_elements() */
+
+/************************************************************************
+ * buffer_elements()
+ *
+ * Copies n_elements (taken as in h5fnal_append_strided_data()) to the
+ * end of the write-behind buffer.
+ ************************************************************************/
+static herr_t
+buffer_elements(h5fnal_appender_t *app, hsize_t n_elements, hsize_t mem_start, hsize_t mem_stride, const void *data)
+{
+    const unsigned char *src = (const unsigned char *)data;
+    unsigned char *dst = NULL;
+    hsize_t u;
+
+    if (h5fnal_reserve_buffer((void **)&(app->buf), &(app->buf_capacity), app->n_buf + n_elements, app->elem_size) < 0)
+        H5FNAL_PROGRAM_ERROR("could not grow append buffer");
+
+    dst = app->buf + app->n_buf * app->elem_size;
+    if (1 == mem_stride)
+        memcpy(dst, src + mem_start * app->elem_size, (size_t)n_elements * app->elem_size);
+    else
+        for (u = 0; u < n_elements; u++)
+            memcpy(dst + u * app->elem_size, src + (mem_start + u * mem_stride) * app->elem_size, app->elem_size);
 
+    app->n_buf += n_elements;
+
+    return H5FNAL_SUCCESS;
+
+error:
     return H5FNAL_FAILURE;
-} /* end h5fnal_append_data() */
+} /* end buffer_elements() */
+
+/************************************************************************
+ * create_deferred_dset()
+ *
+ * Creates a deferred dataset now that we've seen some appends, then
+ * appends the buffered elements to it as usual.
+ *
+ * The chunk size is what the profile would give, rounded down to a
+ * whole number of the average append (if that is smaller) so that
+ * typical events don't straddle chunks.
+ ************************************************************************/
+static herr_t
+create_deferred_dset(h5fnal_appender_t *app)
+{
+    h5fnal_storage_profile_t profile = app->create_profile;
+    unsigned char *buf = NULL;
+    hsize_t n_buf;
+    hsize_t chunk_size;
+    hsize_t per_append;
+
+    if (0 == (chunk_size = h5fnal_get_profile_chunk_size(&profile, app->elem_size)))
+        H5FNAL_PROGRAM_ERROR("could not get chunk size");
+    if (app->n_appends > 0 && app->n_buf > 0) {
+        per_append = (app->n_buf + app->n_appends - 1) / app->n_appends;
+        if (per_append < chunk_size)
+            chunk_size -= chunk_size % per_append;
+    }
+    profile.chunk_size = chunk_size;
+    profile.chunk_bytes = 0;
+    profile.n_sample_appends = 0;
+
+    if (h5fnal_create_1D_dset(app->create_loc_id, app->create_name, app->tid, &profile, &(app->did)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create dataset");
+    *(app->create_did) = app->did;
+
+    free(app->create_name);
+    app->create_name = NULL;
+    app->create_did = NULL;
+    app->create_loc_id = H5FNAL_BAD_HID_T;
+
+    /* Append what we've been holding on to */
+    buf = app->buf;
+    n_buf = app->n_buf;
+    app->buf = NULL;
+    app->n_buf = 0;
+    app->buf_capacity = 0;
+    if (h5fnal_appender_append(app, n_buf, buf) < 0)
+        H5FNAL_PROGRAM_ERROR("could not append buffered data");
+    free(buf);
+
+    return H5FNAL_SUCCESS;
+
+error:
+    free(buf);
+
+    return H5FNAL_FAILURE;
+} /* end create_deferred_dset() */
+
+herr_t
+h5fnal_appender_append(h5fnal_appender_t *app, hsize_t n_elements, const void *data)
+{
+    return h5fnal_appender_append_strided(app, n_elements, 0, 1, data);
+} /* end h5fnal_appender_append() */
+
+/************************************************************************
+ * h5fnal_appender_append_strided()
+ *
+ * Appends n_elements to the end of the dataset. See
+ * h5fnal_append_strided_data() for mem_start and mem_stride.
+ *
+ * Buffered appenders only write whole chunks. The buffer is topped up
+ * to the next chunk boundary and written, then any whole chunks left
+ * in the caller's data are written straight from it and the rest is
+ * buffered. The data can be freed as soon as this returns.
+ ************************************************************************/
+herr_t
+h5fnal_appender_append_strided(h5fnal_appender_t *app, hsize_t n_elements, hsize_t mem_start, hsize_t mem_stride, const void *data)
+{
+    hsize_t n;
 
+    /* NOTE: no parameter check on data parameter to make it easier on higher-level code */
+
+    if (NULL == app)
+        H5FNAL_PROGRAM_ERROR("app parameter cannot be NULL");
+
+    /* Trivial case of no elements */
+    if (0 == n_elements)
+        return H5FNAL_SUCCESS;
+
+    if (0 == mem_stride)
+        H5FNAL_PROGRAM_ERROR("mem_stride parameter cannot be zero");
+
+    /* Hold on to the first appends until the dataset is created */
+    if (app->create_name) {
+        if (buffer_elements(app, n_elements, mem_start, mem_stride, data) < 0)
+            H5FNAL_PROGRAM_ERROR("could not buffer data");
+        if (++app->n_appends >= app->create_profile.n_sample_appends)
+            if (create_deferred_dset(app) < 0)
+                H5FNAL_PROGRAM_ERROR("could not create deferred dataset");
+        return H5FNAL_SUCCESS;
+    }
+
+    if (attach_appender(app) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get dataset dataspace");
+
+    if (!app->buffered) {
+        if (write_elements(app, n_elements, mem_start, mem_stride, data) < 0)
+            H5FNAL_PROGRAM_ERROR("could not write data");
+        return H5FNAL_SUCCESS;
+    }
+
+    /* Fill up to the next chunk boundary, if we're not on one */
+    if (app->n_buf > 0 || app->size % app->chunk_size) {
+        n = app->chunk_size - (app->size + app->n_buf) % app->chunk_size;
+        if (n > n_elements)
+            n = n_elements;
+        if (buffer_elements(app, n, mem_start, mem_stride, data) < 0)
+            H5FNAL_PROGRAM_ERROR("could not buffer data");
+        mem_start += n * mem_stride;
+        n_elements -= n;
+
+        if (0 == (app->size + app->n_buf) % app->chunk_size)
+            if (h5fnal_flush_appender(app) < 0)
+                H5FNAL_PROGRAM_ERROR("could not write buffered data");
+    }
+
+    /* Write whole chunks straight from the caller's buffer */
+    n = n_elements - n_elements % app->chunk_size;
+    if (n > 0) {
+        if (write_elements(app, n, mem_start, mem_stride, data) < 0)
+            H5FNAL_PROGRAM_ERROR("could not write data");
+        mem_start += n * mem_stride;
+        n_elements -= n;
+    }
+
+    /* Hang on to the rest */
+    if (n_elements > 0)
+        if (buffer_elements(app, n_elements, mem_start, mem_stride, data) < 0)
+            H5FNAL_PROGRAM_ERROR("could not buffer data");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_appender_append_strided() */
+
+/************************************************************************
+ * h5fnal_flush_appender()
+ *
+ * Writes out any buffered elements (and waits for any chunks that
+ * are being compressed). This can leave a partial chunk at the end
+ * of the dataset, so only call it when the data has to be in the
+ * file (before reading it back, at close, etc.).
+ ************************************************************************/
+herr_t
+h5fnal_flush_appender(h5fnal_appender_t *app)
+{
+    if (NULL == app)
+        H5FNAL_PROGRAM_ERROR("app parameter cannot be NULL");
+
+    /* The dataset has to exist once we're flushed */
+    if (app->create_name)
+        if (create_deferred_dset(app) < 0)
+            H5FNAL_PROGRAM_ERROR("could not create deferred dataset");
+
+    if (write_pending_chunks(app, 0) < 0)
+        H5FNAL_PROGRAM_ERROR("could not write compressed chunks");
+
+    if (0 == app->n_buf)
+        return H5FNAL_SUCCESS;
+
+    if (write_elements(app, app->n_buf, 0, 1, app->buf) < 0)
+        H5FNAL_PROGRAM_ERROR("could not write buffered data");
+    app->n_buf = 0;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_flush_appender() */
+
+/************************************************************************
+ * h5fnal_close_appender()
+ *
+ * Writes out any buffered elements and closes the cached dataspaces.
+ * Everything is released even if the write fails. The appender can
+ * be used again afterwards (it will just go back to the file for the
+ * size).
+ ************************************************************************/
+herr_t
+h5fnal_close_appender(h5fnal_appender_t *app)
+{
+    herr_t ret = H5FNAL_SUCCESS;
+
+    if (NULL == app)
+        H5FNAL_PROGRAM_ERROR("app parameter cannot be NULL");
+
+    if (h5fnal_flush_appender(app) < 0)
+        ret = H5FNAL_FAILURE;
+    discard_pending_chunks(app);
+
+    if (app->file_sid >= 0 && H5Sclose(app->file_sid) < 0)
+        ret = H5FNAL_FAILURE;
+    if (app->mem_sid >= 0 && H5Sclose(app->mem_sid) < 0)
+        ret = H5FNAL_FAILURE;
+
+    free(app->buf);
+    free(app->create_name);
+
+    app->file_sid = H5FNAL_BAD_HID_T;
+    app->mem_sid = H5FNAL_BAD_HID_T;
+    app->mem_size = 0;
+    app->buf = NULL;
+    app->n_buf = 0;
+    app->buf_capacity = 0;
+    app->direct = FALSE;
+    app->create_name = NULL;
+    app->create_did = NULL;
+
+    return ret;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_close_appender() */
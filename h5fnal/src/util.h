@@ -8,6 +8,68 @@
 
 #include "h5fnal.h"
 
+/* Appender for a 1D, unlimited dataset
+ *
+ * Caches the dataset's current size and the dataspaces used to write
+ * to it so that repeated appends to the same dataset don't have to
+ * query the dataset and build new dataspaces every time. The cache
+ * is only valid while all appends to the dataset go through the
+ * appender.
+ *
+ * A buffered appender is also a write-behind buffer: elements are
+ * held in memory and only written a whole chunk at a time, so each
+ * chunk is compressed once. The buffered tail is written when the
+ * appender is flushed or closed, and must be flushed before the
+ * dataset is read.
+ *
+ * The dataset and type IDs are borrowed, not owned. The file
+ * dataspace is fetched on the first append (or size query), so
+ * setting up an appender for a dataset that is only read costs
+ * nothing.
+ *
+ * An appender can also create its dataset (see
+ * h5fnal_appender_create_dset()). If the storage profile asks for
+ * it, the dataset isn't created until the first few appends have
+ * been seen, and the new dataset's ID is stored through the did
+ * pointer that was passed in (so that must stay put).
+ */
+typedef struct h5fnal_appender_t {
+    hid_t       did;
+    hid_t       tid;
+    hsize_t     size;           /* elements in the file              */
+    hsize_t     max_size;
+    hid_t       file_sid;       /* at the current dataset extent     */
+    hid_t       mem_sid;
+    hsize_t     mem_size;       /* extent of mem_sid                 */
+
+    /* Write-behind buffer (holds less than a chunk) */
+    hbool_t         buffered;
+    size_t          elem_size;  /* size of tid                       */
+    hsize_t         chunk_size; /* elements per chunk                */
+    unsigned char  *buf;
+    hsize_t         n_buf;      /* elements not yet in the file      */
+    hsize_t         buf_capacity;
+
+    /* Direct chunk writes (see h5fnal_set_direct_chunk_write()).
+     * Chunks being compressed, oldest first. They are written in
+     * that order.
+     */
+    hbool_t         direct;
+    int             deflate_level;
+    struct h5fnal_chunk_job_t  *pending_head;
+    struct h5fnal_chunk_job_t  *pending_tail;
+    hsize_t         n_pending;
+
+    /* Deferred dataset creation. Everything is buffered until the
+     * dataset exists (create_name is NULL once it does).
+     */
+    hid_t           create_loc_id;
+    char           *create_name;
+    h5fnal_storage_profile_t    create_profile;
+    hid_t          *create_did;
+    hsize_t         n_appends;  /* appends seen before creation      */
+} h5fnal_appender_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -16,14 +78,44 @@ extern "C" {
 herr_t h5fnal_add_string_attribute(hid_t loc_id, const char *name, const char *value);
 herr_t h5fnal_get_string_attribute(hid_t loc_id, const char *name, char **value);
 
+/* Set (creating if needed) and get attributes holding n doubles */
+herr_t h5fnal_set_double_attribute(hid_t loc_id, const char *name, hsize_t n, const double *values);
+herr_t h5fnal_get_double_attribute(hid_t loc_id, const char *name, hsize_t n, double *values);
+
+/* Add and get scalar unsigned attributes */
+herr_t h5fnal_add_uint_attribute(hid_t loc_id, const char *name, unsigned value);
+herr_t h5fnal_get_uint_attribute(hid_t loc_id, const char *name, unsigned *value);
+
 /* Get the size of a 1D dataset */
 hssize_t h5fnal_get_dset_size(hid_t did);
 
-/* Create an empty, chunked, 1D dataset */
-herr_t h5fnal_create_1D_dset(hid_t loc_id, const char *name, hid_t tid, hsize_t chunk_dim, /*OUT*/ hid_t *did);
+/* Read part of a 1D dataset */
+herr_t h5fnal_read_dset_range(hid_t did, hid_t tid, hsize_t start, hsize_t count, void *buf);
+
+/* Create an empty, chunked, 1D dataset (NULL profile for the default) */
+herr_t h5fnal_create_1D_dset(hid_t loc_id, const char *name, hid_t tid, const h5fnal_storage_profile_t *profile, /*OUT*/ hid_t *did);
+
+/* Grow a caller-owned buffer so it holds at least n elements */
+herr_t h5fnal_reserve_buffer(void **buf, hsize_t *capacity, hsize_t n, size_t elem_size);
 
 /* Append data to a 1D dataset */
 herr_t h5fnal_append_data(hid_t did, hid_t tid, hsize_t n_elements, const void *data);
+herr_t h5fnal_append_strided_data(hid_t did, hid_t tid, hsize_t n_elements, hsize_t mem_start, hsize_t mem_stride, const void *data);
+
+/* Shuffle and deflate whole chunks in h5fnal and write them with
+ * H5Dwrite_chunk() instead of going through the filter pipeline
+ */
+void h5fnal_set_direct_chunk_write(hbool_t enable);
+hbool_t h5fnal_get_direct_chunk_write(void);
+
+/* Append data through an appender */
+void h5fnal_init_appender(h5fnal_appender_t *app, hid_t did, hid_t tid, hbool_t buffered);
+herr_t h5fnal_appender_create_dset(h5fnal_appender_t *app, hid_t loc_id, const char *name, const h5fnal_storage_profile_t *profile, /*OUT*/ hid_t *did);
+hssize_t h5fnal_get_appender_size(h5fnal_appender_t *app);
+herr_t h5fnal_appender_append(h5fnal_appender_t *app, hsize_t n_elements, const void *data);
+herr_t h5fnal_appender_append_strided(h5fnal_appender_t *app, hsize_t n_elements, hsize_t mem_start, hsize_t mem_stride, const void *data);
+herr_t h5fnal_flush_appender(h5fnal_appender_t *app);
+herr_t h5fnal_close_appender(h5fnal_appender_t *app);
 
 #ifdef __cplusplus
 }
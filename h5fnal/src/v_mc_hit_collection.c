@@ -14,38 +14,82 @@
 #define H5FNAL_HITCOLL_DATASET_NAME     "hit_collections"
 
 
+/* Attribute that records how the hits are stored */
+#define H5FNAL_HIT_LAYOUT_ATTR_NAME     "hit layout"
+#define H5FNAL_HIT_LAYOUT_COMPOUND_NAME "compound"
+#define H5FNAL_HIT_LAYOUT_COLUMNAR_NAME "columnar"
+
+/* Event table slots */
+#define HIT_EVENT_HITS                  0
+#define HIT_EVENT_HITCOLLS              1
+
+/* The MCHit fields, in h5fnal_hit_t order (entry i goes with the
+ * field flag 1 << i). These are the compound member names and, in the
+ * columnar layout, the dataset names.
+ */
+typedef struct hit_field_t {
+    const char *name;
+    size_t      offset;
+    hbool_t     is_int;
+} hit_field_t;
+
+static const hit_field_t hit_fields[H5FNAL_HIT_N_FIELDS] = {
+    {"fSignalTime",     HOFFSET(h5fnal_hit_t, signal_time),     FALSE},
+    {"fSignalWidth",    HOFFSET(h5fnal_hit_t, signal_width),    FALSE},
+    {"fPeakAmp",        HOFFSET(h5fnal_hit_t, peak_amp),        FALSE},
+    {"fCharge",         HOFFSET(h5fnal_hit_t, charge),          FALSE},
+    {"fPartVertexX",    HOFFSET(h5fnal_hit_t, part_vertex_x),   FALSE},
+    {"fPartVertexY",    HOFFSET(h5fnal_hit_t, part_vertex_y),   FALSE},
+    {"fPartVertexZ",    HOFFSET(h5fnal_hit_t, part_vertex_z),   FALSE},
+    {"fPartEnergy",     HOFFSET(h5fnal_hit_t, part_energy),     FALSE},
+    {"fTrackId",        HOFFSET(h5fnal_hit_t, part_track_id),   TRUE}
+};
+
+#define HIT_FIELD_TYPE(f)   ((f)->is_int ? H5T_NATIVE_INT : H5T_NATIVE_FLOAT)
+
+/* Every field is 4 bytes, so an h5fnal_hit_t array can be treated as
+ * an array of 4-byte slots and a single field selected with a strided
+ * hyperslab. This lets the columnar code read and write the fields
+ * in place.
+ */
+#define HIT_FIELD_SIZE      4
+#define HIT_N_SLOTS         (sizeof(h5fnal_hit_t) / HIT_FIELD_SIZE)
+
+/* An append queued for the writer thread, with its own copy of the
+ * data
+ */
+typedef struct hits_job_t {
+    h5fnal_async_job_t          job;
+    h5fnal_vect_hitcoll_t      *vector;
+    hbool_t                     for_event;
+    uint32_t                    run;
+    uint32_t                    subrun;
+    uint32_t                    event;
+    h5fnal_vect_hitcoll_data_t  data;
+} hits_job_t;
+
+static herr_t append_hits_for_event(h5fnal_vect_hitcoll_t *vector, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_vect_hitcoll_data_t *data);
+
+
 /************************************************************************
- * h5fnal_create_hit_type()
+ * create_hit_mem_type()
  *
- * Creates and returns an HDF5 compound datatype that represents an MCHit.
- * The fields correspond directly to the internal data stored in an MCHit.
+ * Creates an h5fnal_hit_t-sized compound that only contains the
+ * fields selected in the flags. Used for partial compound reads.
  ************************************************************************/
-hid_t
-h5fnal_create_hit_type(void)
+static hid_t
+create_hit_mem_type(unsigned fields)
 {
     hid_t tid = H5FNAL_BAD_HID_T;
+    unsigned u;
 
     if ((tid = H5Tcreate(H5T_COMPOUND, sizeof(h5fnal_hit_t))) < 0)
         H5FNAL_HDF5_ERROR;
 
-    if (H5Tinsert(tid, "fSignalTime", HOFFSET(h5fnal_hit_t, signal_time), H5T_NATIVE_FLOAT) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Tinsert(tid, "fSignalWidth", HOFFSET(h5fnal_hit_t, signal_width), H5T_NATIVE_FLOAT) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Tinsert(tid, "fPeakAmp", HOFFSET(h5fnal_hit_t, peak_amp), H5T_NATIVE_FLOAT) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Tinsert(tid, "fCharge", HOFFSET(h5fnal_hit_t, charge), H5T_NATIVE_FLOAT) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Tinsert(tid, "fPartVertexX", HOFFSET(h5fnal_hit_t, part_vertex_x), H5T_NATIVE_FLOAT) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Tinsert(tid, "fPartVertexY", HOFFSET(h5fnal_hit_t, part_vertex_y), H5T_NATIVE_FLOAT) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Tinsert(tid, "fPartVertexZ", HOFFSET(h5fnal_hit_t, part_vertex_z), H5T_NATIVE_FLOAT) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Tinsert(tid, "fPartEnergy", HOFFSET(h5fnal_hit_t, part_energy), H5T_NATIVE_FLOAT) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Tinsert(tid, "fTrackId", HOFFSET(h5fnal_hit_t, part_track_id), H5T_NATIVE_INT) < 0)
-        H5FNAL_HDF5_ERROR;
+    for (u = 0; u < H5FNAL_HIT_N_FIELDS; u++)
+        if (fields & (1u << u))
+            if (H5Tinsert(tid, hit_fields[u].name, hit_fields[u].offset, HIT_FIELD_TYPE(&hit_fields[u])) < 0)
+                H5FNAL_HDF5_ERROR;
 
     return tid;
 
@@ -55,6 +99,19 @@ error:
     } H5E_END_TRY;
 
     return H5FNAL_BAD_HID_T;
+} /* end create_hit_mem_type() */
+
+
+/************************************************************************
+ * h5fnal_create_hit_type()
+ *
+ * Creates and returns an HDF5 compound datatype that represents an MCHit.
+ * The fields correspond directly to the internal data stored in an MCHit.
+ ************************************************************************/
+hid_t
+h5fnal_create_hit_type(void)
+{
+    return create_hit_mem_type(H5FNAL_HIT_ALL_FIELDS);
 } /* h5fnal_create_hit_type */
 
 
@@ -92,6 +149,60 @@ error:
 } /* h5fnal_create_hitcoll_type */
 
 
+/************************************************************************
+ * free_channel_index()
+ ************************************************************************/
+static void
+free_channel_index(h5fnal_vect_hitcoll_t *vector)
+{
+    free(vector->channel_index);
+    vector->channel_index = NULL;
+    vector->n_channel_index = 0;
+
+    return;
+} /* end free_channel_index() */
+
+
+/************************************************************************
+ * init_appenders()
+ *
+ * Points the appenders at the vector's current dataset IDs.
+ ************************************************************************/
+static void
+init_appenders(h5fnal_vect_hitcoll_t *vector)
+{
+    unsigned u;
+
+    h5fnal_init_appender(&(vector->hit_app), vector->hit_dset_id, vector->hit_dtype_id, TRUE);
+    h5fnal_init_appender(&(vector->hitcoll_app), vector->hitcoll_dset_id, vector->hitcoll_dtype_id, TRUE);
+    for (u = 0; u < H5FNAL_HIT_N_FIELDS; u++)
+        h5fnal_init_appender(&(vector->hit_field_apps[u]), vector->hit_field_dset_ids[u], HIT_FIELD_TYPE(&hit_fields[u]), TRUE);
+
+    return;
+} /* end init_appenders() */
+
+
+/************************************************************************
+ * close_appenders()
+ ************************************************************************/
+static herr_t
+close_appenders(h5fnal_vect_hitcoll_t *vector)
+{
+    herr_t ret = H5FNAL_SUCCESS;
+    unsigned u;
+
+    if (h5fnal_close_appender(&(vector->hit_app)) < 0)
+        ret = H5FNAL_FAILURE;
+    if (h5fnal_close_appender(&(vector->hitcoll_app)) < 0)
+        ret = H5FNAL_FAILURE;
+    for (u = 0; u < H5FNAL_HIT_N_FIELDS; u++)
+        if (h5fnal_close_appender(&(vector->hit_field_apps[u])) < 0)
+            ret = H5FNAL_FAILURE;
+
+    return ret;
+} /* end close_appenders() */
+
+
 /************************************************************************
  * h5fnal_close_vector_on_err()
  *
@@ -103,8 +214,14 @@ error:
 static void
 h5fnal_close_vector_on_err(h5fnal_vect_hitcoll_t *vector)
 {
+    unsigned u;
+
     if (vector) {
         H5E_BEGIN_TRY {
+            close_appenders(vector);
+            h5fnal_close_event_table(&(vector->events));
+            for (u = 0; u < H5FNAL_HIT_N_FIELDS; u++)
+                H5Dclose(vector->hit_field_dset_ids[u]);
             H5Dclose(vector->hit_dset_id);
             H5Tclose(vector->hit_dtype_id);
             H5Dclose(vector->hitcoll_dset_id);
@@ -117,6 +234,10 @@ h5fnal_close_vector_on_err(h5fnal_vect_hitcoll_t *vector)
         vector->hitcoll_dset_id     = H5FNAL_BAD_HID_T;
         vector->hitcoll_dtype_id    = H5FNAL_BAD_HID_T;
         vector->top_level_group_id  = H5FNAL_BAD_HID_T;
+        for (u = 0; u < H5FNAL_HIT_N_FIELDS; u++)
+            vector->hit_field_dset_ids[u] = H5FNAL_BAD_HID_T;
+
+        free_channel_index(vector);
     }
 
     return;
@@ -125,15 +246,27 @@ h5fnal_close_vector_on_err(h5fnal_vect_hitcoll_t *vector)
 
 /************************************************************************
  * h5fnal_create_v_mc_hit_collection()
+ *
+ * Creates a data product that uses the (default) compound hit layout.
  ************************************************************************/
 herr_t
-h5fnal_create_v_mc_hit_collection(hid_t loc_id, const char *name, h5fnal_vect_hitcoll_t *vector)
+h5fnal_create_v_mc_hit_collection(hid_t loc_id, const char *name, const h5fnal_storage_profile_t *profile, h5fnal_vect_hitcoll_t *vector)
 {
-    hid_t dcpl_id = -1;
-    hid_t sid = -1;
-    hsize_t chunk_dims[1];
-    hsize_t init_dims[1];
-    hsize_t max_dims[1];
+    return h5fnal_create_v_mc_hit_collection_with_layout(loc_id, name, H5FNAL_HIT_LAYOUT_COMPOUND, profile, vector);
+} /* end h5fnal_create_v_mc_hit_collection() */
+
+
+/************************************************************************
+ * h5fnal_create_v_mc_hit_collection_with_layout()
+ ************************************************************************/
+herr_t
+h5fnal_create_v_mc_hit_collection_with_layout(hid_t loc_id, const char *name, h5fnal_hit_layout_t layout, const h5fnal_storage_profile_t *profile, h5fnal_vect_hitcoll_t *vector)
+{
+    const h5fnal_product_types_t *types = NULL;
+    const char *layout_name = NULL;
+    unsigned u;
+
+    h5fnal_drain_async_writes();
 
     if (loc_id < 0)
         H5FNAL_PROGRAM_ERROR("invalid loc_id parameter");
@@ -141,74 +274,83 @@ h5fnal_create_v_mc_hit_collection(hid_t loc_id, const char *name, h5fnal_vect_hi
         H5FNAL_PROGRAM_ERROR("name parameter cannot be NULL");
     if (NULL == vector)
         H5FNAL_PROGRAM_ERROR("vector parameter cannot be NULL");
+    if (H5FNAL_HIT_LAYOUT_COMPOUND == layout)
+        layout_name = H5FNAL_HIT_LAYOUT_COMPOUND_NAME;
+    else if (H5FNAL_HIT_LAYOUT_COLUMNAR == layout)
+        layout_name = H5FNAL_HIT_LAYOUT_COLUMNAR_NAME;
+    else
+        H5FNAL_PROGRAM_ERROR("invalid layout parameter");
 
     /* Initialize the data product struct */
     memset(vector, 0, sizeof(h5fnal_vect_hitcoll_t));
+    vector->layout = layout;
+    vector->hit_dset_id = H5FNAL_BAD_HID_T;
+    for (u = 0; u < H5FNAL_HIT_N_FIELDS; u++)
+        vector->hit_field_dset_ids[u] = H5FNAL_BAD_HID_T;
+    init_appenders(vector);
+    h5fnal_init_event_table(&(vector->events));
 
     /* Create top-level group */
     if ((vector->top_level_group_id = H5Gcreate2(loc_id, name, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT)) < 0)
         H5FNAL_HDF5_ERROR;
 
-    /* Create the dataset creation property list */
-    if ((dcpl_id = H5Pcreate(H5P_DATASET_CREATE)) < 0)
-        H5FNAL_HDF5_ERROR;
-
-    /* Set up chunking (size is arbitrary for now) */
-    chunk_dims[0] = 1024;
-    if (H5Pset_chunk(dcpl_id, 1, chunk_dims) < 0)
-        H5FNAL_HDF5_ERROR;
+    /* Record the hit layout */
+    if (h5fnal_add_string_attribute(vector->top_level_group_id, H5FNAL_HIT_LAYOUT_ATTR_NAME, layout_name) < 0)
+        H5FNAL_PROGRAM_ERROR("could not add hit layout attribute");
 
-    /* Turn on compession */
-    if (H5Pset_shuffle(dcpl_id) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Pset_deflate(dcpl_id, 6) < 0)
-        H5FNAL_HDF5_ERROR;
+    /* Set up the (empty) event table */
+    if (h5fnal_open_event_table(vector->top_level_group_id, &(vector->events)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not set up event table");
 
-    /* Create the dataspace (set of points describing the data size, etc.) */
-    init_dims[0] = 0;
-    max_dims[0] = H5S_UNLIMITED;
-    if ((sid = H5Screate_simple(1, init_dims, max_dims)) < 0)
-        H5FNAL_HDF5_ERROR;
-
-    /* Create datatypes */
-    if ((vector->hit_dtype_id = h5fnal_create_hit_type()) < 0)
+    /* Share the library's in-memory datatypes */
+    if (NULL == (types = h5fnal_get_product_types()))
+        H5FNAL_PROGRAM_ERROR("could not get product datatypes");
+    if ((vector->hit_dtype_id = h5fnal_share_type(types->hit_dtype_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create hit datatype");
-    if ((vector->hitcoll_dtype_id = h5fnal_create_hitcoll_type()) < 0)
+    if ((vector->hitcoll_dtype_id = h5fnal_share_type(types->hitcoll_dtype_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create hitcoll datatype");
 
-    /* Create datasets */
-    if ((vector->hit_dset_id = H5Dcreate2(vector->top_level_group_id, H5FNAL_HIT_DATASET_NAME, vector->hit_dtype_id, sid, H5P_DEFAULT, dcpl_id, H5P_DEFAULT)) < 0)
-        H5FNAL_HDF5_ERROR;
-    if ((vector->hitcoll_dset_id = H5Dcreate2(vector->top_level_group_id, H5FNAL_HITCOLL_DATASET_NAME, vector->hitcoll_dtype_id, sid, H5P_DEFAULT, dcpl_id, H5P_DEFAULT)) < 0)
-        H5FNAL_HDF5_ERROR;
-
-    /* close everything */
-    if (H5Pclose(dcpl_id) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Sclose(sid) < 0)
-        H5FNAL_HDF5_ERROR;
+    /* Create datasets (the appenders create them, as the storage
+     * profile says, and may put that off until the first appends)
+     */
+    init_appenders(vector);
+    if (H5FNAL_HIT_LAYOUT_COLUMNAR == layout) {
+        for (u = 0; u < H5FNAL_HIT_N_FIELDS; u++)
+            if (h5fnal_appender_create_dset(&(vector->hit_field_apps[u]), vector->top_level_group_id, hit_fields[u].name, profile, &(vector->hit_field_dset_ids[u])) < 0)
+                H5FNAL_PROGRAM_ERROR("could not create hit field dataset");
+    }
+    else {
+        if (h5fnal_appender_create_dset(&(vector->hit_app), vector->top_level_group_id, H5FNAL_HIT_DATASET_NAME, profile, &(vector->hit_dset_id)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not create hit dataset");
+    }
+    if (h5fnal_appender_create_dset(&(vector->hitcoll_app), vector->top_level_group_id, H5FNAL_HITCOLL_DATASET_NAME, profile, &(vector->hitcoll_dset_id)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create hitcoll dataset");
 
     return H5FNAL_SUCCESS;
 
 error:
-    H5E_BEGIN_TRY {
-        H5Sclose(sid);
-        H5Pclose(dcpl_id);
-    } H5E_END_TRY;
-
     if (vector)
         h5fnal_close_vector_on_err(vector);
 
     return H5FNAL_FAILURE;
-} /* end h5fnal_create_v_mc_hit_collection() */
+} /* end h5fnal_create_v_mc_hit_collection_with_layout() */
 
 
 /************************************************************************
- * h5fnal_open_v_mc_hit_collection()
+ * h5fnal_open_v_mc_hit_collection_with_types()
+ *
+ * Same as h5fnal_open_v_mc_hit_collection(), but shares the datatypes
+ * in types (if not NULL) instead of the library's.
  ************************************************************************/
 herr_t
-h5fnal_open_v_mc_hit_collection(hid_t loc_id, const char *name, h5fnal_vect_hitcoll_t *vector)
+h5fnal_open_v_mc_hit_collection_with_types(hid_t loc_id, const char *name, const h5fnal_product_types_t *types, h5fnal_vect_hitcoll_t *vector)
 {
+    char *layout_name = NULL;
+    htri_t exists;
+    unsigned u;
+
+    h5fnal_drain_async_writes();
+
     if (loc_id < 0)
         H5FNAL_PROGRAM_ERROR("invalid loc_id parameter");
     if (NULL == name)
@@ -218,30 +360,78 @@ h5fnal_open_v_mc_hit_collection(hid_t loc_id, const char *name, h5fnal_vect_hitc
 
     /* Initialize the data product struct */
     memset(vector, 0, sizeof(h5fnal_vect_hitcoll_t));
+    vector->hit_dset_id = H5FNAL_BAD_HID_T;
+    for (u = 0; u < H5FNAL_HIT_N_FIELDS; u++)
+        vector->hit_field_dset_ids[u] = H5FNAL_BAD_HID_T;
+    init_appenders(vector);
+    h5fnal_init_event_table(&(vector->events));
 
     /* Open top-level group */
     if ((vector->top_level_group_id = H5Gopen2(loc_id, name, H5P_DEFAULT)) < 0)
         H5FNAL_HDF5_ERROR;
 
-    /* Create datatypes */
-    if ((vector->hit_dtype_id = h5fnal_create_hit_type()) < 0)
+    /* Get the hit layout (files without the attribute are compound) */
+    vector->layout = H5FNAL_HIT_LAYOUT_COMPOUND;
+    if ((exists = H5Aexists(vector->top_level_group_id, H5FNAL_HIT_LAYOUT_ATTR_NAME)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (exists) {
+        if (h5fnal_get_string_attribute(vector->top_level_group_id, H5FNAL_HIT_LAYOUT_ATTR_NAME, &layout_name) < 0)
+            H5FNAL_PROGRAM_ERROR("could not get hit layout attribute");
+        if (!strcmp(layout_name, H5FNAL_HIT_LAYOUT_COLUMNAR_NAME))
+            vector->layout = H5FNAL_HIT_LAYOUT_COLUMNAR;
+        else if (strcmp(layout_name, H5FNAL_HIT_LAYOUT_COMPOUND_NAME))
+            H5FNAL_PROGRAM_ERROR("unknown hit layout");
+        free(layout_name);
+        layout_name = NULL;
+    }
+
+    /* Share the in-memory datatypes (the library's, unless the
+     * caller passed its own)
+     */
+    if (NULL == types && NULL == (types = h5fnal_get_product_types()))
+        H5FNAL_PROGRAM_ERROR("could not get product datatypes");
+    if ((vector->hit_dtype_id = h5fnal_share_type(types->hit_dtype_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create hit datatype");
-    if ((vector->hitcoll_dtype_id = h5fnal_create_hitcoll_type()) < 0)
+    if ((vector->hitcoll_dtype_id = h5fnal_share_type(types->hitcoll_dtype_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create hitcoll datatype");
 
     /* Open datasets */
-    if ((vector->hit_dset_id = H5Dopen2(vector->top_level_group_id, H5FNAL_HIT_DATASET_NAME, H5P_DEFAULT)) < 0)
-        H5FNAL_HDF5_ERROR;
+    if (H5FNAL_HIT_LAYOUT_COLUMNAR == vector->layout) {
+        for (u = 0; u < H5FNAL_HIT_N_FIELDS; u++)
+            if ((vector->hit_field_dset_ids[u] = H5Dopen2(vector->top_level_group_id, hit_fields[u].name, H5P_DEFAULT)) < 0)
+                H5FNAL_HDF5_ERROR;
+    }
+    else {
+        if ((vector->hit_dset_id = H5Dopen2(vector->top_level_group_id, H5FNAL_HIT_DATASET_NAME, H5P_DEFAULT)) < 0)
+            H5FNAL_HDF5_ERROR;
+    }
     if ((vector->hitcoll_dset_id = H5Dopen2(vector->top_level_group_id, H5FNAL_HITCOLL_DATASET_NAME, H5P_DEFAULT)) < 0)
         H5FNAL_HDF5_ERROR;
+    init_appenders(vector);
+
+    /* Load the event table, if there is one */
+    if (h5fnal_open_event_table(vector->top_level_group_id, &(vector->events)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not open event table");
 
     return H5FNAL_SUCCESS;
 
 error:
+    free(layout_name);
+
     if (vector)
         h5fnal_close_vector_on_err(vector);
 
     return H5FNAL_FAILURE;
+} /* end h5fnal_open_v_mc_hit_collection_with_types() */
+
+
+/************************************************************************
+ * h5fnal_open_v_mc_hit_collection()
+ ************************************************************************/
+herr_t
+h5fnal_open_v_mc_hit_collection(hid_t loc_id, const char *name, h5fnal_vect_hitcoll_t *vector)
+{
+    return h5fnal_open_v_mc_hit_collection_with_types(loc_id, name, NULL, vector);
 } /* end h5fnal_open_v_mc_hit_collection() */
 
 
@@ -251,11 +441,29 @@ error:
 herr_t
 h5fnal_close_v_mc_hit_collection(h5fnal_vect_hitcoll_t *vector)
 {
+    unsigned u;
+
+    h5fnal_drain_async_writes();
+
     if (NULL == vector)
         H5FNAL_PROGRAM_ERROR("vector parameter cannot be NULL")
 
-    if (H5Dclose(vector->hit_dset_id) < 0)
-        H5FNAL_HDF5_ERROR;
+    if (close_appenders(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close appenders");
+    if (h5fnal_close_event_table(&(vector->events)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close event table");
+
+    if (H5FNAL_HIT_LAYOUT_COLUMNAR == vector->layout) {
+        for (u = 0; u < H5FNAL_HIT_N_FIELDS; u++) {
+            if (H5Dclose(vector->hit_field_dset_ids[u]) < 0)
+                H5FNAL_HDF5_ERROR;
+            vector->hit_field_dset_ids[u] = H5FNAL_BAD_HID_T;
+        }
+    }
+    else {
+        if (H5Dclose(vector->hit_dset_id) < 0)
+            H5FNAL_HDF5_ERROR;
+    }
     if (H5Tclose(vector->hit_dtype_id) < 0)
         H5FNAL_HDF5_ERROR;
     if (H5Dclose(vector->hitcoll_dset_id) < 0)
@@ -271,6 +479,8 @@ h5fnal_close_v_mc_hit_collection(h5fnal_vect_hitcoll_t *vector)
     vector->hitcoll_dtype_id    = H5FNAL_BAD_HID_T;
     vector->top_level_group_id  = H5FNAL_BAD_HID_T;
 
+    free_channel_index(vector);
+
     return H5FNAL_SUCCESS;
 
 error:
@@ -282,19 +492,269 @@ error:
 
 
 /************************************************************************
- * h5fnal_append_hits()
+ * hits_dset_id()
+ *
+ * Returns a dataset that has one element per stored hit.
+ ************************************************************************/
+static hid_t
+hits_dset_id(const h5fnal_vect_hitcoll_t *vector)
+{
+    if (H5FNAL_HIT_LAYOUT_COLUMNAR == vector->layout)
+        return vector->hit_field_dset_ids[0];
+    else
+        return vector->hit_dset_id;
+} /* end hits_dset_id() */
+
+
+/************************************************************************
+ * hits_appender()
+ *
+ * Returns the appender for hits_dset_id().
+ ************************************************************************/
+static h5fnal_appender_t *
+hits_appender(h5fnal_vect_hitcoll_t *vector)
+{
+    if (H5FNAL_HIT_LAYOUT_COLUMNAR == vector->layout)
+        return &(vector->hit_field_apps[0]);
+    else
+        return &(vector->hit_app);
+} /* end hits_appender() */
+
+
+/************************************************************************
+ * read_hits()
+ *
+ * Reads the selected hit fields of the n_hits hits selected in
+ * file_sid (which may be H5S_ALL) into hits. Fields that are not
+ * read are left alone.
+ *
+ * With the columnar layout, only the datasets for the selected fields
+ * are touched. With the compound layout the whole hit chunks still
+ * have to be read and decompressed, but only the selected fields are
+ * converted.
+ ************************************************************************/
+static herr_t
+read_hits(h5fnal_vect_hitcoll_t *vector, unsigned fields, hid_t file_sid, hsize_t n_hits, h5fnal_hit_t *hits)
+{
+    hid_t       mem_sid = H5FNAL_BAD_HID_T;
+    hid_t       mem_tid = H5FNAL_BAD_HID_T;
+    hsize_t     dims[1];
+    hsize_t     start[1];
+    hsize_t     stride[1];
+    hsize_t     count[1];
+    unsigned    u;
+
+    if (0 == n_hits || 0 == fields)
+        return H5FNAL_SUCCESS;
+
+    if (H5FNAL_HIT_LAYOUT_COLUMNAR == vector->layout) {
+        /* Read each requested column straight into the hit structs */
+        dims[0] = n_hits * HIT_N_SLOTS;
+        if ((mem_sid = H5Screate_simple(1, dims, NULL)) < 0)
+            H5FNAL_HDF5_ERROR;
+        stride[0] = HIT_N_SLOTS;
+        count[0] = n_hits;
+        for (u = 0; u < H5FNAL_HIT_N_FIELDS; u++) {
+            if (!(fields & (1u << u)))
+                continue;
+            start[0] = hit_fields[u].offset / HIT_FIELD_SIZE;
+            if (H5Sselect_hyperslab(mem_sid, H5S_SELECT_SET, start, stride, count, NULL) < 0)
+                H5FNAL_HDF5_ERROR;
+            if (H5Dread(vector->hit_field_dset_ids[u], HIT_FIELD_TYPE(&hit_fields[u]), mem_sid, file_sid, H5P_DEFAULT, hits) < 0)
+                H5FNAL_HDF5_ERROR;
+        }
+    }
+    else {
+        if (H5S_ALL != file_sid) {
+            dims[0] = n_hits;
+            if ((mem_sid = H5Screate_simple(1, dims, NULL)) < 0)
+                H5FNAL_HDF5_ERROR;
+        }
+        else
+            mem_sid = H5S_ALL;
+
+        if (H5FNAL_HIT_ALL_FIELDS == fields) {
+            if (H5Dread(vector->hit_dset_id, vector->hit_dtype_id, mem_sid, file_sid, H5P_DEFAULT, hits) < 0)
+                H5FNAL_HDF5_ERROR;
+        }
+        else {
+            if ((mem_tid = create_hit_mem_type(fields)) < 0)
+                H5FNAL_PROGRAM_ERROR("could not create hit datatype");
+            if (H5Dread(vector->hit_dset_id, mem_tid, mem_sid, file_sid, H5P_DEFAULT, hits) < 0)
+                H5FNAL_HDF5_ERROR;
+            if (H5Tclose(mem_tid) < 0)
+                H5FNAL_HDF5_ERROR;
+        }
+    }
+
+    if (H5S_ALL != mem_sid && H5Sclose(mem_sid) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        if (H5S_ALL != mem_sid)
+            H5Sclose(mem_sid);
+        H5Tclose(mem_tid);
+    } H5E_END_TRY;
+
+    return H5FNAL_FAILURE;
+} /* end read_hits() */
+
+
+/************************************************************************
+ * compare_hitcoll_channels()
+ *
+ * qsort() callback that orders hit collections by channel and then
+ * by position in the hits dataset.
+ ************************************************************************/
+static int
+compare_hitcoll_channels(const void *_a, const void *_b)
+{
+    const h5fnal_hitcoll_t *a = (const h5fnal_hitcoll_t *)_a;
+    const h5fnal_hitcoll_t *b = (const h5fnal_hitcoll_t *)_b;
+
+    if (a->channel != b->channel)
+        return a->channel < b->channel ? -1 : 1;
+    if (a->start != b->start)
+        return a->start < b->start ? -1 : 1;
+    return 0;
+} /* end compare_hitcoll_channels() */
+
+
+/* A run of contiguous hits to read for h5fnal_read_hits_for_channels() */
+typedef struct hit_run_t {
+    hsize_t     file_start;     /* first hit in the hits dataset    */
+    hsize_t     count;          /* number of hits                   */
+    hsize_t     mem_start;      /* first hit in the output buffer   */
+} hit_run_t;
+
+
+/************************************************************************
+ * compare_hit_runs()
+ *
+ * qsort() callback that orders hit runs by position in the hits
+ * dataset.
+ ************************************************************************/
+static int
+compare_hit_runs(const void *_a, const void *_b)
+{
+    const hit_run_t *a = (const hit_run_t *)_a;
+    const hit_run_t *b = (const hit_run_t *)_b;
+
+    if (a->file_start != b->file_start)
+        return a->file_start < b->file_start ? -1 : 1;
+    return 0;
+} /* end compare_hit_runs() */
+
+
+/************************************************************************
+ * build_channel_index()
+ *
+ * Reads the hit collections and sorts them by channel, if that hasn't
+ * already been done.
+ ************************************************************************/
+static herr_t
+build_channel_index(h5fnal_vect_hitcoll_t *vector)
+{
+    hssize_t n;
+
+    if (vector->channel_index)
+        return H5FNAL_SUCCESS;
+
+    if ((n = h5fnal_get_dset_size(vector->hitcoll_dset_id)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get size of hit collections dataset");
+    if (NULL == (vector->channel_index = (h5fnal_hitcoll_t *)malloc(((size_t)n + 1) * sizeof(h5fnal_hitcoll_t))))
+        H5FNAL_PROGRAM_ERROR("could not allocate memory for channel index");
+    vector->n_channel_index = (hsize_t)n;
+
+    if (n > 0) {
+        if (H5Dread(vector->hitcoll_dset_id, vector->hitcoll_dtype_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, vector->channel_index) < 0)
+            H5FNAL_HDF5_ERROR;
+        qsort(vector->channel_index, (size_t)n, sizeof(h5fnal_hitcoll_t), compare_hitcoll_channels);
+    }
+
+    return H5FNAL_SUCCESS;
+
+error:
+    free_channel_index(vector);
+
+    return H5FNAL_FAILURE;
+} /* end build_channel_index() */
+
+
+/************************************************************************
+ * find_channel()
+ *
+ * Returns the position of the first channel index entry for channel
+ * (or where it would go if it is not there).
+ ************************************************************************/
+static hsize_t
+find_channel(const h5fnal_vect_hitcoll_t *vector, unsigned channel)
+{
+    hsize_t lo = 0;
+    hsize_t hi = vector->n_channel_index;
+
+    while (lo < hi) {
+        hsize_t mid = lo + (hi - lo) / 2;
+
+        if (vector->channel_index[mid].channel < channel)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+} /* end find_channel() */
+
+
+/************************************************************************
+ * h5fnal_flush_v_mc_hit_collection()
+ *
+ * Writes out any hits and hit collections still in the append
+ * buffers. Reads do this themselves.
  ************************************************************************/
 herr_t
-h5fnal_append_hits(h5fnal_vect_hitcoll_t *vector, h5fnal_vect_hitcoll_data_t *data)
+h5fnal_flush_v_mc_hit_collection(h5fnal_vect_hitcoll_t *vector)
 {
-    hid_t       sid     = H5FNAL_BAD_HID_T;
-    hsize_t     offset;
-    hsize_t     u;
+    unsigned u;
+
+    h5fnal_drain_async_writes();
 
     if (NULL == vector)
         H5FNAL_PROGRAM_ERROR("vector parameter cannot be NULL");
-    if (NULL == data)
-        H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL");
+
+    if (h5fnal_flush_appender(&(vector->hit_app)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush hit data");
+    for (u = 0; u < H5FNAL_HIT_N_FIELDS; u++)
+        if (h5fnal_flush_appender(&(vector->hit_field_apps[u])) < 0)
+            H5FNAL_PROGRAM_ERROR("could not flush hit field data");
+    if (h5fnal_flush_appender(&(vector->hitcoll_app)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush hit collection data");
+    if (h5fnal_flush_event_table(&(vector->events)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush event table");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_flush_v_mc_hit_collection() */
+
+
+/************************************************************************
+ * append_hits()
+ *
+ * Does the work of h5fnal_append_hits(), on the calling thread.
+ ************************************************************************/
+static herr_t
+append_hits(h5fnal_vect_hitcoll_t *vector, h5fnal_vect_hitcoll_data_t *data)
+{
+    hssize_t    offset;
+    hsize_t     u;
+
+    /* The channel index won't cover the new hit collections */
+    free_channel_index(vector);
 
     /* Hit collection fixup.
      *
@@ -302,30 +762,128 @@ h5fnal_append_hits(h5fnal_vect_hitcoll_t *vector, h5fnal_vect_hitcoll_data_t *da
      * the 'start' references in the incoming data will have to be
      * modified so that they refer to the correct elements in the dataset. 
      */
-    if ((sid = H5Dget_space(vector->hit_dset_id)) < 0)
-        H5FNAL_HDF5_ERROR;
-    if ((offset = H5Sget_simple_extent_npoints(sid)) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Sclose(sid) < 0)
-        H5FNAL_HDF5_ERROR;
+    if ((offset = h5fnal_get_appender_size(hits_appender(vector))) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get size of hits dataset");
     if (offset > 0)
         for (u = 0; u < data->n_hit_collections; u++)
             if (data->hit_collections[u].count > 0)
-                data->hit_collections[u].start += offset;
+                data->hit_collections[u].start += (hsize_t)offset;
 
     /* append data */
-    if (h5fnal_append_data(vector->hit_dset_id, vector->hit_dtype_id, data->n_hits, (const void *)data->hits) < 0)
-        H5FNAL_PROGRAM_ERROR("could not append hit data");
-    if (h5fnal_append_data(vector->hitcoll_dset_id, vector->hitcoll_dtype_id, data->n_hit_collections, (const void *)data->hit_collections) < 0)
+    if (H5FNAL_HIT_LAYOUT_COLUMNAR == vector->layout) {
+        /* Write each field straight out of the hit structs */
+        for (u = 0; u < H5FNAL_HIT_N_FIELDS; u++)
+            if (h5fnal_appender_append_strided(&(vector->hit_field_apps[u]), data->n_hits,
+                    hit_fields[u].offset / HIT_FIELD_SIZE, HIT_N_SLOTS, (const void *)data->hits) < 0)
+                H5FNAL_PROGRAM_ERROR("could not append hit field data");
+    }
+    else {
+        if (h5fnal_appender_append(&(vector->hit_app), data->n_hits, (const void *)data->hits) < 0)
+            H5FNAL_PROGRAM_ERROR("could not append hit data");
+    }
+    if (h5fnal_appender_append(&(vector->hitcoll_app), data->n_hit_collections, (const void *)data->hit_collections) < 0)
         H5FNAL_PROGRAM_ERROR("could not append hit collection data");
 
     return H5FNAL_SUCCESS;
 
 error:
-    H5E_BEGIN_TRY {
-        H5Sclose(sid);
-    } H5E_END_TRY;
+    return H5FNAL_FAILURE;
+} /* end append_hits() */
+
+/************************************************************************
+ * write_hits_job()
+ *
+ * Runs on the writer thread. Appends the job's copy of the hits, as
+ * the caller would have without a writer thread.
+ ************************************************************************/
+static herr_t
+write_hits_job(h5fnal_async_job_t *job)
+{
+    hits_job_t *hj = (hits_job_t *)job;
+
+    if (hj->for_event)
+        return append_hits_for_event(hj->vector, hj->run, hj->subrun, hj->event, &(hj->data));
+    else
+        return append_hits(hj->vector, &(hj->data));
+} /* end write_hits_job() */
+
+static void
+release_hits_job(h5fnal_async_job_t *job)
+{
+    hits_job_t *hj = (hits_job_t *)job;
+
+    free(hj->data.hits);
+    free(hj->data.hit_collections);
+    free(hj);
+
+    return;
+} /* end release_hits_job() */
+
+/************************************************************************
+ * queue_hits()
+ *
+ * Copies the hits and hit collections into a job for the writer
+ * thread (see h5fnal_set_async_writes()).
+ ************************************************************************/
+static herr_t
+queue_hits(h5fnal_vect_hitcoll_t *vector, hbool_t for_event, uint32_t run, uint32_t subrun, uint32_t event, const h5fnal_vect_hitcoll_data_t *data)
+{
+    hits_job_t *hj = NULL;
+
+    if (NULL == (hj = (hits_job_t *)calloc(1, sizeof(hits_job_t))))
+        H5FNAL_PROGRAM_ERROR("could not get memory for queued append");
+    hj->job.write = write_hits_job;
+    hj->job.release = release_hits_job;
+    hj->vector = vector;
+    hj->for_event = for_event;
+    hj->run = run;
+    hj->subrun = subrun;
+    hj->event = event;
+
+    if (h5fnal_copy_async_array((void **)&(hj->data.hits), data->hits, data->n_hits, sizeof(h5fnal_hit_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not copy hits");
+    hj->data.n_hits = data->n_hits;
+    if (h5fnal_copy_async_array((void **)&(hj->data.hit_collections), data->hit_collections, data->n_hit_collections, sizeof(h5fnal_hitcoll_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not copy hit collections");
+    hj->data.n_hit_collections = data->n_hit_collections;
+
+    if (h5fnal_submit_async_job(&(hj->job)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not queue append");
+
+    return H5FNAL_SUCCESS;
 
+error:
+    if (hj)
+        release_hits_job(&(hj->job));
+
+    return H5FNAL_FAILURE;
+} /* end queue_hits() */
+
+/************************************************************************
+ * h5fnal_append_hits()
+ *
+ * With asynchronous appends on, the data is copied and the append
+ * is done later on the writer thread, so the start values in data
+ * are not fixed up.
+ ************************************************************************/
+herr_t
+h5fnal_append_hits(h5fnal_vect_hitcoll_t *vector, h5fnal_vect_hitcoll_data_t *data)
+{
+    if (NULL == vector)
+        H5FNAL_PROGRAM_ERROR("vector parameter cannot be NULL");
+    if (NULL == data)
+        H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL");
+
+    if (h5fnal_get_async_writes() > 0) {
+        if (queue_hits(vector, FALSE, 0, 0, 0, data) < 0)
+            H5FNAL_PROGRAM_ERROR("could not queue hits");
+    }
+    else if (append_hits(vector, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not append hits");
+
+    return H5FNAL_SUCCESS;
+
+error:
     return H5FNAL_FAILURE;
 } /* end h5fnal_append_hits() */
 
@@ -336,55 +894,418 @@ error:
 herr_t
 h5fnal_read_all_hits(h5fnal_vect_hitcoll_t *vector, h5fnal_vect_hitcoll_data_t *data)
 {
-    hid_t       sid     = H5FNAL_BAD_HID_T;
+    return h5fnal_read_hit_fields(vector, H5FNAL_HIT_ALL_FIELDS, data);
+} /* end h5fnal_read_all_hits() */
+
 
+/************************************************************************
+ * h5fnal_read_hit_fields()
+ *
+ * Reads all the hit collections and the hit fields selected in the
+ * fields flags (H5FNAL_HIT_* values OR'd together). Fields that were
+ * not asked for are set to zero.
+ ************************************************************************/
+herr_t
+h5fnal_read_hit_fields(h5fnal_vect_hitcoll_t *vector, unsigned fields, h5fnal_vect_hitcoll_data_t *data)
+{
     if (!data)
         H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL")
 
     /* Initialize the data struct */
     memset(data, 0, sizeof(h5fnal_vect_hitcoll_data_t));
 
-    /* Get the size of the hits dataset */
-    if ((sid = H5Dget_space(vector->hit_dset_id)) < 0)
-        H5FNAL_HDF5_ERROR;
-    if ((data->n_hits = H5Sget_simple_extent_npoints(sid)) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Sclose(sid) < 0)
-        H5FNAL_HDF5_ERROR;
+    if (h5fnal_read_hit_fields_into(vector, fields, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read hits");
 
-    /* Get the size of the hit collections dataset */
-    if ((sid = H5Dget_space(vector->hitcoll_dset_id)) < 0)
-        H5FNAL_HDF5_ERROR;
-    if ((data->n_hit_collections = H5Sget_simple_extent_npoints(sid)) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Sclose(sid) < 0)
-        H5FNAL_HDF5_ERROR;
+    return H5FNAL_SUCCESS;
+
+error:
+    if (data)
+        h5fnal_free_hitcoll_mem_data(data);
 
-    /* Generate buffers for reading the hits */
-    if (NULL == (data->hits = (h5fnal_hit_t *)calloc(data->n_hits, sizeof(h5fnal_hit_t))))
+    return H5FNAL_FAILURE;
+} /* end h5fnal_read_hit_fields() */
+
+
+/************************************************************************
+ * h5fnal_read_all_hits_into()
+ ************************************************************************/
+herr_t
+h5fnal_read_all_hits_into(h5fnal_vect_hitcoll_t *vector, h5fnal_vect_hitcoll_data_t *data)
+{
+    return h5fnal_read_hit_fields_into(vector, H5FNAL_HIT_ALL_FIELDS, data);
+} /* end h5fnal_read_all_hits_into() */
+
+
+/************************************************************************
+ * h5fnal_read_hit_fields_into()
+ *
+ * Same as h5fnal_read_hit_fields(), but reads into the buffers that
+ * are already in data, growing them only if needed. data must be
+ * zeroed (or hold buffers from an earlier read) and is still owned by
+ * the caller on failure (the element counts are set to zero).
+ ************************************************************************/
+herr_t
+h5fnal_read_hit_fields_into(h5fnal_vect_hitcoll_t *vector, unsigned fields, h5fnal_vect_hitcoll_data_t *data)
+{
+    hssize_t    n_hits;
+    hssize_t    n_hit_collections;
+
+    if (!vector)
+        H5FNAL_PROGRAM_ERROR("vector parameter cannot be NULL")
+    if (!data)
+        H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL")
+    if (fields & ~H5FNAL_HIT_ALL_FIELDS)
+        H5FNAL_PROGRAM_ERROR("invalid fields parameter")
+
+    data->n_hits = 0;
+    data->n_hit_collections = 0;
+
+    if (h5fnal_flush_v_mc_hit_collection(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush appended data");
+
+    /* Get the sizes of the hits and hit collections datasets */
+    if ((n_hits = h5fnal_get_dset_size(hits_dset_id(vector))) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get size of hits dataset");
+    if ((n_hit_collections = h5fnal_get_dset_size(vector->hitcoll_dset_id)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get size of hit collections dataset");
+
+    /* Make sure the buffers are big enough */
+    if (h5fnal_reserve_buffer((void **)&(data->hits), &(data->hits_capacity), (hsize_t)n_hits, sizeof(h5fnal_hit_t)) < 0)
         H5FNAL_PROGRAM_ERROR("could not allocate memory for hits");
-    if (NULL == (data->hit_collections = (h5fnal_hitcoll_t *)calloc(data->n_hit_collections, sizeof(h5fnal_hitcoll_t))))
+    if (h5fnal_reserve_buffer((void **)&(data->hit_collections), &(data->hit_collections_capacity), (hsize_t)n_hit_collections, sizeof(h5fnal_hitcoll_t)) < 0)
         H5FNAL_PROGRAM_ERROR("could not allocate memory for hit collections");
 
-    /* Read the data from the datasets */
-    if (H5Dread(vector->hit_dset_id, vector->hit_dtype_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, data->hits) < 0)
-        H5FNAL_HDF5_ERROR;
+    /* Fields that aren't read are zero */
+    if (fields != H5FNAL_HIT_ALL_FIELDS)
+        memset(data->hits, 0, (size_t)n_hits * sizeof(h5fnal_hit_t));
+
+    /* Read the hits */
+    if (read_hits(vector, fields, H5S_ALL, (hsize_t)n_hits, data->hits) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read hits");
+
+    /* Read the hit collections */
     if (H5Dread(vector->hitcoll_dset_id, vector->hitcoll_dtype_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, data->hit_collections) < 0)
         H5FNAL_HDF5_ERROR;
 
+    data->n_hits = (hsize_t)n_hits;
+    data->n_hit_collections = (hsize_t)n_hit_collections;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_read_hit_fields_into() */
+
+
+/************************************************************************
+ * h5fnal_read_hits_for_channels()
+ *
+ * Reads only the hit collections for the given channels and their
+ * hits. The hit collections come back in the order the channels were
+ * given (a channel with several hit collections gets them all, a
+ * channel with none gets nothing) and their start values are indexes
+ * into data->hits.
+ *
+ * The hit ranges are merged and read with a single selection, so only
+ * the chunks that hold the wanted hits are read.
+ ************************************************************************/
+herr_t
+h5fnal_read_hits_for_channels(h5fnal_vect_hitcoll_t *vector, const unsigned *channels, size_t n_channels, h5fnal_vect_hitcoll_data_t *data)
+{
+    hid_t       file_sid    = H5FNAL_BAD_HID_T;
+    hit_run_t  *runs        = NULL;
+    hsize_t     n_runs      = 0;
+    hsize_t     n, lo, hi, mid;
+    hsize_t     u, v;
+    size_t      i;
+
+    if (!vector)
+        H5FNAL_PROGRAM_ERROR("vector parameter cannot be NULL")
+    if (!channels && n_channels > 0)
+        H5FNAL_PROGRAM_ERROR("channels parameter cannot be NULL")
+    if (!data)
+        H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL")
+
+    /* Initialize the data struct */
+    memset(data, 0, sizeof(h5fnal_vect_hitcoll_data_t));
+
+    if (h5fnal_flush_v_mc_hit_collection(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush appended data");
+    if (build_channel_index(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not build channel index");
+
+    /* Count and then copy out the matching hit collections */
+    n = 0;
+    for (i = 0; i < n_channels; i++)
+        for (u = find_channel(vector, channels[i]); u < vector->n_channel_index && vector->channel_index[u].channel == channels[i]; u++)
+            n++;
+
+    if (NULL == (data->hit_collections = (h5fnal_hitcoll_t *)calloc((size_t)n + 1, sizeof(h5fnal_hitcoll_t))))
+        H5FNAL_PROGRAM_ERROR("could not allocate memory for hit collections");
+    data->hit_collections_capacity = n + 1;
+    if (NULL == (runs = (hit_run_t *)malloc(((size_t)n + 1) * sizeof(hit_run_t))))
+        H5FNAL_PROGRAM_ERROR("could not allocate memory for hit runs");
+
+    for (i = 0; i < n_channels; i++)
+        for (u = find_channel(vector, channels[i]); u < vector->n_channel_index && vector->channel_index[u].channel == channels[i]; u++) {
+            const h5fnal_hitcoll_t *hc = &(vector->channel_index[u]);
+
+            data->hit_collections[data->n_hit_collections++] = *hc;
+            if (hc->count > 0) {
+                runs[n_runs].file_start = hc->start;
+                runs[n_runs].count = hc->count;
+                n_runs++;
+            }
+        }
+
+    /* Sort the hit ranges and merge overlapping/adjacent ones */
+    if (n_runs > 0) {
+        qsort(runs, (size_t)n_runs, sizeof(hit_run_t), compare_hit_runs);
+        for (u = 1, v = 0; u < n_runs; u++) {
+            hsize_t end = runs[v].file_start + runs[v].count;
+
+            if (runs[u].file_start <= end) {
+                if (runs[u].file_start + runs[u].count > end)
+                    runs[v].count = runs[u].file_start + runs[u].count - runs[v].file_start;
+            }
+            else
+                runs[++v] = runs[u];
+        }
+        n_runs = v + 1;
+    }
+
+    /* Build the file selection. The hits land in memory in file order. */
+    if ((file_sid = H5Dget_space(hits_dset_id(vector))) < 0)
+        H5FNAL_HDF5_ERROR;
+    for (u = 0; u < n_runs; u++) {
+        if (H5Sselect_hyperslab(file_sid, 0 == u ? H5S_SELECT_SET : H5S_SELECT_OR, &(runs[u].file_start), NULL, &(runs[u].count), NULL) < 0)
+            H5FNAL_HDF5_ERROR;
+        runs[u].mem_start = data->n_hits;
+        data->n_hits += runs[u].count;
+    }
+
+    /* Read the hits */
+    if (NULL == (data->hits = (h5fnal_hit_t *)calloc((size_t)data->n_hits + 1, sizeof(h5fnal_hit_t))))
+        H5FNAL_PROGRAM_ERROR("could not allocate memory for hits");
+    data->hits_capacity = data->n_hits + 1;
+    if (read_hits(vector, H5FNAL_HIT_ALL_FIELDS, file_sid, data->n_hits, data->hits) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read hits");
+
+    /* Point the hit collections at the hits in memory */
+    for (u = 0; u < data->n_hit_collections; u++) {
+        h5fnal_hitcoll_t *hc = &(data->hit_collections[u]);
+
+        if (0 == hc->count) {
+            hc->start = 0;
+            continue;
+        }
+
+        /* Find the run that holds this hit collection */
+        lo = 0;
+        hi = n_runs;
+        while (hi - lo > 1) {
+            mid = lo + (hi - lo) / 2;
+            if (runs[mid].file_start <= hc->start)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        hc->start = runs[lo].mem_start + (hc->start - runs[lo].file_start);
+    }
+
+    if (H5Sclose(file_sid) < 0)
+        H5FNAL_HDF5_ERROR;
+    free(runs);
+
     return H5FNAL_SUCCESS;
 
 error:
     H5E_BEGIN_TRY {
-        H5Sclose(sid);
+        H5Sclose(file_sid);
     } H5E_END_TRY;
 
+    free(runs);
+
     if (data)
         h5fnal_free_hitcoll_mem_data(data);
 
     return H5FNAL_FAILURE;
-    
-} /* end h5fnal_read_all_hits() */
+} /* end h5fnal_read_hits_for_channels() */
+
+
+/************************************************************************
+ * h5fnal_append_hits_for_event()
+ *
+ * Appends an event's hits and hit collections (as in
+ * h5fnal_append_hits()) and records where they went in the vector's
+ * event table. Used when one vector holds a whole run or sub-run.
+ * Unlike h5fnal_append_hits(), the hit collection start values in
+ * data are left as they were (event-local).
+ ************************************************************************/
+herr_t
+h5fnal_append_hits_for_event(h5fnal_vect_hitcoll_t *vector, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_vect_hitcoll_data_t *data)
+{
+    if (NULL == vector)
+        H5FNAL_PROGRAM_ERROR("vector parameter cannot be NULL");
+    if (NULL == data)
+        H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL");
+
+    if (h5fnal_get_async_writes() > 0) {
+        if (queue_hits(vector, TRUE, run, subrun, event, data) < 0)
+            H5FNAL_PROGRAM_ERROR("could not queue hits");
+    }
+    else if (append_hits_for_event(vector, run, subrun, event, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not append hits");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_append_hits_for_event() */
+
+static herr_t
+append_hits_for_event(h5fnal_vect_hitcoll_t *vector, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_vect_hitcoll_data_t *data)
+{
+    hsize_t     start[H5FNAL_MAX_EVENT_DSETS];
+    hsize_t     count[H5FNAL_MAX_EVENT_DSETS];
+    hssize_t    n;
+    hsize_t     u;
+
+    /* Fail before any data is written */
+    if (h5fnal_check_new_event(&(vector->events), run, subrun, event) < 0)
+        H5FNAL_PROGRAM_ERROR("event is already in the product");
+
+    memset(start, 0, sizeof(start));
+    memset(count, 0, sizeof(count));
+
+    if ((n = h5fnal_get_appender_size(hits_appender(vector))) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get size of hits dataset");
+    start[HIT_EVENT_HITS] = (hsize_t)n;
+    count[HIT_EVENT_HITS] = data->n_hits;
+    if ((n = h5fnal_get_appender_size(&(vector->hitcoll_app))) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get size of hit collections dataset");
+    start[HIT_EVENT_HITCOLLS] = (hsize_t)n;
+    count[HIT_EVENT_HITCOLLS] = data->n_hit_collections;
+
+    if (append_hits(vector, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not append hits");
+    if (start[HIT_EVENT_HITS] > 0)
+        for (u = 0; u < data->n_hit_collections; u++)
+            if (data->hit_collections[u].count > 0)
+                data->hit_collections[u].start -= start[HIT_EVENT_HITS];
+    if (h5fnal_add_event(&(vector->events), run, subrun, event, start, count) < 0)
+        H5FNAL_PROGRAM_ERROR("could not add event to event table");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end append_hits_for_event() */
+
+
+/************************************************************************
+ * h5fnal_read_hits_for_event()
+ *
+ * Reads one event's hits and hit collections from a vector that holds
+ * a whole run or sub-run. The hit collection start values are indexes
+ * into data->hits, as they were when the event was appended.
+ ************************************************************************/
+herr_t
+h5fnal_read_hits_for_event(h5fnal_vect_hitcoll_t *vector, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_vect_hitcoll_data_t *data)
+{
+    if (!data)
+        H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL")
+
+    /* Initialize the data struct */
+    memset(data, 0, sizeof(h5fnal_vect_hitcoll_data_t));
+
+    if (h5fnal_read_hits_for_event_into(vector, run, subrun, event, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read hits");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    if (data)
+        h5fnal_free_hitcoll_mem_data(data);
+
+    return H5FNAL_FAILURE;
+} /* end h5fnal_read_hits_for_event() */
+
+
+/************************************************************************
+ * h5fnal_read_hits_for_event_into()
+ *
+ * Same as h5fnal_read_hits_for_event(), but reuses the buffers in data
+ * (see h5fnal_read_hit_fields_into()).
+ ************************************************************************/
+herr_t
+h5fnal_read_hits_for_event_into(h5fnal_vect_hitcoll_t *vector, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_vect_hitcoll_data_t *data)
+{
+    h5fnal_event_entry_t entry;
+    hid_t       file_sid = H5FNAL_BAD_HID_T;
+    hsize_t     hit_start, n_hits, n_hit_collections;
+    hsize_t     u;
+    htri_t      found;
+
+    if (!vector)
+        H5FNAL_PROGRAM_ERROR("vector parameter cannot be NULL")
+    if (!data)
+        H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL")
+
+    data->n_hits = 0;
+    data->n_hit_collections = 0;
+
+    if (h5fnal_flush_v_mc_hit_collection(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush appended data");
+
+    if ((found = h5fnal_find_event(&(vector->events), run, subrun, event, &entry)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not look up event");
+    if (!found)
+        H5FNAL_PROGRAM_ERROR("event is not in the event table");
+    hit_start = entry.start[HIT_EVENT_HITS];
+    n_hits = entry.count[HIT_EVENT_HITS];
+    n_hit_collections = entry.count[HIT_EVENT_HITCOLLS];
+
+    /* Make sure the buffers are big enough */
+    if (h5fnal_reserve_buffer((void **)&(data->hits), &(data->hits_capacity), n_hits, sizeof(h5fnal_hit_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not allocate memory for hits");
+    if (h5fnal_reserve_buffer((void **)&(data->hit_collections), &(data->hit_collections_capacity), n_hit_collections, sizeof(h5fnal_hitcoll_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not allocate memory for hit collections");
+
+    /* Read the hits */
+    if (n_hits > 0) {
+        if ((file_sid = H5Dget_space(hits_dset_id(vector))) < 0)
+            H5FNAL_HDF5_ERROR;
+        if (H5Sselect_hyperslab(file_sid, H5S_SELECT_SET, &hit_start, NULL, &n_hits, NULL) < 0)
+            H5FNAL_HDF5_ERROR;
+        if (read_hits(vector, H5FNAL_HIT_ALL_FIELDS, file_sid, n_hits, data->hits) < 0)
+            H5FNAL_PROGRAM_ERROR("could not read hits");
+        if (H5Sclose(file_sid) < 0)
+            H5FNAL_HDF5_ERROR;
+        file_sid = H5FNAL_BAD_HID_T;
+    }
+
+    /* Read the hit collections and point them at the hits in memory */
+    if (h5fnal_read_dset_range(vector->hitcoll_dset_id, vector->hitcoll_dtype_id,
+            entry.start[HIT_EVENT_HITCOLLS], n_hit_collections, data->hit_collections) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read hit collections");
+    for (u = 0; u < n_hit_collections; u++)
+        if (data->hit_collections[u].count > 0)
+            data->hit_collections[u].start -= hit_start;
+
+    data->n_hits = n_hits;
+    data->n_hit_collections = n_hit_collections;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Sclose(file_sid);
+    } H5E_END_TRY;
+
+    return H5FNAL_FAILURE;
+} /* end h5fnal_read_hits_for_event_into() */
 
 
 /************************************************************************
@@ -25,6 +25,36 @@ typedef struct h5fnal_hit_t {
     int         part_track_id;
 } h5fnal_hit_t;
 
+/* Hit field flags
+ *
+ * Used to pick which hit fields h5fnal_read_hit_fields() reads.
+ * The bits are in h5fnal_hit_t member order.
+ */
+#define H5FNAL_HIT_SIGNAL_TIME      0x0001u
+#define H5FNAL_HIT_SIGNAL_WIDTH     0x0002u
+#define H5FNAL_HIT_PEAK_AMP         0x0004u
+#define H5FNAL_HIT_CHARGE           0x0008u
+#define H5FNAL_HIT_PART_VERTEX_X    0x0010u
+#define H5FNAL_HIT_PART_VERTEX_Y    0x0020u
+#define H5FNAL_HIT_PART_VERTEX_Z    0x0040u
+#define H5FNAL_HIT_PART_ENERGY      0x0080u
+#define H5FNAL_HIT_PART_TRACK_ID    0x0100u
+#define H5FNAL_HIT_ALL_FIELDS       0x01FFu
+
+#define H5FNAL_HIT_N_FIELDS         9
+
+/* How the hits are stored in the file
+ *
+ * COMPOUND stores each hit as an h5fnal_hit_t compound in a single
+ * dataset. COLUMNAR stores each hit field in its own 1D dataset
+ * (named after the compound field) so readers that only want a few
+ * fields don't have to read and decompress the others.
+ */
+typedef enum h5fnal_hit_layout_t {
+    H5FNAL_HIT_LAYOUT_COMPOUND  = 0,
+    H5FNAL_HIT_LAYOUT_COLUMNAR  = 1
+} h5fnal_hit_layout_t;
+
 
 /* MC Hit Collection type
  *
@@ -49,12 +79,20 @@ typedef struct h5fnal_hitcoll_t {
  * Used to hold data when performing dataset I/O. Data packing
  * and unpacking to the vector<MCHitCollection> must be done
  * by the caller (presumably in a higher-level C++ library).
+ *
+ * The capacities are the allocated sizes of the arrays (in
+ * elements). The *_into() reads reuse the arrays and only grow
+ * them when an event doesn't fit, so zero the struct once and pass
+ * it to every read in an event loop.
  */
 typedef struct h5fnal_vect_hitcoll_data_t {
     h5fnal_hit_t        *hits;
     hsize_t             n_hits;
     h5fnal_hitcoll_t    *hit_collections;
     hsize_t             n_hit_collections;
+
+    hsize_t             hits_capacity;
+    hsize_t             hit_collections_capacity;
 } h5fnal_vect_hitcoll_data_t;
 
 
@@ -69,6 +107,26 @@ typedef struct h5fnal_vect_hitcoll_t {
     hid_t       hit_dtype_id;
     hid_t       hitcoll_dset_id;
     hid_t       hitcoll_dtype_id;
+
+    /* Columnar layout only (hit_dset_id is unused) */
+    h5fnal_hit_layout_t layout;
+    hid_t       hit_field_dset_ids[H5FNAL_HIT_N_FIELDS];
+
+    /* Appenders for the datasets (cache the sizes and dataspaces) */
+    h5fnal_appender_t   hit_app;
+    h5fnal_appender_t   hitcoll_app;
+    h5fnal_appender_t   hit_field_apps[H5FNAL_HIT_N_FIELDS];
+
+    /* All the hit collections, sorted by channel. Built on the first
+     * h5fnal_read_hits_for_channels() call and dropped on append.
+     */
+    h5fnal_hitcoll_t   *channel_index;
+    hsize_t             n_channel_index;
+
+    /* Where each event is, when the vector holds a whole run or
+     * sub-run (see h5fnal_append_hits_for_event())
+     */
+    h5fnal_event_table_t    events;
 } h5fnal_vect_hitcoll_t;
 
 
@@ -79,12 +137,24 @@ extern "C" {
 hid_t h5fnal_create_hit_type(void);
 hid_t h5fnal_create_hitcoll_type(void);
 
-herr_t h5fnal_create_v_mc_hit_collection(hid_t loc_id, const char *name, h5fnal_vect_hitcoll_t *vector);
+herr_t h5fnal_create_v_mc_hit_collection(hid_t loc_id, const char *name, const h5fnal_storage_profile_t *profile, h5fnal_vect_hitcoll_t *vector);
+herr_t h5fnal_create_v_mc_hit_collection_with_layout(hid_t loc_id, const char *name, h5fnal_hit_layout_t layout, const h5fnal_storage_profile_t *profile, h5fnal_vect_hitcoll_t *vector);
 herr_t h5fnal_open_v_mc_hit_collection(hid_t loc_id, const char *name, h5fnal_vect_hitcoll_t *vector);
+herr_t h5fnal_open_v_mc_hit_collection_with_types(hid_t loc_id, const char *name, const h5fnal_product_types_t *types, h5fnal_vect_hitcoll_t *vector);
 herr_t h5fnal_close_v_mc_hit_collection(h5fnal_vect_hitcoll_t *vector);
 
 herr_t h5fnal_append_hits(h5fnal_vect_hitcoll_t *vector, h5fnal_vect_hitcoll_data_t *data);
+herr_t h5fnal_flush_v_mc_hit_collection(h5fnal_vect_hitcoll_t *vector);
 herr_t h5fnal_read_all_hits(h5fnal_vect_hitcoll_t *vector, h5fnal_vect_hitcoll_data_t *data);
+herr_t h5fnal_read_hit_fields(h5fnal_vect_hitcoll_t *vector, unsigned fields, h5fnal_vect_hitcoll_data_t *data);
+herr_t h5fnal_read_all_hits_into(h5fnal_vect_hitcoll_t *vector, h5fnal_vect_hitcoll_data_t *data);
+herr_t h5fnal_read_hit_fields_into(h5fnal_vect_hitcoll_t *vector, unsigned fields, h5fnal_vect_hitcoll_data_t *data);
+herr_t h5fnal_read_hits_for_channels(h5fnal_vect_hitcoll_t *vector, const unsigned *channels, size_t n_channels, h5fnal_vect_hitcoll_data_t *data);
+
+/* One vector per run or sub-run, with an event table */
+herr_t h5fnal_append_hits_for_event(h5fnal_vect_hitcoll_t *vector, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_vect_hitcoll_data_t *data);
+herr_t h5fnal_read_hits_for_event(h5fnal_vect_hitcoll_t *vector, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_vect_hitcoll_data_t *data);
+herr_t h5fnal_read_hits_for_event_into(h5fnal_vect_hitcoll_t *vector, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_vect_hitcoll_data_t *data);
 
 herr_t h5fnal_free_hitcoll_mem_data(h5fnal_vect_hitcoll_data_t *data);
 
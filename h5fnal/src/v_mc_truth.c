@@ -1,5 +1,7 @@
 /* v_mc_truth.c */
 
+#include <float.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -16,7 +18,70 @@
 #define H5FNAL_TRUTH_DAUGHTER_DATASET_NAME      "daughters"
 #define H5FNAL_TRUTH_TRAJECTORY_DATASET_NAME    "trajectories"
 
+/* Attribute holding the path of the string dictionary */
+#define H5FNAL_TRUTH_DICTIONARY_ATTR_NAME       "string dictionary"
+
+/* Trajectory encoding attributes */
+#define H5FNAL_TRUTH_ENCODING_ATTR_NAME         "trajectory encoding"
+#define H5FNAL_TRUTH_ENCODING_DOUBLE_NAME       "double"
+#define H5FNAL_TRUTH_ENCODING_FLOAT_NAME        "float"
+#define H5FNAL_TRUTH_ENCODING_FIXED_NAME        "fixed"
+#define H5FNAL_TRUTH_SCALES_ATTR_NAME           "trajectory scales"
+#define H5FNAL_TRUTH_MAX_ERROR_ATTR_NAME        "trajectory max error"
+#define H5FNAL_TRUTH_VERSION_ATTR_NAME          "trajectory version"
+
+/* Event table slots */
+#define TRUTH_EVENT_TRUTHS                      0
+#define TRUTH_EVENT_TRAJECTORIES                1
+#define TRUTH_EVENT_DAUGHTERS                   2
+#define TRUTH_EVENT_PARTICLES                   3
+#define TRUTH_EVENT_NEUTRINOS                   4
+
+/* The values in a trajectory point, in h5fnal_trajectory_t order.
+ * The first TRAJECTORY_N_DELTAS are stored as differences in the
+ * fixed-point encoding.
+ */
+#define TRAJECTORY_N_VALUES     8
+#define TRAJECTORY_N_DELTAS     4
+
+typedef struct trajectory_value_t {
+    const char *name;
+    size_t      offset;
+    unsigned    scale;      /* H5FNAL_TRAJECTORY_* scale index */
+} trajectory_value_t;
+
+static const trajectory_value_t trajectory_values[TRAJECTORY_N_VALUES] = {
+    { "Vx",     HOFFSET(h5fnal_trajectory_t, Vx),   H5FNAL_TRAJECTORY_POSITION  },
+    { "Vy",     HOFFSET(h5fnal_trajectory_t, Vy),   H5FNAL_TRAJECTORY_POSITION  },
+    { "Vz",     HOFFSET(h5fnal_trajectory_t, Vz),   H5FNAL_TRAJECTORY_POSITION  },
+    { "T",      HOFFSET(h5fnal_trajectory_t, T),    H5FNAL_TRAJECTORY_TIME      },
+    { "Px",     HOFFSET(h5fnal_trajectory_t, Px),   H5FNAL_TRAJECTORY_MOMENTUM  },
+    { "Py",     HOFFSET(h5fnal_trajectory_t, Py),   H5FNAL_TRAJECTORY_MOMENTUM  },
+    { "Pz",     HOFFSET(h5fnal_trajectory_t, Pz),   H5FNAL_TRAJECTORY_MOMENTUM  },
+    { "E",      HOFFSET(h5fnal_trajectory_t, E),    H5FNAL_TRAJECTORY_MOMENTUM  }
+};
+
+/* Fixed-point values are kept below this in magnitude so that the
+ * differences between them fit in an int64_t too
+ */
+#define TRAJECTORY_FIXED_LIMIT  ((double)((int64_t)1 << 61))
+
+/* An append queued for the writer thread, with its own copy of the
+ * data
+ */
+typedef struct truths_job_t {
+    h5fnal_async_job_t          job;
+    h5fnal_vect_truth_t        *vector;
+    hbool_t                     for_event;
+    uint32_t                    run;
+    uint32_t                    subrun;
+    uint32_t                    event;
+    h5fnal_vect_truth_data_t    data;
+} truths_job_t;
+
 /* Prototypes */
+static herr_t append_truths(h5fnal_vect_truth_t *vector, h5fnal_vect_truth_data_t *data);
+static herr_t append_truths_for_event(h5fnal_vect_truth_t *vector, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_vect_truth_data_t *data);
 
 hid_t
 h5fnal_create_origin_type(void)
@@ -234,6 +299,437 @@ error:
     return H5FNAL_BAD_HID_T;
 } /* h5fnal_create_trajectory_type */
 
+/************************************************************************
+ * h5fnal_default_trajectory_encoding()
+ ************************************************************************/
+void
+h5fnal_default_trajectory_encoding(h5fnal_trajectory_encoding_t *encoding, h5fnal_trajectory_format_t format)
+{
+    encoding->format = format;
+    encoding->version = H5FNAL_TRAJECTORY_VERSION_1;
+    encoding->scale[H5FNAL_TRAJECTORY_POSITION] = H5FNAL_DEFAULT_POSITION_SCALE;
+    encoding->scale[H5FNAL_TRAJECTORY_TIME] = H5FNAL_DEFAULT_TIME_SCALE;
+    encoding->scale[H5FNAL_TRAJECTORY_MOMENTUM] = H5FNAL_DEFAULT_MOMENTUM_SCALE;
+
+    return;
+} /* end h5fnal_default_trajectory_encoding() */
+
+/************************************************************************
+ * trajectory_value_size()
+ ************************************************************************/
+static size_t
+trajectory_value_size(h5fnal_trajectory_format_t format)
+{
+    if (H5FNAL_TRAJECTORY_FLOAT == format)
+        return sizeof(float);
+    else if (H5FNAL_TRAJECTORY_FIXED == format)
+        return sizeof(int64_t);
+    else
+        return sizeof(double);
+} /* end trajectory_value_size() */
+
+/************************************************************************
+ * encoded_trajectory_size()
+ *
+ * Encoded trajectory points are TRAJECTORY_N_VALUES values of the
+ * encoding's value type, followed by the particle_index in version 1.
+ ************************************************************************/
+static size_t
+encoded_trajectory_size(const h5fnal_trajectory_encoding_t *encoding)
+{
+    size_t size = TRAJECTORY_N_VALUES * trajectory_value_size(encoding->format);
+
+    if (H5FNAL_TRAJECTORY_VERSION_1 == encoding->version)
+        size += sizeof(hsize_t);
+
+    return size;
+} /* end encoded_trajectory_size() */
+
+/************************************************************************
+ * trajectories_encoded()
+ *
+ * Doubles with the particle index are read and written as
+ * h5fnal_trajectory_t. Everything else goes through
+ * vector->trajectory_buf.
+ ************************************************************************/
+static hbool_t
+trajectories_encoded(const h5fnal_vect_truth_t *vector)
+{
+    return H5FNAL_TRAJECTORY_DOUBLE != vector->trajectory_encoding.format
+        || H5FNAL_TRAJECTORY_VERSION_1 != vector->trajectory_encoding.version;
+} /* end trajectories_encoded() */
+
+/************************************************************************
+ * h5fnal_create_encoded_trajectory_type()
+ *
+ * The type of an encoded trajectory point (used in memory and in the
+ * file).
+ ************************************************************************/
+hid_t
+h5fnal_create_encoded_trajectory_type(h5fnal_trajectory_format_t format, unsigned version)
+{
+    h5fnal_trajectory_encoding_t encoding;
+    hid_t tid = H5FNAL_BAD_HID_T;
+    hid_t value_tid;
+    size_t value_size = trajectory_value_size(format);
+    unsigned v;
+
+    h5fnal_default_trajectory_encoding(&encoding, format);
+    encoding.version = version;
+
+    if (H5FNAL_TRAJECTORY_FLOAT == format)
+        value_tid = H5T_NATIVE_FLOAT;
+    else if (H5FNAL_TRAJECTORY_FIXED == format)
+        value_tid = H5T_NATIVE_INT64;
+    else
+        value_tid = H5T_NATIVE_DOUBLE;
+
+    if ((tid = H5Tcreate(H5T_COMPOUND, encoded_trajectory_size(&encoding))) < 0)
+        H5FNAL_HDF5_ERROR;
+    for (v = 0; v < TRAJECTORY_N_VALUES; v++)
+        if (H5Tinsert(tid, trajectory_values[v].name, v * value_size, value_tid) < 0)
+            H5FNAL_HDF5_ERROR;
+    if (H5FNAL_TRAJECTORY_VERSION_1 == version)
+        if (H5Tinsert(tid, "particle_index", TRAJECTORY_N_VALUES * value_size, H5T_NATIVE_HSIZE) < 0)
+            H5FNAL_HDF5_ERROR;
+
+    return tid;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Tclose(tid);
+    } H5E_END_TRY;
+
+    return H5FNAL_BAD_HID_T;
+} /* end h5fnal_create_encoded_trajectory_type() */
+
+/************************************************************************
+ * trajectory_value()
+ *
+ * Points at value v of a trajectory point.
+ ************************************************************************/
+static double *
+trajectory_value(h5fnal_trajectory_t *trajectory, unsigned v)
+{
+    return (double *)((unsigned char *)trajectory + trajectory_values[v].offset);
+} /* end trajectory_value() */
+
+/************************************************************************
+ * get_trajectory_range()
+ *
+ * Gets the trajectory points [*first, *last] of a particle, in an
+ * array of n_trajectories points whose first point has index base.
+ * Returns FALSE if it has none.
+ ************************************************************************/
+static htri_t
+get_trajectory_range(const h5fnal_particle_t *particle, hssize_t base, hsize_t n_trajectories, hsize_t *first, hsize_t *last)
+{
+    if (particle->trajectory_start_index < 0)
+        return FALSE;
+    if (particle->trajectory_start_index < base
+            || particle->trajectory_end_index < particle->trajectory_start_index
+            || (hsize_t)(particle->trajectory_end_index - base) >= n_trajectories)
+        H5FNAL_PROGRAM_ERROR("particle's trajectory indexes are out of range");
+
+    *first = (hsize_t)(particle->trajectory_start_index - base);
+    *last = (hsize_t)(particle->trajectory_end_index - base);
+
+    return TRUE;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end get_trajectory_range() */
+
+/************************************************************************
+ * note_trajectory_error()
+ ************************************************************************/
+static void
+note_trajectory_error(h5fnal_vect_truth_t *vector, unsigned v, double error)
+{
+    unsigned scale = trajectory_values[v].scale;
+
+    if (error > vector->trajectory_max_error[scale]) {
+        vector->trajectory_max_error[scale] = error;
+        vector->trajectory_error_changed = TRUE;
+    }
+
+    return;
+} /* end note_trajectory_error() */
+
+/************************************************************************
+ * check_trajectory_ranges()
+ *
+ * The fixed-point differences are taken along each particle's
+ * trajectory, so the particles' trajectory ranges must be disjoint
+ * and in particle order.
+ ************************************************************************/
+static herr_t
+check_trajectory_ranges(const h5fnal_vect_truth_data_t *data, hssize_t base)
+{
+    hsize_t first, last;
+    hsize_t next = 0;       /* first point not yet in a range */
+    hsize_t u;
+    htri_t has_range;
+
+    for (u = 0; u < data->n_particles; u++) {
+        if ((has_range = get_trajectory_range(&(data->particles[u]), base, data->n_trajectories, &first, &last)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not get particle's trajectory");
+        if (!has_range)
+            continue;
+        if (first < next)
+            H5FNAL_PROGRAM_ERROR("particles' trajectory ranges overlap or are out of order");
+        next = last + 1;
+    }
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end check_trajectory_ranges() */
+
+/************************************************************************
+ * encode_trajectories()
+ *
+ * Encodes data's trajectories into vector->trajectory_buf. The
+ * particles' trajectory indexes start at base (the first point's
+ * index in the dataset).
+ ************************************************************************/
+static herr_t
+encode_trajectories(h5fnal_vect_truth_t *vector, h5fnal_vect_truth_data_t *data, hssize_t base)
+{
+    const h5fnal_trajectory_encoding_t *encoding = &(vector->trajectory_encoding);
+    size_t stride = encoded_trajectory_size(encoding);
+    size_t index_offset = TRAJECTORY_N_VALUES * trajectory_value_size(encoding->format);
+    unsigned char *point;
+    hsize_t first, last;
+    hsize_t u, r;
+    htri_t has_range;
+    unsigned v;
+
+    if (H5FNAL_TRAJECTORY_FIXED == encoding->format)
+        if (check_trajectory_ranges(data, base) < 0)
+            H5FNAL_PROGRAM_ERROR("can't take fixed-point differences along the trajectories");
+
+    if (h5fnal_reserve_buffer(&(vector->trajectory_buf), &(vector->trajectory_buf_capacity),
+            data->n_trajectories, stride) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get memory for encoded trajectories");
+
+    for (u = 0; u < data->n_trajectories; u++) {
+        point = (unsigned char *)vector->trajectory_buf + u * stride;
+
+        for (v = 0; v < TRAJECTORY_N_VALUES; v++) {
+            double x = *trajectory_value(&(data->trajectories[u]), v);
+
+            if (H5FNAL_TRAJECTORY_FLOAT == encoding->format) {
+                float *f = (float *)point + v;
+
+                if (isfinite(x) && fabs(x) > FLT_MAX)
+                    H5FNAL_PROGRAM_ERROR("trajectory value is too large for a float");
+                *f = (float)x;
+                note_trajectory_error(vector, v, fabs((double)*f - x));
+            }
+            else if (H5FNAL_TRAJECTORY_FIXED == encoding->format) {
+                int64_t *i = (int64_t *)point + v;
+                double step = encoding->scale[trajectory_values[v].scale];
+                double q = x / step;
+
+                if (!(fabs(q) < TRAJECTORY_FIXED_LIMIT))
+                    H5FNAL_PROGRAM_ERROR("trajectory value is out of range for the fixed-point encoding");
+                *i = (int64_t)llround(q);
+                note_trajectory_error(vector, v, fabs((double)*i * step - x));
+            }
+            else
+                ((double *)point)[v] = x;
+        }
+        if (H5FNAL_TRAJECTORY_VERSION_1 == encoding->version)
+            memcpy(point + index_offset, &(data->trajectories[u].particle_index), sizeof(hsize_t));
+    }
+
+    /* Store the fixed-point positions and times as differences along
+     * each particle's trajectory (last point first, so the point
+     * before is still whole)
+     */
+    if (H5FNAL_TRAJECTORY_FIXED == encoding->format)
+        for (u = 0; u < data->n_particles; u++) {
+            if ((has_range = get_trajectory_range(&(data->particles[u]), base, data->n_trajectories, &first, &last)) < 0)
+                H5FNAL_PROGRAM_ERROR("could not encode trajectories");
+            if (!has_range)
+                continue;
+            for (r = last; r > first; r--) {
+                int64_t *cur = (int64_t *)((unsigned char *)vector->trajectory_buf + r * stride);
+                const int64_t *prev = (const int64_t *)((unsigned char *)vector->trajectory_buf + (r - 1) * stride);
+
+                for (v = 0; v < TRAJECTORY_N_DELTAS; v++)
+                    cur[v] -= prev[v];
+            }
+        }
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end encode_trajectories() */
+
+/************************************************************************
+ * decode_trajectories()
+ *
+ * Decodes the data->n_trajectories encoded trajectory points in
+ * vector->trajectory_buf into data->trajectories. The particles'
+ * trajectory indexes start at base (the first point's index in the
+ * dataset). Does nothing for trajectories that aren't encoded.
+ *
+ * Version 2 points get H5FNAL_NO_PARTICLE_INDEX (see
+ * h5fnal_fill_trajectory_particle_indexes()).
+ ************************************************************************/
+static herr_t
+decode_trajectories(h5fnal_vect_truth_t *vector, h5fnal_vect_truth_data_t *data, hssize_t base)
+{
+    const h5fnal_trajectory_encoding_t *encoding = &(vector->trajectory_encoding);
+    size_t stride = encoded_trajectory_size(encoding);
+    size_t index_offset = TRAJECTORY_N_VALUES * trajectory_value_size(encoding->format);
+    const unsigned char *point;
+    hsize_t first, last;
+    hsize_t u, r;
+    htri_t has_range;
+    unsigned v;
+
+    if (!trajectories_encoded(vector))
+        return H5FNAL_SUCCESS;
+
+    if (h5fnal_reserve_buffer((void **)&(data->trajectories), &(data->trajectories_capacity),
+            data->n_trajectories, sizeof(h5fnal_trajectory_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not allocate memory");
+
+    /* Sum the fixed-point differences (in place) */
+    if (H5FNAL_TRAJECTORY_FIXED == encoding->format)
+        for (u = 0; u < data->n_particles; u++) {
+            if ((has_range = get_trajectory_range(&(data->particles[u]), base, data->n_trajectories, &first, &last)) < 0)
+                H5FNAL_PROGRAM_ERROR("could not decode trajectories");
+            if (!has_range)
+                continue;
+            for (r = first + 1; r <= last; r++) {
+                int64_t *cur = (int64_t *)((unsigned char *)vector->trajectory_buf + r * stride);
+                const int64_t *prev = (const int64_t *)((unsigned char *)vector->trajectory_buf + (r - 1) * stride);
+
+                for (v = 0; v < TRAJECTORY_N_DELTAS; v++)
+                    cur[v] += prev[v];
+            }
+        }
+
+    for (u = 0; u < data->n_trajectories; u++) {
+        point = (const unsigned char *)vector->trajectory_buf + u * stride;
+
+        for (v = 0; v < TRAJECTORY_N_VALUES; v++) {
+            double *x = trajectory_value(&(data->trajectories[u]), v);
+
+            if (H5FNAL_TRAJECTORY_FLOAT == encoding->format)
+                *x = (double)((const float *)point)[v];
+            else if (H5FNAL_TRAJECTORY_FIXED == encoding->format)
+                *x = (double)((const int64_t *)point)[v] * encoding->scale[trajectory_values[v].scale];
+            else
+                *x = ((const double *)point)[v];
+        }
+        if (H5FNAL_TRAJECTORY_VERSION_1 == encoding->version)
+            memcpy(&(data->trajectories[u].particle_index), point + index_offset, sizeof(hsize_t));
+        else
+            data->trajectories[u].particle_index = H5FNAL_NO_PARTICLE_INDEX;
+    }
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end decode_trajectories() */
+
+/************************************************************************
+ * read_trajectories()
+ *
+ * Reads trajectory points [start, start + count) into
+ * data->trajectories, or into vector->trajectory_buf if they are
+ * encoded (see decode_trajectories()).
+ ************************************************************************/
+static herr_t
+read_trajectories(h5fnal_vect_truth_t *vector, hsize_t start, hsize_t count, h5fnal_vect_truth_data_t *data)
+{
+    void *buf = data->trajectories;
+
+    if (trajectories_encoded(vector)) {
+        if (h5fnal_reserve_buffer(&(vector->trajectory_buf), &(vector->trajectory_buf_capacity),
+                count, encoded_trajectory_size(&(vector->trajectory_encoding))) < 0)
+            H5FNAL_PROGRAM_ERROR("could not get memory for encoded trajectories");
+        buf = vector->trajectory_buf;
+    }
+
+    if (h5fnal_read_dset_range(vector->trajectory_dset_id, vector->trajectory_dtype_id, start, count, buf) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read trajectories");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end read_trajectories() */
+
+/************************************************************************
+ * save_trajectory_error()
+ *
+ * Updates the max error attribute, if it has changed.
+ ************************************************************************/
+static herr_t
+save_trajectory_error(h5fnal_vect_truth_t *vector)
+{
+    if (!vector->trajectory_error_changed)
+        return H5FNAL_SUCCESS;
+
+    if (h5fnal_set_double_attribute(vector->top_level_group_id, H5FNAL_TRUTH_MAX_ERROR_ATTR_NAME,
+            H5FNAL_TRAJECTORY_N_SCALES, vector->trajectory_max_error) < 0)
+        H5FNAL_PROGRAM_ERROR("could not write trajectory max error attribute");
+    vector->trajectory_error_changed = FALSE;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end save_trajectory_error() */
+
+/************************************************************************
+ * init_appenders()
+ *
+ * Points the appenders at the vector's current dataset IDs.
+ ************************************************************************/
+static void
+init_appenders(h5fnal_vect_truth_t *vector)
+{
+    h5fnal_init_appender(&(vector->neutrino_app), vector->neutrino_dset_id, vector->neutrino_dtype_id, TRUE);
+    h5fnal_init_appender(&(vector->particle_app), vector->particle_dset_id, vector->particle_dtype_id, TRUE);
+    h5fnal_init_appender(&(vector->daughter_app), vector->daughter_dset_id, vector->daughter_dtype_id, TRUE);
+    h5fnal_init_appender(&(vector->trajectory_app), vector->trajectory_dset_id, vector->trajectory_dtype_id, TRUE);
+    h5fnal_init_appender(&(vector->truth_app), vector->truth_dset_id, vector->truth_dtype_id, TRUE);
+
+    return;
+} /* end init_appenders() */
+
+/************************************************************************
+ * close_appenders()
+ ************************************************************************/
+static herr_t
+close_appenders(h5fnal_vect_truth_t *vector)
+{
+    herr_t ret = H5FNAL_SUCCESS;
+
+    if (h5fnal_close_appender(&(vector->neutrino_app)) < 0)
+        ret = H5FNAL_FAILURE;
+    if (h5fnal_close_appender(&(vector->particle_app)) < 0)
+        ret = H5FNAL_FAILURE;
+    if (h5fnal_close_appender(&(vector->daughter_app)) < 0)
+        ret = H5FNAL_FAILURE;
+    if (h5fnal_close_appender(&(vector->trajectory_app)) < 0)
+        ret = H5FNAL_FAILURE;
+    if (h5fnal_close_appender(&(vector->truth_app)) < 0)
+        ret = H5FNAL_FAILURE;
+
+    return ret;
+} /* end close_appenders() */
+
 /************************************************************************
  * h5fnal_close_vector_on_err()
  *
@@ -247,6 +743,9 @@ h5fnal_close_vector_on_err(h5fnal_vect_truth_t *vector)
 {
     if (vector) {
         H5E_BEGIN_TRY {
+            close_appenders(vector);
+            h5fnal_close_event_table(&(vector->events));
+
             H5Tclose(vector->origin_dtype_id);
 
             H5Dclose(vector->neutrino_dset_id);
@@ -285,19 +784,50 @@ h5fnal_close_vector_on_err(h5fnal_vect_truth_t *vector)
         vector->truth_dtype_id      = H5FNAL_BAD_HID_T;
 
         vector->top_level_group_id  = H5FNAL_BAD_HID_T;
+
+        /* Owned by the file */
+        vector->dict                = NULL;
+
+        free(vector->trajectory_buf);
+        vector->trajectory_buf          = NULL;
+        vector->trajectory_buf_capacity = 0;
     }
 
     return;
 } /* end h5fnal_close_vector_on_err() */
 
+/************************************************************************
+ * h5fnal_create_v_mc_truth()
+ *
+ * Creates a data product that stores the trajectories as doubles.
+ ************************************************************************/
+herr_t
+h5fnal_create_v_mc_truth(hid_t loc_id, const char *name, const h5fnal_storage_profile_t *profile, h5fnal_vect_truth_t *vector)
+{
+    return h5fnal_create_v_mc_truth_with_encoding(loc_id, name, NULL, profile, vector);
+} /* end h5fnal_create_v_mc_truth() */
+
+/************************************************************************
+ * h5fnal_create_v_mc_truth_with_encoding()
+ *
+ * Creates a data product whose trajectories are stored with the given
+ * encoding (NULL for doubles). The encoding is kept in the product's
+ * attributes, along with the largest error it has made in each kind
+ * of value so far.
+ *
+ * With the fixed-point encoding, the particles' trajectory ranges in
+ * each append must be disjoint and in particle order (appends that
+ * aren't fail). With version 2, the trajectory points' particle
+ * indexes aren't stored.
+ ************************************************************************/
 herr_t
-h5fnal_create_v_mc_truth(hid_t loc_id, const char *name, h5fnal_vect_truth_t *vector)
+h5fnal_create_v_mc_truth_with_encoding(hid_t loc_id, const char *name, const h5fnal_trajectory_encoding_t *encoding, const h5fnal_storage_profile_t *profile, h5fnal_vect_truth_t *vector)
 {
-    hid_t dcpl_id = -1;
-    hid_t sid = -1;
-    hsize_t chunk_dims[1];
-    hsize_t init_dims[1];
-    hsize_t max_dims[1];
+    const h5fnal_product_types_t *types = NULL;
+    const char *encoding_name = NULL;
+    unsigned u;
+
+    h5fnal_drain_async_writes();
 
     if (loc_id < 0)
         H5FNAL_PROGRAM_ERROR("invalid loc_id parameter");
@@ -308,84 +838,120 @@ h5fnal_create_v_mc_truth(hid_t loc_id, const char *name, h5fnal_vect_truth_t *ve
 
     /* Initialize the data product struct */
     memset(vector, 0, sizeof(h5fnal_vect_truth_t));
+    init_appenders(vector);
+    h5fnal_init_event_table(&(vector->events));
+
+    /* Check the encoding */
+    if (encoding)
+        vector->trajectory_encoding = *encoding;
+    else
+        h5fnal_default_trajectory_encoding(&(vector->trajectory_encoding), H5FNAL_TRAJECTORY_DOUBLE);
+    if (H5FNAL_TRAJECTORY_DOUBLE == vector->trajectory_encoding.format)
+        encoding_name = H5FNAL_TRUTH_ENCODING_DOUBLE_NAME;
+    else if (H5FNAL_TRAJECTORY_FLOAT == vector->trajectory_encoding.format)
+        encoding_name = H5FNAL_TRUTH_ENCODING_FLOAT_NAME;
+    else if (H5FNAL_TRAJECTORY_FIXED == vector->trajectory_encoding.format) {
+        encoding_name = H5FNAL_TRUTH_ENCODING_FIXED_NAME;
+        for (u = 0; u < H5FNAL_TRAJECTORY_N_SCALES; u++)
+            if (!(vector->trajectory_encoding.scale[u] > 0.0) || !isfinite(vector->trajectory_encoding.scale[u]))
+                H5FNAL_PROGRAM_ERROR("fixed-point scales must be positive");
+    }
+    else
+        H5FNAL_PROGRAM_ERROR("invalid trajectory encoding");
+    if (H5FNAL_TRAJECTORY_VERSION_1 != vector->trajectory_encoding.version
+            && H5FNAL_TRAJECTORY_VERSION_2 != vector->trajectory_encoding.version)
+        H5FNAL_PROGRAM_ERROR("invalid trajectory version");
 
     /* Create the top-level group for the vector */
     if ((vector->top_level_group_id = H5Gcreate2(loc_id, name, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT)) < 0)
         H5FNAL_HDF5_ERROR
 
-    /* Create the datatypes */
-    if ((vector->origin_dtype_id = h5fnal_create_origin_type()) < 0)
+    /* Use the file-wide string dictionary and note where it lives */
+    if (h5fnal_get_string_dictionary(loc_id, H5FNAL_FILE_DICTIONARY_PATH, TRUE, &(vector->dict)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get the file's string dictionary");
+    if (h5fnal_add_string_attribute(vector->top_level_group_id, H5FNAL_TRUTH_DICTIONARY_ATTR_NAME, H5FNAL_FILE_DICTIONARY_PATH) < 0)
+        H5FNAL_PROGRAM_ERROR("could not add string dictionary attribute");
+
+    /* Record the trajectory encoding */
+    if (h5fnal_add_string_attribute(vector->top_level_group_id, H5FNAL_TRUTH_ENCODING_ATTR_NAME, encoding_name) < 0)
+        H5FNAL_PROGRAM_ERROR("could not add trajectory encoding attribute");
+    if (h5fnal_add_uint_attribute(vector->top_level_group_id, H5FNAL_TRUTH_VERSION_ATTR_NAME, vector->trajectory_encoding.version) < 0)
+        H5FNAL_PROGRAM_ERROR("could not add trajectory version attribute");
+    if (H5FNAL_TRAJECTORY_FIXED == vector->trajectory_encoding.format)
+        if (h5fnal_set_double_attribute(vector->top_level_group_id, H5FNAL_TRUTH_SCALES_ATTR_NAME,
+                H5FNAL_TRAJECTORY_N_SCALES, vector->trajectory_encoding.scale) < 0)
+            H5FNAL_PROGRAM_ERROR("could not add trajectory scales attribute");
+    if (H5FNAL_TRAJECTORY_DOUBLE != vector->trajectory_encoding.format)
+        vector->trajectory_error_changed = TRUE;
+
+    /* Set up the (empty) event table */
+    if (h5fnal_open_event_table(vector->top_level_group_id, &(vector->events)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not set up event table");
+
+    /* Share the library's in-memory datatypes */
+    if (NULL == (types = h5fnal_get_product_types()))
+        H5FNAL_PROGRAM_ERROR("could not get product datatypes");
+    if ((vector->origin_dtype_id = h5fnal_share_type(types->origin_dtype_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create datatype");
-    if ((vector->neutrino_dtype_id = h5fnal_create_neutrino_type()) < 0)
+    if ((vector->neutrino_dtype_id = h5fnal_share_type(types->neutrino_dtype_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create datatype");
-    if ((vector->particle_dtype_id = h5fnal_create_particle_type()) < 0)
+    if ((vector->particle_dtype_id = h5fnal_share_type(types->particle_dtype_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create datatype");
-    if ((vector->daughter_dtype_id = h5fnal_create_daughter_type()) < 0)
+    if ((vector->daughter_dtype_id = h5fnal_share_type(types->daughter_dtype_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create datatype");
-    if ((vector->trajectory_dtype_id = h5fnal_create_trajectory_type()) < 0)
+    if (!trajectories_encoded(vector)) {
+        if ((vector->trajectory_dtype_id = h5fnal_share_type(types->trajectory_dtype_id)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not create datatype");
+    }
+    else if ((vector->trajectory_dtype_id = h5fnal_share_type(types->encoded_trajectory_dtype_ids[vector->trajectory_encoding.format]
+            [vector->trajectory_encoding.version - H5FNAL_TRAJECTORY_VERSION_1])) < 0)
         H5FNAL_PROGRAM_ERROR("could not create datatype");
-    if ((vector->truth_dtype_id = h5fnal_create_truth_type()) < 0)
+    if ((vector->truth_dtype_id = h5fnal_share_type(types->truth_dtype_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create datatype");
 
-    /* Set up chunking (for all datasets, size is arbitrary for now) */
-    chunk_dims[0] = 1024;
-    if ((dcpl_id = H5Pcreate(H5P_DATASET_CREATE)) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Pset_chunk(dcpl_id, 1, chunk_dims) < 0)
-        H5FNAL_HDF5_ERROR;
-
-    /* Turn on compession */
-    if (H5Pset_shuffle(dcpl_id) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Pset_deflate(dcpl_id, 6) < 0)
-        H5FNAL_HDF5_ERROR;
-
-    /* Create the dataspace (set of points describing the data size, etc.) */
-    init_dims[0] = 0;
-    max_dims[0] = H5S_UNLIMITED;
-    if ((sid = H5Screate_simple(1, init_dims, max_dims)) < 0)
-        H5FNAL_HDF5_ERROR;
-
-    /* Create the datasets */
-    if ((vector->truth_dset_id = H5Dcreate2(vector->top_level_group_id, H5FNAL_TRUTH_TRUTH_DATASET_NAME,
-            vector->truth_dtype_id, sid, H5P_DEFAULT, dcpl_id, H5P_DEFAULT)) < 0)
-        H5FNAL_HDF5_ERROR;
-    if ((vector->neutrino_dset_id = H5Dcreate2(vector->top_level_group_id, H5FNAL_TRUTH_NEUTRINO_DATASET_NAME,
-            vector->neutrino_dtype_id, sid, H5P_DEFAULT, dcpl_id, H5P_DEFAULT)) < 0)
-        H5FNAL_HDF5_ERROR;
-    if ((vector->particle_dset_id = H5Dcreate2(vector->top_level_group_id, H5FNAL_TRUTH_PARTICLE_DATASET_NAME,
-            vector->particle_dtype_id, sid, H5P_DEFAULT, dcpl_id, H5P_DEFAULT)) < 0)
-        H5FNAL_HDF5_ERROR;
-    if ((vector->daughter_dset_id = H5Dcreate2(vector->top_level_group_id, H5FNAL_TRUTH_DAUGHTER_DATASET_NAME,
-            vector->daughter_dtype_id, sid, H5P_DEFAULT, dcpl_id, H5P_DEFAULT)) < 0)
-        H5FNAL_HDF5_ERROR;
-    if ((vector->trajectory_dset_id = H5Dcreate2(vector->top_level_group_id, H5FNAL_TRUTH_TRAJECTORY_DATASET_NAME,
-            vector->trajectory_dtype_id, sid, H5P_DEFAULT, dcpl_id, H5P_DEFAULT)) < 0)
-        H5FNAL_HDF5_ERROR;
-
-    /* close everything */
-    if (H5Pclose(dcpl_id) < 0)
-        H5FNAL_HDF5_ERROR;
-    if (H5Sclose(sid) < 0)
-        H5FNAL_HDF5_ERROR;
+    /* Create the datasets (the appenders create them, as the storage
+     * profile says, and may put that off until the first appends)
+     */
+    init_appenders(vector);
+    if (h5fnal_appender_create_dset(&(vector->truth_app), vector->top_level_group_id,
+            H5FNAL_TRUTH_TRUTH_DATASET_NAME, profile, &(vector->truth_dset_id)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create truth dataset");
+    if (h5fnal_appender_create_dset(&(vector->neutrino_app), vector->top_level_group_id,
+            H5FNAL_TRUTH_NEUTRINO_DATASET_NAME, profile, &(vector->neutrino_dset_id)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create neutrino dataset");
+    if (h5fnal_appender_create_dset(&(vector->particle_app), vector->top_level_group_id,
+            H5FNAL_TRUTH_PARTICLE_DATASET_NAME, profile, &(vector->particle_dset_id)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create particle dataset");
+    if (h5fnal_appender_create_dset(&(vector->daughter_app), vector->top_level_group_id,
+            H5FNAL_TRUTH_DAUGHTER_DATASET_NAME, profile, &(vector->daughter_dset_id)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create daughter dataset");
+    if (h5fnal_appender_create_dset(&(vector->trajectory_app), vector->top_level_group_id,
+            H5FNAL_TRUTH_TRAJECTORY_DATASET_NAME, profile, &(vector->trajectory_dset_id)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create trajectory dataset");
 
     return H5FNAL_SUCCESS;
 
 error:
-    H5E_BEGIN_TRY {
-        H5Sclose(sid);
-        H5Pclose(dcpl_id);
-    } H5E_END_TRY;
-
     if (vector)
         h5fnal_close_vector_on_err(vector);
 
     return H5FNAL_FAILURE;
 } /* h5fnal_create_v_mc_truth */
 
+/************************************************************************
+ * h5fnal_open_v_mc_truth_with_types()
+ *
+ * Same as h5fnal_open_v_mc_truth(), but shares the datatypes in types
+ * (if not NULL) instead of the library's.
+ ************************************************************************/
 herr_t
-h5fnal_open_v_mc_truth(hid_t loc_id, const char *name, h5fnal_vect_truth_t *vector)
+h5fnal_open_v_mc_truth_with_types(hid_t loc_id, const char *name, const h5fnal_product_types_t *types, h5fnal_vect_truth_t *vector)
 {
+    char *dict_path = NULL;
+    char *encoding_name = NULL;
+    htri_t exists;
+
+    h5fnal_drain_async_writes();
 
     if (loc_id < 0)
         H5FNAL_PROGRAM_ERROR("invalid loc_id parameter");
@@ -396,23 +962,84 @@ h5fnal_open_v_mc_truth(hid_t loc_id, const char *name, h5fnal_vect_truth_t *vect
 
     /* Initialize the data product struct */
     memset(vector, 0, sizeof(h5fnal_vect_truth_t));
+    init_appenders(vector);
+    h5fnal_init_event_table(&(vector->events));
 
     /* Open top-level group */
     if ((vector->top_level_group_id = H5Gopen2(loc_id, name, H5P_DEFAULT)) < 0)
         H5FNAL_HDF5_ERROR;
 
-    /* Create the datatypes */
-    if ((vector->origin_dtype_id = h5fnal_create_origin_type()) < 0)
+    /* Get the string dictionary (older files kept it in the root group
+     * and have no attribute)
+     */
+    if ((exists = H5Aexists(vector->top_level_group_id, H5FNAL_TRUTH_DICTIONARY_ATTR_NAME)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (exists) {
+        if (h5fnal_get_string_attribute(vector->top_level_group_id, H5FNAL_TRUTH_DICTIONARY_ATTR_NAME, &dict_path) < 0)
+            H5FNAL_PROGRAM_ERROR("could not get string dictionary attribute");
+    }
+    if (h5fnal_get_string_dictionary(loc_id, dict_path ? dict_path : H5FNAL_LEGACY_DICTIONARY_PATH, FALSE, &(vector->dict)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get the file's string dictionary");
+    free(dict_path);
+    dict_path = NULL;
+
+    /* Get the trajectory encoding and version (files without the
+     * attributes store doubles with the particle index)
+     */
+    h5fnal_default_trajectory_encoding(&(vector->trajectory_encoding), H5FNAL_TRAJECTORY_DOUBLE);
+    if ((exists = H5Aexists(vector->top_level_group_id, H5FNAL_TRUTH_ENCODING_ATTR_NAME)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (exists) {
+        if (h5fnal_get_string_attribute(vector->top_level_group_id, H5FNAL_TRUTH_ENCODING_ATTR_NAME, &encoding_name) < 0)
+            H5FNAL_PROGRAM_ERROR("could not get trajectory encoding attribute");
+        if (!strcmp(encoding_name, H5FNAL_TRUTH_ENCODING_FLOAT_NAME))
+            vector->trajectory_encoding.format = H5FNAL_TRAJECTORY_FLOAT;
+        else if (!strcmp(encoding_name, H5FNAL_TRUTH_ENCODING_FIXED_NAME))
+            vector->trajectory_encoding.format = H5FNAL_TRAJECTORY_FIXED;
+        else if (strcmp(encoding_name, H5FNAL_TRUTH_ENCODING_DOUBLE_NAME))
+            H5FNAL_PROGRAM_ERROR("unknown trajectory encoding");
+        free(encoding_name);
+        encoding_name = NULL;
+    }
+    if ((exists = H5Aexists(vector->top_level_group_id, H5FNAL_TRUTH_VERSION_ATTR_NAME)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (exists) {
+        if (h5fnal_get_uint_attribute(vector->top_level_group_id, H5FNAL_TRUTH_VERSION_ATTR_NAME, &(vector->trajectory_encoding.version)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not get trajectory version attribute");
+        if (H5FNAL_TRAJECTORY_VERSION_1 != vector->trajectory_encoding.version
+                && H5FNAL_TRAJECTORY_VERSION_2 != vector->trajectory_encoding.version)
+            H5FNAL_PROGRAM_ERROR("unknown trajectory version");
+    }
+    if (H5FNAL_TRAJECTORY_FIXED == vector->trajectory_encoding.format)
+        if (h5fnal_get_double_attribute(vector->top_level_group_id, H5FNAL_TRUTH_SCALES_ATTR_NAME,
+                H5FNAL_TRAJECTORY_N_SCALES, vector->trajectory_encoding.scale) < 0)
+            H5FNAL_PROGRAM_ERROR("could not get trajectory scales attribute");
+    if (H5FNAL_TRAJECTORY_DOUBLE != vector->trajectory_encoding.format)
+        if (h5fnal_get_double_attribute(vector->top_level_group_id, H5FNAL_TRUTH_MAX_ERROR_ATTR_NAME,
+                H5FNAL_TRAJECTORY_N_SCALES, vector->trajectory_max_error) < 0)
+            H5FNAL_PROGRAM_ERROR("could not get trajectory max error attribute");
+
+    /* Share the in-memory datatypes (the library's, unless the
+     * caller passed its own)
+     */
+    if (NULL == types && NULL == (types = h5fnal_get_product_types()))
+        H5FNAL_PROGRAM_ERROR("could not get product datatypes");
+    if ((vector->origin_dtype_id = h5fnal_share_type(types->origin_dtype_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create datatype");
-    if ((vector->neutrino_dtype_id = h5fnal_create_neutrino_type()) < 0)
+    if ((vector->neutrino_dtype_id = h5fnal_share_type(types->neutrino_dtype_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create datatype");
-    if ((vector->particle_dtype_id = h5fnal_create_particle_type()) < 0)
+    if ((vector->particle_dtype_id = h5fnal_share_type(types->particle_dtype_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create datatype");
-    if ((vector->daughter_dtype_id = h5fnal_create_daughter_type()) < 0)
+    if ((vector->daughter_dtype_id = h5fnal_share_type(types->daughter_dtype_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create datatype");
-    if ((vector->trajectory_dtype_id = h5fnal_create_trajectory_type()) < 0)
+    if (!trajectories_encoded(vector)) {
+        if ((vector->trajectory_dtype_id = h5fnal_share_type(types->trajectory_dtype_id)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not create datatype");
+    }
+    else if ((vector->trajectory_dtype_id = h5fnal_share_type(types->encoded_trajectory_dtype_ids[vector->trajectory_encoding.format]
+            [vector->trajectory_encoding.version - H5FNAL_TRAJECTORY_VERSION_1])) < 0)
         H5FNAL_PROGRAM_ERROR("could not create datatype");
-    if ((vector->truth_dtype_id = h5fnal_create_truth_type()) < 0)
+    if ((vector->truth_dtype_id = h5fnal_share_type(types->truth_dtype_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create datatype");
 
     /* Open the datasets */
@@ -426,22 +1053,46 @@ h5fnal_open_v_mc_truth(hid_t loc_id, const char *name, h5fnal_vect_truth_t *vect
         H5FNAL_HDF5_ERROR;
     if ((vector->trajectory_dset_id = H5Dopen2(vector->top_level_group_id, H5FNAL_TRUTH_TRAJECTORY_DATASET_NAME, H5P_DEFAULT)) < 0)
         H5FNAL_HDF5_ERROR;
+    init_appenders(vector);
+
+    /* Load the event table, if there is one */
+    if (h5fnal_open_event_table(vector->top_level_group_id, &(vector->events)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not open event table");
 
     return H5FNAL_SUCCESS;
 
 error:
+    free(dict_path);
+    free(encoding_name);
+
     if (vector)
         h5fnal_close_vector_on_err(vector);
 
     return H5FNAL_FAILURE;
+} /* h5fnal_open_v_mc_truth_with_types */
+
+herr_t
+h5fnal_open_v_mc_truth(hid_t loc_id, const char *name, h5fnal_vect_truth_t *vector)
+{
+    return h5fnal_open_v_mc_truth_with_types(loc_id, name, NULL, vector);
 } /* h5fnal_open_v_mc_truth */
 
 herr_t
 h5fnal_close_v_mc_truth(h5fnal_vect_truth_t *vector)
 {
+    h5fnal_drain_async_writes();
+
     if (NULL == vector)
         H5FNAL_PROGRAM_ERROR("vector parameter cannot be NULL");
 
+    /* Cached dataspaces */
+    if (close_appenders(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close appenders");
+    if (h5fnal_close_event_table(&(vector->events)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close event table");
+    if (save_trajectory_error(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not save trajectory max error");
+
     /* Top-level group */
     if (H5Gclose(vector->top_level_group_id) < 0)
         H5FNAL_HDF5_ERROR;
@@ -492,6 +1143,13 @@ h5fnal_close_v_mc_truth(h5fnal_vect_truth_t *vector)
 
     vector->top_level_group_id  = H5FNAL_BAD_HID_T;
 
+    /* The string dictionary is closed with the file */
+    vector->dict                = NULL;
+
+    free(vector->trajectory_buf);
+    vector->trajectory_buf          = NULL;
+    vector->trajectory_buf_capacity = 0;
+
     return H5FNAL_SUCCESS;
 
 error:
@@ -501,6 +1159,135 @@ error:
     return H5FNAL_FAILURE;
 } /* h5fnal_close_v_mc_truth */
 
+/************************************************************************
+ * h5fnal_flush_v_mc_truth()
+ *
+ * Writes out anything still in the append buffers. Reads do this
+ * themselves.
+ ************************************************************************/
+herr_t
+h5fnal_flush_v_mc_truth(h5fnal_vect_truth_t *vector)
+{
+    h5fnal_drain_async_writes();
+
+    if (!vector)
+        H5FNAL_PROGRAM_ERROR("vector parameter cannot be NULL");
+
+    if (h5fnal_flush_appender(&(vector->truth_app)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush truth data");
+    if (h5fnal_flush_appender(&(vector->trajectory_app)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush trajectory data");
+    if (h5fnal_flush_appender(&(vector->daughter_app)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush daughter data");
+    if (h5fnal_flush_appender(&(vector->particle_app)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush particle data");
+    if (h5fnal_flush_appender(&(vector->neutrino_app)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush neutrino data");
+    if (h5fnal_flush_event_table(&(vector->events)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush event table");
+    if (save_trajectory_error(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not save trajectory max error");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_flush_v_mc_truth() */
+
+/************************************************************************
+ * write_truths_job()
+ *
+ * Runs on the writer thread. Appends the job's copy of the truth
+ * data (whose indexes are fixed up in the copy, not the caller's
+ * data).
+ ************************************************************************/
+static herr_t
+write_truths_job(h5fnal_async_job_t *job)
+{
+    truths_job_t *tj = (truths_job_t *)job;
+
+    if (tj->for_event)
+        return append_truths_for_event(tj->vector, tj->run, tj->subrun, tj->event, &(tj->data));
+    else
+        return append_truths(tj->vector, &(tj->data));
+} /* end write_truths_job() */
+
+static void
+release_truths_job(h5fnal_async_job_t *job)
+{
+    truths_job_t *tj = (truths_job_t *)job;
+
+    free(tj->data.truths);
+    free(tj->data.trajectories);
+    free(tj->data.daughters);
+    free(tj->data.particles);
+    free(tj->data.neutrinos);
+    free(tj);
+
+    return;
+} /* end release_truths_job() */
+
+/************************************************************************
+ * queue_truths()
+ *
+ * Copies the truth data into a job for the writer thread (see
+ * h5fnal_set_async_writes()).
+ ************************************************************************/
+static herr_t
+queue_truths(h5fnal_vect_truth_t *vector, hbool_t for_event, uint32_t run, uint32_t subrun, uint32_t event, const h5fnal_vect_truth_data_t *data)
+{
+    truths_job_t *tj = NULL;
+
+    if (NULL == (tj = (truths_job_t *)calloc(1, sizeof(truths_job_t))))
+        H5FNAL_PROGRAM_ERROR("could not get memory for queued append");
+    tj->job.write = write_truths_job;
+    tj->job.release = release_truths_job;
+    tj->vector = vector;
+    tj->for_event = for_event;
+    tj->run = run;
+    tj->subrun = subrun;
+    tj->event = event;
+
+    if (h5fnal_copy_async_array((void **)&(tj->data.truths), data->truths, data->n_truths, sizeof(h5fnal_truth_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not copy truths");
+    tj->data.n_truths = data->n_truths;
+    if (h5fnal_copy_async_array((void **)&(tj->data.trajectories), data->trajectories, data->n_trajectories, sizeof(h5fnal_trajectory_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not copy trajectories");
+    tj->data.n_trajectories = data->n_trajectories;
+    if (h5fnal_copy_async_array((void **)&(tj->data.daughters), data->daughters, data->n_daughters, sizeof(h5fnal_daughter_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not copy daughters");
+    tj->data.n_daughters = data->n_daughters;
+    if (h5fnal_copy_async_array((void **)&(tj->data.particles), data->particles, data->n_particles, sizeof(h5fnal_particle_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not copy particles");
+    tj->data.n_particles = data->n_particles;
+    if (h5fnal_copy_async_array((void **)&(tj->data.neutrinos), data->neutrinos, data->n_neutrinos, sizeof(h5fnal_neutrino_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not copy neutrinos");
+    tj->data.n_neutrinos = data->n_neutrinos;
+
+    if (h5fnal_submit_async_job(&(tj->job)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not queue append");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    if (tj)
+        release_truths_job(&(tj->job));
+
+    return H5FNAL_FAILURE;
+} /* end queue_truths() */
+
+/************************************************************************
+ * h5fnal_append_truths()
+ *
+ * Appends to whatever the vector already holds. The indexes in data
+ * (particle, trajectory, daughter and neutrino) are local to data
+ * and are moved along to where the elements go in the datasets, so
+ * a vector can be written a few truths at a time.
+ *
+ * With asynchronous appends on, the data is copied and appended
+ * later on the writer thread, so the indexes in data are not fixed
+ * up.
+ ************************************************************************/
 herr_t
 h5fnal_append_truths(h5fnal_vect_truth_t *vector, h5fnal_vect_truth_data_t *data)
 {
@@ -509,72 +1296,198 @@ h5fnal_append_truths(h5fnal_vect_truth_t *vector, h5fnal_vect_truth_data_t *data
     if (!data)
         H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL");
 
-    /* XXX: Fixup datasets for multiple appends here */
+    if (h5fnal_get_async_writes() > 0) {
+        if (queue_truths(vector, FALSE, 0, 0, 0, data) < 0)
+            H5FNAL_PROGRAM_ERROR("could not queue truths");
+    }
+    else if (append_truths(vector, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not append truths");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_append_truths() */
+
+/************************************************************************
+ * shift_truth_indices()
+ *
+ * Adds shift[<dataset's event table slot>] to the indexes that refer
+ * to that dataset (-1 values, meaning nothing stored, are left alone).
+ ************************************************************************/
+static void
+shift_truth_indices(h5fnal_vect_truth_data_t *data, const hssize_t shift[])
+{
+    hsize_t u;
+
+    for (u = 0; u < data->n_truths; u++) {
+        h5fnal_truth_t *truth = &(data->truths[u]);
+
+        if (truth->neutrino_index >= 0)
+            truth->neutrino_index += shift[TRUTH_EVENT_NEUTRINOS];
+        if (truth->particle_start_index >= 0) {
+            truth->particle_start_index += shift[TRUTH_EVENT_PARTICLES];
+            truth->particle_end_index += shift[TRUTH_EVENT_PARTICLES];
+        }
+    }
+
+    for (u = 0; u < data->n_particles; u++) {
+        h5fnal_particle_t *particle = &(data->particles[u]);
+
+        if (particle->trajectory_start_index >= 0) {
+            particle->trajectory_start_index += shift[TRUTH_EVENT_TRAJECTORIES];
+            particle->trajectory_end_index += shift[TRUTH_EVENT_TRAJECTORIES];
+        }
+        if (particle->daughter_start_index >= 0) {
+            particle->daughter_start_index += shift[TRUTH_EVENT_DAUGHTERS];
+            particle->daughter_end_index += shift[TRUTH_EVENT_DAUGHTERS];
+        }
+    }
+
+    for (u = 0; u < data->n_trajectories; u++)
+        if (H5FNAL_NO_PARTICLE_INDEX != data->trajectories[u].particle_index)
+            data->trajectories[u].particle_index += (hsize_t)shift[TRUTH_EVENT_PARTICLES];
+
+    return;
+} /* end shift_truth_indices() */
+
+static herr_t
+append_truths(h5fnal_vect_truth_t *vector, h5fnal_vect_truth_data_t *data)
+{
+    h5fnal_appender_t *apps[H5FNAL_MAX_EVENT_DSETS];
+    hssize_t    shift[H5FNAL_MAX_EVENT_DSETS];
+    hbool_t     encoded = trajectories_encoded(vector);
+    hbool_t     fixup = FALSE;
+    unsigned    u;
 
     /* Trivial case of zero truths to append */
     if (0 == data->n_truths)
         return H5FNAL_SUCCESS;
 
+    /* Index fixup.
+     *
+     * When appending to non-empty datasets, the indexes in the
+     * incoming data have to be moved along so that they refer to the
+     * correct elements in the datasets.
+     */
+    memset(apps, 0, sizeof(apps));
+    memset(shift, 0, sizeof(shift));
+    apps[TRUTH_EVENT_TRAJECTORIES] = &(vector->trajectory_app);
+    apps[TRUTH_EVENT_DAUGHTERS] = &(vector->daughter_app);
+    apps[TRUTH_EVENT_PARTICLES] = &(vector->particle_app);
+    apps[TRUTH_EVENT_NEUTRINOS] = &(vector->neutrino_app);
+    for (u = 0; u < H5FNAL_MAX_EVENT_DSETS; u++) {
+        if (NULL == apps[u])
+            continue;
+        if ((shift[u] = h5fnal_get_appender_size(apps[u])) < 0)
+            H5FNAL_PROGRAM_ERROR("could not get dataset size");
+        if (shift[u] > 0)
+            fixup = TRUE;
+    }
+    if (fixup)
+        shift_truth_indices(data, shift);
+
+    if (encoded)
+        if (encode_trajectories(vector, data, shift[TRUTH_EVENT_TRAJECTORIES]) < 0)
+            H5FNAL_PROGRAM_ERROR("could not encode trajectories");
+
     /* append data to all the datasets */
-    if (h5fnal_append_data(vector->truth_dset_id, vector->truth_dtype_id, data->n_truths, (const void *)(data->truths)) < 0)
+    if (h5fnal_appender_append(&(vector->truth_app), data->n_truths, (const void *)(data->truths)) < 0)
         H5FNAL_PROGRAM_ERROR("could not append truth data");
-    if (h5fnal_append_data(vector->trajectory_dset_id, vector->trajectory_dtype_id, data->n_trajectories, (const void *)(data->trajectories)) < 0)
+    if (h5fnal_appender_append(&(vector->trajectory_app), data->n_trajectories,
+            (const void *)(encoded ? vector->trajectory_buf : data->trajectories)) < 0)
         H5FNAL_PROGRAM_ERROR("could not append trajectory data");
-    if (h5fnal_append_data(vector->daughter_dset_id, vector->daughter_dtype_id, data->n_daughters, (const void *)(data->daughters)) < 0)
+    if (h5fnal_appender_append(&(vector->daughter_app), data->n_daughters, (const void *)(data->daughters)) < 0)
         H5FNAL_PROGRAM_ERROR("could not append daughter data");
-    if (h5fnal_append_data(vector->particle_dset_id, vector->particle_dtype_id, data->n_particles, (const void *)(data->particles)) < 0)
+    if (h5fnal_appender_append(&(vector->particle_app), data->n_particles, (const void *)(data->particles)) < 0)
         H5FNAL_PROGRAM_ERROR("could not append particle data");
-    if (h5fnal_append_data(vector->neutrino_dset_id, vector->neutrino_dtype_id, data->n_neutrinos, (const void *)(data->neutrinos)) < 0)
+    if (h5fnal_appender_append(&(vector->neutrino_app), data->n_neutrinos, (const void *)(data->neutrinos)) < 0)
         H5FNAL_PROGRAM_ERROR("could not append neutrino data");
 
     return H5FNAL_SUCCESS;
 
 error:
     return H5FNAL_FAILURE;
-} /* end h5fnal_append_truths() */
+} /* end append_truths() */
 
 herr_t
 h5fnal_read_all_truths(h5fnal_vect_truth_t *vector, h5fnal_vect_truth_data_t *data)
 {
-    if (!vector)
-        H5FNAL_PROGRAM_ERROR("vector parameter cannot be NULL");
     if (!data)
         H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL");
 
     /* Initialize the data struct */
     memset(data, 0, sizeof(h5fnal_vect_truth_data_t));
 
-    /* Get dataset sizes and allocate memory */
-    if ((data->n_truths = h5fnal_get_dset_size(vector->truth_dset_id)) < 0)
+    if (h5fnal_read_all_truths_into(vector, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read truths");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    if (data)
+        h5fnal_free_truth_mem_data(data);
+    return H5FNAL_FAILURE;
+} /* end h5fnal_read_all_truths() */
+
+/************************************************************************
+ * h5fnal_read_all_truths_into()
+ *
+ * Same as h5fnal_read_all_truths(), but reads into the buffers that
+ * are already in data, growing them only if needed. data must be
+ * zeroed (or hold buffers from an earlier read) and is still owned by
+ * the caller on failure (the element counts are set to zero).
+ ************************************************************************/
+herr_t
+h5fnal_read_all_truths_into(h5fnal_vect_truth_t *vector, h5fnal_vect_truth_data_t *data)
+{
+    hssize_t n_truths, n_trajectories, n_daughters, n_particles, n_neutrinos;
+
+    if (!vector)
+        H5FNAL_PROGRAM_ERROR("vector parameter cannot be NULL");
+    if (!data)
+        H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL");
+
+    data->n_truths = 0;
+    data->n_trajectories = 0;
+    data->n_daughters = 0;
+    data->n_particles = 0;
+    data->n_neutrinos = 0;
+
+    if (h5fnal_flush_v_mc_truth(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush appended data");
+
+    /* Get dataset sizes and make sure the buffers are big enough */
+    if ((n_truths = h5fnal_get_dset_size(vector->truth_dset_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not get dataset size");
-    if (NULL == (data->truths = (h5fnal_truth_t *)calloc(data->n_truths, sizeof(h5fnal_truth_t))))
+    if (h5fnal_reserve_buffer((void **)&(data->truths), &(data->truths_capacity), (hsize_t)n_truths, sizeof(h5fnal_truth_t)) < 0)
         H5FNAL_PROGRAM_ERROR("could not allocate memory");
 
-    if ((data->n_trajectories = h5fnal_get_dset_size(vector->trajectory_dset_id)) < 0)
+    if ((n_trajectories = h5fnal_get_dset_size(vector->trajectory_dset_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not get dataset size");
-    if (NULL == (data->trajectories = (h5fnal_trajectory_t *)calloc(data->n_trajectories, sizeof(h5fnal_trajectory_t))))
+    if (h5fnal_reserve_buffer((void **)&(data->trajectories), &(data->trajectories_capacity), (hsize_t)n_trajectories, sizeof(h5fnal_trajectory_t)) < 0)
         H5FNAL_PROGRAM_ERROR("could not allocate memory");
 
-    if ((data->n_daughters = h5fnal_get_dset_size(vector->daughter_dset_id)) < 0)
+    if ((n_daughters = h5fnal_get_dset_size(vector->daughter_dset_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not get dataset size");
-    if (NULL == (data->daughters = (h5fnal_daughter_t *)calloc(data->n_daughters, sizeof(h5fnal_daughter_t))))
+    if (h5fnal_reserve_buffer((void **)&(data->daughters), &(data->daughters_capacity), (hsize_t)n_daughters, sizeof(h5fnal_daughter_t)) < 0)
         H5FNAL_PROGRAM_ERROR("could not allocate memory");
 
-    if ((data->n_particles = h5fnal_get_dset_size(vector->particle_dset_id)) < 0)
+    if ((n_particles = h5fnal_get_dset_size(vector->particle_dset_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not get dataset size");
-    if (NULL == (data->particles = (h5fnal_particle_t *)calloc(data->n_particles, sizeof(h5fnal_particle_t))))
+    if (h5fnal_reserve_buffer((void **)&(data->particles), &(data->particles_capacity), (hsize_t)n_particles, sizeof(h5fnal_particle_t)) < 0)
         H5FNAL_PROGRAM_ERROR("could not allocate memory");
 
-    if ((data->n_neutrinos = h5fnal_get_dset_size(vector->neutrino_dset_id)) < 0)
+    if ((n_neutrinos = h5fnal_get_dset_size(vector->neutrino_dset_id)) < 0)
         H5FNAL_PROGRAM_ERROR("could not get dataset size");
-    if (NULL == (data->neutrinos = (h5fnal_neutrino_t *)calloc(data->n_neutrinos, sizeof(h5fnal_neutrino_t))))
+    if (h5fnal_reserve_buffer((void **)&(data->neutrinos), &(data->neutrinos_capacity), (hsize_t)n_neutrinos, sizeof(h5fnal_neutrino_t)) < 0)
         H5FNAL_PROGRAM_ERROR("could not allocate memory");
 
     /* Read data */
     if (H5Dread(vector->truth_dset_id, vector->truth_dtype_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, data->truths) < 0)
         H5FNAL_HDF5_ERROR;
-    if (H5Dread(vector->trajectory_dset_id, vector->trajectory_dtype_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, data->trajectories) < 0)
-        H5FNAL_HDF5_ERROR;
+    if (read_trajectories(vector, 0, (hsize_t)n_trajectories, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read trajectories");
     if (H5Dread(vector->daughter_dset_id, vector->daughter_dtype_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, data->daughters) < 0)
         H5FNAL_HDF5_ERROR;
     if (H5Dread(vector->particle_dset_id, vector->particle_dtype_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, data->particles) < 0)
@@ -582,13 +1495,423 @@ h5fnal_read_all_truths(h5fnal_vect_truth_t *vector, h5fnal_vect_truth_data_t *da
     if (H5Dread(vector->neutrino_dset_id, vector->neutrino_dtype_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, data->neutrinos) < 0)
         H5FNAL_HDF5_ERROR;
 
+    data->n_truths = (hsize_t)n_truths;
+    data->n_trajectories = (hsize_t)n_trajectories;
+    data->n_daughters = (hsize_t)n_daughters;
+    data->n_particles = (hsize_t)n_particles;
+    data->n_neutrinos = (hsize_t)n_neutrinos;
+
+    if (decode_trajectories(vector, data, 0) < 0)
+        H5FNAL_PROGRAM_ERROR("could not decode trajectories");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_read_all_truths_into() */
+
+/************************************************************************
+ * h5fnal_append_truths_for_event()
+ *
+ * Appends an event's truths (as in h5fnal_append_truths()) and
+ * records where they went in the vector's event table. Used when one
+ * vector holds a whole run or sub-run. Unlike h5fnal_append_truths(),
+ * the indexes in data are left as they were (event-local).
+ ************************************************************************/
+herr_t
+h5fnal_append_truths_for_event(h5fnal_vect_truth_t *vector, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_vect_truth_data_t *data)
+{
+    if (!vector)
+        H5FNAL_PROGRAM_ERROR("vector parameter cannot be NULL");
+    if (!data)
+        H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL");
+
+    if (h5fnal_get_async_writes() > 0) {
+        if (queue_truths(vector, TRUE, run, subrun, event, data) < 0)
+            H5FNAL_PROGRAM_ERROR("could not queue truths");
+    }
+    else if (append_truths_for_event(vector, run, subrun, event, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not append truths");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_append_truths_for_event() */
+
+static herr_t
+append_truths_for_event(h5fnal_vect_truth_t *vector, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_vect_truth_data_t *data)
+{
+    h5fnal_appender_t *apps[H5FNAL_MAX_EVENT_DSETS];
+    hsize_t start[H5FNAL_MAX_EVENT_DSETS];
+    hsize_t count[H5FNAL_MAX_EVENT_DSETS];
+    hssize_t shift[H5FNAL_MAX_EVENT_DSETS];
+    hssize_t n;
+    unsigned u;
+
+    /* Fail before any data is written */
+    if (h5fnal_check_new_event(&(vector->events), run, subrun, event) < 0)
+        H5FNAL_PROGRAM_ERROR("event is already in the product");
+
+    apps[TRUTH_EVENT_TRUTHS] = &(vector->truth_app);
+    apps[TRUTH_EVENT_TRAJECTORIES] = &(vector->trajectory_app);
+    apps[TRUTH_EVENT_DAUGHTERS] = &(vector->daughter_app);
+    apps[TRUTH_EVENT_PARTICLES] = &(vector->particle_app);
+    apps[TRUTH_EVENT_NEUTRINOS] = &(vector->neutrino_app);
+    for (u = 0; u < H5FNAL_MAX_EVENT_DSETS; u++) {
+        if ((n = h5fnal_get_appender_size(apps[u])) < 0)
+            H5FNAL_PROGRAM_ERROR("could not get dataset size");
+        start[u] = (hsize_t)n;
+    }
+
+    /* h5fnal_append_truths() writes nothing without truths */
+    memset(count, 0, sizeof(count));
+    if (data->n_truths > 0) {
+        count[TRUTH_EVENT_TRUTHS] = data->n_truths;
+        count[TRUTH_EVENT_TRAJECTORIES] = data->n_trajectories;
+        count[TRUTH_EVENT_DAUGHTERS] = data->n_daughters;
+        count[TRUTH_EVENT_PARTICLES] = data->n_particles;
+        count[TRUTH_EVENT_NEUTRINOS] = data->n_neutrinos;
+    }
+
+    if (append_truths(vector, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not append truths");
+    if (data->n_truths > 0) {
+        for (u = 0; u < H5FNAL_MAX_EVENT_DSETS; u++)
+            shift[u] = -(hssize_t)start[u];
+        shift_truth_indices(data, shift);
+    }
+    if (h5fnal_add_event(&(vector->events), run, subrun, event, start, count) < 0)
+        H5FNAL_PROGRAM_ERROR("could not add event to event table");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end append_truths_for_event() */
+
+herr_t
+h5fnal_read_truths_for_event(h5fnal_vect_truth_t *vector, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_vect_truth_data_t *data)
+{
+    if (!data)
+        H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL");
+
+    /* Initialize the data struct */
+    memset(data, 0, sizeof(h5fnal_vect_truth_data_t));
+
+    if (h5fnal_read_truths_for_event_into(vector, run, subrun, event, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read truths");
+
     return H5FNAL_SUCCESS;
 
 error:
     if (data)
         h5fnal_free_truth_mem_data(data);
     return H5FNAL_FAILURE;
-} /* end h5fnal_read_all_truths() */
+} /* end h5fnal_read_truths_for_event() */
+
+/************************************************************************
+ * h5fnal_read_truths_for_event_into()
+ *
+ * Reads one event's truths from a vector that holds a whole run or
+ * sub-run, reusing the buffers in data (see
+ * h5fnal_read_all_truths_into()). The indexes refer to the arrays in
+ * data, as they did when the event was appended.
+ ************************************************************************/
+herr_t
+h5fnal_read_truths_for_event_into(h5fnal_vect_truth_t *vector, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_vect_truth_data_t *data)
+{
+    h5fnal_event_entry_t entry;
+    hssize_t shift[H5FNAL_MAX_EVENT_DSETS];
+    htri_t found;
+    unsigned u;
+
+    if (!vector)
+        H5FNAL_PROGRAM_ERROR("vector parameter cannot be NULL");
+    if (!data)
+        H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL");
+
+    data->n_truths = 0;
+    data->n_trajectories = 0;
+    data->n_daughters = 0;
+    data->n_particles = 0;
+    data->n_neutrinos = 0;
+
+    if (h5fnal_flush_v_mc_truth(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush appended data");
+
+    if ((found = h5fnal_find_event(&(vector->events), run, subrun, event, &entry)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not look up event");
+    if (!found)
+        H5FNAL_PROGRAM_ERROR("event is not in the event table");
+
+    /* Make sure the buffers are big enough */
+    if (h5fnal_reserve_buffer((void **)&(data->truths), &(data->truths_capacity), entry.count[TRUTH_EVENT_TRUTHS], sizeof(h5fnal_truth_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not allocate memory");
+    if (h5fnal_reserve_buffer((void **)&(data->trajectories), &(data->trajectories_capacity), entry.count[TRUTH_EVENT_TRAJECTORIES], sizeof(h5fnal_trajectory_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not allocate memory");
+    if (h5fnal_reserve_buffer((void **)&(data->daughters), &(data->daughters_capacity), entry.count[TRUTH_EVENT_DAUGHTERS], sizeof(h5fnal_daughter_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not allocate memory");
+    if (h5fnal_reserve_buffer((void **)&(data->particles), &(data->particles_capacity), entry.count[TRUTH_EVENT_PARTICLES], sizeof(h5fnal_particle_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not allocate memory");
+    if (h5fnal_reserve_buffer((void **)&(data->neutrinos), &(data->neutrinos_capacity), entry.count[TRUTH_EVENT_NEUTRINOS], sizeof(h5fnal_neutrino_t)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not allocate memory");
+
+    /* Read the event's part of each dataset */
+    if (h5fnal_read_dset_range(vector->truth_dset_id, vector->truth_dtype_id,
+            entry.start[TRUTH_EVENT_TRUTHS], entry.count[TRUTH_EVENT_TRUTHS], data->truths) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read truths");
+    if (read_trajectories(vector, entry.start[TRUTH_EVENT_TRAJECTORIES], entry.count[TRUTH_EVENT_TRAJECTORIES], data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read trajectories");
+    if (h5fnal_read_dset_range(vector->daughter_dset_id, vector->daughter_dtype_id,
+            entry.start[TRUTH_EVENT_DAUGHTERS], entry.count[TRUTH_EVENT_DAUGHTERS], data->daughters) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read daughters");
+    if (h5fnal_read_dset_range(vector->particle_dset_id, vector->particle_dtype_id,
+            entry.start[TRUTH_EVENT_PARTICLES], entry.count[TRUTH_EVENT_PARTICLES], data->particles) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read particles");
+    if (h5fnal_read_dset_range(vector->neutrino_dset_id, vector->neutrino_dtype_id,
+            entry.start[TRUTH_EVENT_NEUTRINOS], entry.count[TRUTH_EVENT_NEUTRINOS], data->neutrinos) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read neutrinos");
+
+    data->n_truths = entry.count[TRUTH_EVENT_TRUTHS];
+    data->n_trajectories = entry.count[TRUTH_EVENT_TRAJECTORIES];
+    data->n_daughters = entry.count[TRUTH_EVENT_DAUGHTERS];
+    data->n_particles = entry.count[TRUTH_EVENT_PARTICLES];
+    data->n_neutrinos = entry.count[TRUTH_EVENT_NEUTRINOS];
+
+    if (decode_trajectories(vector, data, (hssize_t)entry.start[TRUTH_EVENT_TRAJECTORIES]) < 0)
+        H5FNAL_PROGRAM_ERROR("could not decode trajectories");
+
+    /* Point the indexes at the event's data in memory */
+    for (u = 0; u < H5FNAL_MAX_EVENT_DSETS; u++)
+        shift[u] = -(hssize_t)entry.start[u];
+    shift_truth_indices(data, shift);
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_read_truths_for_event_into() */
+
+/************************************************************************
+ * widen_span()
+ *
+ * Widens [*lo, *hi] to take in [start, end]. A negative start means
+ * no elements, as does a negative *lo.
+ ************************************************************************/
+static void
+widen_span(hssize_t start, hssize_t end, hssize_t *lo, hssize_t *hi)
+{
+    if (start < 0)
+        return;
+
+    if (*lo < 0 || start < *lo)
+        *lo = start;
+    if (end > *hi)
+        *hi = end;
+
+    return;
+} /* end widen_span() */
+
+/************************************************************************
+ * read_truth_span()
+ *
+ * Reads dataset elements [lo, hi] (none if lo is negative) into a
+ * buffer in data, growing it if needed, and sets *n.
+ ************************************************************************/
+static herr_t
+read_truth_span(hid_t did, hid_t tid, hssize_t lo, hssize_t hi, void **buf, hsize_t *capacity, size_t elem_size, hsize_t *n)
+{
+    hssize_t size;
+    hsize_t count;
+
+    *n = 0;
+    if (lo < 0)
+        return H5FNAL_SUCCESS;
+
+    if ((size = h5fnal_get_dset_size(did)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get dataset size");
+    if (hi < lo || hi >= size)
+        H5FNAL_PROGRAM_ERROR("index is out of range");
+    count = (hsize_t)(hi - lo + 1);
+
+    if (h5fnal_reserve_buffer(buf, capacity, count, elem_size) < 0)
+        H5FNAL_PROGRAM_ERROR("could not allocate memory");
+    if (h5fnal_read_dset_range(did, tid, (hsize_t)lo, count, *buf) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read dataset elements");
+    *n = count;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end read_truth_span() */
+
+/************************************************************************
+ * h5fnal_read_truth()
+ *
+ * Reads truth i and the particles, trajectories, daughters and
+ * neutrino it refers to (see h5fnal_read_truth_range()).
+ ************************************************************************/
+herr_t
+h5fnal_read_truth(h5fnal_vect_truth_t *vector, hsize_t i, h5fnal_vect_truth_data_t *data)
+{
+    return h5fnal_read_truth_range(vector, i, 1, data);
+} /* end h5fnal_read_truth() */
+
+herr_t
+h5fnal_read_truth_range(h5fnal_vect_truth_t *vector, hsize_t start, hsize_t count, h5fnal_vect_truth_data_t *data)
+{
+    if (!data)
+        H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL");
+
+    /* Initialize the data struct */
+    memset(data, 0, sizeof(h5fnal_vect_truth_data_t));
+
+    if (h5fnal_read_truth_range_into(vector, start, count, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read truths");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    if (data)
+        h5fnal_free_truth_mem_data(data);
+    return H5FNAL_FAILURE;
+} /* end h5fnal_read_truth_range() */
+
+/************************************************************************
+ * h5fnal_read_truth_range_into()
+ *
+ * Reads truths [start, start + count) without reading the rest of
+ * the vector: the truth rows first, then only the spans of the
+ * particle, neutrino, trajectory and daughter datasets that their
+ * indexes cover. The indexes are moved to refer to the arrays in
+ * data. Reuses the buffers in data (see h5fnal_read_all_truths_into()).
+ ************************************************************************/
+herr_t
+h5fnal_read_truth_range_into(h5fnal_vect_truth_t *vector, hsize_t start, hsize_t count, h5fnal_vect_truth_data_t *data)
+{
+    hssize_t    lo[H5FNAL_MAX_EVENT_DSETS];
+    hssize_t    hi[H5FNAL_MAX_EVENT_DSETS];
+    hssize_t    shift[H5FNAL_MAX_EVENT_DSETS];
+    hsize_t     u;
+
+    if (!vector)
+        H5FNAL_PROGRAM_ERROR("vector parameter cannot be NULL");
+    if (!data)
+        H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL");
+
+    data->n_truths = 0;
+    data->n_trajectories = 0;
+    data->n_daughters = 0;
+    data->n_particles = 0;
+    data->n_neutrinos = 0;
+
+    if (h5fnal_flush_v_mc_truth(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush appended data");
+
+    for (u = 0; u < H5FNAL_MAX_EVENT_DSETS; u++) {
+        lo[u] = -1;
+        hi[u] = -1;
+    }
+
+    /* The truths */
+    if (count > 0) {
+        lo[TRUTH_EVENT_TRUTHS] = (hssize_t)start;
+        hi[TRUTH_EVENT_TRUTHS] = (hssize_t)(start + count - 1);
+    }
+    if (read_truth_span(vector->truth_dset_id, vector->truth_dtype_id, lo[TRUTH_EVENT_TRUTHS], hi[TRUTH_EVENT_TRUTHS],
+            (void **)&(data->truths), &(data->truths_capacity), sizeof(h5fnal_truth_t), &(data->n_truths)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read truths");
+
+    /* Their particles and neutrinos */
+    for (u = 0; u < data->n_truths; u++) {
+        widen_span(data->truths[u].particle_start_index, data->truths[u].particle_end_index,
+                &lo[TRUTH_EVENT_PARTICLES], &hi[TRUTH_EVENT_PARTICLES]);
+        widen_span(data->truths[u].neutrino_index, data->truths[u].neutrino_index,
+                &lo[TRUTH_EVENT_NEUTRINOS], &hi[TRUTH_EVENT_NEUTRINOS]);
+    }
+    if (read_truth_span(vector->particle_dset_id, vector->particle_dtype_id, lo[TRUTH_EVENT_PARTICLES], hi[TRUTH_EVENT_PARTICLES],
+            (void **)&(data->particles), &(data->particles_capacity), sizeof(h5fnal_particle_t), &(data->n_particles)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read particles");
+    if (read_truth_span(vector->neutrino_dset_id, vector->neutrino_dtype_id, lo[TRUTH_EVENT_NEUTRINOS], hi[TRUTH_EVENT_NEUTRINOS],
+            (void **)&(data->neutrinos), &(data->neutrinos_capacity), sizeof(h5fnal_neutrino_t), &(data->n_neutrinos)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read neutrinos");
+
+    /* The particles' trajectories and daughters */
+    for (u = 0; u < data->n_particles; u++) {
+        widen_span(data->particles[u].trajectory_start_index, data->particles[u].trajectory_end_index,
+                &lo[TRUTH_EVENT_TRAJECTORIES], &hi[TRUTH_EVENT_TRAJECTORIES]);
+        widen_span(data->particles[u].daughter_start_index, data->particles[u].daughter_end_index,
+                &lo[TRUTH_EVENT_DAUGHTERS], &hi[TRUTH_EVENT_DAUGHTERS]);
+    }
+    if (!trajectories_encoded(vector)) {
+        if (read_truth_span(vector->trajectory_dset_id, vector->trajectory_dtype_id, lo[TRUTH_EVENT_TRAJECTORIES], hi[TRUTH_EVENT_TRAJECTORIES],
+                (void **)&(data->trajectories), &(data->trajectories_capacity), sizeof(h5fnal_trajectory_t), &(data->n_trajectories)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not read trajectories");
+    }
+    else {
+        if (read_truth_span(vector->trajectory_dset_id, vector->trajectory_dtype_id, lo[TRUTH_EVENT_TRAJECTORIES], hi[TRUTH_EVENT_TRAJECTORIES],
+                &(vector->trajectory_buf), &(vector->trajectory_buf_capacity),
+                encoded_trajectory_size(&(vector->trajectory_encoding)), &(data->n_trajectories)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not read trajectories");
+    }
+    if (read_truth_span(vector->daughter_dset_id, vector->daughter_dtype_id, lo[TRUTH_EVENT_DAUGHTERS], hi[TRUTH_EVENT_DAUGHTERS],
+            (void **)&(data->daughters), &(data->daughters_capacity), sizeof(h5fnal_daughter_t), &(data->n_daughters)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read daughters");
+
+    if (decode_trajectories(vector, data, (lo[TRUTH_EVENT_TRAJECTORIES] > 0) ? lo[TRUTH_EVENT_TRAJECTORIES] : 0) < 0)
+        H5FNAL_PROGRAM_ERROR("could not decode trajectories");
+
+    /* Point the indexes at the arrays in data */
+    for (u = 0; u < H5FNAL_MAX_EVENT_DSETS; u++)
+        shift[u] = (lo[u] > 0) ? -lo[u] : 0;
+    shift_truth_indices(data, shift);
+
+    return H5FNAL_SUCCESS;
+
+error:
+    data->n_truths = 0;
+    data->n_trajectories = 0;
+    data->n_daughters = 0;
+    data->n_particles = 0;
+    data->n_neutrinos = 0;
+
+    return H5FNAL_FAILURE;
+} /* end h5fnal_read_truth_range_into() */
+
+/************************************************************************
+ * h5fnal_fill_trajectory_particle_indexes()
+ *
+ * Points not in any particle's trajectory get H5FNAL_NO_PARTICLE_INDEX.
+ ************************************************************************/
+herr_t
+h5fnal_fill_trajectory_particle_indexes(h5fnal_vect_truth_data_t *data)
+{
+    hsize_t first, last;
+    hsize_t u, r;
+    htri_t has_range;
+
+    if (!data)
+        H5FNAL_PROGRAM_ERROR("data parameter cannot be NULL");
+
+    for (u = 0; u < data->n_trajectories; u++)
+        data->trajectories[u].particle_index = H5FNAL_NO_PARTICLE_INDEX;
+
+    for (u = 0; u < data->n_particles; u++) {
+        if ((has_range = get_trajectory_range(&(data->particles[u]), 0, data->n_trajectories, &first, &last)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not get particle's trajectory");
+        if (!has_range)
+            continue;
+        for (r = first; r <= last; r++)
+            data->trajectories[r].particle_index = u;
+    }
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+} /* end h5fnal_fill_trajectory_particle_indexes() */
 
 /* Important in case the library and application use a different
  * memory allocator.
@@ -71,7 +71,10 @@ typedef struct h5fnal_daughter_t {
     int         track_id;
 } h5fnal_daughter_t;
 
-/* Trajectory type */
+/* Trajectory type
+ * particle_index is H5FNAL_NO_PARTICLE_INDEX when read from a version
+ * 2 vector (see h5fnal_fill_trajectory_particle_indexes())
+ */
 typedef struct h5fnal_trajectory_t {
     double      Vx;
     double      Vy;
@@ -84,6 +87,54 @@ typedef struct h5fnal_trajectory_t {
     hsize_t     particle_index;
 } h5fnal_trajectory_t;
 
+/* Trajectory encodings
+ *
+ * How the trajectory points are stored (see
+ * h5fnal_create_v_mc_truth_with_encoding()). They are always read
+ * back as h5fnal_trajectory_t.
+ *
+ * FLOAT stores the values as 32-bit floats. FIXED stores them as
+ * 64-bit integers, in steps of the encoding's scales, with Vx, Vy,
+ * Vz and T stored as the change from the previous point on the same
+ * particle's trajectory. The small differences compress well with
+ * the shuffle filter. The integers are summed before scaling, so
+ * every read gives exactly the values that were stored. The
+ * particles' trajectory ranges must be disjoint and in particle
+ * order.
+ */
+typedef enum h5fnal_trajectory_format_t {
+    H5FNAL_TRAJECTORY_DOUBLE    = 0,
+    H5FNAL_TRAJECTORY_FLOAT     = 1,
+    H5FNAL_TRAJECTORY_FIXED     = 2
+} h5fnal_trajectory_format_t;
+
+/* Fixed-point steps (cm, ns and GeV) */
+#define H5FNAL_DEFAULT_POSITION_SCALE   1.0e-4
+#define H5FNAL_DEFAULT_TIME_SCALE       1.0e-3
+#define H5FNAL_DEFAULT_MOMENTUM_SCALE   1.0e-6
+
+/* Indexes of the scales and errors */
+#define H5FNAL_TRAJECTORY_POSITION      0   /* Vx, Vy, Vz       */
+#define H5FNAL_TRAJECTORY_TIME          1   /* T                */
+#define H5FNAL_TRAJECTORY_MOMENTUM      2   /* Px, Py, Pz, E    */
+#define H5FNAL_TRAJECTORY_N_SCALES      3
+
+/* Trajectory versions
+ *
+ * Version 2 doesn't store the particle index, which duplicates the
+ * particles' trajectory indexes.
+ */
+#define H5FNAL_TRAJECTORY_VERSION_1     1
+#define H5FNAL_TRAJECTORY_VERSION_2     2
+
+#define H5FNAL_NO_PARTICLE_INDEX        ((hsize_t)-1)
+
+typedef struct h5fnal_trajectory_encoding_t {
+    h5fnal_trajectory_format_t  format;
+    unsigned                    version;
+    double                      scale[H5FNAL_TRAJECTORY_N_SCALES];  /* FIXED only */
+} h5fnal_trajectory_encoding_t;
+
 /* MC Truth Type
  * -1 values mean nothing stored
  */
@@ -109,16 +160,49 @@ typedef struct h5fnal_vect_truth_t {
     hid_t       daughter_dtype_id;
     hid_t       daughter_dset_id;
 
-    hid_t       trajectory_dtype_id;
+    hid_t       trajectory_dtype_id;    /* the encoded type, if encoded */
     hid_t       trajectory_dset_id;
 
     hid_t       truth_dtype_id;
     hid_t       truth_dset_id;
 
-    string_dictionary_t dict;
+    /* Appenders for the datasets (cache the sizes and dataspaces) */
+    h5fnal_appender_t   neutrino_app;
+    h5fnal_appender_t   particle_app;
+    h5fnal_appender_t   daughter_app;
+    h5fnal_appender_t   trajectory_app;
+    h5fnal_appender_t   truth_app;
+
+    /* Process name strings. This is the file-wide dictionary,
+     * which is owned (and closed) by the file, not the vector.
+     */
+    string_dictionary_t *dict;
+
+    /* Where each event is, when the vector holds a whole run or
+     * sub-run (see h5fnal_append_truths_for_event())
+     */
+    h5fnal_event_table_t    events;
+
+    /* How the trajectories are stored, and the largest difference
+     * between a value that was appended and the value stored (for
+     * each scale; kept in the product's attributes)
+     */
+    h5fnal_trajectory_encoding_t    trajectory_encoding;
+    double                          trajectory_max_error[H5FNAL_TRAJECTORY_N_SCALES];
+    hbool_t                         trajectory_error_changed;
+
+    /* Encoded trajectories on their way to or from the file */
+    void                           *trajectory_buf;
+    hsize_t                         trajectory_buf_capacity;
 } h5fnal_vect_truth_t;
 
-/* In-memory data container for I/O calls */
+/* In-memory data container for I/O calls
+ *
+ * The capacities are the allocated sizes of the arrays (in
+ * elements). h5fnal_read_all_truths_into() reuses the arrays and
+ * only grows them when an event doesn't fit, so zero the struct
+ * once and pass it to every read in an event loop.
+ */
 typedef struct h5fnal_vect_truth_data_t {
     hsize_t                 n_truths;
     hsize_t                 n_trajectories;
@@ -131,6 +215,12 @@ typedef struct h5fnal_vect_truth_data_t {
     h5fnal_particle_t      *particles;
     h5fnal_neutrino_t      *neutrinos;
     h5fnal_truth_strings_t *truth_strings;
+
+    hsize_t                 truths_capacity;
+    hsize_t                 trajectories_capacity;
+    hsize_t                 daughters_capacity;
+    hsize_t                 particles_capacity;
+    hsize_t                 neutrinos_capacity;
 } h5fnal_vect_truth_data_t;
 
 #ifdef __cplusplus
@@ -143,13 +233,36 @@ hid_t h5fnal_create_particle_type(void);
 hid_t h5fnal_create_daughter_type(void);
 hid_t h5fnal_create_trajectory_type(void);
 hid_t h5fnal_create_truth_type(void);
+hid_t h5fnal_create_encoded_trajectory_type(h5fnal_trajectory_format_t format, unsigned version);
+
+/* Fill in an encoding (with the default scales) */
+void h5fnal_default_trajectory_encoding(h5fnal_trajectory_encoding_t *encoding, h5fnal_trajectory_format_t format);
 
-herr_t h5fnal_create_v_mc_truth(hid_t loc_id, const char *name, h5fnal_vect_truth_t *vector);
+herr_t h5fnal_create_v_mc_truth(hid_t loc_id, const char *name, const h5fnal_storage_profile_t *profile, h5fnal_vect_truth_t *vector);
+herr_t h5fnal_create_v_mc_truth_with_encoding(hid_t loc_id, const char *name, const h5fnal_trajectory_encoding_t *encoding, const h5fnal_storage_profile_t *profile, h5fnal_vect_truth_t *vector);
 herr_t h5fnal_open_v_mc_truth(hid_t loc_id, const char *name, h5fnal_vect_truth_t *vector);
+herr_t h5fnal_open_v_mc_truth_with_types(hid_t loc_id, const char *name, const h5fnal_product_types_t *types, h5fnal_vect_truth_t *vector);
 herr_t h5fnal_close_v_mc_truth(h5fnal_vect_truth_t *vector);
 
 herr_t h5fnal_append_truths(h5fnal_vect_truth_t *vector, h5fnal_vect_truth_data_t *data);
+herr_t h5fnal_flush_v_mc_truth(h5fnal_vect_truth_t *vector);
 herr_t h5fnal_read_all_truths(h5fnal_vect_truth_t *vector, h5fnal_vect_truth_data_t *data);
+herr_t h5fnal_read_all_truths_into(h5fnal_vect_truth_t *vector, h5fnal_vect_truth_data_t *data);
+
+/* Read some of the truths (and only the data they refer to) */
+herr_t h5fnal_read_truth(h5fnal_vect_truth_t *vector, hsize_t i, h5fnal_vect_truth_data_t *data);
+herr_t h5fnal_read_truth_range(h5fnal_vect_truth_t *vector, hsize_t start, hsize_t count, h5fnal_vect_truth_data_t *data);
+herr_t h5fnal_read_truth_range_into(h5fnal_vect_truth_t *vector, hsize_t start, hsize_t count, h5fnal_vect_truth_data_t *data);
+
+/* One vector per run or sub-run, with an event table */
+herr_t h5fnal_append_truths_for_event(h5fnal_vect_truth_t *vector, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_vect_truth_data_t *data);
+herr_t h5fnal_read_truths_for_event(h5fnal_vect_truth_t *vector, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_vect_truth_data_t *data);
+herr_t h5fnal_read_truths_for_event_into(h5fnal_vect_truth_t *vector, uint32_t run, uint32_t subrun, uint32_t event, h5fnal_vect_truth_data_t *data);
+
+/* Sets the trajectory points' particle indexes from the particles'
+ * trajectory indexes (for data read from a version 2 vector)
+ */
+herr_t h5fnal_fill_trajectory_particle_indexes(h5fnal_vect_truth_data_t *data);
 
 herr_t h5fnal_free_truth_mem_data(h5fnal_vect_truth_data_t *data);
 
@@ -13,9 +13,16 @@
 #define EVENT_NAME          "testevent"
 #define ASSNS_NAME          "assns"
 #define ASSNS_DATA_NAME     "assns_data"
+#define ASSNS_SUBRUN_NAME   "assns_subrun"
 #define LEFT_NAME           "left_data_product"
 #define RIGHT_NAME          "right_data_product"
 
+/* Events in the sub-run Assns and the pairs in each */
+#define RUN_NUMBER          1
+#define SUBRUN_NUMBER       1
+#define N_SUBRUN_EVENTS     3
+#define N_EVENT_PAIRS       1000
+
 h5fnal_assns_data_t *
 generate_test_assns(size_t n)
 {
@@ -64,6 +71,24 @@ error:
 
 } /* end generate_test_assns() */
 
+/* Compares pairs field by field (the structs have padding) */
+static hbool_t
+pairs_match(const h5fnal_pair_t *a, const h5fnal_pair_t *b, hsize_t n)
+{
+    hsize_t u;
+
+    for (u = 0; u < n; u++)
+        if (a[u].left_process_index != b[u].left_process_index
+                || a[u].left_product_index != b[u].left_product_index
+                || a[u].left_key != b[u].left_key
+                || a[u].right_process_index != b[u].right_process_index
+                || a[u].right_product_index != b[u].right_product_index
+                || a[u].right_key != b[u].right_key)
+            return FALSE;
+
+    return TRUE;
+} /* end pairs_match() */
+
 
 /************************************************************************
  * Function:    main()
@@ -86,12 +111,23 @@ main(void)
     /* Assns */
     h5fnal_assns_t         *assns = NULL;
     h5fnal_assns_t         *assns_data = NULL;
+    h5fnal_assns_t         *assns_subrun = NULL;
     hsize_t                 n;
 
+    /* Storage */
+    h5fnal_storage_profile_t    scratch;
+    h5fnal_storage_profile_t    zstd;
+    hid_t                   dcpl_id = -1;
+
     /* Data */
     h5fnal_assns_data_t    *data = NULL;
     h5fnal_assns_data_t    *data_out = NULL;
+    h5fnal_assns_data_t     event_data;
     size_t                  size;
+    hssize_t                n_pairs_before;
+    hssize_t                n_data_before;
+    herr_t                  ret;
+    unsigned                u;
 
     printf("Testing Assns operations... ");
 
@@ -119,18 +155,34 @@ main(void)
     /* CREATE DATA PRODUCT */
     /***********************/
 
+    /* Storage profiles: no compression, and Zstd (which is deflate
+     * unless the Zstd plugin can be loaded)
+     */
+    h5fnal_scratch_storage_profile(&scratch);
+    if (h5fnal_filter_storage_profile(&zstd, H5FNAL_FILTER_ZSTD, 0, NULL) < 0)
+        H5FNAL_PROGRAM_ERROR("could not set up Zstd storage profile");
+
     /* Create the assns data product */
     if (NULL == (assns = calloc(1, sizeof(h5fnal_assns_t))))
         H5FNAL_PROGRAM_ERROR("could not get memory for assns");
-    if (h5fnal_create_assns(event_id, ASSNS_NAME, LEFT_NAME, RIGHT_NAME, H5FNAL_BAD_HID_T, assns) < 0)
+    if (h5fnal_create_assns(event_id, ASSNS_NAME, LEFT_NAME, RIGHT_NAME, H5FNAL_BAD_HID_T, &scratch, assns) < 0)
         H5FNAL_PROGRAM_ERROR("could not create assns data product");
 
     /* Create the assns data product that uses 'extra' data */
     if (NULL == (assns_data = calloc(1, sizeof(h5fnal_assns_t))))
         H5FNAL_PROGRAM_ERROR("could not get memory for assns_data");
-    if (h5fnal_create_assns(event_id, ASSNS_DATA_NAME, LEFT_NAME, RIGHT_NAME, H5T_STD_I64LE, assns_data) < 0)
+    if (h5fnal_create_assns(event_id, ASSNS_DATA_NAME, LEFT_NAME, RIGHT_NAME, H5T_STD_I64LE, &zstd, assns_data) < 0)
         H5FNAL_PROGRAM_ERROR("could not create assns_data data product");
 
+    /* The scratch profile has no filters */
+    if ((dcpl_id = H5Dget_create_plist(assns->pair_dset_id)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (0 != H5Pget_nfilters(dcpl_id))
+        H5FNAL_PROGRAM_ERROR("scratch storage profile dataset has filters");
+    if (H5Pclose(dcpl_id) < 0)
+        H5FNAL_HDF5_ERROR;
+    dcpl_id = -1;
+
     /* Make sure we are getting the names of the left and right data products out */
     if (!assns->right)
         H5FNAL_PROGRAM_ERROR("right data product name in struct is NULL")
@@ -297,6 +349,74 @@ main(void)
     if (h5fnal_free_assns_mem_data(data_out) < 0)
         H5FNAL_PROGRAM_ERROR("could not free assns memory");
 
+    /*********************************/
+    /* ONE ASSNS FOR A WHOLE SUB-RUN */
+    /*********************************/
+
+    /* Each event gets its own slice of the test data */
+    if (NULL == (assns_subrun = calloc(1, sizeof(h5fnal_assns_t))))
+        H5FNAL_PROGRAM_ERROR("could not get memory for assns_subrun");
+    if (h5fnal_create_assns(subrun_id, ASSNS_SUBRUN_NAME, LEFT_NAME, RIGHT_NAME, H5T_STD_I64LE, NULL, assns_subrun) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create sub-run assns data product");
+
+    /* Events 3, 1, 2, so event 2's pairs don't start at zero */
+    memset(&event_data, 0, sizeof(h5fnal_assns_data_t));
+    event_data.n = N_EVENT_PAIRS;
+    for (u = N_SUBRUN_EVENTS; u > 0; u--) {
+        unsigned e = (u % N_SUBRUN_EVENTS) + 1;
+
+        event_data.pairs = data->pairs + (e - 1) * N_EVENT_PAIRS;
+        event_data.data = (int64_t *)data->data + (e - 1) * N_EVENT_PAIRS;
+        if (h5fnal_append_assns_for_event(assns_subrun, RUN_NUMBER, SUBRUN_NUMBER, e, &event_data) < 0)
+            H5FNAL_PROGRAM_ERROR("could not write event assns to the file");
+    }
+
+    /* A duplicate event is rejected before any of its data is written */
+    if ((n_pairs_before = h5fnal_get_appender_size(&(assns_subrun->pair_app))) < 0
+            || (n_data_before = h5fnal_get_appender_size(&(assns_subrun->data_app))) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get dataset sizes");
+    H5E_BEGIN_TRY {
+        ret = h5fnal_append_assns_for_event(assns_subrun, RUN_NUMBER, SUBRUN_NUMBER, 1, &event_data);
+    } H5E_END_TRY;
+    if (ret >= 0)
+        H5FNAL_PROGRAM_ERROR("duplicate event was appended");
+    if (h5fnal_get_appender_size(&(assns_subrun->pair_app)) != n_pairs_before
+            || h5fnal_get_appender_size(&(assns_subrun->data_app)) != n_data_before
+            || assns_subrun->events.n_entries != N_SUBRUN_EVENTS)
+        H5FNAL_PROGRAM_ERROR("rejected duplicate event wrote data");
+
+    /* Read single events back */
+    if (h5fnal_read_assns_for_event(assns_subrun, RUN_NUMBER, SUBRUN_NUMBER, 2, data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read event assns from the file");
+    if (data_out->n != N_EVENT_PAIRS || !pairs_match(data->pairs + N_EVENT_PAIRS, data_out->pairs, N_EVENT_PAIRS)
+            || memcmp((int64_t *)data->data + N_EVENT_PAIRS, data_out->data, N_EVENT_PAIRS * sizeof(int64_t)))
+        H5FNAL_PROGRAM_ERROR("Assns event 2 incorrect");
+    if (h5fnal_read_assns_for_event_into(assns_subrun, RUN_NUMBER, SUBRUN_NUMBER, 3, data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read event assns from the file");
+    if (data_out->n != N_EVENT_PAIRS || !pairs_match(data->pairs + 2 * N_EVENT_PAIRS, data_out->pairs, N_EVENT_PAIRS)
+            || memcmp((int64_t *)data->data + 2 * N_EVENT_PAIRS, data_out->data, N_EVENT_PAIRS * sizeof(int64_t)))
+        H5FNAL_PROGRAM_ERROR("Assns event 3 incorrect");
+
+    /* And through the saved event table */
+    if (h5fnal_close_assns(assns_subrun) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close assns_subrun");
+    if (h5fnal_open_assns(subrun_id, ASSNS_SUBRUN_NAME, assns_subrun) < 0)
+        H5FNAL_PROGRAM_ERROR("could not open sub-run assns data product");
+    if (h5fnal_read_assns_for_event_into(assns_subrun, RUN_NUMBER, SUBRUN_NUMBER, 1, data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read event assns from the file");
+    if (data_out->n != N_EVENT_PAIRS || !pairs_match(data->pairs, data_out->pairs, N_EVENT_PAIRS)
+            || memcmp(data->data, data_out->data, N_EVENT_PAIRS * sizeof(int64_t)))
+        H5FNAL_PROGRAM_ERROR("Assns event 1 incorrect after re-opening");
+    H5E_BEGIN_TRY {
+        ret = h5fnal_read_assns_for_event_into(assns_subrun, RUN_NUMBER, SUBRUN_NUMBER, N_SUBRUN_EVENTS + 1, data_out);
+    } H5E_END_TRY;
+    if (ret >= 0)
+        H5FNAL_PROGRAM_ERROR("reading a missing event should have failed");
+
+    /* Clean up */
+    if (h5fnal_free_assns_mem_data(data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not free assns memory");
+
     /********************/
     /* CLOSE EVERYTHING */
     /********************/
@@ -306,6 +426,8 @@ main(void)
         H5FNAL_PROGRAM_ERROR("could not close assns");
     if (h5fnal_close_assns(assns_data) < 0)
         H5FNAL_PROGRAM_ERROR("could not close assns_data");
+    if (h5fnal_close_assns(assns_subrun) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close assns_subrun");
 
     /* Close boilerplate */
     if (h5fnal_close_run(run_id) < 0)
@@ -321,6 +443,7 @@ main(void)
 
     free(assns);
     free(assns_data);
+    free(assns_subrun);
 
     if (h5fnal_free_assns_mem_data(data) < 0)
         H5FNAL_PROGRAM_ERROR("could not free assns memory");
@@ -335,10 +458,13 @@ main(void)
 
 error:
     H5E_BEGIN_TRY {
+        H5Pclose(dcpl_id);
         if(assns)
             h5fnal_close_assns(assns);
         if(assns_data)
             h5fnal_close_assns(assns_data);
+        if(assns_subrun)
+            h5fnal_close_assns(assns_subrun);
         h5fnal_close_run(run_id);
         h5fnal_close_run(subrun_id);
         h5fnal_close_event(event_id);
@@ -348,6 +474,7 @@ error:
 
     free(assns);
     free(assns_data);
+    free(assns_subrun);
 
     if (data) {
         h5fnal_free_assns_mem_data(data);
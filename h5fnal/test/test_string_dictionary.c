@@ -14,6 +14,16 @@
 #define STRING_EMPTY        ""
 #define STRING_SHORT        "foo"
 #define STRING_LONG         "This is a longer string with spaces!\n"
+#define STRING_AFTER_FLUSH  "added after a flush"
+#define STRING_APPENDED     "appended after re-opening"
+
+/* Enough strings to force the hash index to grow a few times */
+#define N_MANY_STRINGS      1000
+#define MANY_STRING_FORMAT  "many string %d"
+#define MANY_STRING_LEN     64
+
+/* Longer than the initial string buffer */
+#define HUGE_STRING_LEN     10000
 
 int
 main(void)
@@ -24,6 +34,9 @@ main(void)
     hbool_t found;
     unsigned index;
     char *s = NULL;
+    char buf[MANY_STRING_LEN];
+    char *huge = NULL;
+    int i;
 
     printf("Testing string dictionary operations... ");
 
@@ -41,11 +54,30 @@ main(void)
     if (create_string_dictionary(fid, dict) < 0)
         H5FNAL_PROGRAM_ERROR("could not create string dictionary");
 
+    /* Pre-size the dictionary */
+    if (reserve_string_dictionary(dict, 64, 1024) < 0)
+        H5FNAL_PROGRAM_ERROR("could not reserve string dictionary space");
+    if (dict->n_allocated < 64 || dict->total_string_alloc < 1024)
+        H5FNAL_PROGRAM_ERROR("reserve did not grow the dictionary");
+
     /* Add some strings */
     if (add_string_to_dictionary(STRING_SHORT, dict) < 0)
         H5FNAL_PROGRAM_ERROR("could not add string to dictionary");
     if (add_string_to_dictionary(STRING_LONG, dict) < 0)
         H5FNAL_PROGRAM_ERROR("could not add string to dictionary");
+    for (i = 0; i < N_MANY_STRINGS; i++) {
+        snprintf(buf, sizeof(buf), MANY_STRING_FORMAT, i);
+        if (add_string_to_dictionary(buf, dict) < 0)
+            H5FNAL_PROGRAM_ERROR("could not add string to dictionary");
+    }
+
+    /* Checkpoint, then add one more string after the flush */
+    if (flush_string_dictionary(dict) < 0)
+        H5FNAL_PROGRAM_ERROR("could not flush string dictionary");
+    if (dict->n_strings_flushed != dict->n_strings)
+        H5FNAL_PROGRAM_ERROR("flush did not write all strings");
+    if (add_string_to_dictionary(STRING_AFTER_FLUSH, dict) < 0)
+        H5FNAL_PROGRAM_ERROR("could not add string to dictionary");
 
     /* Close (and save) the dictionary */
     if(close_string_dictionary(dict) < 0)
@@ -76,6 +108,19 @@ main(void)
     if(!found || index != 2)
         H5FNAL_PROGRAM_ERROR("wrong string index returned");
 
+    for (i = 0; i < N_MANY_STRINGS; i++) {
+        snprintf(buf, sizeof(buf), MANY_STRING_FORMAT, i);
+        if (get_string_index(buf, dict, &found, &index) < 0)
+            H5FNAL_PROGRAM_ERROR("problem checking for string");
+        if(!found || index != (unsigned)(3 + i))
+            H5FNAL_PROGRAM_ERROR("wrong string index returned");
+    }
+
+    if (get_string_index(STRING_AFTER_FLUSH, dict, &found, &index) < 0)
+        H5FNAL_PROGRAM_ERROR("problem checking for string");
+    if(!found || index != (unsigned)(3 + N_MANY_STRINGS))
+        H5FNAL_PROGRAM_ERROR("wrong string index returned");
+
     /* Check the string values */
     if (get_string(dict, 0, &s) < 0)
         H5FNAL_PROGRAM_ERROR("problem getting string");
@@ -95,6 +140,71 @@ main(void)
         H5FNAL_PROGRAM_ERROR("wrong string returned");
     free(s);
 
+    /* Check the borrowed string pointers */
+    {
+        const char *cs = NULL;
+        size_t len = 0;
+
+        if (get_string_ptr(dict, 2, &cs, &len) < 0)
+            H5FNAL_PROGRAM_ERROR("problem getting string pointer");
+        if (len != strlen(STRING_LONG) || strcmp(STRING_LONG, cs))
+            H5FNAL_PROGRAM_ERROR("wrong string returned");
+        if (get_string_ptr(dict, 0, &cs, &len) < 0)
+            H5FNAL_PROGRAM_ERROR("problem getting string pointer");
+        if (len != 0 || strcmp(STRING_EMPTY, cs))
+            H5FNAL_PROGRAM_ERROR("wrong string returned");
+    }
+
+    /* Intern existing and new strings (the length excludes the tail here) */
+    if (intern_string(dict, STRING_SHORT "bar", strlen(STRING_SHORT), &index) < 0)
+        H5FNAL_PROGRAM_ERROR("problem interning string");
+    if (index != 1)
+        H5FNAL_PROGRAM_ERROR("wrong string index returned");
+    if (intern_string(dict, STRING_APPENDED, strlen(STRING_APPENDED), &index) < 0)
+        H5FNAL_PROGRAM_ERROR("problem interning string");
+    if (index != (unsigned)(4 + N_MANY_STRINGS))
+        H5FNAL_PROGRAM_ERROR("wrong string index returned");
+    if (get_string_index(STRING_APPENDED, dict, &found, &index) < 0)
+        H5FNAL_PROGRAM_ERROR("problem checking for string");
+    if(!found || index != (unsigned)(4 + N_MANY_STRINGS))
+        H5FNAL_PROGRAM_ERROR("wrong string index returned");
+
+    /* A string that forces the string buffer to grow more than once */
+    if (NULL == (huge = (char *)malloc(HUGE_STRING_LEN)))
+        H5FNAL_PROGRAM_ERROR("could not get memory for huge string");
+    memset(huge, 'x', HUGE_STRING_LEN);
+    if (intern_string(dict, huge, HUGE_STRING_LEN, &index) < 0)
+        H5FNAL_PROGRAM_ERROR("problem interning string");
+    {
+        const char *cs = NULL;
+        size_t len = 0;
+
+        if (get_string_ptr(dict, index, &cs, &len) < 0)
+            H5FNAL_PROGRAM_ERROR("problem getting string pointer");
+        if (len != HUGE_STRING_LEN || memcmp(huge, cs, len) || cs[len] != '\0')
+            H5FNAL_PROGRAM_ERROR("wrong string returned");
+    }
+    free(huge);
+    huge = NULL;
+
+    /* Close (appending the new strings) and re-open the dictionary */
+    if(close_string_dictionary(dict) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close string dictionary");
+    if (open_string_dictionary(fid, dict) < 0)
+        H5FNAL_PROGRAM_ERROR("could not open string dictionary");
+
+    /* The strings added after re-opening should be there */
+    if (dict->n_strings != (unsigned)(6 + N_MANY_STRINGS))
+        H5FNAL_PROGRAM_ERROR("wrong number of strings after appending");
+    if (get_string_index(STRING_APPENDED, dict, &found, &index) < 0)
+        H5FNAL_PROGRAM_ERROR("problem checking for string");
+    if(!found || index != (unsigned)(4 + N_MANY_STRINGS))
+        H5FNAL_PROGRAM_ERROR("wrong string index returned");
+    if (get_string_index(STRING_SHORT, dict, &found, &index) < 0)
+        H5FNAL_PROGRAM_ERROR("problem checking for string");
+    if(!found || index != 1)
+        H5FNAL_PROGRAM_ERROR("wrong string index returned");
+
     /* Close everything */
     if(close_string_dictionary(dict) < 0)
         H5FNAL_PROGRAM_ERROR("could not close string dictionary");
@@ -118,6 +228,7 @@ error:
         close_string_dictionary(dict);
     free(dict);
     free(s);
+    free(huge);
 
     printf("*** FAILURE ***\n");
 
@@ -1,5 +1,6 @@
 /* Test the vector of MC Hit Collection API */
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,6 +13,33 @@
 #define SUBRUN_NAME "test_subrun"
 #define EVENT_NAME  "test_event"
 #define VECTOR_NAME "test_hit_collection"
+#define COLUMNAR_VECTOR_NAME "test_columnar_hit_collection"
+#define MULTI_VECTOR_NAME "test_multi_append_hit_collection"
+#define DIRECT_VECTOR_NAME "test_direct_chunk_hit_collection"
+#define DIRECT_COLUMNAR_VECTOR_NAME "test_direct_chunk_columnar_hit_collection"
+#define SUBRUN_VECTOR_NAME "test_subrun_hit_collection"
+#define ASYNC_VECTOR_NAME "test_async_hit_collection"
+
+/* Numbered run, sub-run and events for the reader test */
+#define READER_RUN_NAME     "1"
+#define READER_SUBRUN_NAME  "2"
+#define READER_N_EVENTS     3
+
+/* Runs of numbered sub-runs and events for the prefetch test */
+#define PREFETCH_MASTER_NAME    "prefetch_runs"
+#define PREFETCH_N_RUNS         2
+#define PREFETCH_N_EVENTS       3
+#define PREFETCH_DEPTH          2
+
+/* Fixed data for the direct chunk write test, a whole number of
+ * small chunks in every dataset
+ */
+#define DIRECT_N_HIT_COLLECTIONS    256
+#define DIRECT_HITS_PER_COLLECTION  4
+#define DIRECT_CHUNK_SIZE           64
+
+/* Fields read back in the partial read test */
+#define PARTIAL_FIELDS  (H5FNAL_HIT_CHARGE | H5FNAL_HIT_PART_TRACK_ID)
 
 h5fnal_vect_hitcoll_data_t *
 generate_test_hit_collections(hsize_t n_hit_collections)
@@ -98,6 +126,164 @@ error:
 
 } /* end generate_test_hit_collectionss() */
 
+/* Hit collections with a fixed number of hits each and hit values
+ * made from the hit's index
+ */
+static h5fnal_vect_hitcoll_data_t *
+generate_fixed_hit_collections(hsize_t n_hit_collections, hsize_t hits_per_collection)
+{
+    h5fnal_vect_hitcoll_data_t *data = NULL;
+    hsize_t u;
+
+    if (NULL == (data = (h5fnal_vect_hitcoll_data_t *)calloc((size_t)1, sizeof(h5fnal_vect_hitcoll_data_t))))
+        H5FNAL_PROGRAM_ERROR("could not allocate memory for test data container");
+
+    data->n_hit_collections = n_hit_collections;
+    data->n_hits = n_hit_collections * hits_per_collection;
+    if (NULL == (data->hit_collections = (h5fnal_hitcoll_t *)calloc((size_t)data->n_hit_collections, sizeof(h5fnal_hitcoll_t))))
+        H5FNAL_PROGRAM_ERROR("could not allocate memory for hit collection data");
+    if (NULL == (data->hits = (h5fnal_hit_t *)calloc((size_t)data->n_hits, sizeof(h5fnal_hit_t))))
+        H5FNAL_PROGRAM_ERROR("could not allocate memory for hit data");
+
+    for (u = 0; u < n_hit_collections; u++) {
+        data->hit_collections[u].channel = (unsigned)u;
+        data->hit_collections[u].start = u * hits_per_collection;
+        data->hit_collections[u].count = hits_per_collection;
+    }
+    for (u = 0; u < data->n_hits; u++) {
+        data->hits[u].signal_time   = (float)u;
+        data->hits[u].signal_width  = (float)(u % 7);
+        data->hits[u].peak_amp      = (float)(u % 100) * 0.5f;
+        data->hits[u].charge        = (float)u * 2.0f;
+        data->hits[u].part_vertex_x = (float)(u % 13);
+        data->hits[u].part_vertex_y = (float)(u % 17);
+        data->hits[u].part_vertex_z = (float)(u % 19);
+        data->hits[u].part_energy   = (float)u * 0.25f;
+        data->hits[u].part_track_id = (int)(u / 3);
+    }
+
+    return data;
+
+error:
+    if (data) {
+        free(data->hits);
+        free(data->hit_collections);
+    }
+    free(data);
+
+    return NULL;
+} /* end generate_fixed_hit_collections() */
+
+/* Checks that a dataset holds n_chunks whole chunks that went through
+ * both filters (the direct writes apply them outside the library)
+ */
+static herr_t
+check_direct_chunks(hid_t did, hsize_t n_chunks)
+{
+    hid_t sid = -1;
+    hid_t dcpl_id = -1;
+    hid_t tid = -1;
+    hsize_t chunk_dims[1];
+    hsize_t offset[1];
+    hsize_t n_stored;
+    hsize_t size;
+    hsize_t raw_size;
+    haddr_t addr;
+    unsigned filter_mask;
+    hsize_t u;
+
+    if ((sid = H5Dget_space(did)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if ((dcpl_id = H5Dget_create_plist(did)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Pget_chunk(dcpl_id, 1, chunk_dims) < 0)
+        H5FNAL_HDF5_ERROR;
+    if ((tid = H5Dget_type(did)) < 0)
+        H5FNAL_HDF5_ERROR;
+    raw_size = chunk_dims[0] * H5Tget_size(tid);
+
+    if (H5Dget_num_chunks(did, sid, &n_stored) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (n_stored != n_chunks)
+        H5FNAL_PROGRAM_ERROR("wrong number of chunks");
+    for (u = 0; u < n_stored; u++) {
+        if (H5Dget_chunk_info(did, sid, u, offset, &filter_mask, &addr, &size) < 0)
+            H5FNAL_HDF5_ERROR;
+        if (filter_mask != 0 || 0 == size || size >= raw_size)
+            H5FNAL_PROGRAM_ERROR("chunk was not filtered");
+    }
+
+    if (H5Tclose(tid) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Pclose(dcpl_id) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Sclose(sid) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Tclose(tid);
+        H5Pclose(dcpl_id);
+        H5Sclose(sid);
+    } H5E_END_TRY;
+
+    return H5FNAL_FAILURE;
+}
+
+/* Reads a subset of the channels (in reverse order, plus one that
+ * doesn't exist) and checks them against the original data.
+ */
+static herr_t
+check_channel_read(h5fnal_vect_hitcoll_t *vector, const h5fnal_vect_hitcoll_data_t *data)
+{
+    unsigned *channels = NULL;
+    size_t n_channels = 0;
+    h5fnal_vect_hitcoll_data_t out;
+    hsize_t u;
+    size_t i;
+
+    memset(&out, 0, sizeof(h5fnal_vect_hitcoll_data_t));
+
+    if (NULL == (channels = (unsigned *)calloc((size_t)data->n_hit_collections + 1, sizeof(unsigned))))
+        H5FNAL_PROGRAM_ERROR("could not allocate memory for channels");
+    for (u = data->n_hit_collections; u > 0; u--)
+        if (0 == (u - 1) % 7)
+            channels[n_channels++] = data->hit_collections[u - 1].channel;
+    channels[n_channels++] = UINT_MAX;
+
+    if (h5fnal_read_hits_for_channels(vector, channels, n_channels, &out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read hits for channels");
+    if (out.n_hit_collections != n_channels - 1)
+        H5FNAL_PROGRAM_ERROR("wrong number of hit collections (channel read)");
+
+    for (i = 0; i < out.n_hit_collections; i++) {
+        const h5fnal_hitcoll_t *in_hc = NULL;
+        const h5fnal_hitcoll_t *out_hc = &(out.hit_collections[i]);
+
+        for (u = 0; u < data->n_hit_collections; u++)
+            if (data->hit_collections[u].channel == channels[i])
+                in_hc = &(data->hit_collections[u]);
+        if (!in_hc || out_hc->channel != in_hc->channel || out_hc->count != in_hc->count)
+            H5FNAL_PROGRAM_ERROR("bad read data (channel read hit collections)");
+        if (out_hc->count > 0 && (out_hc->start + out_hc->count > out.n_hits
+                || memcmp(&(out.hits[out_hc->start]), &(data->hits[in_hc->start]), in_hc->count * sizeof(h5fnal_hit_t)) != 0))
+            H5FNAL_PROGRAM_ERROR("bad read data (channel read hits)");
+    }
+
+    h5fnal_free_hitcoll_mem_data(&out);
+    free(channels);
+
+    return H5FNAL_SUCCESS;
+
+error:
+    h5fnal_free_hitcoll_mem_data(&out);
+    free(channels);
+
+    return H5FNAL_FAILURE;
+} /* end check_channel_read() */
+
 int
 main(void)
 {
@@ -106,13 +292,33 @@ main(void)
     hid_t   run_id = -1;
     hid_t   subrun_id = -1;
     hid_t   event_id = -1;
+    hid_t   reader_run_id = -1;
+    hid_t   reader_subrun_id = -1;
+    hid_t   reader_event_id = -1;
+    hid_t   first_subrun_id = -1;
+    hid_t   prefetch_master_id = -1;
+    h5fnal_reader_t reader;
+    h5fnal_prefetcher_t pf;
+    hbool_t pf_running = FALSE;
+    const h5fnal_prefetched_event_t *pf_event = NULL;
     h5fnal_vect_hitcoll_t *vector = NULL;
     hsize_t n_hit_collections;
     h5fnal_vect_hitcoll_data_t *data = NULL;
     h5fnal_vect_hitcoll_data_t *data_out = NULL;
+    h5fnal_vect_hitcoll_data_t reuse;
+    h5fnal_hit_t *hits_buf = NULL;
+    h5fnal_event_entry_t entry;
+    h5fnal_storage_profile_t profile;
+    hssize_t n_hits_before;
+    hssize_t n_hitcolls_before;
+    herr_t ret;
+    hsize_t u;
 
     printf("Testing Vector of MC Hit Collection operations... ");
 
+    memset(&reuse, 0, sizeof(h5fnal_vect_hitcoll_data_t));
+    memset(&reader, 0, sizeof(h5fnal_reader_t));
+
     /* Create the file */
     if ((fapl_id = H5Pcreate(H5P_FILE_ACCESS)) < 0)
         H5FNAL_HDF5_ERROR;
@@ -132,7 +338,7 @@ main(void)
     /* Create the vector of MC hit collection data product */
     if (NULL == (vector = (h5fnal_vect_hitcoll_t *)calloc(1, sizeof(h5fnal_vect_hitcoll_t))))
         H5FNAL_PROGRAM_ERROR("could not get memory for vector");
-    if (h5fnal_create_v_mc_hit_collection(event_id, VECTOR_NAME, vector) < 0)
+    if (h5fnal_create_v_mc_hit_collection(event_id, VECTOR_NAME, NULL, vector) < 0)
         H5FNAL_PROGRAM_ERROR("could not create vector of mc hit collection");
 
     /* Generate some test data */
@@ -176,10 +382,392 @@ main(void)
     if (memcmp(data->hit_collections, data_out->hit_collections, data->n_hit_collections * sizeof(h5fnal_hitcoll_t)) != 0)
         H5FNAL_PROGRAM_ERROR("bad read data (hit collections)");
 
+    /* Read twice into caller-owned buffers (the second read should reuse them) */
+    if (h5fnal_read_all_hits_into(vector, &reuse) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read hit collections into buffers");
+    hits_buf = reuse.hits;
+    if (h5fnal_read_all_hits_into(vector, &reuse) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read hit collections into buffers");
+    if (reuse.hits != hits_buf || reuse.hits_capacity < reuse.n_hits)
+        H5FNAL_PROGRAM_ERROR("buffers were not reused");
+    if (reuse.n_hits != data->n_hits || memcmp(data->hits, reuse.hits, data->n_hits * sizeof(h5fnal_hit_t)) != 0)
+        H5FNAL_PROGRAM_ERROR("bad read data (hits into buffers)");
+    if (reuse.n_hit_collections != data->n_hit_collections
+            || memcmp(data->hit_collections, reuse.hit_collections, data->n_hit_collections * sizeof(h5fnal_hitcoll_t)) != 0)
+        H5FNAL_PROGRAM_ERROR("bad read data (hit collections into buffers)");
+    if (h5fnal_free_hitcoll_mem_data(&reuse) < 0)
+        H5FNAL_PROGRAM_ERROR("could not free in-memory hit collection data");
+
     /* Close the vector */
     if(h5fnal_close_v_mc_hit_collection(vector) < 0)
         H5FNAL_PROGRAM_ERROR("could not close vector");
 
+    /* Columnar layout: write the same data and check a full and partial read */
+    if (h5fnal_create_v_mc_hit_collection_with_layout(event_id, COLUMNAR_VECTOR_NAME, H5FNAL_HIT_LAYOUT_COLUMNAR, NULL, vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create columnar vector of mc hit collection");
+    if (h5fnal_append_hits(vector, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not write hit collections to the file");
+    if (h5fnal_close_v_mc_hit_collection(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close vector");
+
+    if (h5fnal_open_v_mc_hit_collection(event_id, COLUMNAR_VECTOR_NAME, vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not open columnar vector of mc hit collection");
+    if (H5FNAL_HIT_LAYOUT_COLUMNAR != vector->layout)
+        H5FNAL_PROGRAM_ERROR("wrong hit layout after re-open");
+
+    if (h5fnal_free_hitcoll_mem_data(data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not free in-memory hit collection data");
+    if (h5fnal_read_all_hits(vector, data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read hit collections from the file");
+    if (memcmp(data->hits, data_out->hits, data->n_hits * sizeof(h5fnal_hit_t)) != 0)
+        H5FNAL_PROGRAM_ERROR("bad read data (columnar hits)");
+    if (memcmp(data->hit_collections, data_out->hit_collections, data->n_hit_collections * sizeof(h5fnal_hitcoll_t)) != 0)
+        H5FNAL_PROGRAM_ERROR("bad read data (columnar hit collections)");
+
+    if (h5fnal_free_hitcoll_mem_data(data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not free in-memory hit collection data");
+    if (h5fnal_read_hit_fields(vector, PARTIAL_FIELDS, data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read hit fields from the file");
+    if (data_out->n_hits != data->n_hits)
+        H5FNAL_PROGRAM_ERROR("wrong number of hits (partial read)");
+    for (u = 0; u < data->n_hits; u++)
+        if (data_out->hits[u].charge != data->hits[u].charge
+                || data_out->hits[u].part_track_id != data->hits[u].part_track_id
+                || data_out->hits[u].signal_time != 0.0f
+                || data_out->hits[u].part_energy != 0.0f)
+            H5FNAL_PROGRAM_ERROR("bad read data (partial read)");
+    if (check_channel_read(vector, data) < 0)
+        H5FNAL_PROGRAM_ERROR("channel read failed (columnar)");
+
+    if (h5fnal_close_v_mc_hit_collection(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close vector");
+
+    /* Partial read of the compound layout */
+    if (h5fnal_open_v_mc_hit_collection(event_id, VECTOR_NAME, vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not open vector of mc hit collection");
+    if (h5fnal_free_hitcoll_mem_data(data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not free in-memory hit collection data");
+    if (h5fnal_read_hit_fields(vector, PARTIAL_FIELDS, data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read hit fields from the file");
+    for (u = 0; u < data->n_hits; u++)
+        if (data_out->hits[u].charge != data->hits[u].charge
+                || data_out->hits[u].part_track_id != data->hits[u].part_track_id
+                || data_out->hits[u].signal_time != 0.0f)
+            H5FNAL_PROGRAM_ERROR("bad read data (compound partial read)");
+    if (check_channel_read(vector, data) < 0)
+        H5FNAL_PROGRAM_ERROR("channel read failed (compound)");
+    if (h5fnal_close_v_mc_hit_collection(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close vector");
+
+    /* Append the same data twice (the second append goes through the
+     * cached sizes and has its hit collection starts fixed up)
+     */
+    if (h5fnal_create_v_mc_hit_collection(event_id, MULTI_VECTOR_NAME, NULL, vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create vector of mc hit collection");
+    if (h5fnal_append_hits(vector, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not write hit collections to the file");
+    if (h5fnal_append_hits(vector, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not write hit collections to the file (second append)");
+    if (h5fnal_free_hitcoll_mem_data(data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not free in-memory hit collection data");
+    if (h5fnal_read_all_hits(vector, data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read hit collections from the file");
+    if (data_out->n_hits != 2 * data->n_hits || data_out->n_hit_collections != 2 * data->n_hit_collections)
+        H5FNAL_PROGRAM_ERROR("wrong number of elements after two appends");
+    if (memcmp(data->hits, data_out->hits + data->n_hits, data->n_hits * sizeof(h5fnal_hit_t)) != 0)
+        H5FNAL_PROGRAM_ERROR("bad read data (second append hits)");
+    if (memcmp(data->hit_collections, data_out->hit_collections + data->n_hit_collections,
+            data->n_hit_collections * sizeof(h5fnal_hitcoll_t)) != 0)
+        H5FNAL_PROGRAM_ERROR("bad read data (second append hit collections)");
+    for (u = 0; u < data->n_hit_collections; u++)
+        if (data->hit_collections[u].count > 0)
+            if (data_out->hit_collections[u].start + data->n_hits != data->hit_collections[u].start)
+                H5FNAL_PROGRAM_ERROR("hit collection start was not fixed up");
+    if (h5fnal_close_v_mc_hit_collection(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close vector");
+
+    /* The same two appends, queued for the writer thread. The caller's
+     * data is copied, so its starts aren't fixed up this time.
+     */
+    if (h5fnal_set_async_writes(2) < 0)
+        H5FNAL_PROGRAM_ERROR("could not start writer thread");
+    if (h5fnal_create_v_mc_hit_collection(event_id, ASYNC_VECTOR_NAME, NULL, vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create vector of mc hit collection");
+    if (h5fnal_append_hits(vector, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not queue hit collections");
+    if (h5fnal_append_hits(vector, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not queue hit collections (second append)");
+    if (h5fnal_wait_all() < 0)
+        H5FNAL_PROGRAM_ERROR("queued appends failed");
+    if (h5fnal_free_hitcoll_mem_data(data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not free in-memory hit collection data");
+    if (h5fnal_read_all_hits(vector, data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read hit collections from the file");
+    if (data_out->n_hits != 2 * data->n_hits || data_out->n_hit_collections != 2 * data->n_hit_collections)
+        H5FNAL_PROGRAM_ERROR("wrong number of elements after two queued appends");
+    if (memcmp(data->hits, data_out->hits + data->n_hits, data->n_hits * sizeof(h5fnal_hit_t)) != 0)
+        H5FNAL_PROGRAM_ERROR("bad read data (queued hits)");
+    if (memcmp(data->hit_collections, data_out->hit_collections, data->n_hit_collections * sizeof(h5fnal_hitcoll_t)) != 0)
+        H5FNAL_PROGRAM_ERROR("caller's hit collections were changed by a queued append");
+    for (u = 0; u < data->n_hit_collections; u++)
+        if (data->hit_collections[u].count > 0)
+            if (data_out->hit_collections[data->n_hit_collections + u].start != data->hit_collections[u].start + data->n_hits)
+                H5FNAL_PROGRAM_ERROR("queued hit collection start was not fixed up");
+    if (h5fnal_close_v_mc_hit_collection(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close vector");
+    if (h5fnal_set_async_writes(0) < 0)
+        H5FNAL_PROGRAM_ERROR("could not stop writer thread");
+
+    /* Direct chunk writes: both layouts should read back the same as
+     * data written through the filter pipeline. The fixed data fills
+     * whole small chunks, so every chunk is written directly.
+     */
+    if (h5fnal_free_hitcoll_mem_data(data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not free in-memory hit collection data");
+    free(data);
+    if (NULL == (data = generate_fixed_hit_collections(DIRECT_N_HIT_COLLECTIONS, DIRECT_HITS_PER_COLLECTION)))
+        H5FNAL_PROGRAM_ERROR("could not generate test data");
+    h5fnal_default_storage_profile(&profile);
+    profile.chunk_size = DIRECT_CHUNK_SIZE;
+
+    h5fnal_set_direct_chunk_write(TRUE);
+    if (h5fnal_create_v_mc_hit_collection(event_id, DIRECT_VECTOR_NAME, &profile, vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create vector of mc hit collection");
+    if (h5fnal_append_hits(vector, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not write hit collections to the file");
+    if (!vector->hit_app.direct || !vector->hitcoll_app.direct)
+        H5FNAL_PROGRAM_ERROR("direct chunk writes were not used");
+    if (h5fnal_close_v_mc_hit_collection(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close vector");
+    /* (and compress on worker threads) */
+    if (h5fnal_set_compression_threads(4) < 0)
+        H5FNAL_PROGRAM_ERROR("could not start compression threads");
+    if (h5fnal_create_v_mc_hit_collection_with_layout(event_id, DIRECT_COLUMNAR_VECTOR_NAME, H5FNAL_HIT_LAYOUT_COLUMNAR, &profile, vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create columnar vector of mc hit collection");
+    if (h5fnal_append_hits(vector, data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not write hit collections to the file");
+    if (!vector->hitcoll_app.direct)
+        H5FNAL_PROGRAM_ERROR("direct chunk writes were not used");
+    for (u = 0; u < H5FNAL_HIT_N_FIELDS; u++)
+        if (!vector->hit_field_apps[u].direct)
+            H5FNAL_PROGRAM_ERROR("direct chunk writes were not used (columnar)");
+    if (h5fnal_close_v_mc_hit_collection(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close vector");
+    if (h5fnal_set_compression_threads(0) < 0)
+        H5FNAL_PROGRAM_ERROR("could not stop compression threads");
+    h5fnal_set_direct_chunk_write(FALSE);
+
+    if (h5fnal_open_v_mc_hit_collection(event_id, DIRECT_VECTOR_NAME, vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not open vector of mc hit collection");
+    if (check_direct_chunks(vector->hit_dset_id, data->n_hits / DIRECT_CHUNK_SIZE) < 0
+            || check_direct_chunks(vector->hitcoll_dset_id, data->n_hit_collections / DIRECT_CHUNK_SIZE) < 0)
+        H5FNAL_PROGRAM_ERROR("bad direct chunks");
+    if (h5fnal_free_hitcoll_mem_data(data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not free in-memory hit collection data");
+    if (h5fnal_read_all_hits(vector, data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read hit collections from the file");
+    if (data_out->n_hits != data->n_hits || memcmp(data->hits, data_out->hits, data->n_hits * sizeof(h5fnal_hit_t)) != 0)
+        H5FNAL_PROGRAM_ERROR("bad read data (direct chunk hits)");
+    if (h5fnal_close_v_mc_hit_collection(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close vector");
+
+    if (h5fnal_open_v_mc_hit_collection(event_id, DIRECT_COLUMNAR_VECTOR_NAME, vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not open columnar vector of mc hit collection");
+    for (u = 0; u < H5FNAL_HIT_N_FIELDS; u++)
+        if (check_direct_chunks(vector->hit_field_dset_ids[u], data->n_hits / DIRECT_CHUNK_SIZE) < 0)
+            H5FNAL_PROGRAM_ERROR("bad direct chunks (columnar)");
+    if (h5fnal_free_hitcoll_mem_data(data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not free in-memory hit collection data");
+    if (h5fnal_read_all_hits(vector, data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read hit collections from the file");
+    if (data_out->n_hits != data->n_hits || memcmp(data->hits, data_out->hits, data->n_hits * sizeof(h5fnal_hit_t)) != 0)
+        H5FNAL_PROGRAM_ERROR("bad read data (direct chunk columnar hits)");
+    if (h5fnal_close_v_mc_hit_collection(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close vector");
+
+    /* One vector for the whole sub-run: append three events (out of
+     * order) and read single events back through the event table
+     */
+    if (h5fnal_free_hitcoll_mem_data(data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not free in-memory hit collection data");
+    free(data);
+    if (NULL == (data = generate_test_hit_collections(n_hit_collections)))
+        H5FNAL_PROGRAM_ERROR("could not generate test data");
+    if (h5fnal_create_v_mc_hit_collection(subrun_id, SUBRUN_VECTOR_NAME, NULL, vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create sub-run vector of mc hit collection");
+    for (u = 3; u > 0; u--)
+        if (h5fnal_append_hits_for_event(vector, 1, 1, (uint32_t)u, data) < 0)
+            H5FNAL_PROGRAM_ERROR("could not write event hit collections to the file");
+
+    /* A duplicate event is rejected before any of its data is written */
+    if ((n_hits_before = h5fnal_get_appender_size(&(vector->hit_app))) < 0
+            || (n_hitcolls_before = h5fnal_get_appender_size(&(vector->hitcoll_app))) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get dataset sizes");
+    H5E_BEGIN_TRY {
+        ret = h5fnal_append_hits_for_event(vector, 1, 1, 2, data);
+    } H5E_END_TRY;
+    if (ret >= 0)
+        H5FNAL_PROGRAM_ERROR("duplicate event was appended");
+    if (h5fnal_get_appender_size(&(vector->hit_app)) != n_hits_before
+            || h5fnal_get_appender_size(&(vector->hitcoll_app)) != n_hitcolls_before
+            || vector->events.n_entries != 3)
+        H5FNAL_PROGRAM_ERROR("rejected duplicate event wrote data");
+    if (h5fnal_free_hitcoll_mem_data(data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not free in-memory hit collection data");
+    if (h5fnal_read_hits_for_event(vector, 1, 1, 2, data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read event hit collections from the file");
+    if (data_out->n_hits != data->n_hits || memcmp(data->hits, data_out->hits, data->n_hits * sizeof(h5fnal_hit_t)) != 0)
+        H5FNAL_PROGRAM_ERROR("bad read data (event hits)");
+    if (data_out->n_hit_collections != data->n_hit_collections
+            || memcmp(data->hit_collections, data_out->hit_collections, data->n_hit_collections * sizeof(h5fnal_hitcoll_t)) != 0)
+        H5FNAL_PROGRAM_ERROR("bad read data (event hit collections)");
+    if (h5fnal_close_v_mc_hit_collection(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close vector");
+
+    if (h5fnal_open_v_mc_hit_collection(subrun_id, SUBRUN_VECTOR_NAME, vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not open sub-run vector of mc hit collection");
+    if (vector->events.n_entries != 3)
+        H5FNAL_PROGRAM_ERROR("wrong number of events in the event table");
+    if (h5fnal_find_event(&(vector->events), 1, 1, 4, &entry) != FALSE)
+        H5FNAL_PROGRAM_ERROR("found an event that was never written");
+    if (h5fnal_free_hitcoll_mem_data(data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not free in-memory hit collection data");
+    if (h5fnal_read_hits_for_event(vector, 1, 1, 1, data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read event hit collections from the file");
+    if (data_out->n_hits != data->n_hits || memcmp(data->hits, data_out->hits, data->n_hits * sizeof(h5fnal_hit_t)) != 0)
+        H5FNAL_PROGRAM_ERROR("bad read data (event hits after reopen)");
+    if (data_out->n_hit_collections != data->n_hit_collections
+            || memcmp(data->hit_collections, data_out->hit_collections, data->n_hit_collections * sizeof(h5fnal_hitcoll_t)) != 0)
+        H5FNAL_PROGRAM_ERROR("bad read data (event hit collections after reopen)");
+    if (h5fnal_close_v_mc_hit_collection(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close vector");
+
+    /* Sequential reads through a reader: the run and sub-run stay
+     * open across events and the products share the reader's types
+     */
+    if ((reader_run_id = h5fnal_create_run(fid, READER_RUN_NAME, FALSE)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create run");
+    if ((reader_subrun_id = h5fnal_create_run(reader_run_id, READER_SUBRUN_NAME, FALSE)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create sub-run");
+    for (u = 0; u < READER_N_EVENTS; u++) {
+        char name[16];
+
+        snprintf(name, sizeof(name), "%u", (unsigned)u);
+        if ((reader_event_id = h5fnal_create_event(reader_subrun_id, name, FALSE)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not create event");
+        if (h5fnal_create_v_mc_hit_collection(reader_event_id, VECTOR_NAME, NULL, vector) < 0)
+            H5FNAL_PROGRAM_ERROR("could not create vector of mc hit collection");
+        if (h5fnal_append_hits(vector, data) < 0)
+            H5FNAL_PROGRAM_ERROR("could not write hit collections to the file");
+        if (h5fnal_close_v_mc_hit_collection(vector) < 0)
+            H5FNAL_PROGRAM_ERROR("could not close vector");
+        if (h5fnal_close_event(reader_event_id) < 0)
+            H5FNAL_PROGRAM_ERROR("could not close event");
+        reader_event_id = -1;
+    }
+
+    if (h5fnal_init_reader(&reader, fid) < 0)
+        H5FNAL_PROGRAM_ERROR("could not set up reader");
+    for (u = 0; u < READER_N_EVENTS; u++) {
+        if ((reader_event_id = h5fnal_reader_open_event(&reader, 1, 2, (uint32_t)u)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not open event through the reader");
+        if (0 == u)
+            first_subrun_id = reader.subrun_id;
+        else if (reader.subrun_id != first_subrun_id)
+            H5FNAL_PROGRAM_ERROR("reader re-opened the sub-run");
+        if (h5fnal_open_v_mc_hit_collection_with_types(reader_event_id, VECTOR_NAME, &(reader.types), vector) < 0)
+            H5FNAL_PROGRAM_ERROR("could not open vector of mc hit collection");
+        if (vector->hit_dtype_id != reader.types.hit_dtype_id)
+            H5FNAL_PROGRAM_ERROR("vector did not share the reader's datatype");
+        if (h5fnal_read_all_hits_into(vector, &reuse) < 0)
+            H5FNAL_PROGRAM_ERROR("could not read hit collections from the file");
+        if (reuse.n_hits != data->n_hits || memcmp(data->hits, reuse.hits, data->n_hits * sizeof(h5fnal_hit_t)) != 0)
+            H5FNAL_PROGRAM_ERROR("bad read data (reader hits)");
+        if (h5fnal_close_v_mc_hit_collection(vector) < 0)
+            H5FNAL_PROGRAM_ERROR("could not close vector");
+        if (h5fnal_close_event(reader_event_id) < 0)
+            H5FNAL_PROGRAM_ERROR("could not close event");
+        reader_event_id = -1;
+    }
+    if (h5fnal_close_reader(&reader) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close reader");
+    if (h5fnal_free_hitcoll_mem_data(&reuse) < 0)
+        H5FNAL_PROGRAM_ERROR("could not free in-memory hit collection data");
+    if (h5fnal_close_run(reader_subrun_id) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close run");
+    if (h5fnal_close_run(reader_run_id) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close run");
+    reader_subrun_id = -1;
+    reader_run_id = -1;
+
+    /* Prefetched reads: events come back in creation order, read
+     * ahead on the prefetcher's thread
+     */
+    if ((prefetch_master_id = h5fnal_create_run(fid, PREFETCH_MASTER_NAME, FALSE)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create run container");
+    for (u = 0; u < PREFETCH_N_RUNS * PREFETCH_N_EVENTS; u++) {
+        char name[16];
+
+        if (0 == u % PREFETCH_N_EVENTS) {
+            snprintf(name, sizeof(name), "%u", (unsigned)(u / PREFETCH_N_EVENTS + 1));
+            if ((reader_run_id = h5fnal_create_run(prefetch_master_id, name, FALSE)) < 0)
+                H5FNAL_PROGRAM_ERROR("could not create run");
+            if ((reader_subrun_id = h5fnal_create_run(reader_run_id, "0", FALSE)) < 0)
+                H5FNAL_PROGRAM_ERROR("could not create sub-run");
+        }
+
+        /* Decreasing event numbers, to check creation order */
+        snprintf(name, sizeof(name), "%u", (unsigned)(PREFETCH_N_EVENTS - u % PREFETCH_N_EVENTS));
+        if ((reader_event_id = h5fnal_create_event(reader_subrun_id, name, FALSE)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not create event");
+        if (h5fnal_create_v_mc_hit_collection(reader_event_id, VECTOR_NAME, NULL, vector) < 0)
+            H5FNAL_PROGRAM_ERROR("could not create vector of mc hit collection");
+        if (h5fnal_append_hits(vector, data) < 0)
+            H5FNAL_PROGRAM_ERROR("could not write hit collections to the file");
+        if (h5fnal_close_v_mc_hit_collection(vector) < 0)
+            H5FNAL_PROGRAM_ERROR("could not close vector");
+        if (h5fnal_close_event(reader_event_id) < 0)
+            H5FNAL_PROGRAM_ERROR("could not close event");
+        reader_event_id = -1;
+
+        if (PREFETCH_N_EVENTS - 1 == u % PREFETCH_N_EVENTS) {
+            if (h5fnal_close_run(reader_subrun_id) < 0)
+                H5FNAL_PROGRAM_ERROR("could not close run");
+            if (h5fnal_close_run(reader_run_id) < 0)
+                H5FNAL_PROGRAM_ERROR("could not close run");
+            reader_subrun_id = -1;
+            reader_run_id = -1;
+        }
+    }
+
+    if (h5fnal_start_prefetcher(&pf, prefetch_master_id, VECTOR_NAME, H5FNAL_PREFETCH_HITS, PREFETCH_DEPTH) < 0)
+        H5FNAL_PROGRAM_ERROR("could not start prefetcher");
+    pf_running = TRUE;
+    for (u = 0; ; u++) {
+        if (h5fnal_prefetcher_next(&pf, &pf_event) < 0)
+            H5FNAL_PROGRAM_ERROR("could not get prefetched event");
+        if (NULL == pf_event)
+            break;
+        if (u >= PREFETCH_N_RUNS * PREFETCH_N_EVENTS)
+            H5FNAL_PROGRAM_ERROR("too many prefetched events");
+        if (pf_event->run != u / PREFETCH_N_EVENTS + 1 || pf_event->subrun != 0
+                || pf_event->event != PREFETCH_N_EVENTS - u % PREFETCH_N_EVENTS)
+            H5FNAL_PROGRAM_ERROR("prefetched events out of order");
+        if (pf_event->hits.n_hits != data->n_hits || memcmp(data->hits, pf_event->hits.hits, data->n_hits * sizeof(h5fnal_hit_t)) != 0)
+            H5FNAL_PROGRAM_ERROR("bad read data (prefetched hits)");
+        if (pf_event->hits.n_hit_collections != data->n_hit_collections
+                || memcmp(data->hit_collections, pf_event->hits.hit_collections, data->n_hit_collections * sizeof(h5fnal_hitcoll_t)) != 0)
+            H5FNAL_PROGRAM_ERROR("bad read data (prefetched hit collections)");
+    }
+    if (u != PREFETCH_N_RUNS * PREFETCH_N_EVENTS)
+        H5FNAL_PROGRAM_ERROR("too few prefetched events");
+    pf_running = FALSE;
+    if (h5fnal_stop_prefetcher(&pf) < 0)
+        H5FNAL_PROGRAM_ERROR("could not stop prefetcher");
+    if (h5fnal_close_run(prefetch_master_id) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close run container");
+    prefetch_master_id = -1;
+
     /* Close everything */
     if (h5fnal_close_run(run_id) < 0)
         H5FNAL_PROGRAM_ERROR("could not close run");
@@ -204,6 +792,9 @@ main(void)
     exit(EXIT_SUCCESS);
 
 error:
+    h5fnal_set_async_writes(0);
+    if (pf_running)
+        h5fnal_stop_prefetcher(&pf);
     H5E_BEGIN_TRY {
         H5Pclose(fapl_id);
         H5Fclose(fid);
@@ -214,9 +805,14 @@ error:
         h5fnal_free_hitcoll_mem_data(data);
     if (data_out)
         h5fnal_free_hitcoll_mem_data(data_out);
+    h5fnal_free_hitcoll_mem_data(&reuse);
     h5fnal_close_run(run_id);
     h5fnal_close_run(subrun_id);
     h5fnal_close_event(event_id);
+    h5fnal_close_event(reader_event_id);
+    h5fnal_close_run(reader_subrun_id);
+    h5fnal_close_run(reader_run_id);
+    h5fnal_close_run(prefetch_master_id);
     free(vector);
     free(data);
     free(data_out);
@@ -1,5 +1,7 @@
 /* Test the vector of MC Truth API */
 
+#include <math.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,7 +13,27 @@
 #define RUN_NAME    "testrun"
 #define SUBRUN_NAME "testsubrun"
 #define EVENT_NAME  "testevent"
+#define EVENT_NAME_2 "testevent2"
 #define VECTOR_NAME "vomct"
+#define VECTOR_NAME_2 "vomct2"
+#define VECTOR_NAME_EMPTY "vomct_empty"
+#define VECTOR_NAME_FLOAT "vomct_float"
+#define VECTOR_NAME_FIXED "vomct_fixed"
+#define VECTOR_NAME_DOUBLE_V2 "vomct_double_v2"
+#define VECTOR_NAME_FIXED_BAD "vomct_fixed_bad"
+#define VECTOR_NAME_FIXED_V2 "vomct_fixed_v2"
+#define VECTOR_NAME_EVENTS "vomct_events"
+#define VECTOR_NAME_EVENTS_FIXED "vomct_events_fixed"
+
+#define AUTO_CHUNK_BYTES    4096
+
+/* (run, sub-run, event) numbers for the event index */
+#define RUN_NUMBER      7
+#define SUBRUN_NUMBER   3
+#define EVENT_NUMBER    42
+
+/* Number of events in a sub-run vector */
+#define N_SUBRUN_EVENTS 3
 
 #define STRING_1    "string 1"
 #define STRING_2    "string 2"
@@ -88,10 +110,20 @@ generate_test_truths(h5fnal_vect_truth_data_t *data)
         data->particles[u].gvtx_z           = (double)rand();
         data->particles[u].gvtx_t           = (double)rand();
         data->particles[u].rescatter        = (double)rand();
-        data->particles[u].trajectory_start_index   = (hssize_t)rand();
-        data->particles[u].trajectory_end_index     = (hssize_t)rand();
-        data->particles[u].daughter_start_index     = (hssize_t)rand();
-        data->particles[u].daughter_end_index       = (hssize_t)rand();
+
+        /* One trajectory point each, and a daughter for particles
+         * 1..n_daughters (the rest have none)
+         */
+        data->particles[u].trajectory_start_index   = (hssize_t)u;
+        data->particles[u].trajectory_end_index     = (hssize_t)u;
+        if (u >= 1 && u <= data->n_daughters) {
+            data->particles[u].daughter_start_index = (hssize_t)u - 1;
+            data->particles[u].daughter_end_index   = (hssize_t)u - 1;
+        }
+        else {
+            data->particles[u].daughter_start_index = -1;
+            data->particles[u].daughter_end_index   = -1;
+        }
     }
 
     /* daughters */
@@ -109,15 +141,19 @@ generate_test_truths(h5fnal_vect_truth_data_t *data)
         data->trajectories[u].Py            = (double)rand();
         data->trajectories[u].Pz            = (double)rand();
         data->trajectories[u].E             = (double)rand();
-        data->trajectories[u].particle_index    = (hsize_t)rand();
+        data->trajectories[u].particle_index    = (hsize_t)u;
     }
 
-    /* truths */
+    /* truths (splitting the particles between them, and only the
+     * first ones having neutrinos)
+     */
     for (u = 0; u < data->n_truths; u++) {
+        hsize_t n = data->n_particles / data->n_truths;
+
         data->truths[u].origin                      = (int)rand();
-        data->truths[u].neutrino_index              = (hsize_t)rand();
-        data->truths[u].particle_start_index        = (hssize_t)rand();
-        data->truths[u].particle_end_index          = (hssize_t)rand();
+        data->truths[u].neutrino_index              = (u < data->n_neutrinos) ? (hssize_t)u : -1;
+        data->truths[u].particle_start_index        = (hssize_t)(u * n);
+        data->truths[u].particle_end_index          = (hssize_t)(u * n + n - 1);
     }
 
     return H5FNAL_SUCCESS;
@@ -131,6 +167,451 @@ error:
 
 } /* end generate_test_truths() */
 
+/* Checks that two datasets use the same committed datatype */
+static herr_t
+check_shared_type(hid_t did1, hid_t did2)
+{
+    hid_t tid1 = -1;
+    hid_t tid2 = -1;
+    H5O_info_t info1;
+    H5O_info_t info2;
+
+    if ((tid1 = H5Dget_type(did1)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if ((tid2 = H5Dget_type(did2)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Tcommitted(tid1) <= 0 || H5Tcommitted(tid2) <= 0)
+        H5FNAL_PROGRAM_ERROR("datatype is not committed");
+    if (H5Oget_info2(tid1, &info1, H5O_INFO_BASIC) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Oget_info2(tid2, &info2, H5O_INFO_BASIC) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (info1.addr != info2.addr)
+        H5FNAL_PROGRAM_ERROR("datatypes are different objects");
+
+    if (H5Tclose(tid1) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Tclose(tid2) < 0)
+        H5FNAL_HDF5_ERROR;
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Tclose(tid1);
+        H5Tclose(tid2);
+    } H5E_END_TRY;
+
+    return H5FNAL_FAILURE;
+}
+
+/* Checks that the value fields of two trajectory points are within
+ * the given errors
+ */
+static hbool_t
+trajectory_close(const h5fnal_trajectory_t *a, const h5fnal_trajectory_t *b, const double max_error[])
+{
+    const double pos = max_error[H5FNAL_TRAJECTORY_POSITION];
+    const double t = max_error[H5FNAL_TRAJECTORY_TIME];
+    const double mom = max_error[H5FNAL_TRAJECTORY_MOMENTUM];
+
+    return fabs(a->Vx - b->Vx) <= pos && fabs(a->Vy - b->Vy) <= pos && fabs(a->Vz - b->Vz) <= pos
+        && fabs(a->T - b->T) <= t
+        && fabs(a->Px - b->Px) <= mom && fabs(a->Py - b->Py) <= mom
+        && fabs(a->Pz - b->Pz) <= mom && fabs(a->E - b->E) <= mom;
+}
+
+/* Writes and reads back a vector with encoded trajectories */
+static herr_t
+check_encoded_vector(hid_t loc_id, const char *name, h5fnal_trajectory_format_t format, unsigned version)
+{
+    h5fnal_vect_truth_t vector;
+    h5fnal_trajectory_encoding_t encoding;
+    h5fnal_vect_truth_data_t data;
+    h5fnal_vect_truth_data_t data_out;
+    h5fnal_vect_truth_data_t data_again;
+    h5fnal_trajectory_t *original = NULL;
+    double max_error[H5FNAL_TRAJECTORY_N_SCALES];
+    hbool_t vector_open = FALSE;
+    char *encoding_name = NULL;
+    const char *expected_name;
+    hid_t tid = -1;
+    size_t value_size;
+    hsize_t n;
+    unsigned u;
+
+    memset(&data, 0, sizeof(data));
+    memset(&data_out, 0, sizeof(data_out));
+    memset(&data_again, 0, sizeof(data_again));
+
+    if (generate_test_truths(&data) < 0)
+        H5FNAL_PROGRAM_ERROR("problem generating data for testing");
+    n = data.n_trajectories;
+
+    /* Give the first particle a trajectory of three points, so the
+     * fixed-point differences are used
+     */
+    data.particles[0].trajectory_end_index = 2;
+    for (u = 1; u <= 2; u++) {
+        data.particles[u].trajectory_start_index = -1;
+        data.particles[u].trajectory_end_index = -1;
+        data.trajectories[u].particle_index = 0;
+    }
+    if (NULL == (original = (h5fnal_trajectory_t *)malloc(n * sizeof(h5fnal_trajectory_t))))
+        H5FNAL_PROGRAM_ERROR("could not allocate memory");
+    memcpy(original, data.trajectories, n * sizeof(h5fnal_trajectory_t));
+
+    h5fnal_default_trajectory_encoding(&encoding, format);
+    encoding.version = version;
+    if (h5fnal_create_v_mc_truth_with_encoding(loc_id, name, &encoding, NULL, &vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create vector of mc truth");
+    vector_open = TRUE;
+    if (vector.trajectory_dtype_id != h5fnal_get_product_types()->encoded_trajectory_dtype_ids[format][encoding.version - H5FNAL_TRAJECTORY_VERSION_1]
+            || vector.events.dtype_id != h5fnal_get_product_types()->event_entry_dtype_id)
+        H5FNAL_PROGRAM_ERROR("vector did not share the library's datatypes");
+    for (u = 0; u < 2; u++)
+        if (h5fnal_append_truths(&vector, &data) < 0)
+            H5FNAL_PROGRAM_ERROR("could not write truths to the file");
+    memcpy(max_error, vector.trajectory_max_error, sizeof(max_error));
+    if (H5FNAL_TRAJECTORY_FIXED == format)
+        for (u = 0; u < H5FNAL_TRAJECTORY_N_SCALES; u++)
+            if (max_error[u] > encoding.scale[u] * 0.5000001)
+                H5FNAL_PROGRAM_ERROR("fixed-point error is larger than half a step");
+
+    /* Both appends should read back within the recorded errors */
+    if (h5fnal_read_all_truths_into(&vector, &data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read truths from the file");
+    if (data_out.n_trajectories != 2 * n)
+        H5FNAL_PROGRAM_ERROR("wrong number of trajectories");
+
+    /* Version 2 only has the particle indexes when asked for */
+    if (H5FNAL_TRAJECTORY_VERSION_2 == version) {
+        for (u = 0; u < data_out.n_trajectories; u++)
+            if (data_out.trajectories[u].particle_index != H5FNAL_NO_PARTICLE_INDEX)
+                H5FNAL_PROGRAM_ERROR("version 2 trajectory has a particle index");
+        if (h5fnal_fill_trajectory_particle_indexes(&data_out) < 0)
+            H5FNAL_PROGRAM_ERROR("could not fill in particle indexes");
+    }
+    for (u = 0; u < data_out.n_trajectories; u++) {
+        if (!trajectory_close(&(data_out.trajectories[u]), &(original[u % n]), max_error))
+            H5FNAL_PROGRAM_ERROR("encoded trajectory is outside the recorded error");
+        if (data_out.trajectories[u].particle_index != original[u % n].particle_index + (u < n ? 0 : data.n_particles))
+            H5FNAL_PROGRAM_ERROR("bad read data (encoded trajectory particle index)");
+    }
+
+    /* Reading part of the vector decodes the same values */
+    if (h5fnal_read_truth_range_into(&vector, data.n_truths, 1, &data_again) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read truth range");
+    if (data_again.n_trajectories != (hsize_t)data.truths[0].particle_end_index + 1 - data.n_particles)
+        H5FNAL_PROGRAM_ERROR("wrong number of trajectories in truth range");
+    if (H5FNAL_TRAJECTORY_VERSION_2 == version)
+        if (h5fnal_fill_trajectory_particle_indexes(&data_again) < 0)
+            H5FNAL_PROGRAM_ERROR("could not fill in particle indexes");
+    for (u = 0; u < data_again.n_trajectories; u++)
+        if (memcmp(&(data_again.trajectories[u]), &(data_out.trajectories[n + u]), offsetof(h5fnal_trajectory_t, particle_index)) != 0
+                || data_again.trajectories[u].particle_index != original[u].particle_index)
+            H5FNAL_PROGRAM_ERROR("bad read data (encoded truth range)");
+
+    if (h5fnal_close_v_mc_truth(&vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close vector");
+    vector_open = FALSE;
+
+    /* Re-open it and check the reads are exact and the encoding and
+     * errors were saved
+     */
+    if (h5fnal_open_v_mc_truth(loc_id, name, &vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not open vector of mc truth");
+    vector_open = TRUE;
+    if (vector.trajectory_encoding.format != format
+            || memcmp(vector.trajectory_max_error, max_error, sizeof(max_error)) != 0)
+        H5FNAL_PROGRAM_ERROR("encoding was not saved");
+    if (h5fnal_get_string_attribute(vector.top_level_group_id, "trajectory encoding", &encoding_name) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get trajectory encoding attribute");
+    if (H5FNAL_TRAJECTORY_FIXED == format)
+        expected_name = "fixed";
+    else if (H5FNAL_TRAJECTORY_FLOAT == format)
+        expected_name = "float";
+    else
+        expected_name = "double";
+    if (strcmp(encoding_name, expected_name) || vector.trajectory_encoding.version != version)
+        H5FNAL_PROGRAM_ERROR("wrong trajectory encoding attribute");
+
+    /* Version 2 doesn't store the particle index */
+    value_size = (H5FNAL_TRAJECTORY_FLOAT == format) ? sizeof(float) : sizeof(double);
+    if ((tid = H5Dget_type(vector.trajectory_dset_id)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Tget_size(tid) != 8 * value_size + (H5FNAL_TRAJECTORY_VERSION_1 == version ? sizeof(hsize_t) : 0))
+        H5FNAL_PROGRAM_ERROR("wrong trajectory type size");
+    if (H5Tclose(tid) < 0)
+        H5FNAL_HDF5_ERROR;
+    tid = -1;
+
+    if (h5fnal_read_all_truths_into(&vector, &data_again) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read truths from the file");
+    if (H5FNAL_TRAJECTORY_VERSION_2 == version)
+        if (h5fnal_fill_trajectory_particle_indexes(&data_again) < 0)
+            H5FNAL_PROGRAM_ERROR("could not fill in particle indexes");
+    if (data_again.n_trajectories != data_out.n_trajectories
+            || memcmp(data_again.trajectories, data_out.trajectories, data_out.n_trajectories * sizeof(h5fnal_trajectory_t)) != 0)
+        H5FNAL_PROGRAM_ERROR("encoded trajectories did not read back the same");
+    if (h5fnal_close_v_mc_truth(&vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close vector");
+    vector_open = FALSE;
+
+    free(encoding_name);
+    free(original);
+    if (h5fnal_free_truth_mem_data(&data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not clean up test data");
+    if (h5fnal_free_truth_mem_data(&data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not clean up read data");
+    if (h5fnal_free_truth_mem_data(&data_again) < 0)
+        H5FNAL_PROGRAM_ERROR("could not clean up read data");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Tclose(tid);
+        if (vector_open)
+            h5fnal_close_v_mc_truth(&vector);
+        h5fnal_free_truth_mem_data(&data);
+        h5fnal_free_truth_mem_data(&data_out);
+        h5fnal_free_truth_mem_data(&data_again);
+    } H5E_END_TRY;
+    free(encoding_name);
+    free(original);
+
+    return H5FNAL_FAILURE;
+}
+
+/* Checks that fixed-point appends whose particles share or reorder
+ * trajectory points are rejected without writing anything (the
+ * errors printed here are expected)
+ */
+static herr_t
+check_bad_fixed_ranges(hid_t loc_id)
+{
+    h5fnal_vect_truth_t vector;
+    h5fnal_trajectory_encoding_t encoding;
+    h5fnal_vect_truth_data_t data;
+    hbool_t vector_open = FALSE;
+    herr_t ret;
+
+    memset(&data, 0, sizeof(data));
+
+    if (generate_test_truths(&data) < 0)
+        H5FNAL_PROGRAM_ERROR("problem generating data for testing");
+
+    h5fnal_default_trajectory_encoding(&encoding, H5FNAL_TRAJECTORY_FIXED);
+    if (h5fnal_create_v_mc_truth_with_encoding(loc_id, VECTOR_NAME_FIXED_BAD, &encoding, NULL, &vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create vector of mc truth");
+    vector_open = TRUE;
+
+    /* Particles 0 and 1 share point 1 */
+    data.particles[0].trajectory_end_index = 1;
+    H5E_BEGIN_TRY {
+        ret = h5fnal_append_truths(&vector, &data);
+    } H5E_END_TRY;
+    if (ret >= 0)
+        H5FNAL_PROGRAM_ERROR("append with overlapping trajectories should have failed");
+
+    /* Particle 1's points come before particle 0's */
+    data.particles[0].trajectory_start_index = 1;
+    data.particles[0].trajectory_end_index = 1;
+    data.particles[1].trajectory_start_index = 0;
+    data.particles[1].trajectory_end_index = 0;
+    H5E_BEGIN_TRY {
+        ret = h5fnal_append_truths(&vector, &data);
+    } H5E_END_TRY;
+    if (ret >= 0)
+        H5FNAL_PROGRAM_ERROR("append with out of order trajectories should have failed");
+
+    if (h5fnal_read_all_truths_into(&vector, &data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read truths from the file");
+    if (data.n_truths != 0 || data.n_trajectories != 0 || data.n_particles != 0)
+        H5FNAL_PROGRAM_ERROR("rejected append wrote data");
+
+    if (h5fnal_close_v_mc_truth(&vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close vector");
+    vector_open = FALSE;
+    if (h5fnal_free_truth_mem_data(&data) < 0)
+        H5FNAL_PROGRAM_ERROR("could not clean up test data");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        if (vector_open)
+            h5fnal_close_v_mc_truth(&vector);
+        h5fnal_free_truth_mem_data(&data);
+    } H5E_END_TRY;
+
+    return H5FNAL_FAILURE;
+}
+
+/* Checks that one event's truths read back as they were appended
+ * (the trajectory values to within max_error)
+ */
+static herr_t
+check_event_truths(const h5fnal_vect_truth_data_t *data, const h5fnal_vect_truth_data_t *data_out, const double max_error[])
+{
+    hsize_t u;
+
+    if (data_out->n_truths != data->n_truths || data_out->n_trajectories != data->n_trajectories
+            || data_out->n_daughters != data->n_daughters || data_out->n_particles != data->n_particles
+            || data_out->n_neutrinos != data->n_neutrinos)
+        H5FNAL_PROGRAM_ERROR("wrong number of elements in event");
+
+    for (u = 0; u < data->n_truths; u++)
+        if (data_out->truths[u].origin != data->truths[u].origin
+                || data_out->truths[u].neutrino_index != data->truths[u].neutrino_index
+                || data_out->truths[u].particle_start_index != data->truths[u].particle_start_index
+                || data_out->truths[u].particle_end_index != data->truths[u].particle_end_index)
+            H5FNAL_PROGRAM_ERROR("bad read data (event truths)");
+    for (u = 0; u < data->n_particles; u++)
+        if (data_out->particles[u].track_id != data->particles[u].track_id
+                || data_out->particles[u].trajectory_start_index != data->particles[u].trajectory_start_index
+                || data_out->particles[u].trajectory_end_index != data->particles[u].trajectory_end_index
+                || data_out->particles[u].daughter_start_index != data->particles[u].daughter_start_index
+                || data_out->particles[u].daughter_end_index != data->particles[u].daughter_end_index)
+            H5FNAL_PROGRAM_ERROR("bad read data (event particles)");
+    for (u = 0; u < data->n_daughters; u++)
+        if (data_out->daughters[u].track_id != data->daughters[u].track_id)
+            H5FNAL_PROGRAM_ERROR("bad read data (event daughters)");
+    for (u = 0; u < data->n_neutrinos; u++)
+        if (data_out->neutrinos[u].mode != data->neutrinos[u].mode)
+            H5FNAL_PROGRAM_ERROR("bad read data (event neutrinos)");
+    for (u = 0; u < data->n_trajectories; u++)
+        if (!trajectory_close(&(data_out->trajectories[u]), &(data->trajectories[u]), max_error)
+                || data_out->trajectories[u].particle_index != data->trajectories[u].particle_index)
+            H5FNAL_PROGRAM_ERROR("bad read data (event trajectories)");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    return H5FNAL_FAILURE;
+}
+
+/* Writes several events to one vector (out of order) and reads single
+ * events back, with event-local indexes, before and after re-opening
+ * it (the errors printed here are expected)
+ */
+static herr_t
+check_truths_for_events(hid_t loc_id, const char *name, h5fnal_trajectory_format_t format)
+{
+    h5fnal_vect_truth_t vector;
+    h5fnal_trajectory_encoding_t encoding;
+    h5fnal_vect_truth_data_t data[N_SUBRUN_EVENTS];
+    h5fnal_vect_truth_data_t data_out;
+    double max_error[H5FNAL_TRAJECTORY_N_SCALES];
+    hbool_t vector_open = FALSE;
+    hssize_t n_truths_before;
+    hssize_t n_trajectories_before;
+    herr_t ret;
+    hsize_t v;
+    unsigned u;
+
+    memset(data, 0, sizeof(data));
+    memset(&data_out, 0, sizeof(data_out));
+    memset(max_error, 0, sizeof(max_error));
+
+    /* Make each event's data different */
+    for (u = 0; u < N_SUBRUN_EVENTS; u++) {
+        if (generate_test_truths(&(data[u])) < 0)
+            H5FNAL_PROGRAM_ERROR("problem generating data for testing");
+        for (v = 0; v < data[u].n_truths; v++)
+            data[u].truths[v].origin = (int)(u * 10 + v);
+        for (v = 0; v < data[u].n_trajectories; v++)
+            data[u].trajectories[v].Vx = (double)(u * 1000 + v);
+    }
+
+    h5fnal_default_trajectory_encoding(&encoding, format);
+    if (h5fnal_create_v_mc_truth_with_encoding(loc_id, name, &encoding, NULL, &vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create vector of mc truth");
+    vector_open = TRUE;
+
+    /* Events 3, 1, 2, so event 2's data doesn't start at zero */
+    for (u = N_SUBRUN_EVENTS; u > 0; u--) {
+        unsigned e = (u % N_SUBRUN_EVENTS) + 1;
+
+        if (h5fnal_append_truths_for_event(&vector, RUN_NUMBER, SUBRUN_NUMBER, e, &(data[e - 1])) < 0)
+            H5FNAL_PROGRAM_ERROR("could not write event truths to the file");
+    }
+    if (H5FNAL_TRAJECTORY_DOUBLE != format)
+        memcpy(max_error, vector.trajectory_max_error, sizeof(max_error));
+
+    /* The caller's indexes are left event-local */
+    for (u = 0; u < N_SUBRUN_EVENTS; u++)
+        if (data[u].truths[1].particle_start_index != (hssize_t)(data[u].n_particles / data[u].n_truths)
+                || data[u].particles[1].trajectory_start_index != 1
+                || data[u].trajectories[1].particle_index != 1)
+            H5FNAL_PROGRAM_ERROR("append changed the caller's indexes");
+
+    /* A duplicate event is rejected before any of its data is written */
+    if ((n_truths_before = h5fnal_get_appender_size(&(vector.truth_app))) < 0
+            || (n_trajectories_before = h5fnal_get_appender_size(&(vector.trajectory_app))) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get dataset sizes");
+    H5E_BEGIN_TRY {
+        ret = h5fnal_append_truths_for_event(&vector, RUN_NUMBER, SUBRUN_NUMBER, 1, &(data[0]));
+    } H5E_END_TRY;
+    if (ret >= 0)
+        H5FNAL_PROGRAM_ERROR("duplicate event was appended");
+    if (h5fnal_get_appender_size(&(vector.truth_app)) != n_truths_before
+            || h5fnal_get_appender_size(&(vector.trajectory_app)) != n_trajectories_before
+            || vector.events.n_entries != N_SUBRUN_EVENTS)
+        H5FNAL_PROGRAM_ERROR("rejected duplicate event wrote data");
+
+    /* Read single events back */
+    if (h5fnal_read_truths_for_event(&vector, RUN_NUMBER, SUBRUN_NUMBER, 2, &data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read event truths");
+    if (check_event_truths(&(data[1]), &data_out, max_error) < 0)
+        H5FNAL_PROGRAM_ERROR("event 2 did not read back the same");
+    if (h5fnal_read_truths_for_event_into(&vector, RUN_NUMBER, SUBRUN_NUMBER, 3, &data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read event truths");
+    if (check_event_truths(&(data[2]), &data_out, max_error) < 0)
+        H5FNAL_PROGRAM_ERROR("event 3 did not read back the same");
+
+    if (h5fnal_close_v_mc_truth(&vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close vector");
+    vector_open = FALSE;
+
+    /* And through the saved event table */
+    if (h5fnal_open_v_mc_truth(loc_id, name, &vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not open vector of mc truth");
+    vector_open = TRUE;
+    if (h5fnal_read_truths_for_event_into(&vector, RUN_NUMBER, SUBRUN_NUMBER, 2, &data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read event truths");
+    if (check_event_truths(&(data[1]), &data_out, max_error) < 0)
+        H5FNAL_PROGRAM_ERROR("event 2 did not read back the same after re-opening");
+    H5E_BEGIN_TRY {
+        ret = h5fnal_read_truths_for_event_into(&vector, RUN_NUMBER, SUBRUN_NUMBER, N_SUBRUN_EVENTS + 1, &data_out);
+    } H5E_END_TRY;
+    if (ret >= 0)
+        H5FNAL_PROGRAM_ERROR("reading a missing event should have failed");
+    if (h5fnal_close_v_mc_truth(&vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close vector");
+    vector_open = FALSE;
+
+    for (u = 0; u < N_SUBRUN_EVENTS; u++)
+        if (h5fnal_free_truth_mem_data(&(data[u])) < 0)
+            H5FNAL_PROGRAM_ERROR("could not clean up test data");
+    if (h5fnal_free_truth_mem_data(&data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not clean up read data");
+
+    return H5FNAL_SUCCESS;
+
+error:
+    H5E_BEGIN_TRY {
+        if (vector_open)
+            h5fnal_close_v_mc_truth(&vector);
+        for (u = 0; u < N_SUBRUN_EVENTS; u++)
+            h5fnal_free_truth_mem_data(&(data[u]));
+        h5fnal_free_truth_mem_data(&data_out);
+    } H5E_END_TRY;
+
+    return H5FNAL_FAILURE;
+}
+
 int
 main(void)
 {
@@ -139,9 +620,21 @@ main(void)
     hid_t   run_id = -1;
     hid_t   subrun_id = -1;
     hid_t   event_id = -1;
+    hid_t   event2_id = -1;
+    unsigned u;
+    const char *s = NULL;
+    size_t len;
     h5fnal_vect_truth_t *vector = NULL;
+    h5fnal_vect_truth_t *vector2 = NULL;
     h5fnal_vect_truth_data_t *data = NULL;
     h5fnal_vect_truth_data_t *data_out = NULL;
+    h5fnal_vect_truth_data_t *data_range = NULL;
+    hsize_t first;
+    h5fnal_storage_profile_t profile;
+    hid_t   dcpl_id = -1;
+    hsize_t chunk_dims[1];
+    hsize_t expected;
+    herr_t  ret;
 
     printf("Testing vector of MC Truth operations... ");
 
@@ -150,8 +643,8 @@ main(void)
         H5FNAL_HDF5_ERROR;
     if (H5Pset_libver_bounds(fapl_id, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST) < 0)
         H5FNAL_HDF5_ERROR;
-    if ((fid = H5Fcreate(FILE_NAME, H5F_ACC_TRUNC, H5P_DEFAULT, fapl_id)) < 0)
-        H5FNAL_HDF5_ERROR;
+    if ((fid = h5fnal_create_file(FILE_NAME, H5F_ACC_TRUNC, H5P_DEFAULT, fapl_id)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create file");
 
     /* Create the run, sub-run, and event */
     if ((run_id = h5fnal_create_run(fid, RUN_NAME, FALSE)) < 0)
@@ -161,11 +654,48 @@ main(void)
     if ((event_id = h5fnal_create_event(subrun_id, EVENT_NAME, TRUE)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create event");
 
+    /* Index it, after another (empty) event that comes later in the index */
+    if ((event2_id = h5fnal_create_event(subrun_id, EVENT_NAME_2, TRUE)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create event");
+    if (h5fnal_index_event(event2_id, RUN_NUMBER, SUBRUN_NUMBER, EVENT_NUMBER + 1) < 0)
+        H5FNAL_PROGRAM_ERROR("could not index event");
+    if (h5fnal_close_event(event2_id) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close event");
+    event2_id = -1;
+    if (h5fnal_index_event(event_id, RUN_NUMBER, SUBRUN_NUMBER, EVENT_NUMBER) < 0)
+        H5FNAL_PROGRAM_ERROR("could not index event");
+    /* The index is out of order now, so its last entry isn't the
+     * largest. A duplicate of the later event must still be caught.
+     */
+    H5E_BEGIN_TRY {
+        ret = h5fnal_index_event(event_id, RUN_NUMBER, SUBRUN_NUMBER, EVENT_NUMBER + 1);
+    } H5E_END_TRY;
+    if (ret >= 0)
+        H5FNAL_PROGRAM_ERROR("indexing a duplicate event should have failed");
+
     /* Create the vector of MC truth data product */
     if (NULL == (vector = (h5fnal_vect_truth_t *)calloc(1, sizeof(h5fnal_vect_truth_t))))
         H5FNAL_PROGRAM_ERROR("could not get memory for vector");
-    if (h5fnal_create_v_mc_truth(event_id, VECTOR_NAME, vector) < 0)
+    if (h5fnal_create_v_mc_truth(event_id, VECTOR_NAME, NULL, vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create vector of mc truth");
+
+    /* A second vector in the file should share the string dictionary.
+     * Its datasets are sized from the first two appends.
+     */
+    h5fnal_default_storage_profile(&profile);
+    h5fnal_set_auto_chunking(&profile, AUTO_CHUNK_BYTES, 2);
+    if (NULL == (vector2 = (h5fnal_vect_truth_t *)calloc(1, sizeof(h5fnal_vect_truth_t))))
+        H5FNAL_PROGRAM_ERROR("could not get memory for vector");
+    if (h5fnal_create_v_mc_truth(subrun_id, VECTOR_NAME_2, &profile, vector2) < 0)
         H5FNAL_PROGRAM_ERROR("could not create vector of mc truth");
+    if (vector2->trajectory_dset_id >= 0)
+        H5FNAL_PROGRAM_ERROR("deferred dataset was created too early");
+    if (NULL == vector->dict || vector->dict != vector2->dict)
+        H5FNAL_PROGRAM_ERROR("vectors do not share the string dictionary");
+    if (intern_string(vector->dict, STRING_1, strlen(STRING_1), &u) < 0)
+        H5FNAL_PROGRAM_ERROR("could not add string to dictionary");
+    if (intern_string(vector2->dict, STRING_2, strlen(STRING_2), &u) < 0)
+        H5FNAL_PROGRAM_ERROR("could not add string to dictionary");
 
     /* Generate some test data */
     if (NULL == (data = (h5fnal_vect_truth_data_t *)calloc(1, sizeof(h5fnal_vect_truth_data_t))))
@@ -173,13 +703,162 @@ main(void)
     if (generate_test_truths(data) < 0)
         H5FNAL_PROGRAM_ERROR("problem generating data for testing");
 
+    /* The second append creates the deferred datasets, with the
+     * trajectory chunks holding a whole number of appends
+     */
+    for (u = 0; u < 2; u++)
+        if (h5fnal_append_truths(vector2, data) < 0)
+            H5FNAL_PROGRAM_ERROR("could not write truths to the file");
+
+    /* The second append's indexes should have been moved past the
+     * first append's data (data now holds the fixed-up values)
+     */
+    if (NULL == (data_out = (h5fnal_vect_truth_data_t *)calloc(1, sizeof(h5fnal_vect_truth_data_t))))
+        H5FNAL_PROGRAM_ERROR("could not get memory for in-memory truth data container");
+    if (h5fnal_read_all_truths(vector2, data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read truths from the file");
+    if (data_out->n_truths != 2 * data->n_truths || data_out->n_particles != 2 * data->n_particles)
+        H5FNAL_PROGRAM_ERROR("wrong number of elements after two appends");
+    if (memcmp(data->truths, data_out->truths + data->n_truths, data->n_truths * sizeof(h5fnal_truth_t)) != 0)
+        H5FNAL_PROGRAM_ERROR("bad read data (second append truths)");
+    if (memcmp(data->particles, data_out->particles + data->n_particles, data->n_particles * sizeof(h5fnal_particle_t)) != 0)
+        H5FNAL_PROGRAM_ERROR("bad read data (second append particles)");
+    if (memcmp(data->trajectories, data_out->trajectories + data->n_trajectories, data->n_trajectories * sizeof(h5fnal_trajectory_t)) != 0)
+        H5FNAL_PROGRAM_ERROR("bad read data (second append trajectories)");
+    for (u = 0; u < data->n_truths; u++)
+        if ((data->truths[u].neutrino_index >= 0
+                    && data_out->truths[u].neutrino_index + (hssize_t)data->n_neutrinos != data->truths[u].neutrino_index)
+                || data_out->truths[u].particle_start_index + (hssize_t)data->n_particles != data->truths[u].particle_start_index
+                || data_out->truths[u].particle_end_index + (hssize_t)data->n_particles != data->truths[u].particle_end_index)
+            H5FNAL_PROGRAM_ERROR("truth indexes were not fixed up");
+    for (u = 0; u < data->n_particles; u++)
+        if (data_out->particles[u].trajectory_start_index + (hssize_t)data->n_trajectories != data->particles[u].trajectory_start_index
+                || data_out->particles[u].trajectory_end_index + (hssize_t)data->n_trajectories != data->particles[u].trajectory_end_index)
+            H5FNAL_PROGRAM_ERROR("particle trajectory indexes were not fixed up");
+    for (u = 0; u < data->n_particles; u++) {
+        if (data_out->particles[u].daughter_start_index < 0) {
+            if (data->particles[u].daughter_start_index != -1 || data->particles[u].daughter_end_index != -1)
+                H5FNAL_PROGRAM_ERROR("missing daughter index was changed");
+        }
+        else if (data_out->particles[u].daughter_start_index + (hssize_t)data->n_daughters != data->particles[u].daughter_start_index)
+            H5FNAL_PROGRAM_ERROR("particle daughter indexes were not fixed up");
+    }
+    for (u = 0; u < data->n_trajectories; u++)
+        if (data_out->trajectories[u].particle_index + data->n_particles != data->trajectories[u].particle_index)
+            H5FNAL_PROGRAM_ERROR("trajectory particle index was not fixed up");
+
+    /* Read the last truth of the first append and the first of the
+     * second (only the data they refer to)
+     */
+    if (NULL == (data_range = (h5fnal_vect_truth_data_t *)calloc(1, sizeof(h5fnal_vect_truth_data_t))))
+        H5FNAL_PROGRAM_ERROR("could not get memory for in-memory truth data container");
+    if (h5fnal_read_truth_range(vector2, data->n_truths - 1, 2, data_range) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read truth range");
+    first = (hsize_t)data_out->truths[data->n_truths - 1].particle_start_index;
+    if (data_range->n_truths != 2
+            || data_range->n_particles != (hsize_t)data->truths[0].particle_end_index + 1 - first
+            || data_range->n_neutrinos != 1)
+        H5FNAL_PROGRAM_ERROR("wrong number of elements in truth range");
+    if (data_range->truths[0].particle_start_index != 0
+            || data_range->truths[1].neutrino_index != 0)
+        H5FNAL_PROGRAM_ERROR("truth range indexes were not rebased");
+    if (memcmp(data_range->neutrinos, data->neutrinos, sizeof(h5fnal_neutrino_t)) != 0)
+        H5FNAL_PROGRAM_ERROR("bad read data (truth range neutrinos)");
+    for (u = 0; u < data_range->n_particles; u++) {
+        const h5fnal_particle_t *p = &(data_range->particles[u]);
+        const h5fnal_particle_t *q = &(data_out->particles[first + u]);
+
+        if (p->mass != q->mass || p->track_id != q->track_id)
+            H5FNAL_PROGRAM_ERROR("bad read data (truth range particles)");
+        if (p->trajectory_start_index < 0 || (hsize_t)p->trajectory_start_index >= data_range->n_trajectories
+                || memcmp(&(data_range->trajectories[p->trajectory_start_index]),
+                    &(data_out->trajectories[q->trajectory_start_index]), offsetof(h5fnal_trajectory_t, particle_index)) != 0)
+            H5FNAL_PROGRAM_ERROR("bad read data (truth range trajectories)");
+        if (p->daughter_start_index >= 0
+                && data_range->daughters[p->daughter_start_index].track_id != data_out->daughters[q->daughter_start_index].track_id)
+            H5FNAL_PROGRAM_ERROR("bad read data (truth range daughters)");
+    }
+
+    /* A single truth */
+    if (h5fnal_free_truth_mem_data(data_range) < 0)
+        H5FNAL_PROGRAM_ERROR("could not clean up read data");
+    if (h5fnal_read_truth(vector2, 0, data_range) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read truth");
+    if (data_range->n_truths != 1 || data_range->truths[0].origin != data_out->truths[0].origin
+            || data_range->n_neutrinos != 1 || data_range->n_daughters != data->n_daughters)
+        H5FNAL_PROGRAM_ERROR("bad read data (single truth)");
+    if (h5fnal_free_truth_mem_data(data_range) < 0)
+        H5FNAL_PROGRAM_ERROR("could not clean up read data");
+    free(data_range);
+    data_range = NULL;
+
+    if (h5fnal_free_truth_mem_data(data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not clean up read data");
+    if (vector2->trajectory_dset_id < 0)
+        H5FNAL_PROGRAM_ERROR("deferred dataset was not created");
+    if ((dcpl_id = H5Dget_create_plist(vector2->trajectory_dset_id)) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Pget_chunk(dcpl_id, 1, chunk_dims) < 0)
+        H5FNAL_HDF5_ERROR;
+    if (H5Pclose(dcpl_id) < 0)
+        H5FNAL_HDF5_ERROR;
+    dcpl_id = -1;
+    expected = AUTO_CHUNK_BYTES / H5Tget_size(vector2->trajectory_dtype_id);
+    expected -= expected % data->n_trajectories;
+    if (chunk_dims[0] != expected)
+        H5FNAL_PROGRAM_ERROR("wrong automatic chunk size");
+
+    /* Both vectors' trajectory datasets should use the one datatype
+     * committed to the file
+     */
+    if (check_shared_type(vector->trajectory_dset_id, vector2->trajectory_dset_id) < 0)
+        H5FNAL_PROGRAM_ERROR("datasets do not share a committed datatype");
+    if (h5fnal_close_v_mc_truth(vector2) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close vector");
+
+    /* A vector that is closed before anything is appended still gets
+     * its deferred datasets
+     */
+    if (h5fnal_create_v_mc_truth(event_id, VECTOR_NAME_EMPTY, &profile, vector2) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create vector of mc truth");
+    if (h5fnal_close_v_mc_truth(vector2) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close empty vector");
+    if (h5fnal_open_v_mc_truth(event_id, VECTOR_NAME_EMPTY, vector2) < 0)
+        H5FNAL_PROGRAM_ERROR("could not open empty vector");
+    if (h5fnal_read_all_truths(vector2, data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not read truths from the file");
+    if (data_out->n_truths != 0 || data_out->n_trajectories != 0 || data_out->n_particles != 0)
+        H5FNAL_PROGRAM_ERROR("empty vector has data");
+    if (h5fnal_free_truth_mem_data(data_out) < 0)
+        H5FNAL_PROGRAM_ERROR("could not clean up read data");
+    if (h5fnal_close_v_mc_truth(vector2) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close vector");
+
+    /* Float and fixed-point trajectories */
+    if (check_encoded_vector(event_id, VECTOR_NAME_FLOAT, H5FNAL_TRAJECTORY_FLOAT, H5FNAL_TRAJECTORY_VERSION_1) < 0)
+        H5FNAL_PROGRAM_ERROR("float trajectories failed");
+    if (check_encoded_vector(event_id, VECTOR_NAME_FIXED, H5FNAL_TRAJECTORY_FIXED, H5FNAL_TRAJECTORY_VERSION_1) < 0)
+        H5FNAL_PROGRAM_ERROR("fixed-point trajectories failed");
+    if (check_bad_fixed_ranges(event_id) < 0)
+        H5FNAL_PROGRAM_ERROR("bad fixed-point trajectory ranges were not rejected");
+
+    /* Trajectories without the particle index */
+    if (check_encoded_vector(event_id, VECTOR_NAME_DOUBLE_V2, H5FNAL_TRAJECTORY_DOUBLE, H5FNAL_TRAJECTORY_VERSION_2) < 0)
+        H5FNAL_PROGRAM_ERROR("version 2 trajectories failed");
+    if (check_encoded_vector(event_id, VECTOR_NAME_FIXED_V2, H5FNAL_TRAJECTORY_FIXED, H5FNAL_TRAJECTORY_VERSION_2) < 0)
+        H5FNAL_PROGRAM_ERROR("version 2 fixed-point trajectories failed");
+
+    /* Sub-run vectors with several events each */
+    if (check_truths_for_events(subrun_id, VECTOR_NAME_EVENTS, H5FNAL_TRAJECTORY_DOUBLE) < 0)
+        H5FNAL_PROGRAM_ERROR("per-event truths failed");
+    if (check_truths_for_events(subrun_id, VECTOR_NAME_EVENTS_FIXED, H5FNAL_TRAJECTORY_FIXED) < 0)
+        H5FNAL_PROGRAM_ERROR("per-event fixed-point truths failed");
+
     /* Append truths */
     if (h5fnal_append_truths(vector, data) < 0)
         H5FNAL_PROGRAM_ERROR("could not write truths to the file");
 
     /* Read the truths */
-    if (NULL == (data_out = (h5fnal_vect_truth_data_t *)calloc(1, sizeof(h5fnal_vect_truth_data_t))))
-        H5FNAL_PROGRAM_ERROR("could not get memory for in-memory truth data container");
     if (h5fnal_read_all_truths(vector, data_out) < 0)
         H5FNAL_PROGRAM_ERROR("could not read truths from the file");
 
@@ -214,15 +893,18 @@ main(void)
         H5FNAL_PROGRAM_ERROR("could not close vector");
 
     /* Close everything else */
-    free(vector);
+    free(vector2);
+    vector2 = NULL;
 
     if (h5fnal_free_truth_mem_data(data) < 0)
         H5FNAL_PROGRAM_ERROR("could not clean up test data");
     free(data);
+    data = NULL;
 
     if (h5fnal_free_truth_mem_data(data_out) < 0)
         H5FNAL_PROGRAM_ERROR("could not clean up read data");
     free(data_out);
+    data_out = NULL;
 
     if (h5fnal_close_run(run_id) < 0)
         H5FNAL_PROGRAM_ERROR("could not close run");
@@ -230,10 +912,36 @@ main(void)
         H5FNAL_PROGRAM_ERROR("could not close run");
     if (h5fnal_close_event(event_id) < 0)
         H5FNAL_PROGRAM_ERROR("could not close run");
+    if (h5fnal_close_file(fid) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close file");
+
+    /* Re-open the file and check that the shared strings were saved
+     * (finding the vector through the event index)
+     */
+    if ((fid = h5fnal_open_file(FILE_NAME, H5F_ACC_RDONLY, fapl_id)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not open file");
+    if ((event_id = h5fnal_open_event_by_id(fid, RUN_NUMBER, SUBRUN_NUMBER, EVENT_NUMBER)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not open event by id");
+    if (h5fnal_open_v_mc_truth(event_id, VECTOR_NAME, vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not open vector of mc truth");
+    if (h5fnal_close_event(event_id) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close event");
+    event_id = -1;
+    if (vector->dict->n_strings != 3)   /* the empty string is always first */
+        H5FNAL_PROGRAM_ERROR("wrong number of strings in dictionary");
+    if (get_string_ptr(vector->dict, 2, &s, &len) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get string from dictionary");
+    if (len != strlen(STRING_2) || strncmp(s, STRING_2, len))
+        H5FNAL_PROGRAM_ERROR("bad string from dictionary");
+    if (h5fnal_close_v_mc_truth(vector) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close vector");
+    free(vector);
+    vector = NULL;
+
     if (H5Pclose(fapl_id) < 0)
         H5FNAL_HDF5_ERROR;
-    if (H5Fclose(fid) < 0)
-        H5FNAL_HDF5_ERROR;
+    if (h5fnal_close_file(fid) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close file");
 
     printf("SUCCESS!\n");
 
@@ -241,10 +949,15 @@ main(void)
 
 error:
     H5E_BEGIN_TRY {
+        H5Pclose(dcpl_id);
         if (vector) {
             h5fnal_close_v_mc_truth(vector);
             free(vector);
         }
+        if (vector2) {
+            h5fnal_close_v_mc_truth(vector2);
+            free(vector2);
+        }
         if (data) {
             h5fnal_free_truth_mem_data(data);
             free(data);
@@ -253,11 +966,16 @@ error:
             h5fnal_free_truth_mem_data(data_out);
             free(data_out);
         }
+        if (data_range) {
+            h5fnal_free_truth_mem_data(data_range);
+            free(data_range);
+        }
         h5fnal_close_run(subrun_id);
         h5fnal_close_run(run_id);
         h5fnal_close_event(event_id);
+        h5fnal_close_event(event2_id);
         H5Pclose(fapl_id);
-        H5Fclose(fid);
+        h5fnal_close_file(fid);
     } H5E_END_TRY;
 
     printf("*** FAILURE ***\n");
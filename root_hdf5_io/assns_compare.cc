@@ -31,38 +31,26 @@ using namespace std::chrono;
  * we'll just compare the individual data fields.
  */
 hbool_t
-compare_hdf5_assns(hid_t loc_id, unsigned run, unsigned subrun, unsigned event, 
+compare_hdf5_assns(h5fnal_reader_t *reader, unsigned run, unsigned subrun, unsigned event, h5fnal_assns_data_t *data,
         art::Assns<recob::Cluster, recob::Hit> root_assns)
 {
-    string  run_name = std::to_string(run);
-    string  subrun_name = std::to_string(subrun);
-    string  event_name = std::to_string(event);
-    hid_t   run_id = -1;
-    hid_t   subrun_id = -1;
     hid_t   event_id = -1;
     h5fnal_assns_t *assns = NULL;
-    h5fnal_assns_data_t *data = NULL;
     hsize_t u;
     hbool_t same = TRUE;
 
-    // Open run, sub-run, and event
-    if ((run_id = h5fnal_open_run(loc_id, run_name.c_str())) < 0)
-        H5FNAL_PROGRAM_ERROR("could not open run")
-    if ((subrun_id = h5fnal_open_run(run_id, subrun_name.c_str())) < 0)
-        H5FNAL_PROGRAM_ERROR("could not open sub-run")
-    if ((event_id = h5fnal_open_event(subrun_id, event_name.c_str())) < 0)
+    // Open the event (the reader keeps the run and sub-run open)
+    if ((event_id = h5fnal_reader_open_event(reader, run, subrun, event)) < 0)
         H5FNAL_PROGRAM_ERROR("could not open event")
 
     // Open the data product
     if (NULL == (assns = (h5fnal_assns_t *)calloc(1, sizeof(h5fnal_assns_t))))
         H5FNAL_PROGRAM_ERROR("could not get memory for assns")
-    if (h5fnal_open_assns(event_id, BADNAME, assns) < 0)
+    if (h5fnal_open_assns_with_types(event_id, BADNAME, &(reader->types), assns) < 0)
         H5FNAL_PROGRAM_ERROR("could not open assns")
 
     // Read all the data
-    if (NULL == (data = (h5fnal_assns_data_t *)calloc(1, sizeof(h5fnal_assns_data_t))))
-        H5FNAL_PROGRAM_ERROR("could not get memory for assns data")
-    if (h5fnal_read_all_assns(assns, data) < 0)
+    if (h5fnal_read_all_assns_into(assns, data) < 0)
         H5FNAL_PROGRAM_ERROR("could not read assns data from the file")
 
     // Compare with Root Assns
@@ -93,32 +81,20 @@ compare_hdf5_assns(hid_t loc_id, unsigned run, unsigned subrun, unsigned event,
 #endif
 
     // Close everything
-    if (h5fnal_close_run(run_id) < 0)
-        H5FNAL_PROGRAM_ERROR("could not close run")
-    if (h5fnal_close_run(subrun_id) < 0)
-        H5FNAL_PROGRAM_ERROR("could not close run")
     if (h5fnal_close_event(event_id) < 0)
         H5FNAL_PROGRAM_ERROR("could not close event")
     if (h5fnal_close_assns(assns) < 0)
         H5FNAL_PROGRAM_ERROR("could not close assns")
-    if (h5fnal_free_assns_mem_data(data) < 0)
-        H5FNAL_PROGRAM_ERROR("could not free assns data");
     free(assns);
-    free(data);
 
     return same;
 
 error:
     H5E_BEGIN_TRY {
-        h5fnal_close_run(run_id);
-        h5fnal_close_run(subrun_id);
         h5fnal_close_event(event_id);
         h5fnal_close_assns(assns);
     } H5E_END_TRY;
-    if (data )
-        h5fnal_free_assns_mem_data(data);
     free(assns);
-    free(data);
 
     return FALSE;
 }
@@ -127,6 +103,11 @@ int main(int argc, char* argv[]) {
 
   hid_t   fid 		= H5FNAL_BAD_HID_T;
   hid_t   master_id = H5FNAL_BAD_HID_T;
+  h5fnal_reader_t reader;
+  bool    reader_open = false;
+
+  // Read buffers, reused for every event
+  h5fnal_assns_data_t hdf5_data;
  
   InputTag mchits_tag { "mchitfinder" };
   InputTag vertex_tag { "linecluster" };
@@ -144,6 +125,8 @@ int main(int argc, char* argv[]) {
     exit(EXIT_FAILURE);
   }
 
+  memset(&hdf5_data, 0, sizeof(h5fnal_assns_data_t));
+
   /* Open the HDF5 file */
   string h5FileName = filenames.back();
   filenames.pop_back();
@@ -154,6 +137,13 @@ int main(int argc, char* argv[]) {
   if ((master_id = h5fnal_open_run(fid, MASTER_RUN_CONTAINER)) < 0)
     H5FNAL_PROGRAM_ERROR("could not open master run containing group");
 
+  /* Read the events through a reader, which keeps the current run and
+   * sub-run open and shares the product datatypes between events
+   */
+  if (h5fnal_init_reader(&reader, master_id) < 0)
+    H5FNAL_PROGRAM_ERROR("could not set up reader");
+  reader_open = true;
+
   // The gallery::Event object acts as a cursor into the stream of events.
   // A newly-constructed gallery::Event is at the start if its stream.
   // Use gallery::Event::atEnd() to check if you've reached the end of the stream.
@@ -181,7 +171,7 @@ int main(int argc, char* argv[]) {
     auto const t1 = system_clock::now();
 
     // Open the data product in the event in the HDF5 file and compare the data with the Root data.
-    same = compare_hdf5_assns(master_id, aux.run(), aux.subRun(), aux.event(), root_clusters_hits);
+    same = compare_hdf5_assns(&reader, aux.run(), aux.subRun(), aux.event(), &hdf5_data, root_clusters_hits);
 
     auto const t2 = system_clock::now();
 
@@ -195,8 +185,13 @@ int main(int argc, char* argv[]) {
   }
 
   /* Clean up */
+  if (h5fnal_free_assns_mem_data(&hdf5_data) < 0)
+    H5FNAL_PROGRAM_ERROR("could not free in-memory assns data")
   if (H5Fclose(fid) < 0)
     H5FNAL_HDF5_ERROR;
+  reader_open = false;
+  if (h5fnal_close_reader(&reader) < 0)
+    H5FNAL_PROGRAM_ERROR("could not close reader")
   if (h5fnal_close_run(master_id) < 0)
     H5FNAL_PROGRAM_ERROR("could not close master run container")
 
@@ -213,9 +208,12 @@ int main(int argc, char* argv[]) {
 error:
 
   H5E_BEGIN_TRY {
+    if (reader_open)
+      h5fnal_close_reader(&reader);
     H5Fclose(fid);
     h5fnal_close_run(master_id);
   } H5E_END_TRY;
+  h5fnal_free_assns_mem_data(&hdf5_data);
 
   std::cout << "*** FAILURE ***\n";
   exit(EXIT_FAILURE);
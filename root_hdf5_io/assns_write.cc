@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <iterator>
@@ -49,11 +50,29 @@ int main(int argc, char* argv[]) {
   /* Create the HDF5 file */
   string h5FileName = filenames.back();
   filenames.pop_back();
+
+  /* Optionally compress whole chunks on worker threads
+   * (H5FNAL_COMPRESSION_THREADS=<n> in the environment)
+   */
+  if (const char *n_threads = getenv("H5FNAL_COMPRESSION_THREADS")) {
+    h5fnal_set_direct_chunk_write(TRUE);
+    if (h5fnal_set_compression_threads((unsigned)atoi(n_threads)) < 0)
+      H5FNAL_PROGRAM_ERROR("could not start compression threads");
+  }
+
+  /* Optionally do the appends on a writer thread, so the next event is
+   * read from the ROOT file while this one is written
+   * (H5FNAL_ASYNC_WRITES=<queue depth> in the environment)
+   */
+  if (const char *depth = getenv("H5FNAL_ASYNC_WRITES"))
+    if (h5fnal_set_async_writes((unsigned)atoi(depth)) < 0)
+      H5FNAL_PROGRAM_ERROR("could not start writer thread");
+
   if ((fapl_id = H5Pcreate(H5P_FILE_ACCESS)) < 0)
     H5FNAL_HDF5_ERROR;
   if (H5Pset_libver_bounds(fapl_id, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST) < 0)
     H5FNAL_HDF5_ERROR;
-  if ((fid = H5Fcreate(h5FileName.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl_id)) < 0)
+  if ((fid = h5fnal_create_file(h5FileName.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl_id)) < 0)
     H5FNAL_HDF5_ERROR;
 
   /* Create a top-level containing group in which creation order is tracked and indexed.
@@ -86,6 +105,40 @@ int main(int argc, char* argv[]) {
               << ',' << aux.subRun()
               << ',' << aux.event();
   
+    // getValidHandle() is preferred to getByLabel(), for both art and
+    // gallery use. It does not require in-your-face error handling.
+    // art::Assns<recob::Cluster, recob::Hit> const& clusters_hits = *ev.getValidHandle<art::Assns<recob::Cluster, recob::Hit>>(assns_tag); 
+    auto const& clusters_hits =  *ev.getValidHandle<art::Assns<recob::Cluster, recob::Hit>>(assns_tag); 
+
+    // Process all data in the Assns
+    for (auto const& p : clusters_hits) {
+        // p.first is an art::Ptr<recob::Cluster>
+        // p.second is an art::Ptr<recob::Hit>
+
+        h5fnal_pair_t h5pair;
+
+        h5pair.left_process_index = p.first.id().processIndex();
+        h5pair.left_product_index = p.first.id().productIndex();
+        h5pair.left_key = p.first.key();
+
+        h5pair.right_process_index = p.second.id().processIndex();
+        h5pair.right_product_index = p.second.id().productIndex();
+        h5pair.right_key = p.second.key();
+
+        h5pairs.push_back(h5pair);
+    } /* end loop over Assns */
+
+    // Close the last event's data product and event. With asynchronous
+    // writes this waits for its append, which ran while this event was
+    // read from the ROOT file.
+    if (event_id != H5FNAL_BAD_HID_T) {
+      if (h5fnal_close_assns(h5assns) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close HDF5 data product");
+      if (h5fnal_close_event(event_id) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close event");
+      event_id = H5FNAL_BAD_HID_T;
+    }
+
     unsigned int currentRun = aux.run();
     unsigned int currentSubRun = aux.subRun();
 
@@ -125,37 +178,16 @@ int main(int argc, char* argv[]) {
     unsigned int currentEvent = aux.event();
     if ((event_id = h5fnal_create_event(subrun_id, std::to_string(currentEvent).c_str(), FALSE)) < 0)
       H5FNAL_PROGRAM_ERROR("could not create event");
+    if (h5fnal_index_event(event_id, currentRun, currentSubRun, currentEvent) < 0)
+      H5FNAL_PROGRAM_ERROR("could not add event to the event index");
    
-    // getValidHandle() is preferred to getByLabel(), for both art and
-    // gallery use. It does not require in-your-face error handling.
-    // art::Assns<recob::Cluster, recob::Hit> const& clusters_hits = *ev.getValidHandle<art::Assns<recob::Cluster, recob::Hit>>(assns_tag); 
-    auto const& clusters_hits =  *ev.getValidHandle<art::Assns<recob::Cluster, recob::Hit>>(assns_tag); 
-
     // Create the Assns via h5fnal.
     // The empty string following the 2nd underscore indicates and empty 'product instance name'.
     // There is no need to represent the 'process name' because that is a top-level of the file entity -- in the root group.
     // TODO: Update the name (using a cheap, hard-coded name for now)
-    if (h5fnal_create_assns(event_id, BADNAME, "recob::Cluster", "recob:Hit", -1, h5assns) < 0)
+    if (h5fnal_create_assns(event_id, BADNAME, "recob::Cluster", "recob:Hit", -1, NULL, h5assns) < 0)
       H5FNAL_PROGRAM_ERROR("could not create HDF5 data product");
 
-    // Process all data in the Assns
-    for (auto const& p : clusters_hits) {
-        // p.first is an art::Ptr<recob::Cluster>
-        // p.second is an art::Ptr<recob::Hit>
-
-        h5fnal_pair_t h5pair;
-
-        h5pair.left_process_index = p.first.id().processIndex();
-        h5pair.left_product_index = p.first.id().productIndex();
-        h5pair.left_key = p.first.key();
-
-        h5pair.right_process_index = p.second.id().processIndex();
-        h5pair.right_product_index = p.second.id().productIndex();
-        h5pair.right_key = p.second.key();
-
-        h5pairs.push_back(h5pair);
-    } /* end loop over Assns */
-
     /* Fill in-memory struct */
     h5assns_data.pairs = &h5pairs[0];
     h5assns_data.data = NULL;
@@ -166,18 +198,23 @@ int main(int argc, char* argv[]) {
     if (h5pairs.size() > 0)
         if (h5fnal_append_assns(h5assns, &h5assns_data) < 0)
             H5FNAL_PROGRAM_ERROR("could not write assns to the HDF5 file");
+  } /* End of loop over events */
 
-    /* Close the event and HDF5 data product */
+  /* Clean up (the last event is still open) */
+  if (event_id != H5FNAL_BAD_HID_T) {
     if (h5fnal_close_assns(h5assns) < 0)
       H5FNAL_PROGRAM_ERROR("could not close HDF5 data product");
     if (h5fnal_close_event(event_id) < 0)
       H5FNAL_PROGRAM_ERROR("could not close event");
-  } /* End of loop over events */
-
-  /* Clean up */
+    event_id = H5FNAL_BAD_HID_T;
+  }
+  if (h5fnal_set_async_writes(0) < 0)
+    H5FNAL_PROGRAM_ERROR("could not write all the data products");
+  if (h5fnal_set_compression_threads(0) < 0)
+    H5FNAL_PROGRAM_ERROR("could not stop compression threads");
   if (H5Pclose(fapl_id) < 0)
     H5FNAL_HDF5_ERROR;
-  if (H5Fclose(fid) < 0)
+  if (h5fnal_close_file(fid) < 0)
     H5FNAL_HDF5_ERROR;
   if (h5fnal_close_run(master_id) < 0)
     H5FNAL_PROGRAM_ERROR("could not close master run container")
@@ -195,9 +232,10 @@ int main(int argc, char* argv[]) {
 
 error:
 
+  h5fnal_set_async_writes(0);
   H5E_BEGIN_TRY {
     H5Pclose(fapl_id);
-    H5Fclose(fid);
+    h5fnal_close_file(fid);
     h5fnal_close_run(run_id);
     h5fnal_close_run(subrun_id);
     h5fnal_close_event(event_id);
@@ -21,44 +21,19 @@
 
 #define MASTER_RUN_CONTAINER    "master_run_container"
 #define BADNAME                 "MCHITCOLL"         // TODO: Replace this with a good name
+#define PREFETCH_DEPTH          4                   // events read ahead
 
 using namespace art;
 using namespace std;
 using namespace std::chrono;
 
+// Convert the prefetched hits to MCHitCollections (no HDF5 calls, since
+// the prefetcher is reading the next events on its own thread)
 void
-get_hdf5_hits(hid_t loc_id, unsigned run, unsigned subrun, unsigned event, std::vector<sim::MCHitCollection> &hdf5_mchits)
+convert_hdf5_hits(const h5fnal_vect_hitcoll_data_t *data, std::vector<sim::MCHitCollection> &hdf5_mchits)
 {
-    string  run_name = std::to_string(run);
-    string  subrun_name = std::to_string(subrun);
-    string  event_name = std::to_string(event);
-    hid_t   run_id = -1;
-    hid_t   subrun_id = -1;
-    hid_t   event_id = -1;
-    h5fnal_vect_hitcoll_t *vector = NULL;
-    h5fnal_vect_hitcoll_data_t *data = NULL;
     hsize_t hc;
 
-    // Open run, sub-run, and event
-    if ((run_id = h5fnal_open_run(loc_id, run_name.c_str())) < 0)
-        H5FNAL_PROGRAM_ERROR("could not open run")
-    if ((subrun_id = h5fnal_open_run(run_id, subrun_name.c_str())) < 0)
-        H5FNAL_PROGRAM_ERROR("could not open sub-run")
-    if ((event_id = h5fnal_open_event(subrun_id, event_name.c_str())) < 0)
-        H5FNAL_PROGRAM_ERROR("could not open event")
-
-    // Open the data product
-    if (NULL == (vector = (h5fnal_vect_hitcoll_t *)calloc(1, sizeof(h5fnal_vect_hitcoll_t))))
-        H5FNAL_PROGRAM_ERROR("could not get memory for vector")
-    if (h5fnal_open_v_mc_hit_collection(event_id, BADNAME, vector) < 0)
-        H5FNAL_PROGRAM_ERROR("could not open vector of mc hit collection")
-
-    // Read all the data
-    if (NULL == (data = (h5fnal_vect_hitcoll_data_t *)calloc(1, sizeof(h5fnal_vect_hitcoll_data_t))))
-        H5FNAL_PROGRAM_ERROR("could not get memory for hit collection data")
-    if (h5fnal_read_all_hits(vector, data) < 0)
-        H5FNAL_PROGRAM_ERROR("could not read hit collection data from the file")
-
     // Convert to MCHitCollections and add to the vector
     for (hc = 0; hc < data->n_hit_collections; hc++)
     {
@@ -85,42 +60,15 @@ get_hdf5_hits(hid_t loc_id, unsigned run, unsigned subrun, unsigned event, std::
             hdf5_mchits.back().push_back(hit);
         } // end loop over his
     } // end loop over hit collections
-
-    // Close everything
-    if (h5fnal_close_run(run_id) < 0)
-        H5FNAL_PROGRAM_ERROR("could not close run")
-    if (h5fnal_close_run(subrun_id) < 0)
-        H5FNAL_PROGRAM_ERROR("could not close run")
-    if (h5fnal_close_event(event_id) < 0)
-        H5FNAL_PROGRAM_ERROR("could not close event")
-    if (h5fnal_close_v_mc_hit_collection(vector) < 0)
-        H5FNAL_PROGRAM_ERROR("could not close vector")
-    if (h5fnal_free_hitcoll_mem_data(data) < 0)
-        H5FNAL_PROGRAM_ERROR("could not free in-memory hit collection data");
-    free(vector);
-    free(data);
-
-    return;
-
-error:
-    H5E_BEGIN_TRY {
-        h5fnal_close_run(run_id);
-        h5fnal_close_run(subrun_id);
-        h5fnal_close_event(event_id);
-        h5fnal_close_v_mc_hit_collection(vector);
-    } H5E_END_TRY;
-    if (data )
-        h5fnal_free_hitcoll_mem_data(data);
-    free(vector);
-    free(data);
-
-    return;
 }
 
 int main(int argc, char* argv[]) {
 
   hid_t   fid 		= H5FNAL_BAD_HID_T;
   hid_t   master_id = H5FNAL_BAD_HID_T;
+  h5fnal_prefetcher_t pf;
+  bool    pf_running = false;
+  const h5fnal_prefetched_event_t *pf_event = NULL;
  
   InputTag mchits_tag { "mchitfinder" };
   InputTag vertex_tag { "linecluster" };
@@ -148,6 +96,14 @@ int main(int argc, char* argv[]) {
   if ((master_id = h5fnal_open_run(fid, MASTER_RUN_CONTAINER)) < 0)
     H5FNAL_PROGRAM_ERROR("could not open master run containing group");
 
+  /* Read the events a few ahead on the prefetcher's thread, in the
+   * order they were written (the order of the ROOT file). No HDF5
+   * calls are made here until the prefetcher is stopped.
+   */
+  if (h5fnal_start_prefetcher(&pf, master_id, BADNAME, H5FNAL_PREFETCH_HITS, PREFETCH_DEPTH) < 0)
+    H5FNAL_PROGRAM_ERROR("could not start prefetcher");
+  pf_running = true;
+
   // The gallery::Event object acts as a cursor into the stream of events.
   // A newly-constructed gallery::Event is at the start if its stream.
   // Use gallery::Event::atEnd() to check if you've reached the end of the stream.
@@ -173,10 +129,16 @@ int main(int argc, char* argv[]) {
 
     auto const t1 = system_clock::now();
 
-    // Open the data product in the event in the HDF5 file and get all
-    // the data out.
+    // Get the next event's data product from the prefetcher and convert
+    // it. It should be the same event.
+    if (h5fnal_prefetcher_next(&pf, &pf_event) < 0)
+      H5FNAL_PROGRAM_ERROR("could not read hit collection data from the file")
+    if (NULL == pf_event)
+      H5FNAL_PROGRAM_ERROR("ran out of events in the HDF5 file")
+    if (pf_event->run != aux.run() || pf_event->subrun != aux.subRun() || pf_event->event != aux.event())
+      H5FNAL_PROGRAM_ERROR("HDF5 file events are not in the same order")
     std::vector<sim::MCHitCollection> hdf5_mchits;
-    get_hdf5_hits(master_id, aux.run(), aux.subRun(), aux.event(), hdf5_mchits);
+    convert_hdf5_hits(&(pf_event->hits), hdf5_mchits);
 
     auto const t2 = system_clock::now();
 
@@ -190,10 +152,13 @@ int main(int argc, char* argv[]) {
   }
 
   /* Clean up */
-  if (H5Fclose(fid) < 0)
-    H5FNAL_HDF5_ERROR;
+  pf_running = false;
+  if (h5fnal_stop_prefetcher(&pf) < 0)
+    H5FNAL_PROGRAM_ERROR("could not stop prefetcher")
   if (h5fnal_close_run(master_id) < 0)
     H5FNAL_PROGRAM_ERROR("could not close master run container")
+  if (H5Fclose(fid) < 0)
+    H5FNAL_HDF5_ERROR;
 
   // Write out the times to a standard output, in a way easily
   // readable with R (or many other tools).
@@ -207,9 +172,11 @@ int main(int argc, char* argv[]) {
 
 error:
 
+  if (pf_running)
+    h5fnal_stop_prefetcher(&pf);
   H5E_BEGIN_TRY {
-    H5Fclose(fid);
     h5fnal_close_run(master_id);
+    H5Fclose(fid);
   } H5E_END_TRY;
 
   std::cout << "*** FAILURE ***\n";
@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <iterator>
@@ -48,11 +49,29 @@ int main(int argc, char* argv[]) {
   /* Create the HDF5 file */
   string h5FileName = filenames.back();
   filenames.pop_back();
+
+  /* Optionally compress whole chunks on worker threads
+   * (H5FNAL_COMPRESSION_THREADS=<n> in the environment)
+   */
+  if (const char *n_threads = getenv("H5FNAL_COMPRESSION_THREADS")) {
+    h5fnal_set_direct_chunk_write(TRUE);
+    if (h5fnal_set_compression_threads((unsigned)atoi(n_threads)) < 0)
+      H5FNAL_PROGRAM_ERROR("could not start compression threads");
+  }
+
+  /* Optionally do the appends on a writer thread, so the next event is
+   * read from the ROOT file while this one is written
+   * (H5FNAL_ASYNC_WRITES=<queue depth> in the environment)
+   */
+  if (const char *depth = getenv("H5FNAL_ASYNC_WRITES"))
+    if (h5fnal_set_async_writes((unsigned)atoi(depth)) < 0)
+      H5FNAL_PROGRAM_ERROR("could not start writer thread");
+
   if ((fapl_id = H5Pcreate(H5P_FILE_ACCESS)) < 0)
     H5FNAL_HDF5_ERROR;
   if (H5Pset_libver_bounds(fapl_id, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST) < 0)
     H5FNAL_HDF5_ERROR;
-  if ((fid = H5Fcreate(h5FileName.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl_id)) < 0)
+  if ((fid = h5fnal_create_file(h5FileName.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl_id)) < 0)
     H5FNAL_HDF5_ERROR;
 
   /* Create a top-level containing group in which creation order is tracked and indexed.
@@ -87,6 +106,54 @@ int main(int argc, char* argv[]) {
               << ',' << aux.subRun()
               << ',' << aux.event() << '\n';
   
+    // getValidHandle() is preferred to getByLabel(), for both art and
+    // gallery use. It does not require in-your-face error handling.
+    std::vector<sim::MCHitCollection> const& mchits = *ev.getValidHandle<vector<sim::MCHitCollection>>(mchits_tag);
+
+    // Process all MC Hit Collections
+    first_hit = 0;
+    for (sim::MCHitCollection const&  hitcol : mchits) {
+      h5fnal_hitcoll_t hc;
+      hsize_t hitcount = 0;
+      
+      // Iterate through all hits
+      for (sim::MCHit const& hit : hitcol) {
+        h5fnal_hit_t h5hit;
+
+        h5hit.signal_time 	= hit.PeakTime();
+        h5hit.signal_width	= hit.PeakWidth();
+        h5hit.peak_amp 		= hit.Charge(true);
+        h5hit.charge 		= hit.Charge(false);
+        h5hit.part_vertex_x	= (hit.PartVertex())[0];
+        h5hit.part_vertex_y 	= (hit.PartVertex())[1];
+        h5hit.part_vertex_z 	= (hit.PartVertex())[2];
+        h5hit.part_energy 	= hit.PartEnergy();
+        h5hit.part_track_id 	= hit.PartTrackId();
+
+        hitcount++;
+        hits.push_back(h5hit);
+      } /* end loop over hits */
+
+      hc.channel = hitcol.Channel();
+      hc.count = hitcount;
+      hc.start = (hitcount > 0) ? first_hit : 0;
+      hit_collections.push_back(hc);
+
+      first_hit += hitcount;
+
+    } /* end loop over hit collections */
+
+    // Close the last event's data product and event. With asynchronous
+    // writes this waits for its append, which ran while this event was
+    // read from the ROOT file.
+    if (event_id != H5FNAL_BAD_HID_T) {
+      if (h5fnal_close_v_mc_hit_collection(h5vmchc) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close HDF5 data product");
+      if (h5fnal_close_event(event_id) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close event");
+      event_id = H5FNAL_BAD_HID_T;
+    }
+
     unsigned int currentRun = aux.run();
     unsigned int currentSubRun = aux.subRun();
 
@@ -126,53 +193,18 @@ int main(int argc, char* argv[]) {
     unsigned int currentEvent = aux.event();
     if ((event_id = h5fnal_create_event(subrun_id, std::to_string(currentEvent).c_str(), FALSE)) < 0)
       H5FNAL_PROGRAM_ERROR("could not create event");
+    if (h5fnal_index_event(event_id, currentRun, currentSubRun, currentEvent) < 0)
+      H5FNAL_PROGRAM_ERROR("could not add event to the event index");
    
-    // getValidHandle() is preferred to getByLabel(), for both art and
-    // gallery use. It does not require in-your-face error handling.
-    std::vector<sim::MCHitCollection> const& mchits = *ev.getValidHandle<vector<sim::MCHitCollection>>(mchits_tag);
-
     // Create the Vector of MC Hit Collection via h5fnal.
     // This will create a group containing datasets. The name for this group should be something like:
     // "MCHitCollections_mchitfinder_"
     // The empty string following the 2nd underscore indicates and empty 'product instance name'.
     // There is no need to represent the 'process name' because that is a top-level of the file entity -- in the root group.
     // TODO: Update the name (using a cheap, hard-coded name for now)
-    if (h5fnal_create_v_mc_hit_collection(event_id, BADNAME, h5vmchc) < 0)
+    if (h5fnal_create_v_mc_hit_collection(event_id, BADNAME, NULL, h5vmchc) < 0)
       H5FNAL_PROGRAM_ERROR("could not create HDF5 data product");
 
-    // Process all MC Hit Collections
-    first_hit = 0;
-    for (sim::MCHitCollection const&  hitcol : mchits) {
-      h5fnal_hitcoll_t hc;
-      hsize_t hitcount = 0;
-      
-      // Iterate through all hits
-      for (sim::MCHit const& hit : hitcol) {
-        h5fnal_hit_t h5hit;
-
-        h5hit.signal_time 	= hit.PeakTime();
-        h5hit.signal_width	= hit.PeakWidth();
-        h5hit.peak_amp 		= hit.Charge(true);
-        h5hit.charge 		= hit.Charge(false);
-        h5hit.part_vertex_x	= (hit.PartVertex())[0];
-        h5hit.part_vertex_y 	= (hit.PartVertex())[1];
-        h5hit.part_vertex_z 	= (hit.PartVertex())[2];
-        h5hit.part_energy 	= hit.PartEnergy();
-        h5hit.part_track_id 	= hit.PartTrackId();
-
-        hitcount++;
-        hits.push_back(h5hit);
-      } /* end loop over hits */
-
-      hc.channel = hitcol.Channel();
-      hc.count = hitcount;
-      hc.start = (hitcount > 0) ? first_hit : 0;
-      hit_collections.push_back(hc);
-
-      first_hit += hitcount;
-
-    } /* end loop over hit collections */
-
     // Write the data to the HDF5 data product
     hc_data.n_hits = hits.size();
     hc_data.n_hit_collections = hit_collections.size();
@@ -184,18 +216,23 @@ int main(int argc, char* argv[]) {
 
     totalHits += hits.size();
     cout << "Wrote " << hits.size() << " hits to the HDF5 file." << endl;
+  }
 
-    /* Close the event and HDF5 data product */
+  /* Clean up (the last event is still open) */
+  if (event_id != H5FNAL_BAD_HID_T) {
     if (h5fnal_close_v_mc_hit_collection(h5vmchc) < 0)
       H5FNAL_PROGRAM_ERROR("could not close HDF5 data product");
     if (h5fnal_close_event(event_id) < 0)
       H5FNAL_PROGRAM_ERROR("could not close event");
+    event_id = H5FNAL_BAD_HID_T;
   }
-
-  /* Clean up */
+  if (h5fnal_set_async_writes(0) < 0)
+    H5FNAL_PROGRAM_ERROR("could not write all the data products");
+  if (h5fnal_set_compression_threads(0) < 0)
+    H5FNAL_PROGRAM_ERROR("could not stop compression threads");
   if (H5Pclose(fapl_id) < 0)
     H5FNAL_HDF5_ERROR;
-  if (H5Fclose(fid) < 0)
+  if (h5fnal_close_file(fid) < 0)
     H5FNAL_HDF5_ERROR;
   if (h5fnal_close_run(master_id) < 0)
     H5FNAL_PROGRAM_ERROR("could not close master run container")
@@ -213,9 +250,10 @@ int main(int argc, char* argv[]) {
 
 error:
 
+  h5fnal_set_async_writes(0);
   H5E_BEGIN_TRY {
     H5Pclose(fapl_id);
-    H5Fclose(fid);
+    h5fnal_close_file(fid);
     h5fnal_close_run(run_id);
     h5fnal_close_run(subrun_id);
     h5fnal_close_event(event_id);
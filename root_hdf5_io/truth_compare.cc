@@ -22,44 +22,18 @@
 
 #define MASTER_RUN_CONTAINER    "master_run_container"
 #define BADNAME                 "MCTRUTH"     // TODO: Replace this with a good name
+#define PREFETCH_DEPTH          4             // events read ahead
 
 using namespace art;
 using namespace std;
 using namespace simb;
 using namespace std::chrono;
 
+// Convert the prefetched truths to MCTruths (no HDF5 calls, since the
+// prefetcher is reading the next events on its own thread)
 static void
-get_hdf5_truths(hid_t loc_id, unsigned run, unsigned subrun, unsigned event, string_dictionary_t *dict, std::vector<simb::MCTruth> &hdf5_truths)
+convert_hdf5_truths(const h5fnal_vect_truth_data_t *data, const string_dictionary_t *dict, std::vector<simb::MCTruth> &hdf5_truths)
 {
-    string  run_name = std::to_string(run);
-    string  subrun_name = std::to_string(subrun);
-    string  event_name = std::to_string(event);
-    hid_t   run_id = -1;
-    hid_t   subrun_id = -1;
-    hid_t   event_id = -1;
-    h5fnal_vect_truth_t *vector = NULL;
-    h5fnal_vect_truth_data_t *data = NULL;
-
-    // Open run, sub-run, and event
-    if ((run_id = h5fnal_open_run(loc_id, run_name.c_str())) < 0)
-        H5FNAL_PROGRAM_ERROR("could not open run")
-    if ((subrun_id = h5fnal_open_run(run_id, subrun_name.c_str())) < 0)
-        H5FNAL_PROGRAM_ERROR("could not open sub-run")
-    if ((event_id = h5fnal_open_event(subrun_id, event_name.c_str())) < 0)
-        H5FNAL_PROGRAM_ERROR("could not open event")
-
-    // Open the data product
-    if (NULL == (vector = (h5fnal_vect_truth_t *)calloc(1, sizeof(h5fnal_vect_truth_t))))
-        H5FNAL_PROGRAM_ERROR("could not get memory for vector")
-    if (h5fnal_open_v_mc_truth(event_id, BADNAME, vector) < 0)
-        H5FNAL_PROGRAM_ERROR("could not open Vector of MCTruth")
-
-    // Read all the data
-    if (NULL == (data = (h5fnal_vect_truth_data_t *)calloc(1, sizeof(h5fnal_vect_truth_data_t))))
-        H5FNAL_PROGRAM_ERROR("could not get memory for truth data")
-    if (h5fnal_read_all_truths(vector, data) < 0)
-        H5FNAL_PROGRAM_ERROR("could not read truth data from the file")
-
     // Convert to MCTruth and add to the vector
     for (hsize_t u = 0; u < data->n_truths; u++)
     {
@@ -80,17 +54,18 @@ get_hdf5_truths(hid_t loc_id, unsigned run, unsigned subrun, unsigned event, str
                 h5fnal_particle_t p = data->particles[v];
                 hssize_t start;
                 hssize_t end;
-                char *s = NULL;
+                const char *s = NULL;
+                size_t len = 0;
 
                 /* Get the Process string from the dictionary */
-                if (get_string(dict, p.process_index, &s) < 0)
+                if (get_string_ptr(dict, p.process_index, &s, &len) < 0)
                     H5FNAL_PROGRAM_ERROR("error getting process string");
 
                 /* ctor */
                 simb::MCParticle newParticle(
                     p.track_id,
                     p.pdg_code,
-                    s,
+                    std::string(s, len),
                     p.mother,
                     p.mass,
                     p.status);
@@ -99,9 +74,9 @@ get_hdf5_truths(hid_t loc_id, unsigned run, unsigned subrun, unsigned event, str
                 newParticle.SetWeight(p.weight);
 
                 /* Set end process */
-                if (get_string(dict, p.endprocess_index, &s) < 0)
+                if (get_string_ptr(dict, p.endprocess_index, &s, &len) < 0)
                     H5FNAL_PROGRAM_ERROR("error getting end process string");
-                newParticle.SetEndProcess(s);
+                newParticle.SetEndProcess(std::string(s, len));
 
                 /* set polarization */
                 TVector3 pol(p.polarization_x, p.polarization_y, p.polarization_z);
@@ -165,44 +140,19 @@ get_hdf5_truths(hid_t loc_id, unsigned run, unsigned subrun, unsigned event, str
 
     } // end loop over truths
 
-    // Close everything
-    if (h5fnal_close_run(run_id) < 0)
-        H5FNAL_PROGRAM_ERROR("could not close run")
-    if (h5fnal_close_run(subrun_id) < 0)
-        H5FNAL_PROGRAM_ERROR("could not close run")
-    if (h5fnal_close_event(event_id) < 0)
-        H5FNAL_PROGRAM_ERROR("could not close event")
-    if (h5fnal_close_v_mc_truth(vector) < 0)
-        H5FNAL_PROGRAM_ERROR("could not close vector")
-    if (h5fnal_free_truth_mem_data(data) < 0)
-        H5FNAL_PROGRAM_ERROR("could not free in-memory truth data");
-    free(vector);
-    free(data);
-
     return;
 
 error:
-    H5E_BEGIN_TRY {
-        h5fnal_close_run(run_id);
-        h5fnal_close_run(subrun_id);
-        h5fnal_close_event(event_id);
-        h5fnal_close_v_mc_truth(vector);
-    } H5E_END_TRY;
-    if (data )
-        h5fnal_free_truth_mem_data(data);
-    free(vector);
-    free(data);
-
     return;
 }
 
 int main(int argc, char* argv[]) {
 
   hid_t   fid 		= H5FNAL_BAD_HID_T;
-  hid_t   dict_id 	= H5FNAL_BAD_HID_T;
   hid_t   master_id = H5FNAL_BAD_HID_T;
-
-  string_dictionary_t *dict = NULL;
+  h5fnal_prefetcher_t pf;
+  bool    pf_running = false;
+  const h5fnal_prefetched_event_t *pf_event = NULL;
 
   InputTag mchits_tag { "mchitfinder" };
   InputTag vertex_tag { "linecluster" };
@@ -224,19 +174,23 @@ int main(int argc, char* argv[]) {
   /* Open the HDF5 file */
   string h5FileName = filenames.back();
   filenames.pop_back();
-  if ((fid = H5Fopen(h5FileName.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT)) < 0)
-    H5FNAL_HDF5_ERROR;
-
-  /* Open the file-wide string dictionary */
-  if (NULL == (dict = (string_dictionary_t *)calloc(1, sizeof(string_dictionary_t))))
-    H5FNAL_PROGRAM_ERROR("could not get memory for string dictionary");
-  if ((dict_id = open_string_dictionary(fid, dict)) < 0)
-    H5FNAL_PROGRAM_ERROR("could not open string dictionary");
+  // The MC Truth products find the file-wide string dictionary
+  // themselves, which requires opening the file through h5fnal.
+  if ((fid = h5fnal_open_file(h5FileName.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT)) < 0)
+    H5FNAL_PROGRAM_ERROR("could not open file");
 
   /* Open the master run container */
   if ((master_id = h5fnal_open_run(fid, MASTER_RUN_CONTAINER)) < 0)
     H5FNAL_PROGRAM_ERROR("could not open master run containing group");
 
+  /* Read the events a few ahead on the prefetcher's thread, in the
+   * order they were written (the order of the ROOT file). No HDF5
+   * calls are made here until the prefetcher is stopped.
+   */
+  if (h5fnal_start_prefetcher(&pf, master_id, BADNAME, H5FNAL_PREFETCH_TRUTHS, PREFETCH_DEPTH) < 0)
+    H5FNAL_PROGRAM_ERROR("could not start prefetcher");
+  pf_running = true;
+
   // The gallery::Event object acts as a cursor into the stream of events.
   // A newly-constructed gallery::Event is at the start if its stream.
   // Use gallery::Event::atEnd() to check if you've reached the end of the stream.
@@ -262,9 +216,16 @@ int main(int argc, char* argv[]) {
 
     auto const t1 = system_clock::now();
 
-    // Open the data product in the event in the HDF5 file and get all the data out.
+    // Get the next event's data product from the prefetcher and convert
+    // it. It should be the same event.
+    if (h5fnal_prefetcher_next(&pf, &pf_event) < 0)
+      H5FNAL_PROGRAM_ERROR("could not read truth data from the file")
+    if (NULL == pf_event)
+      H5FNAL_PROGRAM_ERROR("ran out of events in the HDF5 file")
+    if (pf_event->run != aux.run() || pf_event->subrun != aux.subRun() || pf_event->event != aux.event())
+      H5FNAL_PROGRAM_ERROR("HDF5 file events are not in the same order")
     std::vector<simb::MCTruth> hdf5_truths;
-    get_hdf5_truths(master_id, aux.run(), aux.subRun(), aux.event(), dict, hdf5_truths);
+    convert_hdf5_truths(&(pf_event->truths), pf_event->dict, hdf5_truths);
 
     auto const t2 = system_clock::now();
 
@@ -281,12 +242,13 @@ int main(int argc, char* argv[]) {
   }
 
   /* Clean up */
-  if (close_string_dictionary(dict) < 0)
-    H5FNAL_PROGRAM_ERROR("could not close string dictionary")
+  pf_running = false;
+  if (h5fnal_stop_prefetcher(&pf) < 0)
+    H5FNAL_PROGRAM_ERROR("could not stop prefetcher")
   if (h5fnal_close_run(master_id) < 0)
     H5FNAL_PROGRAM_ERROR("could not close master run container")
-  if (H5Fclose(fid) < 0)
-    H5FNAL_HDF5_ERROR;
+  if (h5fnal_close_file(fid) < 0)
+    H5FNAL_PROGRAM_ERROR("could not close file")
 
   // Write out the times to a standard output, in a way easily
   // readable with R (or many other tools).
@@ -300,11 +262,11 @@ int main(int argc, char* argv[]) {
 
 error:
 
+  if (pf_running)
+    h5fnal_stop_prefetcher(&pf);
   H5E_BEGIN_TRY {
-    H5Fclose(fid);
     h5fnal_close_run(master_id);
-    if (dict)
-      close_string_dictionary(dict);
+    h5fnal_close_file(fid);
   } H5E_END_TRY;
 
   std::cout << "*** FAILURE ***\n";
@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <iterator>
@@ -33,11 +34,10 @@ int main(int argc, char* argv[]) {
     hid_t   run_id 	= H5FNAL_BAD_HID_T;
     hid_t   subrun_id = H5FNAL_BAD_HID_T;
     hid_t   event_id 	= H5FNAL_BAD_HID_T;
-    hid_t   dict_id 	= H5FNAL_BAD_HID_T;
     int prevRun 		= -1;
     int prevSubRun 	= -1;
-    string_dictionary_t *dict = NULL;
     h5fnal_vect_truth_t *h5vtruth = NULL;
+    string_dictionary_t *dict = NULL;
  
     InputTag mchits_tag { "mchitfinder" };
     InputTag vertex_tag { "linecluster" };
@@ -53,18 +53,32 @@ int main(int argc, char* argv[]) {
     /* Create the HDF5 file */
     string h5FileName = filenames.back();
     filenames.pop_back();
+
+    /* Optionally compress whole chunks on worker threads
+     * (H5FNAL_COMPRESSION_THREADS=<n> in the environment)
+     */
+    if (const char *n_threads = getenv("H5FNAL_COMPRESSION_THREADS")) {
+        h5fnal_set_direct_chunk_write(TRUE);
+        if (h5fnal_set_compression_threads((unsigned)atoi(n_threads)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not start compression threads");
+    }
+
+    /* Optionally do the appends on a writer thread, so the next event is
+     * read from the ROOT file while this one is written
+     * (H5FNAL_ASYNC_WRITES=<queue depth> in the environment)
+     */
+    if (const char *depth = getenv("H5FNAL_ASYNC_WRITES"))
+        if (h5fnal_set_async_writes((unsigned)atoi(depth)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not start writer thread");
+
     if ((fapl_id = H5Pcreate(H5P_FILE_ACCESS)) < 0)
         H5FNAL_HDF5_ERROR;
     if (H5Pset_libver_bounds(fapl_id, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST) < 0)
         H5FNAL_HDF5_ERROR;
-    if ((fid = H5Fcreate(h5FileName.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl_id)) < 0)
-        H5FNAL_HDF5_ERROR;
-
-    /* Create a file-wide string dictionary */
-    if (NULL == (dict = (string_dictionary_t *)calloc(1, sizeof(string_dictionary_t))))
-        H5FNAL_PROGRAM_ERROR("could not get memory for string dictionary");
-    if ((dict_id = create_string_dictionary(fid, dict)) < 0)
-        H5FNAL_PROGRAM_ERROR("could not create string dictionary");
+    // The MC Truth products share a file-wide string dictionary, which
+    // h5fnal sets up when the product is created.
+    if ((fid = h5fnal_create_file(h5FileName.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl_id)) < 0)
+        H5FNAL_PROGRAM_ERROR("could not create file");
 
     /* Create a top-level containing group in which creation order is tracked and indexed.
      * There is no way to do this in the root group, so we can't use that.
@@ -72,6 +86,13 @@ int main(int argc, char* argv[]) {
     if ((master_id = h5fnal_create_run(fid, MASTER_RUN_CONTAINER, FALSE)) < 0)
         H5FNAL_PROGRAM_ERROR("could not create master run containing group");
 
+    /* Get the string dictionary up front so the process strings can be
+     * interned before the event's data product is created (it's only
+     * written when the file is closed)
+     */
+    if (h5fnal_get_string_dictionary(fid, H5FNAL_FILE_DICTIONARY_PATH, TRUE, &dict) < 0)
+        H5FNAL_PROGRAM_ERROR("could not get the file's string dictionary");
+
     /* Allocate memory for the data product struct
      *
      * This will be re-used for all data products we read in root and create
@@ -101,59 +122,10 @@ int main(int argc, char* argv[]) {
                   << ',' << aux.subRun()
                   << ',' << aux.event() << '\n';
   
-        unsigned int currentRun = aux.run();
-        unsigned int currentSubRun = aux.subRun();
-
-        if ((int)currentRun != prevRun) {
-            // Create a new run (create name from the integer ID)
-            if (run_id != H5FNAL_BAD_HID_T)
-                if (h5fnal_close_run(run_id) < 0)
-                    H5FNAL_PROGRAM_ERROR("could not close run")
-
-            if ((run_id = h5fnal_create_run(master_id, std::to_string(currentRun).c_str(), FALSE)) < 0)
-                H5FNAL_PROGRAM_ERROR("could not create run");
-
-            // Create a new sub-run (create name from the integer ID)
-            if (subrun_id != H5FNAL_BAD_HID_T)
-                if (h5fnal_close_run(subrun_id) < 0)
-                    H5FNAL_PROGRAM_ERROR("could not close sub-run");
-
-            if ((subrun_id = h5fnal_create_run(run_id, std::to_string(currentSubRun).c_str(), FALSE)) < 0)
-                H5FNAL_PROGRAM_ERROR("could not create sub-run");
-
-            prevRun = currentRun;
-            prevSubRun = currentSubRun;
-        }
-        else if ((int)currentSubRun != prevSubRun) {
-            // make new group for SubRun in the same run
-            if (subrun_id != H5FNAL_BAD_HID_T)
-                if (h5fnal_close_run(subrun_id) < 0)
-                    H5FNAL_PROGRAM_ERROR("could not close sub-run");
-
-            if ((subrun_id = h5fnal_create_run(run_id, std::to_string(currentSubRun).c_str(), FALSE)) < 0)
-                H5FNAL_PROGRAM_ERROR("could not create sub-run");
-
-            prevSubRun = currentSubRun;
-        }
-
-        // Create a new event (create name from the integer ID)
-        unsigned int currentEvent = aux.event();
-        if ((event_id = h5fnal_create_event(subrun_id, std::to_string(currentEvent).c_str(), FALSE)) < 0)
-            H5FNAL_PROGRAM_ERROR("could not create event");
-   
         // getValidHandle() is preferred to getByLabel(), for both art and
         // gallery use. It does not require in-your-face error handling.
         std::vector<simb::MCTruth> const& rootTruths = *ev.getValidHandle<vector<simb::MCTruth>>(truths_tag);
 
-        // Create the Vector of MC Truth via h5fnal.
-        // This will create a group containing datasets. The name for this group should be something like:
-        // "MCHitCollections_mchitfinder_"
-        // The empty string following the 2nd underscore indicates and empty 'product instance name'.
-        // There is no need to represent the 'process name' because that is a top-level of the file entity -- in the root group.
-        // TODO: Update the name (using a cheap, hard-coded name for now)
-        if (h5fnal_create_v_mc_truth(event_id, BADNAME, h5vtruth) < 0)
-            H5FNAL_PROGRAM_ERROR("could not create HDF5 data product");
-
         // Iterate through all truths in the vector
         totalTruths += rootTruths.size();
         for (unsigned n = 0; n < rootTruths.size(); n++) {
@@ -172,7 +144,6 @@ int main(int argc, char* argv[]) {
                 h5fnal_particle_t particle;
                 hsize_t new_trajectories = 0;
                 hsize_t new_daughters = 0;
-                hbool_t string_found;
                 unsigned string_index;
 
                 particle.status     = p.StatusCode();
@@ -194,19 +165,15 @@ int main(int argc, char* argv[]) {
                 particle.polarization_z = pol.z();
 
                 // Store the process string
-                if (get_string_index(p.Process().c_str(), dict, &string_found, &string_index) < 0)
-                    H5FNAL_PROGRAM_ERROR("error getting Process string index");
-                if (!string_found)
-                    if (add_string_to_dictionary(p.Process().c_str(), dict) < 0)
-                        H5FNAL_PROGRAM_ERROR("error adding Process string to dictionary");
+                const std::string& process = p.Process();
+                if (intern_string(dict, process.data(), process.size(), &string_index) < 0)
+                    H5FNAL_PROGRAM_ERROR("error interning Process string");
                 particle.process_index = static_cast<hsize_t>(string_index);
 
                 // Store the end process string
-                if (get_string_index(p.EndProcess().c_str(), dict, &string_found, &string_index) < 0)
-                    H5FNAL_PROGRAM_ERROR("error getting EndProcess string index");
-                if (!string_found)
-                    if (add_string_to_dictionary(p.EndProcess().c_str(), dict) < 0)
-                        H5FNAL_PROGRAM_ERROR("error adding EndProcess string to dictionary");
+                const std::string& endProcess = p.EndProcess();
+                if (intern_string(dict, endProcess.data(), endProcess.size(), &string_index) < 0)
+                    H5FNAL_PROGRAM_ERROR("error interning EndProcess string");
                 particle.endprocess_index = static_cast<hsize_t>(string_index);
 
                 // Copy trajectories
@@ -223,6 +190,9 @@ int main(int argc, char* argv[]) {
                     trajectory.Pz   = p.Pz(u);
                     trajectory.E    = p.E(u);
 
+                    // The particle is added after its trajectory points
+                    trajectory.particle_index = particles.size();
+
                     new_trajectories++;
                     trajectories.push_back(trajectory);
                 } /* end loop over trajectory points */
@@ -303,6 +273,68 @@ int main(int argc, char* argv[]) {
 
         } /* end loop over truths */
 
+        // Close the last event's data product and event. With asynchronous
+        // writes this waits for its append, which ran while this event was
+        // read from the ROOT file.
+        if (event_id != H5FNAL_BAD_HID_T) {
+            if (h5fnal_close_v_mc_truth(h5vtruth) < 0)
+                H5FNAL_PROGRAM_ERROR("could not close HDF5 data product");
+            if (h5fnal_close_event(event_id) < 0)
+                H5FNAL_PROGRAM_ERROR("could not close event");
+            event_id = H5FNAL_BAD_HID_T;
+        }
+
+        unsigned int currentRun = aux.run();
+        unsigned int currentSubRun = aux.subRun();
+
+        if ((int)currentRun != prevRun) {
+            // Create a new run (create name from the integer ID)
+            if (run_id != H5FNAL_BAD_HID_T)
+                if (h5fnal_close_run(run_id) < 0)
+                    H5FNAL_PROGRAM_ERROR("could not close run")
+
+            if ((run_id = h5fnal_create_run(master_id, std::to_string(currentRun).c_str(), FALSE)) < 0)
+                H5FNAL_PROGRAM_ERROR("could not create run");
+
+            // Create a new sub-run (create name from the integer ID)
+            if (subrun_id != H5FNAL_BAD_HID_T)
+                if (h5fnal_close_run(subrun_id) < 0)
+                    H5FNAL_PROGRAM_ERROR("could not close sub-run");
+
+            if ((subrun_id = h5fnal_create_run(run_id, std::to_string(currentSubRun).c_str(), FALSE)) < 0)
+                H5FNAL_PROGRAM_ERROR("could not create sub-run");
+
+            prevRun = currentRun;
+            prevSubRun = currentSubRun;
+        }
+        else if ((int)currentSubRun != prevSubRun) {
+            // make new group for SubRun in the same run
+            if (subrun_id != H5FNAL_BAD_HID_T)
+                if (h5fnal_close_run(subrun_id) < 0)
+                    H5FNAL_PROGRAM_ERROR("could not close sub-run");
+
+            if ((subrun_id = h5fnal_create_run(run_id, std::to_string(currentSubRun).c_str(), FALSE)) < 0)
+                H5FNAL_PROGRAM_ERROR("could not create sub-run");
+
+            prevSubRun = currentSubRun;
+        }
+
+        // Create a new event (create name from the integer ID)
+        unsigned int currentEvent = aux.event();
+        if ((event_id = h5fnal_create_event(subrun_id, std::to_string(currentEvent).c_str(), FALSE)) < 0)
+            H5FNAL_PROGRAM_ERROR("could not create event");
+        if (h5fnal_index_event(event_id, currentRun, currentSubRun, currentEvent) < 0)
+            H5FNAL_PROGRAM_ERROR("could not add event to the event index");
+   
+        // Create the Vector of MC Truth via h5fnal.
+        // This will create a group containing datasets. The name for this group should be something like:
+        // "MCHitCollections_mchitfinder_"
+        // The empty string following the 2nd underscore indicates and empty 'product instance name'.
+        // There is no need to represent the 'process name' because that is a top-level of the file entity -- in the root group.
+        // TODO: Update the name (using a cheap, hard-coded name for now)
+        if (h5fnal_create_v_mc_truth(event_id, BADNAME, NULL, h5vtruth) < 0)
+            H5FNAL_PROGRAM_ERROR("could not create HDF5 data product");
+
         truth_data.n_truths         = truths.size();
         truth_data.truths           = &truths[0];
         truth_data.n_trajectories   = trajectories.size();
@@ -318,15 +350,22 @@ int main(int argc, char* argv[]) {
         if (h5fnal_append_truths(h5vtruth, &truth_data) < 0)
             H5FNAL_PROGRAM_ERROR("could not write truths to the HDF5 data product");
 
-        /* Close the event and HDF5 data product */
+    } /* end of loop over events */
+
+    /* The last event is still open */
+    if (event_id != H5FNAL_BAD_HID_T) {
         if (h5fnal_close_v_mc_truth(h5vtruth) < 0)
             H5FNAL_PROGRAM_ERROR("could not close HDF5 data product");
         if (h5fnal_close_event(event_id) < 0)
             H5FNAL_PROGRAM_ERROR("could not close event");
-
-    } /* end of loop over events */
+        event_id = H5FNAL_BAD_HID_T;
+    }
 
     /* Clean up */
+    if (h5fnal_set_async_writes(0) < 0)
+        H5FNAL_PROGRAM_ERROR("could not write all the data products");
+    if (h5fnal_set_compression_threads(0) < 0)
+        H5FNAL_PROGRAM_ERROR("could not stop compression threads");
     if (H5Pclose(fapl_id) < 0)
         H5FNAL_HDF5_ERROR;
     if (h5fnal_close_run(master_id) < 0)
@@ -336,12 +375,9 @@ int main(int argc, char* argv[]) {
         H5FNAL_PROGRAM_ERROR("could not close run")
     if (h5fnal_close_run(subrun_id) < 0)
         H5FNAL_PROGRAM_ERROR("could not close sub-run")
-    if (close_string_dictionary(dict) < 0)
-        H5FNAL_PROGRAM_ERROR("could not string dictionary")
-    if (H5Fclose(fid) < 0)
-        H5FNAL_HDF5_ERROR;
+    if (h5fnal_close_file(fid) < 0)
+        H5FNAL_PROGRAM_ERROR("could not close file")
 
-    free(dict);
     free(h5vtruth);
 
     cout << "Wrote " << totalTruths << " TOTAL truths to the HDF5 file." << endl;
@@ -350,6 +386,7 @@ int main(int argc, char* argv[]) {
 
 error:
 
+    h5fnal_set_async_writes(0);
     H5E_BEGIN_TRY {
         H5Pclose(fapl_id);
         h5fnal_close_run(run_id);
@@ -358,12 +395,9 @@ error:
         h5fnal_close_run(master_id);
         if (h5vtruth)
             h5fnal_close_v_mc_truth(h5vtruth);
-        if (dict)
-            close_string_dictionary(dict);
-        H5Fclose(fid);
+        h5fnal_close_file(fid);
     } H5E_END_TRY;
 
-    free(dict);
     free(h5vtruth);
 
     std::cout << "*** FAILURE ***\n";